@@ -0,0 +1,309 @@
+/*
+ * bench.c — uprintf micro-benchmarks
+ *
+ * Measures ns/call and throughput of uprintf_narrow, usnprintf_narrow,
+ * usnprintf_wide and the %n scanner over three formats (short, long,
+ * conversion-heavy), each next to the raw libc call it wraps. Results are
+ * printed as JSON on stdout; progress goes to stderr.
+ *
+ *   uprintf_bench [--quick] [--filter SUBSTRING]
+ *
+ * Each case is calibrated to run for about UPRINTF_BENCH_MS milliseconds,
+ * repeated UPRINTF_BENCH_REPS times, and the fastest repetition is kept.
+ * "ratio" is the case's time over the libc row of the same group and
+ * format: below 1.0 is faster than libc.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+/* ========================================================================== */
+/*  Formats                                                                   */
+/* ========================================================================== */
+
+#define FMT_SHORT 0
+#define FMT_LONG  1
+#define FMT_CONV  2
+
+static const char *const g_format_names[] = { "short", "long", "conversions" };
+
+#define LONG_TEXT \
+    "The quick brown fox jumps over the lazy dog while the request handler " \
+    "walks the routing table, checks the session cookie and renders the "    \
+    "page template for user "
+
+#define SHORT_N  "id=%d\n", 42
+#define LONG_N   LONG_TEXT "%s\n", "alice"
+#define CONV_N   "%d %u %ld %#x %8.3f %e %s %c %p %-6s|%05d\n", \
+                 -17, 4000000000u, 123456789L, 0xbeefu, 3.14159, 6.02e23, \
+                 "str", 'z', (void *)g_buf, "pad", 7
+
+#define SHORT_W  L"id=%d\n", 42
+#define LONG_W   L"" LONG_TEXT L"%ls\n", L"alice"
+#define CONV_W   L"%d %u %ld %#x %8.3f %e %ls %lc %p %-6ls|%05d\n", \
+                 -17, 4000000000u, 123456789L, 0xbeefu, 3.14159, 6.02e23, \
+                 L"str", (wint_t)L'z', (void *)g_buf, L"pad", 7
+
+/* Formats handed to the %n scanner */
+static const char *const g_scan_formats[] = {
+    "id=%d\n",
+    LONG_TEXT "%s\n",
+    "%d %u %ld %#x %8.3f %e %s %c %p %-6s|%05d\n"
+};
+
+/* ========================================================================== */
+/*  Cases                                                                     */
+/* ========================================================================== */
+
+static char    g_buf[1024];
+static wchar_t g_wbuf[1024];
+
+static size_t run_printf(int fmt) {
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)printf(SHORT_N);
+        case FMT_LONG:  return (size_t)printf(LONG_N);
+        default:        return (size_t)printf(CONV_N);
+    }
+}
+
+static size_t run_uprintf(int fmt) {
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)uprintf_narrow(SHORT_N);
+        case FMT_LONG:  return (size_t)uprintf_narrow(LONG_N);
+        default:        return (size_t)uprintf_narrow(CONV_N);
+    }
+}
+
+static size_t run_snprintf(int fmt) {
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)snprintf(g_buf, sizeof(g_buf), SHORT_N);
+        case FMT_LONG:  return (size_t)snprintf(g_buf, sizeof(g_buf), LONG_N);
+        default:        return (size_t)snprintf(g_buf, sizeof(g_buf), CONV_N);
+    }
+}
+
+static size_t run_usnprintf(int fmt) {
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)usnprintf_narrow(g_buf, sizeof(g_buf), SHORT_N);
+        case FMT_LONG:  return (size_t)usnprintf_narrow(g_buf, sizeof(g_buf), LONG_N);
+        default:        return (size_t)usnprintf_narrow(g_buf, sizeof(g_buf), CONV_N);
+    }
+}
+
+/* The built-in engine, whatever UPRINTF_NATIVE_ENGINE says */
+static size_t native_snprintf(const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    ret = uprintf_native_vsnprintf(g_buf, sizeof(g_buf), fmt, ap);
+    va_end(ap);
+    return (size_t)ret;
+}
+
+static size_t run_native(int fmt) {
+    switch (fmt) {
+        case FMT_SHORT: return native_snprintf(SHORT_N);
+        case FMT_LONG:  return native_snprintf(LONG_N);
+        default:        return native_snprintf(CONV_N);
+    }
+}
+
+static size_t run_swprintf(int fmt) {
+    size_t n = sizeof(g_wbuf) / sizeof(g_wbuf[0]);
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)swprintf(g_wbuf, n, SHORT_W) * sizeof(wchar_t);
+        case FMT_LONG:  return (size_t)swprintf(g_wbuf, n, LONG_W) * sizeof(wchar_t);
+        default:        return (size_t)swprintf(g_wbuf, n, CONV_W) * sizeof(wchar_t);
+    }
+}
+
+static size_t run_usnprintf_wide(int fmt) {
+    size_t n = sizeof(g_wbuf) / sizeof(g_wbuf[0]);
+    switch (fmt) {
+        case FMT_SHORT: return (size_t)usnprintf_wide(g_wbuf, n, SHORT_W) * sizeof(wchar_t);
+        case FMT_LONG:  return (size_t)usnprintf_wide(g_wbuf, n, LONG_W) * sizeof(wchar_t);
+        default:        return (size_t)usnprintf_wide(g_wbuf, n, CONV_W) * sizeof(wchar_t);
+    }
+}
+
+#ifndef UPRINTF_ENABLE_N
+
+/* Scanner baseline: one libc pass over the format */
+static size_t run_strlen(int fmt) {
+    return strlen(g_scan_formats[fmt]);
+}
+
+static size_t run_scan(int fmt) {
+    g_sink += (size_t)uprintf_has_percent_n_narrow(g_scan_formats[fmt]);
+    return strlen(g_scan_formats[fmt]);
+}
+
+static size_t run_scan_scalar(int fmt) {
+    g_sink += (size_t)uprintf__has_percent_n_narrow_scalar(g_scan_formats[fmt]);
+    return strlen(g_scan_formats[fmt]);
+}
+
+#endif /* UPRINTF_ENABLE_N */
+
+typedef struct {
+    const char *group;      /* what is measured           */
+    const char *impl;       /* "libc" rows are baselines  */
+    bench_fn    fn;
+    int         to_stdout;  /* writes to stdout           */
+} bench_case;
+
+static const bench_case g_cases[] = {
+    { "uprintf_narrow",   "libc",    run_printf,         1 },
+    { "uprintf_narrow",   "uprintf", run_uprintf,        1 },
+    { "usnprintf_narrow", "libc",    run_snprintf,       0 },
+    { "usnprintf_narrow", "uprintf", run_usnprintf,      0 },
+    { "usnprintf_narrow", "native",  run_native,         0 },
+    { "usnprintf_wide",   "libc",    run_swprintf,       0 },
+    { "usnprintf_wide",   "uprintf", run_usnprintf_wide, 0 },
+#ifndef UPRINTF_ENABLE_N
+    { "scan_percent_n",   "libc",    run_strlen,         0 },
+    { "scan_percent_n",   "uprintf", run_scan,           0 },
+    { "scan_percent_n",   "scalar",  run_scan_scalar,    0 }
+#endif
+};
+
+#define N_CASES (sizeof(g_cases) / sizeof(g_cases[0]))
+#define N_FORMATS 3
+
+/* ========================================================================== */
+/*  stdout redirection                                                        */
+/* ========================================================================== */
+
+/* The uprintf_narrow group writes to stdout: send it to the null device */
+static int g_saved_stdout = -1;
+
+static void stdout_to_null(void) {
+#if defined(_WIN32)
+    int null_fd = _open("NUL", _O_WRONLY);
+#else
+    int null_fd = open("/dev/null", O_WRONLY);
+#endif
+    fflush(stdout);
+    if (null_fd < 0) return;
+#if defined(_WIN32)
+    g_saved_stdout = _dup(1);
+    _dup2(null_fd, 1);
+    _close(null_fd);
+#else
+    g_saved_stdout = dup(1);
+    dup2(null_fd, 1);
+    close(null_fd);
+#endif
+}
+
+static void stdout_restore(void) {
+    fflush(stdout);
+    if (g_saved_stdout < 0) return;
+#if defined(_WIN32)
+    _dup2(g_saved_stdout, 1);
+    _close(g_saved_stdout);
+#else
+    dup2(g_saved_stdout, 1);
+    close(g_saved_stdout);
+#endif
+    g_saved_stdout = -1;
+}
+
+/* ========================================================================== */
+/*  Report                                                                    */
+/* ========================================================================== */
+
+static const char *bench_scanner(void) {
+#if defined(UPRINTF_ENABLE_N)
+    return "disabled";
+#elif defined(UPRINTF_SIMD_AVX2)
+    return uprintf__scan_level() >= 2 ? "avx2" : "sse2";
+#elif defined(UPRINTF_SIMD)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+int main(int argc, char **argv) {
+    bench_result results[N_CASES][N_FORMATS];
+    const char *filter = NULL;
+    int ms = UPRINTF_BENCH_MS, reps = UPRINTF_BENCH_REPS;
+    int i, f, first = 1;
+    size_t c;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            ms = 10;
+            reps = 2;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--filter SUBSTRING]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    memset(results, 0, sizeof(results));
+    for (c = 0; c < N_CASES; c++) {
+        const bench_case *bc = &g_cases[c];
+        if (filter != NULL && strstr(bc->group, filter) == NULL) continue;
+        for (f = 0; f < N_FORMATS; f++) {
+            fprintf(stderr, "  %-18s %-8s %-12s", bc->group, bc->impl, g_format_names[f]);
+            if (bc->to_stdout) stdout_to_null();
+            results[c][f] = bench_measure(bc->fn, f, ms, reps);
+            if (bc->to_stdout) stdout_restore();
+            fprintf(stderr, "%10.1f ns/call\n", results[c][f].ns_per_call);
+        }
+    }
+
+    printf("{\n");
+    printf("  \"suite\": \"uprintf\",\n");
+    printf("  \"compiler\": \"%s\",\n", bench_compiler());
+    printf("  \"engine\": \"%s\",\n",
+#if defined(UPRINTF_NATIVE_ENGINE)
+           "native"
+#else
+           "libc"
+#endif
+    );
+    printf("  \"scanner\": \"%s\",\n", bench_scanner());
+    printf("  \"target_ms\": %d,\n", ms);
+    printf("  \"repetitions\": %d,\n", reps);
+    printf("  \"results\": [");
+    for (c = 0; c < N_CASES; c++) {
+        const bench_case *bc = &g_cases[c];
+        if (results[c][0].iterations == 0) continue;
+        for (f = 0; f < N_FORMATS; f++) {
+            const bench_result *r = &results[c][f];
+            double base = 0.0;
+            size_t b;
+
+            /* The libc row of the same group is the baseline */
+            for (b = 0; b < N_CASES; b++)
+                if (strcmp(g_cases[b].group, bc->group) == 0 && strcmp(g_cases[b].impl, "libc") == 0)
+                    base = results[b][f].ns_per_call;
+
+            printf("%s\n    {\"group\": \"%s\", \"impl\": \"%s\", \"format\": \"%s\", "
+                   "\"ns_per_call\": %.2f, \"calls_per_sec\": %.0f, \"mb_per_sec\": %.1f, "
+                   "\"iterations\": %ld, \"ratio\": %.3f}",
+                   first ? "" : ",", bc->group, bc->impl, g_format_names[f],
+                   r->ns_per_call, 1e9 / r->ns_per_call,
+                   r->bytes_per_call * 1e3 / r->ns_per_call,
+                   r->iterations, base > 0.0 ? r->ns_per_call / base : 0.0);
+            first = 0;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * bench.h — Shared harness for the uprintf benchmarks
+ *
+ * Timing, calibration and the bits of JSON reporting the benchmark
+ * programs have in common. Include after uprintf.h, once per program.
+ */
+
+#ifndef UPRINTF_BENCH_H
+#define UPRINTF_BENCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifndef UPRINTF_BENCH_MS
+    #define UPRINTF_BENCH_MS 100
+#endif
+
+#ifndef UPRINTF_BENCH_REPS
+    #define UPRINTF_BENCH_REPS 5
+#endif
+
+/* ========================================================================== */
+/*  Timing                                                                    */
+/* ========================================================================== */
+
+static double bench_now_ns(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+/* Results are folded in here so no call can be optimized away */
+static volatile size_t g_sink;
+
+/* ========================================================================== */
+/*  Measurement                                                               */
+/* ========================================================================== */
+
+/* One call of the measured operation; returns the bytes it produced or read */
+typedef size_t (*bench_fn)(int arg);
+
+typedef struct {
+    double ns_per_call;
+    double bytes_per_call;
+    long   iterations;
+} bench_result;
+
+/* Fastest of `reps` timed runs of fn(arg), each sized to last about `ms` */
+static bench_result bench_measure(bench_fn fn, int arg, int ms, int reps) {
+    bench_result res;
+    double t0, elapsed, best = 0.0, per_call = 0.0;
+    long iters = 1, i;
+    size_t bytes = 0;
+    int r;
+
+    /*
+     * Calibrate: double until one run takes a tenth of the budget. The
+     * cheapest round sets the pace, so one preempted round does not
+     * shrink the timed runs.
+     */
+    for (;;) {
+        t0 = bench_now_ns();
+        for (i = 0; i < iters; i++) bytes += fn(arg);
+        elapsed = bench_now_ns() - t0;
+        if (per_call == 0.0 || elapsed / (double)iters < per_call) per_call = elapsed / (double)iters;
+        if (elapsed >= ms * 1e5 || iters >= (1L << 30)) break;
+        iters *= 2;
+    }
+    iters = (long)(ms * 1e6 / (per_call > 0.0 ? per_call : 1.0)) + 1;
+
+    for (r = 0; r < reps; r++) {
+        bytes = 0;
+        t0 = bench_now_ns();
+        for (i = 0; i < iters; i++) bytes += fn(arg);
+        elapsed = bench_now_ns() - t0;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    g_sink += bytes;
+
+    res.ns_per_call = best / (double)iters;
+    res.bytes_per_call = (double)bytes / (double)iters;
+    res.iterations = iters;
+    return res;
+}
+
+/* ========================================================================== */
+/*  Report                                                                    */
+/* ========================================================================== */
+
+static const char *bench_compiler(void) {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc";
+#else
+    return "unknown";
+#endif
+}
+
+#endif /* UPRINTF_BENCH_H */
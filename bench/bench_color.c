@@ -0,0 +1,360 @@
+/*
+ * bench_color.c — uprintf_color.h micro-benchmarks
+ *
+ * Measures conversions per second for uc_fg_rgb, uc_fg_hex, uc_fg_hsl,
+ * uc_fg_oklch and uc_fg_css, narrow and wide, 256-color OKLCH and HSL
+ * conversions one by one and through the batch API, a styled line built
+ * with uc_fg_css and %s splicing next to the same line written with
+ * UPRINTF_MARKUP tags, and bytes per second for rendering a colorized
+ * 10k-line log. Results are printed as JSON on
+ * stdout; progress goes to stderr.
+ *
+ *   uprintf_bench_color [--quick] [--baseline FILE] [--threshold PCT]
+ *
+ * With --baseline, every case is compared with the same case in FILE (the
+ * JSON this program wrote earlier) and flagged as a regression when it is
+ * more than PCT percent slower (default 25). The exit status is 1 when a
+ * regression was found.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#define UPRINTF_HEADER_ONLY
+#define UPRINTF_MARKUP
+#include "uprintf.h"
+#include "uprintf_color.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#define N_INPUTS  256
+#define LOG_LINES 10000
+
+/* ========================================================================== */
+/*  Inputs                                                                    */
+/* ========================================================================== */
+
+/* Cycled through so the compiler cannot fold a constant color */
+static int    g_rgb[N_INPUTS][3];
+static char   g_hex[N_INPUTS][8];
+static double g_hsl[N_INPUTS][3];
+static double g_oklch[N_INPUTS][3];
+
+/* The same inputs, one float array per component, for the batch API */
+static float  g_f_hsl[3][N_INPUTS];
+static float  g_f_oklch[3][N_INPUTS];
+static uint8_t g_rgb8[3 * N_INPUTS];
+
+static const char *const g_css[] = {
+    "red", "CornflowerBlue", "tomato", "darkslategray", "gold", "MediumSeaGreen",
+    "orchid", "steelblue", "whitesmoke", "Crimson", "teal", "navajowhite",
+    "lightgoldenrodyellow", "black", "rebeccapurple", "salmon"
+};
+#define N_CSS (sizeof(g_css) / sizeof(g_css[0]))
+
+static void init_inputs(void) {
+    unsigned seed = 12345u;
+    int i, c;
+    for (i = 0; i < N_INPUTS; i++) {
+        seed = seed * 1103515245u + 12345u;
+        g_rgb[i][0] = (int)(seed >> 8 & 255u);
+        g_rgb[i][1] = (int)(seed >> 16 & 255u);
+        g_rgb[i][2] = (int)(seed >> 24 & 255u);
+        snprintf(g_hex[i], sizeof(g_hex[i]), "#%02x%02x%02x",
+                 (unsigned)g_rgb[i][0], (unsigned)g_rgb[i][1], (unsigned)g_rgb[i][2]);
+        g_hsl[i][0] = (double)(i * 360) / N_INPUTS;
+        g_hsl[i][1] = 0.5 + (double)(i % 8) / 16.0;
+        g_hsl[i][2] = 0.3 + (double)(i % 5) / 10.0;
+        g_oklch[i][0] = 0.4 + (double)(i % 6) / 10.0;
+        g_oklch[i][1] = (double)(i % 9) / 30.0;
+        g_oklch[i][2] = (double)(i * 360) / N_INPUTS;
+        for (c = 0; c < 3; c++) {
+            g_f_hsl[c][i] = (float)g_hsl[i][c];
+            g_f_oklch[c][i] = (float)g_oklch[i][c];
+        }
+    }
+}
+
+/* ========================================================================== */
+/*  Cases                                                                     */
+/* ========================================================================== */
+
+static char    g_seq[UC_SEQ_MAX];
+static wchar_t g_wseq[UC_SEQ_MAX];
+static unsigned g_next;
+
+#define NEXT (g_next++ % N_INPUTS)
+
+static size_t run_fg_rgb(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_fg_rgb(g_seq, g_rgb[i][0], g_rgb[i][1], g_rgb[i][2]);
+    return strlen(g_seq);
+}
+
+static size_t run_wfg_rgb(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_wfg_rgb(g_wseq, g_rgb[i][0], g_rgb[i][1], g_rgb[i][2]);
+    return wcslen(g_wseq) * sizeof(wchar_t);
+}
+
+static size_t run_fg_hex(int unused) {
+    (void)unused;
+    uc_fg_hex(g_seq, g_hex[NEXT]);
+    return strlen(g_seq);
+}
+
+static size_t run_wfg_hex(int unused) {
+    (void)unused;
+    uc_wfg_hex(g_wseq, g_hex[NEXT]);
+    return wcslen(g_wseq) * sizeof(wchar_t);
+}
+
+static size_t run_fg_hsl(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_fg_hsl(g_seq, g_hsl[i][0], g_hsl[i][1], g_hsl[i][2]);
+    return strlen(g_seq);
+}
+
+static size_t run_wfg_hsl(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_wfg_hsl(g_wseq, g_hsl[i][0], g_hsl[i][1], g_hsl[i][2]);
+    return wcslen(g_wseq) * sizeof(wchar_t);
+}
+
+static size_t run_fg_oklch(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_fg_oklch(g_seq, g_oklch[i][0], g_oklch[i][1], g_oklch[i][2]);
+    return strlen(g_seq);
+}
+
+static size_t run_wfg_oklch(int unused) {
+    unsigned i = NEXT;
+    (void)unused;
+    uc_wfg_oklch(g_wseq, g_oklch[i][0], g_oklch[i][1], g_oklch[i][2]);
+    return wcslen(g_wseq) * sizeof(wchar_t);
+}
+
+static size_t run_fg_css(int unused) {
+    (void)unused;
+    uc_fg_css(g_seq, g_css[g_next++ % N_CSS]);
+    return strlen(g_seq);
+}
+
+static size_t run_wfg_css(int unused) {
+    (void)unused;
+    uc_wfg_css(g_wseq, g_css[g_next++ % N_CSS]);
+    return wcslen(g_wseq) * sizeof(wchar_t);
+}
+
+/* All N_INPUTS colors per call: one at a time, then through the batch API */
+static size_t run_oklch_scalar(int unused) {
+    int i, r, g, b;
+    (void)unused;
+    for (i = 0; i < N_INPUTS; i++) {
+        uc__oklch_to_rgb(g_oklch[i][0], g_oklch[i][1], g_oklch[i][2], &r, &g, &b);
+        g_rgb8[3 * i] = (uint8_t)r;
+        g_rgb8[3 * i + 1] = (uint8_t)g;
+        g_rgb8[3 * i + 2] = (uint8_t)b;
+    }
+    return sizeof(g_rgb8);
+}
+
+static size_t run_oklch_batch(int unused) {
+    (void)unused;
+    uc_oklch_to_rgb_batch(g_f_oklch[0], g_f_oklch[1], g_f_oklch[2], g_rgb8, N_INPUTS);
+    return sizeof(g_rgb8);
+}
+
+static size_t run_hsl_scalar(int unused) {
+    int i, r, g, b;
+    (void)unused;
+    for (i = 0; i < N_INPUTS; i++) {
+        uc__hsl_to_rgb(g_hsl[i][0], g_hsl[i][1], g_hsl[i][2], &r, &g, &b);
+        g_rgb8[3 * i] = (uint8_t)r;
+        g_rgb8[3 * i + 1] = (uint8_t)g;
+        g_rgb8[3 * i + 2] = (uint8_t)b;
+    }
+    return sizeof(g_rgb8);
+}
+
+static size_t run_hsl_batch(int unused) {
+    (void)unused;
+    uc_hsl_to_rgb_batch(g_f_hsl[0], g_f_hsl[1], g_f_hsl[2], g_rgb8, N_INPUTS);
+    return sizeof(g_rgb8);
+}
+
+/* One styled line: colors looked up per call, or markup expanded once */
+static char g_line[256];
+
+static size_t run_styled_splice(int unused) {
+    char seq[UC_SEQ_MAX];
+    (void)unused;
+    uc_fg_css(seq, "tomato");
+    return (size_t)usnprintf_narrow(g_line, sizeof(g_line), UC_BOLD "%s%s" UC_RESET " done in %d ms\n",
+                                    seq, "build", 42);
+}
+
+static size_t run_styled_markup(int unused) {
+    (void)unused;
+    return (size_t)usnprintf_narrow(g_line, sizeof(g_line), "{bold}{tomato}%s{/} done in %d ms\n", "build", 42);
+}
+
+/*
+ * A dashboard-style log: a colored level tag, a dimmed counter and a
+ * message whose color follows a hue gradient, reset at the end of each
+ * line. One call renders all LOG_LINES lines into a memory buffer.
+ */
+static char *g_log;
+static size_t g_log_cap;
+
+static size_t run_log(int unused) {
+    static const char *const levels[] = { "INFO", "WARN", "ERROR", "DEBUG" };
+    static const char *const tags[] = { "seagreen", "orange", "crimson", "slategray" };
+    char level_seq[UC_SEQ_MAX], msg_seq[UC_SEQ_MAX];
+    size_t pos = 0;
+    int i, n;
+
+    (void)unused;
+    for (i = 0; i < LOG_LINES; i++) {
+        uc_fg_css(level_seq, tags[i & 3]);
+        uc_fg_hsl(msg_seq, (double)(i % 360), 0.8, 0.6);
+        n = usnprintf_narrow(g_log + pos, g_log_cap - pos,
+                             "%s%-5s" UC_RESET " " UC_DIM "#%06d" UC_RESET " %scpu=%3d%% mem=%5.1f MiB %s" UC_RESET "\n",
+                             level_seq, levels[i & 3], i, msg_seq, i % 100, (double)(i % 4096) / 4.0, "ok");
+        if (n < 0 || (size_t)n >= g_log_cap - pos) break;
+        pos += (size_t)n;
+    }
+    return pos;
+}
+
+typedef struct {
+    const char *name;
+    bench_fn    fn;
+} bench_case;
+
+static const bench_case g_cases[] = {
+    { "uc_fg_rgb",    run_fg_rgb },
+    { "uc_wfg_rgb",   run_wfg_rgb },
+    { "uc_fg_hex",    run_fg_hex },
+    { "uc_wfg_hex",   run_wfg_hex },
+    { "uc_fg_hsl",    run_fg_hsl },
+    { "uc_wfg_hsl",   run_wfg_hsl },
+    { "uc_fg_oklch",  run_fg_oklch },
+    { "uc_wfg_oklch", run_wfg_oklch },
+    { "uc_fg_css",    run_fg_css },
+    { "uc_wfg_css",   run_wfg_css },
+    { "oklch_scalar_256", run_oklch_scalar },
+    { "oklch_batch_256",  run_oklch_batch },
+    { "hsl_scalar_256",   run_hsl_scalar },
+    { "hsl_batch_256",    run_hsl_batch },
+    { "styled_splice",    run_styled_splice },
+    { "styled_markup",    run_styled_markup },
+    { "log_10k",      run_log }
+};
+
+#define N_CASES (sizeof(g_cases) / sizeof(g_cases[0]))
+
+/* ========================================================================== */
+/*  Baseline                                                                  */
+/* ========================================================================== */
+
+/*
+ * ns_per_call of `name` in a previous report, or 0 when absent. The
+ * report has one result object per line, which is all this relies on.
+ */
+static double baseline_lookup(const char *path, const char *name) {
+    char line[512], key[80];
+    double ns = 0.0;
+    FILE *in = fopen(path, "r");
+
+    if (in == NULL) return 0.0;
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    while (fgets(line, sizeof(line), in) != NULL) {
+        const char *p;
+        if (strstr(line, key) == NULL) continue;
+        if ((p = strstr(line, "\"ns_per_call\": ")) != NULL)
+            ns = strtod(p + 15, NULL);
+        break;
+    }
+    fclose(in);
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    bench_result results[N_CASES];
+    double base[N_CASES];
+    const char *baseline = NULL;
+    double threshold = 25.0;
+    int ms = UPRINTF_BENCH_MS, reps = UPRINTF_BENCH_REPS;
+    int i, regressions = 0;
+    size_t c;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            ms = 10;
+            reps = 2;
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], NULL);
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--baseline FILE] [--threshold PCT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    init_inputs();
+    g_log_cap = (size_t)LOG_LINES * 160;
+    g_log = (char *)malloc(g_log_cap);
+    if (g_log == NULL) return 1;
+
+    for (c = 0; c < N_CASES; c++) {
+        fprintf(stderr, "  %-18s", g_cases[c].name);
+        results[c] = bench_measure(g_cases[c].fn, 0, ms, reps);
+        base[c] = baseline != NULL ? baseline_lookup(baseline, g_cases[c].name) : 0.0;
+        fprintf(stderr, "%12.1f ns/call", results[c].ns_per_call);
+        if (base[c] > 0.0) {
+            double delta = (results[c].ns_per_call / base[c] - 1.0) * 100.0;
+            int slow = delta > threshold;
+            regressions += slow;
+            fprintf(stderr, "  %+6.1f%% vs baseline%s", delta, slow ? "  REGRESSION" : "");
+        }
+        fprintf(stderr, "\n");
+    }
+    free(g_log);
+
+    printf("{\n");
+    printf("  \"suite\": \"uprintf_color\",\n");
+    printf("  \"compiler\": \"%s\",\n", bench_compiler());
+    printf("  \"target_ms\": %d,\n", ms);
+    printf("  \"repetitions\": %d,\n", reps);
+    if (baseline != NULL) {
+        printf("  \"baseline\": \"%s\",\n", baseline);
+        printf("  \"threshold_pct\": %.1f,\n", threshold);
+        printf("  \"regressions\": %d,\n", regressions);
+    }
+    printf("  \"results\": [");
+    for (c = 0; c < N_CASES; c++) {
+        const bench_result *r = &results[c];
+        printf("%s\n    {\"name\": \"%s\", \"ns_per_call\": %.2f, \"calls_per_sec\": %.0f, "
+               "\"mb_per_sec\": %.1f, \"iterations\": %ld",
+               c == 0 ? "" : ",", g_cases[c].name, r->ns_per_call, 1e9 / r->ns_per_call,
+               r->bytes_per_call * 1e3 / r->ns_per_call, r->iterations);
+        if (base[c] > 0.0)
+            printf(", \"baseline_ns\": %.2f, \"regression\": %s", base[c],
+                   (r->ns_per_call / base[c] - 1.0) * 100.0 > threshold ? "true" : "false");
+        printf("}");
+    }
+    printf("\n  ]\n}\n");
+    return regressions > 0 ? 1 : 0;
+}
@@ -9,6 +9,7 @@
  *
  *   ufprintf(stderr, "error: %s\n", msg);
  *   usnprintf(buf, sizeof(buf), "val=%d", 42);
+ *   ufdprintf(sock, "req %d\n", id);        // one write(2), no stdio
  *
  * With TCHAR mode (C99 compatible):
  *   #define UPRINTF_UNICODE   // optional, forces wide
@@ -23,12 +24,34 @@
  *   UPRINTF_NO_GENERIC   - Force C99 mode (no _Generic)
  *   UPRINTF_ENABLE_N     - Allow %n specifier
  *   UPRINTF_DEBUG        - Enable internal assertions
+ *   UPRINTF_NATIVE_ENGINE - Format narrow output with the built-in engine
+ *   UPRINTF_NO_SIMD      - Disable the SSE2/AVX2 %n scanner
+ *   UPRINTF_NO_INT128    - Portable 64-bit products in the float formatter
+ *   UPRINTF_SCAN_CACHE   - Cache the %n verdict per format pointer
+ *   UPRINTF_NO_LITERAL_CHECK - No compile-time %n check of literal formats
+ *   UPRINTF_THREAD_SINK  - Per-thread buffered stdout/stderr (POSIX)
+ *   UPRINTF_ASYNC        - ufprintf_async() through a writer thread (POSIX)
+ *   UPRINTF_DEFERRED     - ulog_deferred() binary logging, ulog_decode()
+ *   UPRINTF_STRIP_ANSI   - Drop CSI escape sequences when output is not a terminal
+ *   UPRINTF_MARKUP       - Expand {bold}{tomato}...{/} tags in narrow formats
+ *   UPRINTF_STATS        - Per-call-site calls/bytes/ticks, uprintf_stats_dump()
+ *   UPRINTF_LATENCY      - Per-thread latency histograms of uprintf/ufprintf (POSIX)
+ *   UPRINTF_STRBUF_INLINE - Inline bytes per ustrbuf before it allocates (default 256)
  */
 
 #ifndef UPRINTF_H
 #define UPRINTF_H
 
 #include "uprintf_config.h"
+#include "uprintf_engine.h"
+#include "uprintf_strip.h"
+#include "uprintf_markup.h"
+#include "uprintf_stats.h"
+#include "uprintf_latency.h"
+#include "uprintf_sink.h"
+#include "uprintf_async.h"
+#include "uprintf_deferred.h"
+#include "uprintf_strbuf.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -41,6 +64,14 @@
 
 #include <locale.h>
 
+#if !defined(UPRINTF_ENABLE_N)
+    #include <stdint.h>
+#endif
+
+#if defined(UPRINTF_SIMD) && !defined(UPRINTF_ENABLE_N)
+    #include <immintrin.h>
+#endif
+
 /* ========================================================================== */
 /*  TCHAR / _T() portable macros                                              */
 /* ========================================================================== */
@@ -69,24 +100,46 @@
 
 #ifndef UPRINTF_ENABLE_N
 
-UPRINTF_INLINE int uprintf_has_percent_n_narrow(const char *fmt) {
+/*
+ * The scan is split in two: a search for the next '%' (vectorized when
+ * UPRINTF_SIMD is available, 16 or 32 characters per step) and the scalar
+ * specifier skip below, which only runs at each '%'. Both halves keep the
+ * exact semantics of the reference character-by-character loop:
+ * uprintf__has_percent_n_narrow_scalar() is kept for the differential test.
+ */
+
+/* Skip flags/width/precision/length after '%'; returns the conversion char */
+UPRINTF_INLINE const char *uprintf__skip_spec_narrow(const char *p) {
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '0' || *p == '#') p++;
+    if (*p == '*') { p++; } else { while (*p >= '0' && *p <= '9') p++; }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') { p++; } else { while (*p >= '0' && *p <= '9') p++; }
+    }
+    while (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L') p++;
+    return p;
+}
+
+UPRINTF_INLINE const wchar_t *uprintf__skip_spec_wide(const wchar_t *p) {
+    while (*p == L'-' || *p == L'+' || *p == L' ' || *p == L'0' || *p == L'#') p++;
+    if (*p == L'*') { p++; } else { while (*p >= L'0' && *p <= L'9') p++; }
+    if (*p == L'.') {
+        p++;
+        if (*p == L'*') { p++; } else { while (*p >= L'0' && *p <= L'9') p++; }
+    }
+    while (*p == L'h' || *p == L'l' || *p == L'j' || *p == L'z' || *p == L't' || *p == L'L') p++;
+    return p;
+}
+
+/* Reference scanner: one character at a time */
+UPRINTF_INLINE int uprintf__has_percent_n_narrow_scalar(const char *fmt) {
     const char *p;
     if (fmt == NULL) return 0;
     for (p = fmt; *p; p++) {
         if (*p == '%') {
             p++;
             if (*p == '%') continue;  /* %% literal */
-            /* skip flags */
-            while (*p == '-' || *p == '+' || *p == ' ' || *p == '0' || *p == '#') p++;
-            /* skip width */
-            if (*p == '*') { p++; } else { while (*p >= '0' && *p <= '9') p++; }
-            /* skip precision */
-            if (*p == '.') {
-                p++;
-                if (*p == '*') { p++; } else { while (*p >= '0' && *p <= '9') p++; }
-            }
-            /* skip length modifiers */
-            while (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L') p++;
+            p = uprintf__skip_spec_narrow(p);
             if (*p == 'n') return 1;
             if (*p == '\0') break;
         }
@@ -94,20 +147,14 @@ UPRINTF_INLINE int uprintf_has_percent_n_narrow(const char *fmt) {
     return 0;
 }
 
-UPRINTF_INLINE int uprintf_has_percent_n_wide(const wchar_t *fmt) {
+UPRINTF_INLINE int uprintf__has_percent_n_wide_scalar(const wchar_t *fmt) {
     const wchar_t *p;
     if (fmt == NULL) return 0;
     for (p = fmt; *p; p++) {
         if (*p == L'%') {
             p++;
             if (*p == L'%') continue;
-            while (*p == L'-' || *p == L'+' || *p == L' ' || *p == L'0' || *p == L'#') p++;
-            if (*p == L'*') { p++; } else { while (*p >= L'0' && *p <= L'9') p++; }
-            if (*p == L'.') {
-                p++;
-                if (*p == L'*') { p++; } else { while (*p >= L'0' && *p <= L'9') p++; }
-            }
-            while (*p == L'h' || *p == L'l' || *p == L'j' || *p == L'z' || *p == L't' || *p == L'L') p++;
+            p = uprintf__skip_spec_wide(p);
             if (*p == L'n') return 1;
             if (*p == L'\0') break;
         }
@@ -115,8 +162,290 @@ UPRINTF_INLINE int uprintf_has_percent_n_wide(const wchar_t *fmt) {
     return 0;
 }
 
+#if defined(UPRINTF_SIMD)
+
+/*
+ * Vector search for the first '%' or NUL at or after p. Loads are aligned,
+ * so a block never straddles a page boundary and reading past the
+ * terminator is safe; lanes before p are masked off. AddressSanitizer
+ * cannot know that, hence no_sanitize_address.
+ */
+
+#define UPRINTF__SCAN_SSE2  1
+#define UPRINTF__SCAN_AVX2  2
+
+#define UPRINTF__NO_ASAN __attribute__((no_sanitize_address))
+
+UPRINTF__NO_ASAN
+UPRINTF_INLINE const char *uprintf__find_percent_sse2(const char *p) {
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i nul = _mm_setzero_si128();
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)15);
+    __m128i v = _mm_load_si128((const __m128i *)(const void *)blk);
+    unsigned int m = (unsigned int)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, nul)));
+    m &= ~0u << (unsigned int)(p - blk);
+    while (m == 0) {
+        blk += 16;
+        v = _mm_load_si128((const __m128i *)(const void *)blk);
+        m = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, nul)));
+    }
+    return blk + __builtin_ctz(m);
+}
+
+#if defined(UPRINTF_SIMD_AVX2)
+UPRINTF__NO_ASAN __attribute__((target("avx2")))
+UPRINTF_INLINE const char *uprintf__find_percent_avx2(const char *p) {
+    const __m256i pct = _mm256_set1_epi8('%');
+    const __m256i nul = _mm256_setzero_si256();
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)31);
+    __m256i v = _mm256_load_si256((const __m256i *)(const void *)blk);
+    unsigned int m = (unsigned int)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, pct), _mm256_cmpeq_epi8(v, nul)));
+    m &= ~0u << (unsigned int)(p - blk);
+    while (m == 0) {
+        blk += 32;
+        v = _mm256_load_si256((const __m256i *)(const void *)blk);
+        m = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, pct), _mm256_cmpeq_epi8(v, nul)));
+    }
+    return blk + __builtin_ctz(m);
+}
+#endif
+
+#if __SIZEOF_WCHAR_T__ == 4
+/* wchar_t lanes: compare 32-bit elements, each maps to 4 mask bits */
+UPRINTF__NO_ASAN
+UPRINTF_INLINE const wchar_t *uprintf__find_percent_wide_sse2(const wchar_t *p) {
+    const __m128i pct = _mm_set1_epi32(L'%');
+    const __m128i nul = _mm_setzero_si128();
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)15);
+    __m128i v = _mm_load_si128((const __m128i *)(const void *)blk);
+    unsigned int m = (unsigned int)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi32(v, pct), _mm_cmpeq_epi32(v, nul)));
+    m &= ~0u << (unsigned int)((const char *)p - blk);
+    while (m == 0) {
+        blk += 16;
+        v = _mm_load_si128((const __m128i *)(const void *)blk);
+        m = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi32(v, pct), _mm_cmpeq_epi32(v, nul)));
+    }
+    return (const wchar_t *)(const void *)(blk + __builtin_ctz(m));
+}
+
+#if defined(UPRINTF_SIMD_AVX2)
+UPRINTF__NO_ASAN __attribute__((target("avx2")))
+UPRINTF_INLINE const wchar_t *uprintf__find_percent_wide_avx2(const wchar_t *p) {
+    const __m256i pct = _mm256_set1_epi32(L'%');
+    const __m256i nul = _mm256_setzero_si256();
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)31);
+    __m256i v = _mm256_load_si256((const __m256i *)(const void *)blk);
+    unsigned int m = (unsigned int)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi32(v, pct), _mm256_cmpeq_epi32(v, nul)));
+    m &= ~0u << (unsigned int)((const char *)p - blk);
+    while (m == 0) {
+        blk += 32;
+        v = _mm256_load_si256((const __m256i *)(const void *)blk);
+        m = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi32(v, pct), _mm256_cmpeq_epi32(v, nul)));
+    }
+    return (const wchar_t *)(const void *)(blk + __builtin_ctz(m));
+}
+#endif
+#endif /* __SIZEOF_WCHAR_T__ == 4 */
+
+/* Best vector width supported by the running CPU */
+UPRINTF_INLINE int uprintf__scan_level(void) {
+#if defined(UPRINTF_SIMD_AVX2)
+    if (__builtin_cpu_supports("avx2")) return UPRINTF__SCAN_AVX2;
+#endif
+    return UPRINTF__SCAN_SSE2;
+}
+
+/* Scan with an explicit vector width (0 = scalar search for '%') */
+UPRINTF_INLINE int uprintf__has_percent_n_narrow_simd(const char *fmt, int level) {
+    const char *p = fmt;
+    if (fmt == NULL) return 0;
+    for (;;) {
+#if defined(UPRINTF_SIMD_AVX2)
+        if (level == UPRINTF__SCAN_AVX2) p = uprintf__find_percent_avx2(p);
+        else
+#endif
+        if (level == UPRINTF__SCAN_SSE2) p = uprintf__find_percent_sse2(p);
+        else while (*p && *p != '%') p++;
+        if (*p == '\0') return 0;
+        p++;
+        if (*p == '%') { p++; continue; }  /* %% literal */
+        p = uprintf__skip_spec_narrow(p);
+        if (*p == 'n') return 1;
+        if (*p == '\0') return 0;
+        p++;
+    }
+}
+
+UPRINTF_INLINE int uprintf__has_percent_n_wide_simd(const wchar_t *fmt, int level) {
+    const wchar_t *p = fmt;
+    if (fmt == NULL) return 0;
+    for (;;) {
+#if __SIZEOF_WCHAR_T__ == 4
+    #if defined(UPRINTF_SIMD_AVX2)
+        if (level == UPRINTF__SCAN_AVX2) p = uprintf__find_percent_wide_avx2(p);
+        else
+    #endif
+        if (level == UPRINTF__SCAN_SSE2) p = uprintf__find_percent_wide_sse2(p);
+        else
+#else
+        (void)level;
+#endif
+        while (*p && *p != L'%') p++;
+        if (*p == L'\0') return 0;
+        p++;
+        if (*p == L'%') { p++; continue; }
+        p = uprintf__skip_spec_wide(p);
+        if (*p == L'n') return 1;
+        if (*p == L'\0') return 0;
+        p++;
+    }
+}
+
+UPRINTF_INLINE int uprintf_has_percent_n_narrow(const char *fmt) {
+    return uprintf__has_percent_n_narrow_simd(fmt, uprintf__scan_level());
+}
+
+UPRINTF_INLINE int uprintf_has_percent_n_wide(const wchar_t *fmt) {
+    return uprintf__has_percent_n_wide_simd(fmt, uprintf__scan_level());
+}
+
+#else /* !UPRINTF_SIMD */
+
+UPRINTF_INLINE int uprintf_has_percent_n_narrow(const char *fmt) {
+    return uprintf__has_percent_n_narrow_scalar(fmt);
+}
+
+UPRINTF_INLINE int uprintf_has_percent_n_wide(const wchar_t *fmt) {
+    return uprintf__has_percent_n_wide_scalar(fmt);
+}
+
+#endif /* UPRINTF_SIMD */
+
 #endif /* UPRINTF_ENABLE_N */
 
+/* --- %n verdict cache: skip the scan for formats seen before --- */
+
+/*
+ * With UPRINTF_SCAN_CACHE, the checks below remember format pointers that
+ * were scanned clean, in a direct-mapped table of UPRINTF_SCAN_CACHE_SIZE
+ * slots (power of two). A slot holds just the pointer, read and written
+ * with relaxed atomics: a racing update can only lose an entry, never
+ * produce a false "clean". Formats containing %n are never cached.
+ *
+ * The key is the address, not the contents: a format built in a mutable
+ * buffer must be dropped with uprintf_scan_cache_invalidate() before the
+ * buffer is rewritten (or the cache cleared with uprintf_scan_cache_clear()).
+ * Hit/miss counters are read with uprintf_scan_cache_get_stats(); define
+ * UPRINTF_SCAN_CACHE_NO_STATS to drop the two shared increments.
+ */
+
+#if defined(UPRINTF_SCAN_CACHE) && defined(UPRINTF_HAS_ATOMICS) && !defined(UPRINTF_ENABLE_N)
+
+#define UPRINTF__SCAN_CACHE_ON 1
+
+#ifndef UPRINTF_SCAN_CACHE_SIZE
+    #define UPRINTF_SCAN_CACHE_SIZE 256
+#endif
+
+#if (UPRINTF_SCAN_CACHE_SIZE & (UPRINTF_SCAN_CACHE_SIZE - 1)) != 0
+    #error "UPRINTF_SCAN_CACHE_SIZE must be a power of two"
+#endif
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+} uprintf_scan_cache_stats;
+
+/* Counters on separate cache lines so hits do not bounce the miss line */
+typedef struct {
+    size_t hits;
+    char   pad[64 - sizeof(size_t)];
+    size_t misses;
+} uprintf__scan_cache_counters_t;
+
+UPRINTF_SHARED uintptr_t uprintf__scan_cache_narrow[UPRINTF_SCAN_CACHE_SIZE];
+UPRINTF_SHARED uintptr_t uprintf__scan_cache_wide[UPRINTF_SCAN_CACHE_SIZE];
+UPRINTF_SHARED uprintf__scan_cache_counters_t uprintf__scan_cache_counters;
+
+/* Fibonacci hash of the address; low bits of literals are poorly spread */
+UPRINTF_INLINE size_t uprintf__scan_cache_slot(const void *fmt) {
+    uintptr_t h = (uintptr_t)fmt;
+    h ^= h >> 16;
+    h = (uintptr_t)((uint32_t)h * 2654435761u);
+    return (size_t)(h >> 8) & (UPRINTF_SCAN_CACHE_SIZE - 1);
+}
+
+#if defined(UPRINTF_SCAN_CACHE_NO_STATS)
+    #define UPRINTF__SCAN_CACHE_COUNT(field) ((void)0)
+#else
+    #define UPRINTF__SCAN_CACHE_COUNT(field) \
+        UPRINTF_ATOMIC_ADD(&uprintf__scan_cache_counters.field, (size_t)1)
+#endif
+
+UPRINTF_INLINE int uprintf__check_n_narrow(const char *fmt) {
+    uintptr_t *slot = &uprintf__scan_cache_narrow[uprintf__scan_cache_slot(fmt)];
+    if (UPRINTF_ATOMIC_LOAD(slot) == (uintptr_t)fmt) {
+        UPRINTF__SCAN_CACHE_COUNT(hits);
+        return 0;
+    }
+    UPRINTF__SCAN_CACHE_COUNT(misses);
+    if (uprintf_has_percent_n_narrow(fmt)) return 1;
+    UPRINTF_ATOMIC_STORE(slot, (uintptr_t)fmt);
+    return 0;
+}
+
+UPRINTF_INLINE int uprintf__check_n_wide(const wchar_t *fmt) {
+    uintptr_t *slot = &uprintf__scan_cache_wide[uprintf__scan_cache_slot(fmt)];
+    if (UPRINTF_ATOMIC_LOAD(slot) == (uintptr_t)fmt) {
+        UPRINTF__SCAN_CACHE_COUNT(hits);
+        return 0;
+    }
+    UPRINTF__SCAN_CACHE_COUNT(misses);
+    if (uprintf_has_percent_n_wide(fmt)) return 1;
+    UPRINTF_ATOMIC_STORE(slot, (uintptr_t)fmt);
+    return 0;
+}
+
+/* Forget a format (narrow or wide) whose buffer is about to change */
+UPRINTF_INLINE void uprintf_scan_cache_invalidate(const void *fmt) {
+    size_t i = uprintf__scan_cache_slot(fmt);
+    uintptr_t key = (uintptr_t)fmt;
+    if (UPRINTF_ATOMIC_LOAD(&uprintf__scan_cache_narrow[i]) == key)
+        UPRINTF_ATOMIC_STORE(&uprintf__scan_cache_narrow[i], (uintptr_t)0);
+    if (UPRINTF_ATOMIC_LOAD(&uprintf__scan_cache_wide[i]) == key)
+        UPRINTF_ATOMIC_STORE(&uprintf__scan_cache_wide[i], (uintptr_t)0);
+}
+
+UPRINTF_INLINE void uprintf_scan_cache_clear(void) {
+    size_t i;
+    for (i = 0; i < UPRINTF_SCAN_CACHE_SIZE; i++) {
+        UPRINTF_ATOMIC_STORE(&uprintf__scan_cache_narrow[i], (uintptr_t)0);
+        UPRINTF_ATOMIC_STORE(&uprintf__scan_cache_wide[i], (uintptr_t)0);
+    }
+}
+
+UPRINTF_INLINE uprintf_scan_cache_stats uprintf_scan_cache_get_stats(void) {
+    uprintf_scan_cache_stats st;
+    st.hits = UPRINTF_ATOMIC_LOAD(&uprintf__scan_cache_counters.hits);
+    st.misses = UPRINTF_ATOMIC_LOAD(&uprintf__scan_cache_counters.misses);
+    return st;
+}
+
+#elif !defined(UPRINTF_ENABLE_N)
+
+#define uprintf__check_n_narrow(fmt) uprintf_has_percent_n_narrow(fmt)
+#define uprintf__check_n_wide(fmt)   uprintf_has_percent_n_wide(fmt)
+
+#endif /* UPRINTF_SCAN_CACHE */
+
 /* --- Safe vsnprintf wrapper for MSVC (guarantees null-termination) --- */
 
 #if defined(UPRINTF_MSVC)
@@ -143,6 +472,194 @@ UPRINTF_INLINE int uprintf_safe_vsnwprintf(wchar_t *buf, size_t n, const wchar_t
 
 #endif /* UPRINTF_MSVC */
 
+/* ========================================================================== */
+/*  Core formatting (after validation)                                        */
+/* ========================================================================== */
+
+/*
+ * These do the actual output once the public entry points have checked
+ * their arguments and the %n rule. The literal entry points further down
+ * call them directly when the format was proven clean at compile time.
+ */
+
+UPRINTF_INLINE int uprintf__vfprintf_plain(FILE *stream, const char *fmt, va_list ap) {
+#if defined(UPRINTF__TSINK_ON)
+    if (stream == stdout || stream == stderr) return uprintf__tsink_vfprintf(stream, fmt, ap);
+#endif
+#if defined(UPRINTF__STRIP_ON)
+    if (uprintf_strip_ansi_active(UPRINTF__FILENO(stream))) return uprintf__strip_vfprintf(stream, fmt, ap);
+#endif
+#if defined(UPRINTF_NATIVE_ENGINE)
+    return uprintf_native_vfprintf(stream, fmt, ap);
+#else
+    return vfprintf(stream, fmt, ap);
+#endif
+}
+
+UPRINTF_INLINE int uprintf__vdprintf_plain(int fd, const char *fmt, va_list ap) {
+#if defined(UPRINTF__STRIP_ON)
+    if (uprintf_strip_ansi_active(fd)) return uprintf__strip_vdprintf(fd, fmt, ap);
+#endif
+    return uprintf_native_vdprintf(fd, fmt, ap);
+}
+
+UPRINTF_INLINE int uprintf__vsnprintf_plain(char *buf, size_t n, const char *fmt, va_list ap) {
+    int ret;
+#if defined(UPRINTF_NATIVE_ENGINE)
+    ret = uprintf_native_vsnprintf(buf, n, fmt, ap);
+#elif defined(UPRINTF_MSVC)
+    ret = uprintf_safe_vsnprintf(buf, n, fmt, ap);
+#else
+    ret = vsnprintf(buf, n, fmt, ap);
+#endif
+    /* Guarantee null-termination */
+    if (n > 0) buf[n - 1] = '\0';
+    return ret;
+}
+
+/*
+ * With UPRINTF_MARKUP the format's style tags are expanded first. The
+ * *_lit variants serve the literal entry points and may cache the
+ * expansion by address; the others expand on every call.
+ */
+#if defined(UPRINTF__MARKUP_ON)
+
+UPRINTF_INLINE int uprintf__vfprintf_markup(FILE *stream, const char *fmt, int cached, va_list ap) {
+    char *heap;
+    int ret = -1;
+    if ((fmt = uprintf__markup(fmt, &heap, cached)) != NULL) ret = uprintf__vfprintf_plain(stream, fmt, ap);
+    free(heap);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf__vdprintf_markup(int fd, const char *fmt, int cached, va_list ap) {
+    char *heap;
+    int ret = -1;
+    if ((fmt = uprintf__markup(fmt, &heap, cached)) != NULL) ret = uprintf__vdprintf_plain(fd, fmt, ap);
+    free(heap);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf__vsnprintf_markup(char *buf, size_t n, const char *fmt, int cached, va_list ap) {
+    char *heap;
+    int ret = -1;
+    if ((fmt = uprintf__markup(fmt, &heap, cached)) != NULL) ret = uprintf__vsnprintf_plain(buf, n, fmt, ap);
+    else if (n > 0) buf[0] = '\0';
+    free(heap);
+    return ret;
+}
+
+#define uprintf__vfprintf_narrow(stream, fmt, ap)   uprintf__vfprintf_markup(stream, fmt, 0, ap)
+#define uprintf__vdprintf_narrow(fd, fmt, ap)       uprintf__vdprintf_markup(fd, fmt, 0, ap)
+#define uprintf__vsnprintf_narrow(buf, n, fmt, ap)  uprintf__vsnprintf_markup(buf, n, fmt, 0, ap)
+#define uprintf__vfprintf_lit(stream, fmt, ap)      uprintf__vfprintf_markup(stream, fmt, 1, ap)
+#define uprintf__vdprintf_lit(fd, fmt, ap)          uprintf__vdprintf_markup(fd, fmt, 1, ap)
+#define uprintf__vsnprintf_lit(buf, n, fmt, ap)     uprintf__vsnprintf_markup(buf, n, fmt, 1, ap)
+
+#else
+
+#define uprintf__vfprintf_narrow  uprintf__vfprintf_plain
+#define uprintf__vdprintf_narrow  uprintf__vdprintf_plain
+#define uprintf__vsnprintf_narrow uprintf__vsnprintf_plain
+#define uprintf__vfprintf_lit     uprintf__vfprintf_plain
+#define uprintf__vdprintf_lit     uprintf__vdprintf_plain
+#define uprintf__vsnprintf_lit    uprintf__vsnprintf_plain
+
+#endif /* UPRINTF__MARKUP_ON */
+
+UPRINTF_INLINE int uprintf__vfprintf_wide(FILE *stream, const wchar_t *fmt, va_list ap) {
+    return vfwprintf(stream, fmt, ap);
+}
+
+UPRINTF_INLINE int uprintf__vsnprintf_wide(wchar_t *buf, size_t n, const wchar_t *fmt, va_list ap) {
+    int ret;
+#if defined(UPRINTF_MSVC)
+    ret = uprintf_safe_vsnwprintf(buf, n, fmt, ap);
+#else
+    ret = vswprintf(buf, n, fmt, ap);
+#endif
+    if (n > 0) buf[n - 1] = L'\0';
+    return ret;
+}
+
+/*
+ * Format into buf (cap characters), or into a malloc'd buffer returned in
+ * *heap when that is too short. Returns the length, -1 on error.
+ * vswprintf reports a short buffer and an encoding error alike, so the
+ * heap buffer stops growing at UPRINTF__FD_WIDE_MAX characters.
+ */
+#define UPRINTF__FD_WIDE_MAX ((size_t)UPRINTF_MAX_WIDTH * 8)
+
+UPRINTF_INLINE int uprintf__vaswprintf_wide(wchar_t *buf, size_t cap, wchar_t **heap,
+                                            const wchar_t *fmt, va_list ap) {
+    va_list args;
+    int len;
+
+    *heap = NULL;
+#if defined(UPRINTF_MSVC)
+    va_copy(args, ap);
+    len = _vscwprintf(fmt, args);
+    va_end(args);
+    if (len < 0) return -1;
+    if ((size_t)len >= cap) {
+        cap = (size_t)len + 1;
+        if ((*heap = (wchar_t *)malloc(cap * sizeof(wchar_t))) == NULL) return -1;
+        buf = *heap;
+    }
+    return _vsnwprintf(buf, cap, fmt, ap);
+#else
+    for (;;) {
+        wchar_t *grown;
+        va_copy(args, ap);
+        len = vswprintf(buf, cap, fmt, args);
+        va_end(args);
+        if (len >= 0 || cap >= UPRINTF__FD_WIDE_MAX) return len;
+        cap *= 2;
+        if ((grown = (wchar_t *)realloc(*heap, cap * sizeof(wchar_t))) == NULL) return -1;
+        *heap = buf = grown;
+    }
+#endif
+}
+
+/*
+ * Wide output to a file descriptor: the record is formatted, converted to
+ * the locale's multibyte encoding and written UPRINTF_STACK_BUF_MAX bytes
+ * at a time. Returns the number of wide characters, like fwprintf.
+ */
+UPRINTF_INLINE int uprintf__vdprintf_wide(int fd, const wchar_t *fmt, va_list ap) {
+    wchar_t wbuf[UPRINTF_STACK_BUF_MAX / sizeof(wchar_t)];
+    char out[UPRINTF_STACK_BUF_MAX];
+    wchar_t *heap, *src;
+    size_t pos = 0;
+    mbstate_t st;
+    int len, i;
+
+    len = uprintf__vaswprintf_wide(wbuf, sizeof(wbuf) / sizeof(wbuf[0]), &heap, fmt, ap);
+    src = heap != NULL ? heap : wbuf;
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < len; i++) {
+        size_t n;
+        if (pos > sizeof(out) - MB_LEN_MAX) {
+            if (uprintf__write_all(fd, out, pos) != 0) { len = -1; break; }
+            pos = 0;
+        }
+        if ((n = wcrtomb(out + pos, src[i], &st)) == (size_t)-1) { len = -1; break; }
+        pos += n;
+    }
+    if (len >= 0 && pos > 0 && uprintf__write_all(fd, out, pos) != 0) len = -1;
+    free(heap);
+    return len;
+}
+
+UPRINTF_INLINE int uprintf__vsprintf_wide(wchar_t *buf, const wchar_t *fmt, va_list ap) {
+#if defined(UPRINTF_MSVC)
+    /* MSVC swprintf without size is deprecated; use a large limit */
+    return uprintf_safe_vsnwprintf(buf, UPRINTF_STACK_BUF_MAX / sizeof(wchar_t), fmt, ap);
+#else
+    return vswprintf(buf, UPRINTF_STACK_BUF_MAX / sizeof(wchar_t), fmt, ap);
+#endif
+}
+
 /* ========================================================================== */
 /*  Core narrow functions                                                     */
 /* ========================================================================== */
@@ -159,10 +676,10 @@ UPRINTF_INLINE int uprintf_narrow(const char *fmt, ...) {
     UPRINTF_ASSERT(fmt != NULL, "uprintf: format string is NULL");
     if (fmt == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_narrow(fmt)) return -1;
+    if (uprintf__check_n_narrow(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-    ret = vprintf(fmt, ap);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_narrow(stdout, fmt, ap));
     va_end(ap);
     return ret;
 }
@@ -179,10 +696,35 @@ UPRINTF_INLINE int ufprintf_narrow(FILE *stream, const char *fmt, ...) {
     UPRINTF_ASSERT(fmt != NULL, "ufprintf: format string is NULL");
     if (fmt == NULL || stream == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_narrow(fmt)) return -1;
+    if (uprintf__check_n_narrow(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-    ret = vfprintf(stream, fmt, ap);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_narrow(stream, fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+/*
+ * Write straight to a file descriptor with write(2): no FILE buffer, lock
+ * or orientation. A record up to UPRINTF_STACK_BUF_MAX bytes is one
+ * write; longer ones are written a buffer at a time.
+ */
+UPRINTF_INLINE int ufdprintf_narrow(int fd, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
+#endif
+;
+
+UPRINTF_INLINE int ufdprintf_narrow(int fd, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    UPRINTF_ASSERT(fmt != NULL, "ufdprintf: format string is NULL");
+    if (fmt == NULL || fd < 0) return -1;
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_narrow(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    ret = uprintf__vdprintf_narrow(fd, fmt, ap);
     va_end(ap);
     return ret;
 }
@@ -201,17 +743,11 @@ UPRINTF_INLINE int usnprintf_narrow(char *buf, size_t n, const char *fmt, ...) {
     if (fmt == NULL) return -1;
     if (buf == NULL || n == 0) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_narrow(fmt)) return -1;
+    if (uprintf__check_n_narrow(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-#if defined(UPRINTF_MSVC)
-    ret = uprintf_safe_vsnprintf(buf, n, fmt, ap);
-#else
-    ret = vsnprintf(buf, n, fmt, ap);
-#endif
+    ret = uprintf__vsnprintf_narrow(buf, n, fmt, ap);
     va_end(ap);
-    /* Guarantee null-termination */
-    if (n > 0) buf[n - 1] = '\0';
     return ret;
 }
 
@@ -228,7 +764,7 @@ UPRINTF_INLINE int usprintf_narrow(char *buf, const char *fmt, ...) {
     UPRINTF_ASSERT(buf != NULL, "usprintf: buf is NULL");
     if (fmt == NULL || buf == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_narrow(fmt)) return -1;
+    if (uprintf__check_n_narrow(fmt)) return -1;
 #endif
     va_start(ap, fmt);
     ret = vsprintf(buf, fmt, ap);
@@ -246,10 +782,10 @@ UPRINTF_INLINE int uprintf_wide(const wchar_t *fmt, ...) {
     UPRINTF_ASSERT(fmt != NULL, "uprintf: format string is NULL");
     if (fmt == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_wide(fmt)) return -1;
+    if (uprintf__check_n_wide(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-    ret = vwprintf(fmt, ap);
+    UPRINTF__LAT_CALL(ret, vwprintf(fmt, ap));
     va_end(ap);
     return ret;
 }
@@ -260,10 +796,24 @@ UPRINTF_INLINE int ufprintf_wide(FILE *stream, const wchar_t *fmt, ...) {
     UPRINTF_ASSERT(fmt != NULL, "ufprintf: format string is NULL");
     if (fmt == NULL || stream == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_wide(fmt)) return -1;
+    if (uprintf__check_n_wide(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-    ret = vfwprintf(stream, fmt, ap);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_wide(stream, fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufdprintf_wide(int fd, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    UPRINTF_ASSERT(fmt != NULL, "ufdprintf: format string is NULL");
+    if (fmt == NULL || fd < 0) return -1;
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_wide(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    ret = uprintf__vdprintf_wide(fd, fmt, ap);
     va_end(ap);
     return ret;
 }
@@ -276,16 +826,11 @@ UPRINTF_INLINE int usnprintf_wide(wchar_t *buf, size_t n, const wchar_t *fmt, ..
     if (fmt == NULL) return -1;
     if (buf == NULL || n == 0) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_wide(fmt)) return -1;
+    if (uprintf__check_n_wide(fmt)) return -1;
 #endif
     va_start(ap, fmt);
-#if defined(UPRINTF_MSVC)
-    ret = uprintf_safe_vsnwprintf(buf, n, fmt, ap);
-#else
-    ret = vswprintf(buf, n, fmt, ap);
-#endif
+    ret = uprintf__vsnprintf_wide(buf, n, fmt, ap);
     va_end(ap);
-    if (n > 0) buf[n - 1] = L'\0';
     return ret;
 }
 
@@ -296,52 +841,603 @@ UPRINTF_INLINE int usprintf_wide(wchar_t *buf, const wchar_t *fmt, ...) {
     UPRINTF_ASSERT(buf != NULL, "usprintf: buf is NULL");
     if (fmt == NULL || buf == NULL) return -1;
 #ifndef UPRINTF_ENABLE_N
-    if (uprintf_has_percent_n_wide(fmt)) return -1;
+    if (uprintf__check_n_wide(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    ret = uprintf__vsprintf_wide(buf, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+/* ========================================================================== */
+/*  Measuring                                                                 */
+/* ========================================================================== */
+
+/*
+ * uprintf_measure(fmt, ...) returns the length usnprintf would need for
+ * the same arguments, without the terminator and without writing
+ * anything: the native engine runs on a sink that only counts, and
+ * integers are sized from their bit length instead of being converted.
+ * Narrow formats get their markup expanded first, as usnprintf does.
+ * Returns -1 on a rejected format (%n) or an encoding error.
+ *
+ *   int len = uprintf_measure("%s: %d\n", name, value);
+ *   char *line = malloc((size_t)len + 1);
+ *   usnprintf(line, (size_t)len + 1, "%s: %d\n", name, value);
+ *
+ * Wide formats the engine does not model are formatted into a scratch
+ * buffer and measured from that.
+ */
+
+/*
+ * Markup expansion and the native engine: snprintf's full-length return
+ * value on every platform, which MSVC's _vsnprintf does not give.
+ */
+UPRINTF_INLINE int uprintf__vsnprintf_exact(char *buf, size_t n, const char *fmt, va_list ap) {
+#if defined(UPRINTF__MARKUP_ON)
+    char *heap;
+    int ret = -1;
+    if ((fmt = uprintf__markup(fmt, &heap, 0)) != NULL) ret = uprintf_native_vsnprintf(buf, n, fmt, ap);
+    free(heap);
+    return ret;
+#else
+    return uprintf_native_vsnprintf(buf, n, fmt, ap);
+#endif
+}
+
+UPRINTF_INLINE int uprintf_measure_narrow(const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 1, 2)))
+#endif
+;
+
+UPRINTF_INLINE int uprintf_measure_narrow(const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    UPRINTF_ASSERT(fmt != NULL, "uprintf_measure: format string is NULL");
+    if (fmt == NULL) return -1;
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_narrow(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    ret = uprintf__vsnprintf_exact(NULL, 0, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf_measure_wide(const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    UPRINTF_ASSERT(fmt != NULL, "uprintf_measure: format string is NULL");
+    if (fmt == NULL) return -1;
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_wide(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    ret = uprintf__native_vswprintf(NULL, 0, fmt, ap);
+    if (ret == UPRINTF__FMT_FOREIGN) {
+        wchar_t wbuf[UPRINTF_STACK_BUF_MAX / sizeof(wchar_t)];
+        wchar_t *heap;
+        ret = uprintf__vaswprintf_wide(wbuf, sizeof(wbuf) / sizeof(wbuf[0]), &heap, fmt, ap);
+        free(heap);
+    }
+    va_end(ap);
+    return ret;
+}
+
+/* ========================================================================== */
+/*  String builders                                                           */
+/* ========================================================================== */
+
+/*
+ * Append formatted output to a ustrbuf / uwstrbuf (uprintf_strbuf.h).
+ * The engine formats straight into the free tail; output longer than the
+ * tail is formatted again once the builder has grown. Returns the number
+ * of chars appended, or -1 with the builder's sticky error set (%n,
+ * encoding error, allocation failure) and its text unchanged.
+ */
+
+UPRINTF_INLINE int ustrbuf_vappendf_narrow(ustrbuf *sb, const char *fmt, va_list ap)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 0)))
+#endif
+;
+
+UPRINTF_INLINE int ustrbuf_vappendf_narrow(ustrbuf *sb, const char *fmt, va_list ap) {
+    va_list args;
+    size_t room;
+    int ret;
+
+    UPRINTF_ASSERT(fmt != NULL, "ustrbuf_appendf: format string is NULL");
+    if (sb == NULL || sb->error) return -1;
+    if (fmt == NULL) { sb->error = 1; return -1; }
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_narrow(fmt)) { sb->error = 1; return -1; }
+#endif
+    room = sb->cap - sb->len;
+    va_copy(args, ap);
+    ret = uprintf__vsnprintf_exact((sb->heap != NULL ? sb->heap : sb->small) + sb->len, room + 1, fmt, args);
+    va_end(args);
+    if (ret >= 0 && (size_t)ret > room) {
+        if (ustrbuf_reserve_narrow(sb, (size_t)ret) != 0) ret = -1;
+        else ret = uprintf__vsnprintf_exact(sb->heap + sb->len, (size_t)ret + 1, fmt, ap);
+    }
+    if (ret < 0) {
+        sb->error = 1;
+        (sb->heap != NULL ? sb->heap : sb->small)[sb->len] = '\0';
+        return -1;
+    }
+    sb->len += (size_t)ret;
+    return ret;
+}
+
+UPRINTF_INLINE int ustrbuf_appendf_narrow(ustrbuf *sb, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
 #endif
+;
+
+UPRINTF_INLINE int ustrbuf_appendf_narrow(ustrbuf *sb, const char *fmt, ...) {
+    va_list ap;
+    int ret;
     va_start(ap, fmt);
+    ret = ustrbuf_vappendf_narrow(sb, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+/* Wide formats the engine does not model: the platform vswprintf, growing the tail until it fits */
+UPRINTF_INLINE int uprintf__strbuf_vswprintf(uwstrbuf *sb, const wchar_t *fmt, va_list ap) {
+    va_list args;
+    int ret;
 #if defined(UPRINTF_MSVC)
-    /* MSVC swprintf without size is deprecated; use a large limit */
-    ret = uprintf_safe_vsnwprintf(buf, UPRINTF_STACK_BUF_MAX / sizeof(wchar_t), fmt, ap);
+    va_copy(args, ap);
+    ret = _vscwprintf(fmt, args);
+    va_end(args);
+    if (ret < 0 || ustrbuf_reserve_wide(sb, (size_t)ret) != 0) return -1;
+    return _vsnwprintf((sb->heap != NULL ? sb->heap : sb->small) + sb->len, (size_t)ret + 1, fmt, ap);
 #else
-    ret = vswprintf(buf, UPRINTF_STACK_BUF_MAX / sizeof(wchar_t), fmt, ap);
+    for (;;) {
+        size_t room = sb->cap - sb->len;
+        va_copy(args, ap);
+        ret = vswprintf((sb->heap != NULL ? sb->heap : sb->small) + sb->len, room + 1, fmt, args);
+        va_end(args);
+        /* vswprintf reports a short buffer and an encoding error alike */
+        if (ret >= 0 || room + 1 >= UPRINTF__FD_WIDE_MAX) return ret;
+        if (ustrbuf_reserve_wide(sb, room + 1) != 0) return -1;
+    }
+#endif
+}
+
+UPRINTF_INLINE int ustrbuf_vappendf_wide(uwstrbuf *sb, const wchar_t *fmt, va_list ap) {
+    va_list args;
+    size_t room;
+    int ret;
+
+    UPRINTF_ASSERT(fmt != NULL, "ustrbuf_appendf: format string is NULL");
+    if (sb == NULL || sb->error) return -1;
+    if (fmt == NULL) { sb->error = 1; return -1; }
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_wide(fmt)) { sb->error = 1; return -1; }
+#endif
+    room = sb->cap - sb->len;
+    va_copy(args, ap);
+    ret = uprintf__native_vswprintf((sb->heap != NULL ? sb->heap : sb->small) + sb->len, room + 1, fmt, args);
+    va_end(args);
+    if (ret == UPRINTF__FMT_FOREIGN) {
+        ret = uprintf__strbuf_vswprintf(sb, fmt, ap);
+    } else if (ret >= 0 && (size_t)ret > room) {
+        if (ustrbuf_reserve_wide(sb, (size_t)ret) != 0) ret = -1;
+        else ret = uprintf__native_vswprintf(sb->heap + sb->len, (size_t)ret + 1, fmt, ap);
+    }
+    if (ret < 0) {
+        sb->error = 1;
+        (sb->heap != NULL ? sb->heap : sb->small)[sb->len] = L'\0';
+        return -1;
+    }
+    sb->len += (size_t)ret;
+    return ret;
+}
+
+UPRINTF_INLINE int ustrbuf_appendf_wide(uwstrbuf *sb, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    ret = ustrbuf_vappendf_wide(sb, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+/* ========================================================================== */
+/*  Asynchronous narrow output (UPRINTF_ASYNC)                                */
+/* ========================================================================== */
+
+/*
+ * Queue a record for the writer thread (see uprintf_async.h). Returns the
+ * formatted length, or -1 on a rejected format or a dropped record. When
+ * the writer is not running the record is printed synchronously.
+ */
+
+#if defined(UPRINTF__ASYNC_ON)
+
+UPRINTF_INLINE int ufprintf_async(FILE *stream, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
 #endif
+;
+
+UPRINTF_INLINE int ufprintf_async(FILE *stream, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    UPRINTF_ASSERT(fmt != NULL, "ufprintf_async: format string is NULL");
+    if (fmt == NULL || stream == NULL) return -1;
+#ifndef UPRINTF_ENABLE_N
+    if (uprintf__check_n_narrow(fmt)) return -1;
+#endif
+    va_start(ap, fmt);
+    if (uprintf__async_enter()) {
+        ret = uprintf__async_vfprintf(stream, fmt, ap);
+        uprintf__async_leave();
+    } else {
+        ret = uprintf__vfprintf_narrow(stream, fmt, ap);
+    }
     va_end(ap);
     return ret;
 }
 
+#define uprintf_async(...) ufprintf_async(stdout, __VA_ARGS__)
+
+#endif /* UPRINTF__ASYNC_ON */
+
+/* ========================================================================== */
+/*  Compile-time %n check for literal formats                                 */
+/* ========================================================================== */
+
+/*
+ * When the format handed to the uprintf/ufprintf/usnprintf/usprintf macros
+ * is an array whose contents the compiler knows (a string literal), the %n
+ * scan is done by the compiler: a 10-state automaton mirroring
+ * uprintf__skip_spec_* is unrolled over the first UPRINTF__LIT_SCAN_MAX
+ * characters through two const lookup tables, and __builtin_constant_p
+ * tells whether the optimizer folded the final state. The outcome is used
+ * in two ways:
+ *
+ *   - %n found: the call is a compile error ("format string literal
+ *     contains %n"), with GCC or Clang >= 14 and optimization enabled;
+ *   - proven clean: the macro calls the *_lit entry points, which skip the
+ *     runtime scan entirely.
+ *
+ * Pointers, longer literals and unoptimized builds keep the runtime scan.
+ */
+
+#if defined(UPRINTF_HAS_GENERIC) && !defined(UPRINTF_ENABLE_N) && \
+    (defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)) && !defined(UPRINTF_NO_LITERAL_CHECK)
+
+#define UPRINTF__LIT_CHECK 1
+
+/* Automaton states; FOUND and CLEAN are absorbing */
+#define UPRINTF__LS_TEXT     0
+#define UPRINTF__LS_FLAGS    1   /* after '%' and while in flags  */
+#define UPRINTF__LS_WDIG     2   /* width digits                  */
+#define UPRINTF__LS_WSTAR    3   /* after '*' width               */
+#define UPRINTF__LS_DOT      4   /* after '.'                     */
+#define UPRINTF__LS_PDIG     5   /* precision digits              */
+#define UPRINTF__LS_PSTAR    6   /* after '*' precision           */
+#define UPRINTF__LS_LEN      7   /* length modifiers              */
+#define UPRINTF__LS_FOUND    8
+#define UPRINTF__LS_CLEAN    9
+#define UPRINTF__LS_UNKNOWN  10
+
+/* Character classes */
+#define UPRINTF__LC_NUL   0
+#define UPRINTF__LC_PCT   1
+#define UPRINTF__LC_FLAG  2   /* - + space #  */
+#define UPRINTF__LC_ZERO  3
+#define UPRINTF__LC_DIGIT 4   /* 1-9          */
+#define UPRINTF__LC_STAR  5
+#define UPRINTF__LC_DOT   6
+#define UPRINTF__LC_LEN   7   /* h l j z t L  */
+#define UPRINTF__LC_N     8
+#define UPRINTF__LC_OTHER 9
+
+static const unsigned char uprintf__lit_class[128] UPRINTF_UNUSED = {
+    /* 0x00 */ 0,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,
+    /* 0x10 */ 9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,
+    /* ' ' ! " # $ % & ' */ 2,9,9,2,9,1,9,9,
+    /* ( ) * + , - . / */ 9,9,5,2,9,2,6,9,
+    /* 0-7 */ 3,4,4,4,4,4,4,4,
+    /* 8 9 : ; < = > ? */ 4,4,9,9,9,9,9,9,
+    /* 0x40 */ 9,9,9,9,9,9,9,9, 9,9,9,9,7,9,9,9,
+    /* 0x50 */ 9,9,9,9,9,9,9,9, 9,9,9,9,9,9,9,9,
+    /* ` a b c d e f g */ 9,9,9,9,9,9,9,9,
+    /* h i j k l m n o */ 7,9,7,9,7,9,8,9,
+    /* p q r s t u v w */ 9,9,9,9,7,9,9,9,
+    /* x y z { | } ~   */ 9,9,7,9,9,9,9,9
+};
+
+/* [state][class] -> state; rows follow uprintf__skip_spec_narrow() */
+static const unsigned char uprintf__lit_next[10][10] UPRINTF_UNUSED = {
+    /*            NUL PCT FLAG ZERO DIG STAR DOT LEN  N  OTHER */
+    /* TEXT  */ {  9,  1,  0,   0,   0,  0,   0,  0,  0,  0 },
+    /* FLAGS */ {  9,  0,  1,   1,   2,  3,   4,  7,  8,  0 },
+    /* WDIG  */ {  9,  0,  0,   2,   2,  0,   4,  7,  8,  0 },
+    /* WSTAR */ {  9,  0,  0,   0,   0,  0,   4,  7,  8,  0 },
+    /* DOT   */ {  9,  0,  0,   5,   5,  6,   0,  7,  8,  0 },
+    /* PDIG  */ {  9,  0,  0,   5,   5,  0,   0,  7,  8,  0 },
+    /* PSTAR */ {  9,  0,  0,   0,   0,  0,   0,  7,  8,  0 },
+    /* LEN   */ {  9,  0,  0,   0,   0,  0,   0,  7,  8,  0 },
+    /* FOUND */ {  8,  8,  8,   8,   8,  8,   8,  8,  8,  8 },
+    /* CLEAN */ {  9,  9,  9,   9,   9,  9,   9,  9,  9,  9 }
+};
+
+/* Characters examined at compile time; longer literals are scanned at run time */
+#define UPRINTF__LIT_SCAN_MAX 128
+
+/* Arrays only: a pointer's sizeof says nothing about the string length */
+#define UPRINTF__LIT_IS_ARRAY(f) \
+    (!__builtin_types_compatible_p(__typeof__(f), __typeof__(&(f)[0])))
+
+/* One automaton step on character i; past the array end reads as NUL */
+#define UPRINTF__LIT_STEP(i)                                                    \
+    uprintf__ls = uprintf__lit_next[uprintf__ls][(size_t)(i) >= uprintf__ln     \
+        ? UPRINTF__LC_NUL                                                       \
+        : (unsigned long)uprintf__lp[i] < 128u                                  \
+            ? uprintf__lit_class[(unsigned char)uprintf__lp[i]]                 \
+            : UPRINTF__LC_OTHER];
+#define UPRINTF__LIT_STEP8(o)                                                   \
+    UPRINTF__LIT_STEP((o))     UPRINTF__LIT_STEP((o) + 1)                       \
+    UPRINTF__LIT_STEP((o) + 2) UPRINTF__LIT_STEP((o) + 3)                       \
+    UPRINTF__LIT_STEP((o) + 4) UPRINTF__LIT_STEP((o) + 5)                       \
+    UPRINTF__LIT_STEP((o) + 6) UPRINTF__LIT_STEP((o) + 7)
+#define UPRINTF__LIT_STEP64(o)                                                  \
+    UPRINTF__LIT_STEP8((o))      UPRINTF__LIT_STEP8((o) + 8)                    \
+    UPRINTF__LIT_STEP8((o) + 16) UPRINTF__LIT_STEP8((o) + 24)                   \
+    UPRINTF__LIT_STEP8((o) + 32) UPRINTF__LIT_STEP8((o) + 40)                   \
+    UPRINTF__LIT_STEP8((o) + 48) UPRINTF__LIT_STEP8((o) + 56)
+
+/*
+ * Final automaton state for f. Also valid at run time on arrays (the
+ * tests use that); UPRINTF__LIT_STATE keeps only folded results.
+ */
+#define UPRINTF__LIT_RUN(f) __extension__({                                     \
+    const __typeof__((f)[0]) *uprintf__lp =                                     \
+        __builtin_choose_expr(UPRINTF__LIT_IS_ARRAY(f), (f), NULL);             \
+    const size_t uprintf__ln =                                                  \
+        __builtin_choose_expr(UPRINTF__LIT_IS_ARRAY(f), sizeof(f), 0)           \
+        / sizeof(*uprintf__lp);                                                 \
+    unsigned int uprintf__ls = UPRINTF__LS_TEXT;                                \
+    UPRINTF__LIT_STEP64(0) UPRINTF__LIT_STEP64(64)                              \
+    uprintf__ls;                                                                \
+})
+
+/*
+ * Folded state, or UPRINTF__LS_UNKNOWN (pointer, too long, not optimizing).
+ * The address must be constant too: a string literal, not a buffer whose
+ * contents the optimizer happens to know (the markup cache keys on it).
+ */
+#if defined(__OPTIMIZE__)
+#define UPRINTF__LIT_STATE(f) __extension__({                                   \
+    const unsigned int uprintf__st = UPRINTF__LIT_RUN(f);                       \
+    UPRINTF__LIT_IS_ARRAY(f) && __builtin_constant_p(f)                         \
+        && __builtin_constant_p(uprintf__st)                                    \
+        ? uprintf__st : (unsigned int)UPRINTF__LS_UNKNOWN;                      \
+})
+#else
+#define UPRINTF__LIT_STATE(f) ((unsigned int)UPRINTF__LS_UNKNOWN)
+#endif
+
+#if defined(__OPTIMIZE__) && (defined(UPRINTF_GCC) || \
+    (defined(UPRINTF_CLANG) && __clang_major__ >= 14))
+extern int uprintf__percent_n_in_literal(void)
+    __attribute__((error("uprintf: format string literal contains %n (define UPRINTF_ENABLE_N to allow it)")));
+#define UPRINTF__LIT_REJECT(st) \
+    ((st) == UPRINTF__LS_FOUND ? (void)uprintf__percent_n_in_literal() : (void)0)
+#else
+#define UPRINTF__LIT_REJECT(st) ((void)0)
+#endif
+
+/*
+ * Select the entry point for f: the *_lit variant when the literal was
+ * proven clean, the checked one otherwise. The verdict is computed once.
+ */
+#define UPRINTF__ENTRY(f, name) __extension__({                                 \
+    const unsigned int uprintf__verdict = UPRINTF__LIT_STATE(f);                \
+    UPRINTF__LIT_REJECT(uprintf__verdict);                                      \
+    uprintf__verdict == UPRINTF__LS_CLEAN                                       \
+        ? UPRINTF__SELECT(f, name, __narrow_lit, __wide_lit)                    \
+        : UPRINTF__SELECT(f, name, _narrow, _wide);                             \
+})
+
+/* Entry points for proven-clean literals: same as above minus the %n scan */
+
+UPRINTF_INLINE int uprintf__narrow_lit(const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_lit(stdout, fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufprintf__narrow_lit(FILE *stream, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (stream == NULL) return -1;
+    va_start(ap, fmt);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_lit(stream, fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufdprintf__narrow_lit(int fd, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (fd < 0) return -1;
+    va_start(ap, fmt);
+    ret = uprintf__vdprintf_lit(fd, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int usnprintf__narrow_lit(char *buf, size_t n, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (buf == NULL || n == 0) return -1;
+    va_start(ap, fmt);
+    ret = uprintf__vsnprintf_lit(buf, n, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int usprintf__narrow_lit(char *buf, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (buf == NULL) return -1;
+    va_start(ap, fmt);
+    ret = vsprintf(buf, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf__wide_lit(const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    UPRINTF__LAT_CALL(ret, vwprintf(fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufprintf__wide_lit(FILE *stream, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (stream == NULL) return -1;
+    va_start(ap, fmt);
+    UPRINTF__LAT_CALL(ret, uprintf__vfprintf_wide(stream, fmt, ap));
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufdprintf__wide_lit(int fd, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (fd < 0) return -1;
+    va_start(ap, fmt);
+    ret = uprintf__vdprintf_wide(fd, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int usnprintf__wide_lit(wchar_t *buf, size_t n, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (buf == NULL || n == 0) return -1;
+    va_start(ap, fmt);
+    ret = uprintf__vsnprintf_wide(buf, n, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int usprintf__wide_lit(wchar_t *buf, const wchar_t *fmt, ...) {
+    va_list ap;
+    int ret;
+    if (buf == NULL) return -1;
+    va_start(ap, fmt);
+    ret = uprintf__vsprintf_wide(buf, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+#else /* no compile-time check */
+
+#define UPRINTF__ENTRY(f, name) UPRINTF__SELECT(f, name, _narrow, _wide)
+
+#endif /* UPRINTF__LIT_CHECK */
+
 /* ========================================================================== */
 /*  Public API macros — C11 _Generic dispatch                                 */
 /* ========================================================================== */
 
 #if defined(UPRINTF_HAS_GENERIC)
 
-#define uprintf(fmt, ...) _Generic((fmt),               \
-    char*:          uprintf_narrow,                     \
-    const char*:    uprintf_narrow,                     \
-    wchar_t*:       uprintf_wide,                       \
-    const wchar_t*: uprintf_wide                        \
-)(fmt, ##__VA_ARGS__)
-
-#define ufprintf(stream, fmt, ...) _Generic((fmt),      \
-    char*:          ufprintf_narrow,                    \
-    const char*:    ufprintf_narrow,                    \
-    wchar_t*:       ufprintf_wide,                      \
-    const wchar_t*: ufprintf_wide                       \
-)(stream, fmt, ##__VA_ARGS__)
-
-#define usnprintf(buf, n, fmt, ...) _Generic((fmt),     \
-    char*:          usnprintf_narrow,                  \
-    const char*:    usnprintf_narrow,                  \
-    wchar_t*:       usnprintf_wide,                     \
-    const wchar_t*: usnprintf_wide                      \
-)(buf, n, fmt, ##__VA_ARGS__)
-
-#define usprintf(buf, fmt, ...) _Generic((fmt),         \
-    char*:          usprintf_narrow,                   \
-    const char*:    usprintf_narrow,                   \
-    wchar_t*:       usprintf_wide,                      \
-    const wchar_t*: usprintf_wide                       \
-)(buf, fmt, ##__VA_ARGS__)
+/* Narrow or wide entry point by format type: name##n or name##w */
+#define UPRINTF__SELECT(f, name, n, w) _Generic((f),   \
+    char*:          name##n,                            \
+    const char*:    name##n,                            \
+    wchar_t*:       name##w,                            \
+    const wchar_t*: name##w                             \
+)
+
+#if defined(UPRINTF__STATS_ON)
+
+/* Each expansion counts into its own call-site record */
+#define uprintf(fmt, ...) \
+    UPRINTF__STATS_CALL(fmt, UPRINTF__ENTRY(fmt, uprintf)(fmt, ##__VA_ARGS__), (size_t)0)
+
+#define ufprintf(stream, fmt, ...) \
+    UPRINTF__STATS_CALL(fmt, UPRINTF__ENTRY(fmt, ufprintf)(stream, fmt, ##__VA_ARGS__), (size_t)0)
+
+#define ufdprintf(fd, fmt, ...) \
+    UPRINTF__STATS_CALL(fmt, UPRINTF__ENTRY(fmt, ufdprintf)(fd, fmt, ##__VA_ARGS__), (size_t)0)
+
+#define usnprintf(buf, n, fmt, ...) __extension__({                             \
+    const size_t uprintf__cap = (n);                                            \
+    UPRINTF__STATS_CALL(fmt, UPRINTF__ENTRY(fmt, usnprintf)(buf, uprintf__cap, fmt, ##__VA_ARGS__), \
+                        uprintf__cap);                                          \
+})
+
+#define usprintf(buf, fmt, ...) \
+    UPRINTF__STATS_CALL(fmt, UPRINTF__ENTRY(fmt, usprintf)(buf, fmt, ##__VA_ARGS__), (size_t)0)
+
+#else
+
+#define uprintf(fmt, ...) \
+    UPRINTF__ENTRY(fmt, uprintf)(fmt, ##__VA_ARGS__)
+
+#define ufprintf(stream, fmt, ...) \
+    UPRINTF__ENTRY(fmt, ufprintf)(stream, fmt, ##__VA_ARGS__)
+
+#define ufdprintf(fd, fmt, ...) \
+    UPRINTF__ENTRY(fmt, ufdprintf)(fd, fmt, ##__VA_ARGS__)
+
+#define usnprintf(buf, n, fmt, ...) \
+    UPRINTF__ENTRY(fmt, usnprintf)(buf, n, fmt, ##__VA_ARGS__)
+
+#define usprintf(buf, fmt, ...) \
+    UPRINTF__ENTRY(fmt, usprintf)(buf, fmt, ##__VA_ARGS__)
+
+#endif /* UPRINTF__STATS_ON */
+
+#define uprintf_measure(fmt, ...) \
+    UPRINTF__SELECT(fmt, uprintf_measure, _narrow, _wide)(fmt, ##__VA_ARGS__)
+
+/* String builders dispatch on the builder type */
+#define UPRINTF__SB_SELECT(sb, name) _Generic((sb),     \
+    ustrbuf*:       name##_narrow,                      \
+    uwstrbuf*:      name##_wide                         \
+)
+
+#define ustrbuf_init(sb, alloc)          UPRINTF__SB_SELECT(sb, ustrbuf_init)(sb, alloc)
+#define ustrbuf_cstr(sb)                 UPRINTF__SB_SELECT(sb, ustrbuf_cstr)(sb)
+#define ustrbuf_reserve(sb, extra)       UPRINTF__SB_SELECT(sb, ustrbuf_reserve)(sb, extra)
+#define ustrbuf_append(sb, str, len)     UPRINTF__SB_SELECT(sb, ustrbuf_append)(sb, str, len)
+#define ustrbuf_appendf(sb, fmt, ...)    UPRINTF__SB_SELECT(sb, ustrbuf_appendf)(sb, fmt, ##__VA_ARGS__)
+#define ustrbuf_vappendf(sb, fmt, ap)    UPRINTF__SB_SELECT(sb, ustrbuf_vappendf)(sb, fmt, ap)
+#define ustrbuf_clear(sb)                UPRINTF__SB_SELECT(sb, ustrbuf_clear)(sb)
+#define ustrbuf_free(sb)                 UPRINTF__SB_SELECT(sb, ustrbuf_free)(sb)
+#define ustrbuf_take(sb, len)            UPRINTF__SB_SELECT(sb, ustrbuf_take)(sb, len)
+
+#define uprintf_compile(prog, fmt) _Generic((fmt),      \
+    char*:          uprintf_compile_narrow,             \
+    const char*:    uprintf_compile_narrow,             \
+    wchar_t*:       uprintf_compile_wide,               \
+    const wchar_t*: uprintf_compile_wide                \
+)(prog, fmt)
+
+#define uprintf_exec(buf, n, prog, ...) _Generic((buf), \
+    char*:          uprintf_exec_narrow,                \
+    wchar_t*:       uprintf_exec_wide                   \
+)(buf, n, prog, ##__VA_ARGS__)
 
 /* ========================================================================== */
 /*  Public API macros — C99 fallback (static dispatch via UPRINTF_UNICODE)    */
@@ -352,13 +1448,39 @@ UPRINTF_INLINE int usprintf_wide(wchar_t *buf, const wchar_t *fmt, ...) {
 #ifdef UPRINTF_UNICODE
     #define uprintf     uprintf_wide
     #define ufprintf    ufprintf_wide
+    #define ufdprintf   ufdprintf_wide
     #define usnprintf   usnprintf_wide
     #define usprintf    usprintf_wide
+    #define uprintf_measure uprintf_measure_wide
+    #define ustrbuf_init     ustrbuf_init_wide
+    #define ustrbuf_cstr     ustrbuf_cstr_wide
+    #define ustrbuf_reserve  ustrbuf_reserve_wide
+    #define ustrbuf_append   ustrbuf_append_wide
+    #define ustrbuf_appendf  ustrbuf_appendf_wide
+    #define ustrbuf_vappendf ustrbuf_vappendf_wide
+    #define ustrbuf_clear    ustrbuf_clear_wide
+    #define ustrbuf_free     ustrbuf_free_wide
+    #define ustrbuf_take     ustrbuf_take_wide
+    #define uprintf_compile uprintf_compile_wide
+    #define uprintf_exec    uprintf_exec_wide
 #else
     #define uprintf     uprintf_narrow
     #define ufprintf    ufprintf_narrow
+    #define ufdprintf   ufdprintf_narrow
     #define usnprintf   usnprintf_narrow
     #define usprintf    usprintf_narrow
+    #define uprintf_measure uprintf_measure_narrow
+    #define ustrbuf_init     ustrbuf_init_narrow
+    #define ustrbuf_cstr     ustrbuf_cstr_narrow
+    #define ustrbuf_reserve  ustrbuf_reserve_narrow
+    #define ustrbuf_append   ustrbuf_append_narrow
+    #define ustrbuf_appendf  ustrbuf_appendf_narrow
+    #define ustrbuf_vappendf ustrbuf_vappendf_narrow
+    #define ustrbuf_clear    ustrbuf_clear_narrow
+    #define ustrbuf_free     ustrbuf_free_narrow
+    #define ustrbuf_take     ustrbuf_take_narrow
+    #define uprintf_compile uprintf_compile_narrow
+    #define uprintf_exec    uprintf_exec_narrow
 #endif
 
 #endif /* UPRINTF_HAS_GENERIC */
@@ -0,0 +1,514 @@
+/*
+ * uprintf_async.h — Asynchronous narrow output through a writer thread
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_ASYNC (POSIX only), ufprintf_async()/uprintf_async() format
+ * each record straight into a slot of a bounded lock-free ring (Vyukov's
+ * sequence-numbered queue) and return. A writer thread started with
+ * uprintf_async_start() drains the ring and hands runs of records to
+ * writev(2), so producers never wait on the terminal or the disk unless
+ * the ring is full and the policy is UPRINTF_ASYNC_BLOCK.
+ *
+ * Records go to the file descriptor behind the stream (fileno), bypassing
+ * its stdio buffer: flush the stream before switching a stream between
+ * synchronous and asynchronous output. A record longer than
+ * UPRINTF_ASYNC_SLOT_SIZE - 1 bytes is truncated (a trailing newline in
+ * the format is kept) and counted. Before uprintf_async_start() and after
+ * uprintf_async_stop(), the async calls print synchronously.
+ */
+
+#ifndef UPRINTF_ASYNC_H
+#define UPRINTF_ASYNC_H
+
+#include "uprintf_config.h"
+#include "uprintf_engine.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#if defined(UPRINTF_ASYNC) && !defined(UPRINTF_WINDOWS) && defined(UPRINTF_SHARED_WEAK)
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define UPRINTF__ASYNC_ON 1
+
+/* Records the ring holds (power of two) */
+#ifndef UPRINTF_ASYNC_SLOTS
+    #define UPRINTF_ASYNC_SLOTS 1024
+#endif
+
+/* Bytes per record, terminating NUL included */
+#ifndef UPRINTF_ASYNC_SLOT_SIZE
+    #define UPRINTF_ASYNC_SLOT_SIZE 256
+#endif
+
+#if (UPRINTF_ASYNC_SLOTS & (UPRINTF_ASYNC_SLOTS - 1)) != 0
+    #error "UPRINTF_ASYNC_SLOTS must be a power of two"
+#endif
+
+/* Records per writev(2) */
+#define UPRINTF__ASYNC_BATCH 64
+
+/* Overflow policy when the ring is full */
+#define UPRINTF_ASYNC_BLOCK     0   /* wait for the writer */
+#define UPRINTF_ASYNC_DROP      1   /* discard the new record */
+#define UPRINTF_ASYNC_OVERWRITE 2   /* discard the oldest queued record */
+
+typedef struct {
+    size_t queued;      /* records accepted into the ring */
+    size_t dropped;     /* records discarded by DROP or OVERWRITE */
+    size_t truncated;   /* records cut to UPRINTF_ASYNC_SLOT_SIZE */
+} uprintf_async_stats;
+
+typedef struct {
+    size_t seq;         /* ring position this slot is ready for */
+    int    fd;
+    int    len;
+    char   data[UPRINTF_ASYNC_SLOT_SIZE];
+} uprintf__async_slot;
+
+/* Producer and consumer positions on their own cache lines */
+typedef struct {
+    size_t          enqueue_pos;
+    char            pad0[64 - sizeof(size_t)];
+    size_t          dequeue_pos;
+    char            pad1[64 - sizeof(size_t)];
+    size_t          done_pos;   /* every record below is written or discarded */
+    size_t          dropped;
+    size_t          truncated;
+    int             running;
+    int             stopping;
+    int             idle;       /* writer is waiting for work */
+    int             policy;
+    int             exit_hook;
+    size_t          producers;  /* ufprintf_async calls inside the ring */
+    size_t          blocked;    /* producers waiting for a free slot */
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;       /* producers/flush -> writer */
+    pthread_cond_t  done;       /* writer -> flush/stop, producers -> stop */
+    pthread_cond_t  space;      /* writer -> blocked producers */
+    uprintf__async_slot slots[UPRINTF_ASYNC_SLOTS];
+    uprintf__async_slot stage[UPRINTF__ASYNC_BATCH];   /* writer-owned copies */
+} uprintf__async_ring;
+
+UPRINTF_SHARED uprintf__async_ring uprintf__async;
+
+#define UPRINTF__ASYNC_MASK ((size_t)UPRINTF_ASYNC_SLOTS - 1)
+
+#define UPRINTF__ACQ_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define UPRINTF__REL_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define UPRINTF__CAS(p, exp, v) \
+    __atomic_compare_exchange_n((p), (exp), (v), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+#if defined(UPRINTF_NATIVE_ENGINE)
+    #define UPRINTF__ASYNC_VSNPRINTF uprintf_native_vsnprintf
+#else
+    #define UPRINTF__ASYNC_VSNPRINTF vsnprintf
+#endif
+
+/* --- Ring ----------------------------------------------------------------- */
+
+/* Reserve the slot at the tail; NULL when the ring is full */
+UPRINTF_INLINE uprintf__async_slot *uprintf__async_claim(size_t *pos_out) {
+    uprintf__async_ring *r = &uprintf__async;
+    size_t pos = UPRINTF_ATOMIC_LOAD(&r->enqueue_pos);
+    for (;;) {
+        uprintf__async_slot *s = &r->slots[pos & UPRINTF__ASYNC_MASK];
+        size_t seq = UPRINTF__ACQ_LOAD(&s->seq);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (UPRINTF__CAS(&r->enqueue_pos, &pos, pos + 1)) {
+                *pos_out = pos;
+                return s;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = UPRINTF_ATOMIC_LOAD(&r->enqueue_pos);
+        }
+    }
+}
+
+/* Take the slot at the head; NULL when empty (*pos_out = head position) */
+UPRINTF_INLINE uprintf__async_slot *uprintf__async_take(size_t *pos_out) {
+    uprintf__async_ring *r = &uprintf__async;
+    size_t pos = UPRINTF_ATOMIC_LOAD(&r->dequeue_pos);
+    for (;;) {
+        uprintf__async_slot *s = &r->slots[pos & UPRINTF__ASYNC_MASK];
+        size_t seq = UPRINTF__ACQ_LOAD(&s->seq);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (UPRINTF__CAS(&r->dequeue_pos, &pos, pos + 1)) {
+                *pos_out = pos;
+                return s;
+            }
+        } else if (dif < 0) {
+            *pos_out = pos;
+            return NULL;
+        } else {
+            pos = UPRINTF_ATOMIC_LOAD(&r->dequeue_pos);
+        }
+    }
+}
+
+/* Hand a taken slot back to producers */
+UPRINTF_INLINE void uprintf__async_release(uprintf__async_slot *s, size_t pos) {
+    UPRINTF__REL_STORE(&s->seq, pos + UPRINTF_ASYNC_SLOTS);
+}
+
+/* --- Writer --------------------------------------------------------------- */
+
+/* writev(2) all of iov[0..cnt), retrying on EINTR and short writes */
+UPRINTF_INLINE int uprintf__writev_all(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t w = writev(fd, iov, cnt);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (cnt > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+/* Write one batch, grouping consecutive records for the same descriptor */
+UPRINTF_INLINE void uprintf__async_write_batch(const uprintf__async_slot *batch, int n) {
+    struct iovec iov[UPRINTF__ASYNC_BATCH];
+    int i = 0;
+    while (i < n) {
+        int fd = batch[i].fd, cnt = 0;
+        while (i < n && batch[i].fd == fd) {
+            iov[cnt].iov_base = (void *)(uintptr_t)batch[i].data;
+            iov[cnt].iov_len = (size_t)batch[i].len;
+            cnt++;
+            i++;
+        }
+        (void)uprintf__writev_all(fd, iov, cnt);
+    }
+}
+
+/* Let producers blocked on a full ring retry after slots were released */
+UPRINTF_INLINE void uprintf__async_notify_space(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    /* Pairs with the blocked count and claim retry in uprintf__async_wait_claim */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->blocked, __ATOMIC_RELAXED) == 0) return;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->space);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Every record below pos is written or discarded: wake flush/stop */
+UPRINTF_INLINE void uprintf__async_set_done(size_t pos) {
+    uprintf__async_ring *r = &uprintf__async;
+    pthread_mutex_lock(&r->lock);
+    if ((intptr_t)(pos - r->done_pos) > 0) r->done_pos = pos;
+    pthread_cond_broadcast(&r->done);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/*
+ * Drain up to one batch; returns the number of records written. Records
+ * are copied out and their slots released before the system call, so a
+ * slow descriptor never pins ring slots and OVERWRITE can always make room.
+ * done_pos moves after every batch, so a flush does not wait for the ring
+ * to run empty.
+ */
+UPRINTF_INLINE int uprintf__async_drain(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    size_t pos, last = 0;
+    int n = 0;
+
+    while (n < UPRINTF__ASYNC_BATCH) {
+        uprintf__async_slot *s = uprintf__async_take(&pos);
+        if (s == NULL) break;
+        r->stage[n].fd = s->fd;
+        r->stage[n].len = s->len;
+        memcpy(r->stage[n].data, s->data, (size_t)s->len);
+        uprintf__async_release(s, pos);
+        last = pos;
+        n++;
+    }
+    if (n == 0) {
+        /* Everything below the head was written or discarded */
+        uprintf__async_set_done(pos);
+        return 0;
+    }
+    uprintf__async_notify_space();
+    uprintf__async_write_batch(r->stage, n);
+    /* Records below the last one taken were written or overwritten */
+    uprintf__async_set_done(last + 1);
+    return n;
+}
+
+/* Time out idle waits so a missed wake-up only delays output */
+#define UPRINTF__ASYNC_IDLE_NS 10000000L
+
+UPRINTF_INLINE void uprintf__async_deadline(struct timespec *ts) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_nsec += UPRINTF__ASYNC_IDLE_NS;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+UPRINTF_INLINE void *uprintf__async_main(void *arg) {
+    uprintf__async_ring *r = &uprintf__async;
+    (void)arg;
+    for (;;) {
+        struct timespec ts;
+        if (uprintf__async_drain() > 0) continue;
+
+        pthread_mutex_lock(&r->lock);
+        if (r->stopping) {
+            pthread_mutex_unlock(&r->lock);
+            break;
+        }
+        __atomic_store_n(&r->idle, 1, __ATOMIC_SEQ_CST);
+        {
+            /* Recheck after publishing idle: pairs with the fence in produce */
+            size_t head = UPRINTF_ATOMIC_LOAD(&r->dequeue_pos);
+            uprintf__async_slot *s = &r->slots[head & UPRINTF__ASYNC_MASK];
+            if (UPRINTF__ACQ_LOAD(&s->seq) != head + 1) {
+                uprintf__async_deadline(&ts);
+                (void)pthread_cond_timedwait(&r->wake, &r->lock, &ts);
+            }
+        }
+        __atomic_store_n(&r->idle, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&r->lock);
+    }
+    return NULL;
+}
+
+UPRINTF_INLINE void uprintf__async_wake(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* --- Producers ------------------------------------------------------------ */
+
+/*
+ * Enter the ring as a producer. Returns 0 when the writer is not running;
+ * the caller then prints synchronously. uprintf_async_stop() waits for
+ * every producer that entered to leave before its final drain.
+ */
+UPRINTF_INLINE int uprintf__async_enter(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    /* Pairs with the running store and producers load in uprintf_async_stop */
+    __atomic_add_fetch(&r->producers, (size_t)1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->running, __ATOMIC_SEQ_CST)) return 1;
+    __atomic_sub_fetch(&r->producers, (size_t)1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+UPRINTF_INLINE void uprintf__async_leave(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    if (__atomic_load_n(&r->running, __ATOMIC_SEQ_CST)) {
+        /* A stop that starts now polls the count: no need to touch the lock */
+        __atomic_sub_fetch(&r->producers, (size_t)1, __ATOMIC_SEQ_CST);
+        return;
+    }
+    /* Stopping: the lock stays valid until the count it guards reaches 0 */
+    pthread_mutex_lock(&r->lock);
+    __atomic_sub_fetch(&r->producers, (size_t)1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&r->done);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Full ring under UPRINTF_ASYNC_BLOCK: sleep until the writer frees a slot */
+UPRINTF_INLINE uprintf__async_slot *uprintf__async_wait_claim(size_t *pos_out) {
+    uprintf__async_ring *r = &uprintf__async;
+    uprintf__async_slot *s;
+
+    pthread_mutex_lock(&r->lock);
+    __atomic_add_fetch(&r->blocked, (size_t)1, __ATOMIC_SEQ_CST);
+    while ((s = uprintf__async_claim(pos_out)) == NULL) {
+        pthread_cond_signal(&r->wake);
+        pthread_cond_wait(&r->space, &r->lock);
+    }
+    __atomic_sub_fetch(&r->blocked, (size_t)1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&r->lock);
+    return s;
+}
+
+/*
+ * Format one record into the ring, between uprintf__async_enter() and
+ * uprintf__async_leave(). Returns the formatted length, or -1 when the
+ * record was dropped or could not be formatted.
+ */
+UPRINTF_INLINE int uprintf__async_vfprintf(FILE *stream, const char *fmt, va_list ap) {
+    uprintf__async_ring *r = &uprintf__async;
+    uprintf__async_slot *s;
+    size_t pos, gone;
+    int n;
+
+    while ((s = uprintf__async_claim(&pos)) == NULL) {
+        switch (r->policy) {
+        case UPRINTF_ASYNC_DROP:
+            UPRINTF_ATOMIC_ADD(&r->dropped, (size_t)1);
+            return -1;
+        case UPRINTF_ASYNC_OVERWRITE: {
+            uprintf__async_slot *old = uprintf__async_take(&gone);
+            if (old != NULL) {
+                uprintf__async_release(old, gone);
+                UPRINTF_ATOMIC_ADD(&r->dropped, (size_t)1);
+                continue;
+            }
+            break;  /* the writer holds every record: wait for it */
+        }
+        default:
+            break;
+        }
+        s = uprintf__async_wait_claim(&pos);
+        break;
+    }
+
+    s->fd = fileno(stream);
+    n = UPRINTF__ASYNC_VSNPRINTF(s->data, UPRINTF_ASYNC_SLOT_SIZE, fmt, ap);
+    if (n < 0) {
+        s->len = 0;
+    } else if (n >= UPRINTF_ASYNC_SLOT_SIZE) {
+        size_t flen = strlen(fmt);
+        s->len = UPRINTF_ASYNC_SLOT_SIZE - 1;
+        if (flen > 0 && fmt[flen - 1] == '\n') s->data[s->len - 1] = '\n';
+        UPRINTF_ATOMIC_ADD(&r->truncated, (size_t)1);
+    } else {
+        s->len = n;
+    }
+    UPRINTF__REL_STORE(&s->seq, pos + 1);
+
+    /* Pairs with the idle store and recheck in the writer */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->idle, __ATOMIC_RELAXED)) uprintf__async_wake();
+    return n;
+}
+
+UPRINTF_INLINE int uprintf__async_running(void) {
+    return __atomic_load_n(&uprintf__async.running, __ATOMIC_ACQUIRE);
+}
+
+/* --- Control -------------------------------------------------------------- */
+
+/*
+ * uprintf_async_flush() — wait until every record queued before the call
+ * has been written. Returns 0, or -1 if the writer is not running.
+ */
+UPRINTF_INLINE int uprintf_async_flush(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    size_t target;
+    if (!uprintf__async_running()) return -1;
+    target = UPRINTF_ATOMIC_LOAD(&r->enqueue_pos);
+    pthread_mutex_lock(&r->lock);
+    while ((intptr_t)(r->done_pos - target) < 0) {
+        pthread_cond_signal(&r->wake);
+        pthread_cond_wait(&r->done, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+/*
+ * uprintf_async_stop() — drain the ring and join the writer. Also run at
+ * exit(). Calls that entered the ring before the stop finish first and are
+ * written; later ones print synchronously.
+ */
+UPRINTF_INLINE void uprintf_async_stop(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    struct timespec ts;
+
+    if (!uprintf__async_running()) return;
+    __atomic_store_n(&r->running, 0, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&r->lock);
+    while (__atomic_load_n(&r->producers, __ATOMIC_SEQ_CST) != 0) {
+        uprintf__async_deadline(&ts);
+        (void)pthread_cond_timedwait(&r->done, &r->lock, &ts);
+    }
+    r->stopping = 1;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    (void)pthread_join(r->thread, NULL);
+
+    while (uprintf__async_drain() > 0) {}
+    pthread_cond_destroy(&r->wake);
+    pthread_cond_destroy(&r->done);
+    pthread_cond_destroy(&r->space);
+    pthread_mutex_destroy(&r->lock);
+}
+
+/*
+ * uprintf_async_start() — start the writer thread with an overflow policy
+ * (UPRINTF_ASYNC_BLOCK, UPRINTF_ASYNC_DROP or UPRINTF_ASYNC_OVERWRITE).
+ * Returns 0, or -1 if already running or the thread cannot be created.
+ */
+UPRINTF_INLINE int uprintf_async_start(int policy) {
+    uprintf__async_ring *r = &uprintf__async;
+    size_t i, pos;
+
+    if (uprintf__async_running()) return -1;
+    if (policy != UPRINTF_ASYNC_DROP && policy != UPRINTF_ASYNC_OVERWRITE)
+        policy = UPRINTF_ASYNC_BLOCK;
+
+    pos = r->enqueue_pos;
+    for (i = 0; i < UPRINTF_ASYNC_SLOTS; i++)
+        r->slots[(pos + i) & UPRINTF__ASYNC_MASK].seq = pos + i;
+    r->dequeue_pos = pos;
+    r->done_pos = pos;
+    r->policy = policy;
+    r->stopping = 0;
+    r->idle = 0;
+    r->blocked = 0;
+
+    if (pthread_mutex_init(&r->lock, NULL) != 0) return -1;
+    pthread_cond_init(&r->wake, NULL);
+    pthread_cond_init(&r->done, NULL);
+    pthread_cond_init(&r->space, NULL);
+    if (pthread_create(&r->thread, NULL, uprintf__async_main, NULL) != 0) {
+        pthread_cond_destroy(&r->wake);
+        pthread_cond_destroy(&r->done);
+        pthread_cond_destroy(&r->space);
+        pthread_mutex_destroy(&r->lock);
+        return -1;
+    }
+    if (!r->exit_hook) {
+        r->exit_hook = 1;
+        (void)atexit(uprintf_async_stop);
+    }
+    __atomic_store_n(&r->running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+UPRINTF_INLINE uprintf_async_stats uprintf_async_get_stats(void) {
+    uprintf__async_ring *r = &uprintf__async;
+    uprintf_async_stats st;
+    st.queued = UPRINTF_ATOMIC_LOAD(&r->enqueue_pos);
+    st.dropped = UPRINTF_ATOMIC_LOAD(&r->dropped);
+    st.truncated = UPRINTF_ATOMIC_LOAD(&r->truncated);
+    return st;
+}
+
+#endif /* UPRINTF_ASYNC */
+
+#endif /* UPRINTF_ASYNC_H */
@@ -72,6 +72,60 @@
     #include <sal.h>
 #endif
 
+/* ========================================================================== */
+/*  SIMD availability (x86 SSE2 baseline, AVX2 selected at runtime)           */
+/* ========================================================================== */
+
+#if !defined(UPRINTF_NO_SIMD) && (defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+    #define UPRINTF_SIMD 1
+    #if (defined(UPRINTF_GCC) && UPRINTF_GCC_VER >= 409) || \
+        (defined(UPRINTF_CLANG) && UPRINTF_CLANG_VER >= 308)
+        #define UPRINTF_SIMD_AVX2 1
+    #endif
+#endif
+
+/* ========================================================================== */
+/*  128-bit integers                                                          */
+/* ========================================================================== */
+
+/*
+ * 128-bit integer products for the float formatters. Define
+ * UPRINTF_NO_INT128 to use the portable 64-bit fallback instead.
+ */
+#if defined(__SIZEOF_INT128__) && !defined(UPRINTF_NO_INT128)
+    #define UPRINTF_HAS_INT128 1
+    __extension__ typedef unsigned __int128 uprintf__u128;
+#endif
+
+/* ========================================================================== */
+/*  Atomics and process-wide state                                            */
+/* ========================================================================== */
+
+/*
+ * Relaxed atomics on pointer-sized words, used by the lock-free caches and
+ * counters. Only GCC/Clang builtins are wired up; features that need them
+ * are compiled out elsewhere.
+ */
+#if (defined(UPRINTF_GCC) && UPRINTF_GCC_VER >= 407) || defined(UPRINTF_CLANG)
+    #define UPRINTF_HAS_ATOMICS 1
+    #define UPRINTF_ATOMIC_LOAD(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+    #define UPRINTF_ATOMIC_STORE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+    #define UPRINTF_ATOMIC_ADD(p, v)    ((void)__atomic_fetch_add((p), (v), __ATOMIC_RELAXED))
+#endif
+
+/*
+ * Header-only state shared by every translation unit: weak definitions are
+ * merged by the linker, so all TUs see one object. Where weak symbols are
+ * unreliable (PE/COFF) each TU keeps its own copy.
+ */
+#if (defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)) && !defined(UPRINTF_WINDOWS)
+    #define UPRINTF_SHARED __attribute__((weak))
+    #define UPRINTF_SHARED_WEAK 1
+#else
+    #define UPRINTF_SHARED static
+#endif
+
 /* ========================================================================== */
 /*  Inline keyword portability                                                */
 /* ========================================================================== */
@@ -0,0 +1,780 @@
+/*
+ * uprintf_deferred.h — Deferred binary logging (ulog_deferred)
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_DEFERRED, ulog_deferred(fmt, ...) does no text formatting:
+ * it appends the call site's format ID and the raw argument values to a
+ * per-thread buffer, which is written to the log opened with ulog_open().
+ * The format itself is written to the file once, straight to the file and
+ * under a lock, the first time its call site logs to that file, so it is
+ * there before any thread's buffered record can reference it. ulog_close()
+ * writes the buffers of every thread. ulog_decode() (and the ulog_decode
+ * tool) turns the file back into the exact text uprintf_narrow() prints.
+ *
+ *   ulog_open("app.ulog");
+ *   ulog_deferred("req %s -> %d in %.3f ms\n", path, status, ms);
+ *   ulog_close();
+ *
+ *   $ ulog_decode app.ulog
+ *
+ * The format must be a string literal: each call site keeps a static
+ * record of its parsed format. Strings are copied into the log (%s up to
+ * the precision, %ls likewise); pointers (%p) are logged as values.
+ * Formats uprintf_compile_narrow() rejects (%n, positional arguments, more
+ * than UPRINTF_PROGRAM_MAX_OPS operations) are not logged. Values are
+ * stored in the writer's byte order and type sizes: decode on the same
+ * ABI. Recording needs POSIX threads; decoding works everywhere.
+ *
+ * File layout (all integers native):
+ *   header  "ULOG", version, sizeof long/wchar_t/long double/void*,
+ *           3 pad bytes, u32 0x01020304
+ *   record  u32 word, u32 payload length, payload
+ *           word with bit 31 set: definition of format ID (word & ~bit 31),
+ *             payload = format bytes;
+ *           otherwise: event for format ID word, payload = arguments.
+ */
+
+#ifndef UPRINTF_DEFERRED_H
+#define UPRINTF_DEFERRED_H
+
+#include "uprintf_config.h"
+#include "uprintf_engine.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#if defined(UPRINTF_DEFERRED)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#define UPRINTF__DLOG_VERSION   1
+#define UPRINTF__DLOG_DEF       0x80000000u
+#define UPRINTF__DLOG_NULL_STR  0xFFFFFFFFu
+#define UPRINTF__DLOG_HDR_SIZE  16
+
+/* Bytes an integer conversion takes in the log */
+UPRINTF_INLINE size_t uprintf__dlog_int_size(const uprintf__spec *spec) {
+    switch (spec->length) {
+        case UPRINTF__LEN_L:    return sizeof(long);
+        case UPRINTF__LEN_LL:
+        case UPRINTF__LEN_J:
+        case UPRINTF__LEN_Z:
+        case UPRINTF__LEN_T:
+        case UPRINTF__LEN_BIGL: return 8;
+        case UPRINTF__LEN_NONE:
+        case UPRINTF__LEN_HH:
+        case UPRINTF__LEN_H:
+        default:                return 4;
+    }
+}
+
+UPRINTF_INLINE void uprintf__dlog_file_header(unsigned char *h) {
+    uint32_t order = 0x01020304u;
+    memcpy(h, "ULOG", 4);
+    h[4] = UPRINTF__DLOG_VERSION;
+    h[5] = (unsigned char)sizeof(long);
+    h[6] = (unsigned char)sizeof(wchar_t);
+    h[7] = (unsigned char)sizeof(long double);
+    h[8] = (unsigned char)sizeof(void *);
+    h[9] = h[10] = h[11] = 0;
+    memcpy(h + 12, &order, 4);
+}
+
+/* Deferred logging accepts what a compiled program can replay, minus %n */
+UPRINTF_INLINE int uprintf__dlog_compile(uprintf_program *prog, const char *fmt) {
+    unsigned i;
+    if (uprintf_compile_narrow(prog, fmt) != 0) return -1;
+    for (i = 0; i < prog->count; i++)
+        if (prog->ops[i].kind == UPRINTF__OP_CONV && prog->ops[i].spec.conv == 'n') return -1;
+    return 0;
+}
+
+/* ========================================================================== */
+/*  Recording (POSIX)                                                         */
+/* ========================================================================== */
+
+#if !defined(UPRINTF_WINDOWS) && defined(UPRINTF_SHARED_WEAK)
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define UPRINTF__DLOG_ON 1
+
+/* Bytes buffered per thread before a write(2) to the log */
+#ifndef UPRINTF_DEFERRED_BUF_SIZE
+    #define UPRINTF_DEFERRED_BUF_SIZE 16384
+#endif
+
+/* Call site states */
+#define UPRINTF__DSITE_NEW      0
+#define UPRINTF__DSITE_BUSY     1
+#define UPRINTF__DSITE_READY    2
+#define UPRINTF__DSITE_REJECTED 3
+
+/* One ulog_deferred() call site; zero-initialized except for fmt */
+typedef struct {
+    const char     *fmt;
+    int             state;      /* UPRINTF__DSITE_*                      */
+    uint32_t        id;
+    unsigned        gen;        /* log file the definition went to       */
+    uprintf_program prog;
+} uprintf__dlog_site;
+
+typedef struct uprintf__dlog_buf {
+    size_t        len;
+    unsigned      gen;          /* log file the buffered records belong to */
+    int           busy;         /* inside a record or flush (ulog_close waits) */
+    unsigned char registered;   /* on the thread list, destructor armed    */
+    struct uprintf__dlog_buf *next;
+    unsigned char buf[UPRINTF_DEFERRED_BUF_SIZE];
+} uprintf__dlog_buf;
+
+typedef struct {
+    int      fd;
+    int      open;              /* records accepted                      */
+    int      fd_open;           /* fd valid; changed under the lock      */
+    unsigned gen;               /* bumped by every ulog_open()           */
+    uint32_t next_id;
+} uprintf__dlog_state;
+
+UPRINTF_SHARED __thread uprintf__dlog_buf uprintf__dlog_tls;
+UPRINTF_SHARED uprintf__dlog_state uprintf__dlog;
+UPRINTF_SHARED pthread_once_t uprintf__dlog_once = PTHREAD_ONCE_INIT;
+UPRINTF_SHARED pthread_key_t uprintf__dlog_key;
+/* Guards the thread list, definition writes, open and close */
+UPRINTF_SHARED pthread_mutex_t uprintf__dlog_lock = PTHREAD_MUTEX_INITIALIZER;
+UPRINTF_SHARED uprintf__dlog_buf *uprintf__dlog_threads;
+
+/* Bounded output cursor; overflow is sticky */
+typedef struct {
+    unsigned char *p;
+    unsigned char *end;
+    int            overflow;
+} uprintf__dlog_out;
+
+UPRINTF_INLINE void uprintf__dlog_put(uprintf__dlog_out *o, const void *src, size_t n) {
+    if (o->overflow || (size_t)(o->end - o->p) < n) {
+        o->overflow = 1;
+        return;
+    }
+    memcpy(o->p, src, n);
+    o->p += n;
+}
+
+UPRINTF_INLINE void uprintf__dlog_put_u32(uprintf__dlog_out *o, uint32_t v) {
+    uprintf__dlog_put(o, &v, 4);
+}
+
+/* Write the record header, payload length patched in by _end */
+UPRINTF_INLINE unsigned char *uprintf__dlog_begin(uprintf__dlog_out *o, uint32_t word) {
+    unsigned char *start = o->p;
+    uprintf__dlog_put_u32(o, word);
+    uprintf__dlog_put_u32(o, 0);
+    return start;
+}
+
+UPRINTF_INLINE int uprintf__dlog_end(uprintf__dlog_out *o, unsigned char *start) {
+    uint32_t len;
+    if (o->overflow) return -1;
+    len = (uint32_t)(o->p - start - 8);
+    memcpy(start + 4, &len, 4);
+    return 0;
+}
+
+/* Append one fetched argument */
+UPRINTF_INLINE void uprintf__dlog_put_arg(uprintf__dlog_out *o, const uprintf__spec *spec,
+                                          const uprintf__arg *arg, int neg) {
+    switch (spec->conv) {
+        case 'd': case 'i': {
+            int64_t v = neg ? -(int64_t)(arg->u - 1) - 1 : (int64_t)arg->u;
+            if (uprintf__dlog_int_size(spec) == 4) {
+                int32_t v32 = (int32_t)v;
+                uprintf__dlog_put(o, &v32, 4);
+            } else {
+                uprintf__dlog_put(o, &v, 8);
+            }
+            break;
+        }
+        case 'u': case 'o': case 'x': case 'X':
+            if (uprintf__dlog_int_size(spec) == 4) {
+                uint32_t v32 = (uint32_t)arg->u;
+                uprintf__dlog_put(o, &v32, 4);
+            } else {
+                uint64_t v = (uint64_t)arg->u;
+                uprintf__dlog_put(o, &v, 8);
+            }
+            break;
+        case 'c':
+            if (spec->length == UPRINTF__LEN_L) {
+                uprintf__dlog_put(o, &arg->wc, sizeof(wint_t));
+            } else {
+                unsigned char c = (unsigned char)arg->u;
+                uprintf__dlog_put(o, &c, 1);
+            }
+            break;
+        case 's':
+            if (arg->p == NULL) {
+                uprintf__dlog_put_u32(o, UPRINTF__DLOG_NULL_STR);
+            } else if (spec->length == UPRINTF__LEN_L) {
+                /* precision counts output bytes, so prec characters suffice */
+                size_t n = uprintf__wcsnlen((const wchar_t *)arg->p, spec->prec);
+                uprintf__dlog_put_u32(o, (uint32_t)n);
+                uprintf__dlog_put(o, arg->p, n * sizeof(wchar_t));
+            } else {
+                size_t n = uprintf__strnlen((const char *)arg->p, spec->prec);
+                uprintf__dlog_put_u32(o, (uint32_t)n);
+                uprintf__dlog_put(o, arg->p, n);
+            }
+            break;
+        case 'p': {
+            uintptr_t v = (uintptr_t)arg->p;
+            uprintf__dlog_put(o, &v, sizeof(v));
+            break;
+        }
+        default:
+            if (spec->length == UPRINTF__LEN_BIGL) uprintf__dlog_put(o, &arg->ld, sizeof(long double));
+            else uprintf__dlog_put(o, &arg->d, sizeof(double));
+            break;
+    }
+}
+
+/* Encode one event: star values as logged ints, then each argument */
+UPRINTF_INLINE int uprintf__dlog_encode(uprintf__dlog_out *o, const uprintf__dlog_site *site, va_list ap) {
+    unsigned char *start = uprintf__dlog_begin(o, site->id);
+    va_list args;
+    unsigned i;
+
+    va_copy(args, ap);
+    for (i = 0; i < site->prog.count && !o->overflow; i++) {
+        const uprintf__op *op = &site->prog.ops[i];
+        uprintf__spec spec;
+        uprintf__arg arg;
+        int neg;
+
+        if (op->kind == UPRINTF__OP_LITERAL) continue;
+        spec = op->spec;
+        if (spec.flags & UPRINTF__F_WSTAR) {
+            int32_t w = (int32_t)va_arg(args, int);
+            uprintf__dlog_put(o, &w, 4);
+        }
+        if (spec.flags & UPRINTF__F_PSTAR) {
+            int32_t p = (int32_t)va_arg(args, int);
+            uprintf__dlog_put(o, &p, 4);
+            spec.prec = p == UPRINTF_SHORTEST ? (int)p : p < 0 ? -1
+                      : (p > UPRINTF_MAX_PRECISION ? UPRINTF_MAX_PRECISION : p);
+        }
+        arg.u = 0;
+        neg = uprintf__fetch_arg(&spec, &args, &arg);
+        uprintf__dlog_put_arg(o, &spec, &arg, neg);
+    }
+    va_end(args);
+    return uprintf__dlog_end(o, start);
+}
+
+/*
+ * Write the thread's buffer if it belongs to the open log; always empties
+ * it. Callers hold the lock, or are the owning thread between
+ * uprintf__dlog_enter() and uprintf__dlog_leave().
+ */
+UPRINTF_INLINE int uprintf__dlog_drain(uprintf__dlog_buf *t) {
+    size_t n = t->len;
+    t->len = 0;
+    if (n == 0 || !uprintf__dlog.fd_open || t->gen != uprintf__dlog.gen) return 0;
+    return uprintf__write_all(uprintf__dlog.fd, (const char *)t->buf, n);
+}
+
+/*
+ * Mark the calling thread's buffer busy if the log is open; 0 if it is
+ * not. ulog_close() clears `open` and then waits for busy buffers, so a
+ * buffer is never written by two threads at once.
+ */
+UPRINTF_INLINE int uprintf__dlog_enter(uprintf__dlog_buf *t) {
+    /* Pairs with the open store and busy loads in ulog_close */
+    __atomic_store_n(&t->busy, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&uprintf__dlog.open, __ATOMIC_SEQ_CST)) return 1;
+    __atomic_store_n(&t->busy, 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+UPRINTF_INLINE void uprintf__dlog_leave(uprintf__dlog_buf *t) {
+    __atomic_store_n(&t->busy, 0, __ATOMIC_RELEASE);
+}
+
+UPRINTF_INLINE void uprintf__dlog_thread_exit(void *arg) {
+    uprintf__dlog_buf *t = (uprintf__dlog_buf *)arg, **pp;
+
+    pthread_mutex_lock(&uprintf__dlog_lock);
+    (void)uprintf__dlog_drain(t);
+    for (pp = &uprintf__dlog_threads; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    t->registered = 0;
+    pthread_mutex_unlock(&uprintf__dlog_lock);
+}
+
+UPRINTF_INLINE void uprintf__dlog_process_exit(void) {
+    uprintf__dlog_buf *t = &uprintf__dlog_tls;
+    if (uprintf__dlog_enter(t)) {
+        (void)uprintf__dlog_drain(t);
+        uprintf__dlog_leave(t);
+    }
+}
+
+/* Only the forking thread survives: forget the others' buffers */
+UPRINTF_INLINE void uprintf__dlog_child(void) {
+    (void)pthread_mutex_init(&uprintf__dlog_lock, NULL);
+    uprintf__dlog_threads = NULL;
+    uprintf__dlog_tls.len = 0;
+    uprintf__dlog_tls.busy = 0;
+    uprintf__dlog_tls.registered = 0;
+}
+
+UPRINTF_INLINE void uprintf__dlog_setup(void) {
+    (void)pthread_key_create(&uprintf__dlog_key, uprintf__dlog_thread_exit);
+    (void)atexit(uprintf__dlog_process_exit);
+    (void)pthread_atfork(NULL, NULL, uprintf__dlog_child);
+}
+
+/* Put the calling thread's buffer on the list ulog_close() drains */
+UPRINTF_INLINE void uprintf__dlog_register(uprintf__dlog_buf *t) {
+    (void)pthread_once(&uprintf__dlog_once, uprintf__dlog_setup);
+    pthread_mutex_lock(&uprintf__dlog_lock);
+    t->next = uprintf__dlog_threads;
+    uprintf__dlog_threads = t;
+    pthread_mutex_unlock(&uprintf__dlog_lock);
+    (void)pthread_setspecific(uprintf__dlog_key, t);
+    t->registered = 1;
+}
+
+/* Parse the site's format on first use; 1 if the site can log */
+UPRINTF_INLINE int uprintf__dlog_site_ready(uprintf__dlog_site *site) {
+    int st = __atomic_load_n(&site->state, __ATOMIC_ACQUIRE);
+    int expected = UPRINTF__DSITE_NEW;
+
+    if (st == UPRINTF__DSITE_READY) return 1;
+    if (st == UPRINTF__DSITE_NEW &&
+        __atomic_compare_exchange_n(&site->state, &expected, UPRINTF__DSITE_BUSY, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        if (uprintf__dlog_compile(&site->prog, site->fmt) != 0) {
+            __atomic_store_n(&site->state, UPRINTF__DSITE_REJECTED, __ATOMIC_RELEASE);
+            return 0;
+        }
+        site->id = __atomic_add_fetch(&uprintf__dlog.next_id, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->state, UPRINTF__DSITE_READY, __ATOMIC_RELEASE);
+        return 1;
+    }
+    while ((st = __atomic_load_n(&site->state, __ATOMIC_ACQUIRE)) == UPRINTF__DSITE_BUSY)
+        sched_yield();
+    return st == UPRINTF__DSITE_READY;
+}
+
+/* Append the record encode_call builds, writing the buffer out first if full */
+#define UPRINTF__DLOG_APPEND(t, encode_call, ret) do {                       \
+    uprintf__dlog_out o_;                                                    \
+    int pass_;                                                               \
+    (ret) = -1;                                                              \
+    for (pass_ = 0; pass_ < 2; pass_++) {                                    \
+        o_.p = (t)->buf + (t)->len;                                          \
+        o_.end = (t)->buf + UPRINTF_DEFERRED_BUF_SIZE;                       \
+        o_.overflow = 0;                                                     \
+        if ((encode_call) == 0) {                                            \
+            (t)->len = (size_t)(o_.p - (t)->buf);                            \
+            (ret) = 0;                                                       \
+            break;                                                           \
+        }                                                                    \
+        if ((t)->len == 0 || uprintf__dlog_drain(t) != 0) break;             \
+    }                                                                        \
+} while (0)
+
+/*
+ * Write the site's definition to log gen unless it is there already. It
+ * goes straight to the file, in one write, before site->gen is published:
+ * a thread that sees the site defined can only buffer records behind it.
+ */
+UPRINTF_INLINE int uprintf__dlog_define(uprintf__dlog_site *site, unsigned gen) {
+    size_t len = strlen(site->fmt);
+    unsigned char *rec;
+    uint32_t word = site->id | UPRINTF__DLOG_DEF, n = (uint32_t)len;
+    int ret = 0;
+
+    if (__atomic_load_n(&site->gen, __ATOMIC_ACQUIRE) == gen) return 0;
+    if ((rec = (unsigned char *)malloc(len + 8)) == NULL) return -1;
+    memcpy(rec, &word, 4);
+    memcpy(rec + 4, &n, 4);
+    memcpy(rec + 8, site->fmt, len);
+
+    pthread_mutex_lock(&uprintf__dlog_lock);
+    if (__atomic_load_n(&site->gen, __ATOMIC_RELAXED) != gen) {
+        if (!uprintf__dlog.fd_open || uprintf__dlog.gen != gen
+            || uprintf__write_all(uprintf__dlog.fd, (const char *)rec, len + 8) != 0)
+            ret = -1;
+        else
+            __atomic_store_n(&site->gen, gen, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&uprintf__dlog_lock);
+    free(rec);
+    return ret;
+}
+
+/* Record one call. Returns 0, or -1 when nothing was logged. */
+UPRINTF_INLINE int uprintf__dlog_record(uprintf__dlog_site *site, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
+#endif
+;
+
+UPRINTF_INLINE int uprintf__dlog_record(uprintf__dlog_site *site, const char *fmt, ...) {
+    uprintf__dlog_buf *t = &uprintf__dlog_tls;
+    unsigned gen;
+    va_list ap;
+    int ret;
+
+    if (!__atomic_load_n(&uprintf__dlog.open, __ATOMIC_ACQUIRE)) return -1;
+    if (!uprintf__dlog_site_ready(site)) return -1;
+    gen = __atomic_load_n(&uprintf__dlog.gen, __ATOMIC_RELAXED);
+    if (!t->registered) uprintf__dlog_register(t);
+    /* First record of this site in this file: write its definition */
+    if (uprintf__dlog_define(site, gen) != 0) return -1;
+
+    if (!uprintf__dlog_enter(t)) return -1;
+    if (t->gen != gen) {
+        t->len = 0;
+        t->gen = gen;
+    }
+    va_start(ap, fmt);
+    UPRINTF__DLOG_APPEND(t, uprintf__dlog_encode(&o_, site, ap), ret);
+    va_end(ap);
+    uprintf__dlog_leave(t);
+    return ret;
+}
+
+#define UPRINTF__DLOG_FMT(fmt, ...) fmt
+
+/*
+ * ulog_deferred(fmt, ...) — log a record; fmt must be a string literal.
+ * Evaluates to 0, or -1 when no log is open, the format is not supported
+ * or the record does not fit in UPRINTF_DEFERRED_BUF_SIZE.
+ */
+#define ulog_deferred(...) __extension__ ({                                  \
+    static uprintf__dlog_site uprintf__dsite_ = {                            \
+        UPRINTF__DLOG_FMT(__VA_ARGS__, 0), 0, 0, 0,                          \
+        { 0, 0, 0, {{0, {0, 0, 0, 0, 0}, 0, 0}} } };                         \
+    uprintf__dlog_record(&uprintf__dsite_, __VA_ARGS__);                     \
+})
+
+/*
+ * ulog_open() — create (truncate) the binary log at path. Returns 0 or -1.
+ * Open is not meant to race with logging threads or with ulog_close().
+ */
+UPRINTF_INLINE int ulog_open(const char *path) {
+    unsigned char hdr[UPRINTF__DLOG_HDR_SIZE];
+    int fd;
+
+    if (path == NULL || uprintf__dlog.open) return -1;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return -1;
+    uprintf__dlog_file_header(hdr);
+    if (uprintf__write_all(fd, (const char *)hdr, sizeof(hdr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_mutex_lock(&uprintf__dlog_lock);
+    uprintf__dlog.fd = fd;
+    uprintf__dlog.fd_open = 1;
+    /* gen 0 marks sites that never logged: skip it on wrap-around */
+    if (++uprintf__dlog.gen == 0) uprintf__dlog.gen = 1;
+    pthread_mutex_unlock(&uprintf__dlog_lock);
+    __atomic_store_n(&uprintf__dlog.open, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* ulog_flush() — write the calling thread's buffered records. 0 or -1. */
+UPRINTF_INLINE int ulog_flush(void) {
+    uprintf__dlog_buf *t = &uprintf__dlog_tls;
+    int ret;
+    if (!uprintf__dlog_enter(t)) return 0;
+    ret = uprintf__dlog_drain(t);
+    uprintf__dlog_leave(t);
+    return ret;
+}
+
+/*
+ * ulog_close() — stop accepting records, write what every thread still
+ * buffers for the log and close it. Calls already recording finish first;
+ * later ones return -1. Safe to call while other threads log.
+ */
+UPRINTF_INLINE int ulog_close(void) {
+    uprintf__dlog_buf *t;
+    int ret = 0;
+
+    /* Pairs with the busy store and open load in uprintf__dlog_enter */
+    if (!__atomic_exchange_n(&uprintf__dlog.open, 0, __ATOMIC_SEQ_CST)) return -1;
+    pthread_mutex_lock(&uprintf__dlog_lock);
+    for (t = uprintf__dlog_threads; t != NULL; t = t->next) {
+        while (__atomic_load_n(&t->busy, __ATOMIC_SEQ_CST))
+            sched_yield();
+        if (uprintf__dlog_drain(t) != 0) ret = -1;
+    }
+    uprintf__dlog.fd_open = 0;
+    if (close(uprintf__dlog.fd) != 0) ret = -1;
+    pthread_mutex_unlock(&uprintf__dlog_lock);
+    return ret;
+}
+
+#endif /* POSIX recording */
+
+/* ========================================================================== */
+/*  Decoding                                                                  */
+/* ========================================================================== */
+
+typedef struct {
+    char           *fmt;        /* NUL-terminated copy, NULL if undefined */
+    uprintf_program prog;
+    int             ok;
+} uprintf__dlog_def;
+
+/* Bounded input cursor; underflow is sticky */
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int                  bad;
+} uprintf__dlog_in;
+
+UPRINTF_INLINE void uprintf__dlog_get(uprintf__dlog_in *in, void *dst, size_t n) {
+    if (in->bad || (size_t)(in->end - in->p) < n) {
+        in->bad = 1;
+        memset(dst, 0, n);
+        return;
+    }
+    memcpy(dst, in->p, n);
+    in->p += n;
+}
+
+/*
+ * Read one argument back into the engine's representation. Strings are
+ * copied, NUL-terminated, to *scratch (sized for the whole payload).
+ */
+UPRINTF_INLINE int uprintf__dlog_get_arg(uprintf__dlog_in *in, const uprintf__spec *spec,
+                                         uprintf__arg *arg, unsigned char **scratch) {
+    int neg = 0;
+    switch (spec->conv) {
+        case 'd': case 'i':
+            if (uprintf__dlog_int_size(spec) == 4) {
+                int32_t v;
+                uprintf__dlog_get(in, &v, 4);
+                neg = v < 0;
+                arg->u = neg ? (uintmax_t)0 - (uintmax_t)(intmax_t)v : (uintmax_t)v;
+            } else {
+                int64_t v;
+                uprintf__dlog_get(in, &v, 8);
+                neg = v < 0;
+                arg->u = neg ? (uintmax_t)0 - (uintmax_t)(intmax_t)v : (uintmax_t)v;
+            }
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            if (uprintf__dlog_int_size(spec) == 4) {
+                uint32_t v;
+                uprintf__dlog_get(in, &v, 4);
+                arg->u = v;
+            } else {
+                uint64_t v;
+                uprintf__dlog_get(in, &v, 8);
+                arg->u = (uintmax_t)v;
+            }
+            break;
+        case 'c':
+            if (spec->length == UPRINTF__LEN_L) {
+                uprintf__dlog_get(in, &arg->wc, sizeof(wint_t));
+            } else {
+                unsigned char c;
+                uprintf__dlog_get(in, &c, 1);
+                arg->u = c;
+            }
+            break;
+        case 's': {
+            uint32_t n;
+            size_t unit = spec->length == UPRINTF__LEN_L ? sizeof(wchar_t) : 1;
+            uprintf__dlog_get(in, &n, 4);
+            if (n == UPRINTF__DLOG_NULL_STR) {
+                arg->p = NULL;
+                break;
+            }
+            if (in->bad || (size_t)(in->end - in->p) / unit < n) {
+                in->bad = 1;
+                break;
+            }
+            /* align for wchar_t */
+            while ((uintptr_t)*scratch % sizeof(wchar_t) != 0) (*scratch)++;
+            memcpy(*scratch, in->p, n * unit);
+            memset(*scratch + n * unit, 0, unit);
+            arg->p = *scratch;
+            *scratch += (n + 1) * unit;
+            in->p += n * unit;
+            break;
+        }
+        case 'p': {
+            uintptr_t v;
+            uprintf__dlog_get(in, &v, sizeof(v));
+            arg->p = (const void *)v;
+            break;
+        }
+        default:
+            if (spec->length == UPRINTF__LEN_BIGL) uprintf__dlog_get(in, &arg->ld, sizeof(long double));
+            else uprintf__dlog_get(in, &arg->d, sizeof(double));
+            break;
+    }
+    return neg;
+}
+
+/* Replay one event into the sink */
+UPRINTF_INLINE int uprintf__dlog_replay(uprintf__sink *s, const uprintf__dlog_def *def,
+                                        const unsigned char *payload, size_t len,
+                                        unsigned char *scratch) {
+    uprintf__dlog_in in;
+    unsigned i;
+
+    in.p = payload;
+    in.end = payload + len;
+    in.bad = 0;
+    for (i = 0; i < def->prog.count && !in.bad && !s->error; i++) {
+        const uprintf__op *op = &def->prog.ops[i];
+        uprintf__spec spec;
+        uprintf__arg arg;
+        int neg;
+
+        if (op->kind == UPRINTF__OP_LITERAL) {
+            uprintf__sink_write(s, def->fmt + op->off, op->len);
+            continue;
+        }
+        spec = op->spec;
+        /* as UPRINTF__RESOLVE_STARS */
+        if (spec.flags & UPRINTF__F_WSTAR) {
+            int32_t w32;
+            long w;
+            uprintf__dlog_get(&in, &w32, 4);
+            w = (long)w32;
+            if (w < 0) { spec.flags |= UPRINTF__F_LEFT; w = -w; }
+            spec.width = (int)(w > UPRINTF_MAX_WIDTH ? UPRINTF_MAX_WIDTH : w);
+        }
+        if (spec.flags & UPRINTF__F_PSTAR) {
+            int32_t p;
+            uprintf__dlog_get(&in, &p, 4);
+            spec.prec = p == UPRINTF_SHORTEST ? (int)p : p < 0 ? -1
+                      : (p > UPRINTF_MAX_PRECISION ? UPRINTF_MAX_PRECISION : p);
+        }
+        arg.u = 0;
+        neg = uprintf__dlog_get_arg(&in, &spec, &arg, &scratch);
+        if (in.bad) break;
+        if (uprintf__emit(s, &spec, &arg, neg) != 0) s->error = 1;
+    }
+    return in.bad || s->error ? -1 : 0;
+}
+
+/*
+ * ulog_decode() — print a binary log as text to out. Definitions may
+ * appear anywhere in the file (each thread writes its own buffer), so the
+ * file is read whole and scanned twice. Events whose format has no usable
+ * definition (a log from a crashed or older writer) are skipped. Returns
+ * the number of records printed, or -1 on a malformed or foreign-ABI file.
+ */
+UPRINTF_INLINE long ulog_decode(FILE *in, FILE *out) {
+    unsigned char hdr[UPRINTF__DLOG_HDR_SIZE];
+    unsigned char *data = NULL, *scratch = NULL;
+    uprintf__dlog_def *defs = NULL;
+    size_t size = 0, cap = 0, ndefs = 0, pos;
+    char obuf[UPRINTF_STACK_BUF_MAX];
+    uprintf__sink s;
+    long count = 0;
+    int pass;
+
+    if (in == NULL || out == NULL) return -1;
+    uprintf__dlog_file_header(hdr);
+
+    /* Slurp the file */
+    for (;;) {
+        size_t got;
+        if (size == cap) {
+            unsigned char *grown;
+            cap = cap ? cap * 2 : 65536;
+            grown = (unsigned char *)realloc(data, cap);
+            if (grown == NULL) goto fail;
+            data = grown;
+        }
+        got = fread(data + size, 1, cap - size, in);
+        size += got;
+        if (got == 0) break;
+    }
+    if (ferror(in) || size < UPRINTF__DLOG_HDR_SIZE || memcmp(data, hdr, UPRINTF__DLOG_HDR_SIZE) != 0)
+        goto fail;
+    /* room for every string of any one event, terminators and alignment */
+    scratch = (unsigned char *)malloc(size * 2 + 64);
+    if (scratch == NULL) goto fail;
+
+    uprintf__sink_init(&s, obuf, sizeof(obuf));
+    s.flush = uprintf__flush_stream;
+    s.ctx = out;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (pos = UPRINTF__DLOG_HDR_SIZE; pos < size; ) {
+            uint32_t word, len, id;
+            if (size - pos < 8) goto fail;
+            memcpy(&word, data + pos, 4);
+            memcpy(&len, data + pos + 4, 4);
+            pos += 8;
+            if (len > size - pos) goto fail;
+            id = word & ~UPRINTF__DLOG_DEF;
+
+            if (pass == 0 && (word & UPRINTF__DLOG_DEF)) {
+                if (id >= ndefs) {
+                    size_t n = id + 1 > ndefs * 2 ? (size_t)id + 1 : ndefs * 2;
+                    uprintf__dlog_def *grown = (uprintf__dlog_def *)realloc(defs, n * sizeof(*defs));
+                    if (grown == NULL) goto fail;
+                    memset(grown + ndefs, 0, (n - ndefs) * sizeof(*defs));
+                    defs = grown;
+                    ndefs = n;
+                }
+                if (defs[id].fmt == NULL) {
+                    defs[id].fmt = (char *)malloc((size_t)len + 1);
+                    if (defs[id].fmt == NULL) goto fail;
+                    memcpy(defs[id].fmt, data + pos, len);
+                    defs[id].fmt[len] = '\0';
+                    defs[id].ok = uprintf__dlog_compile(&defs[id].prog, defs[id].fmt) == 0;
+                }
+            } else if (pass == 1 && !(word & UPRINTF__DLOG_DEF)) {
+                if (id >= ndefs || !defs[id].ok) {
+                    pos += len;
+                    continue;
+                }
+                if (uprintf__dlog_replay(&s, &defs[id], data + pos, len, scratch) != 0) goto fail;
+                count++;
+            }
+            pos += len;
+        }
+    }
+    if (s.pos > 0 && uprintf__flush_stream(&s) != 0) goto fail;
+    goto done;
+
+fail:
+    count = -1;
+done:
+    while (ndefs > 0) free(defs[--ndefs].fmt);
+    free(defs);
+    free(scratch);
+    free(data);
+    return count;
+}
+
+#endif /* UPRINTF_DEFERRED */
+
+#endif /* UPRINTF_DEFERRED_H */
@@ -0,0 +1,608 @@
+/*
+ * uprintf_dtoa.h — Shortest round-trip formatting of doubles and floats
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * uprintf_dtoa_shortest() prints the fewest significant digits that read
+ * back (strtod) as the same double, the nearest such digits when there
+ * is a choice. "%.17g" round-trips too, but prints 0.1 as
+ * 0.10000000000000001. glibc also needs multi-precision arithmetic to do
+ * it for large exponents.
+ *
+ *   char buf[UPRINTF_DTOA_SHORTEST_MAX];
+ *   uprintf_dtoa_shortest(buf, 0.1);      // "0.1"
+ *   uprintf_dtoa_shortest(buf, 1e300);    // "1e+300"
+ *
+ * The digits come from Ryu (Ulf Adams, PLDI 2018): the rounding interval
+ * of the value is scaled by a 125-bit approximation of 5^±k and shrunk to
+ * the shortest decimal with a handful of 64-bit divisions. The powers are
+ * rebuilt from 28 table entries instead of Ryu's full 668: two extra
+ * multiplications per value save about 10 KiB of tables.
+ *
+ * In the native engine, a '*' precision of UPRINTF_SHORTEST selects the
+ * same digits for %e, %f and %g, so format checking keeps working:
+ *
+ *   usnprintf(buf, sizeof(buf), "%.*g", UPRINTF_SHORTEST, x);
+ *
+ * The platform printf reads a negative precision as "none" and prints
+ * six digits instead.
+ */
+
+#ifndef UPRINTF_DTOA_H
+#define UPRINTF_DTOA_H
+
+#include "uprintf_config.h"
+#include "uprintf_itoa.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+/* Longest uprintf_dtoa_shortest() result with its terminator: "-1.2345678901234567e-308" */
+#define UPRINTF_DTOA_SHORTEST_MAX 25
+
+/* '*' precision selecting shortest round-trip digits in the native engine */
+#define UPRINTF_SHORTEST INT_MIN
+
+/* ========================================================================== */
+/*  Ryu tables                                                                */
+/* ========================================================================== */
+
+#define UPRINTF__RYU_POW5_BITS     125
+#define UPRINTF__RYU_INV_BITS      125
+
+/* 5^0 .. 5^25 */
+static const uint64_t uprintf__ryu_pow5[26] UPRINTF_UNUSED = {
+    1u, 5u, 25u,
+    125u, 625u, 3125u,
+    15625u, 78125u, 390625u,
+    1953125u, 9765625u, 48828125u,
+    244140625u, 1220703125u, 6103515625u,
+    30517578125u, 152587890625u, 762939453125u,
+    3814697265625u, 19073486328125u, 95367431640625u,
+    476837158203125u, 2384185791015625u, 11920928955078125u,
+    59604644775390625u, 298023223876953125u
+};
+
+/* Top 125 bits of 5^(26k), low word first */
+static const uint64_t uprintf__ryu_pow5_split2[13][2] UPRINTF_UNUSED = {
+    { 0x0000000000000000u, 0x1000000000000000u },
+    { 0x0000000000000000u, 0x14adf4b7320334b9u },
+    { 0x0e549208b31adb10u, 0x1aba4714957d300du },
+    { 0x6dc6ad264d8f0866u, 0x1145b7e285bf98f5u },
+    { 0xeb1dbd923d8596cau, 0x1652efdc6018a1fcu },
+    { 0xb4c1b80b22ae923cu, 0x1cda62055b2d9d83u },
+    { 0x5bb28b4e8f7e4c30u, 0x12a5568b9f52f416u },
+    { 0xf08aed437682d4fbu, 0x1819651531f9e78fu },
+    { 0xb4ee134ad99bf150u, 0x1f25c186a6f04c28u },
+    { 0x16499ecb70c25f03u, 0x1420eb449c8842e6u },
+    { 0x85a56ead360865b0u, 0x1a03fde214caf085u },
+    { 0x093db1d57999890bu, 0x10cfeb353a97dad8u },
+    { 0xcf38bb735e3f36acu, 0x15baaf44fa52673eu }
+};
+
+/* 2^(125 + bits(5^(26k)) - 1) / 5^(26k), plus one */
+static const uint64_t uprintf__ryu_inv_split2[15][2] UPRINTF_UNUSED = {
+    { 0x0000000000000001u, 0x2000000000000000u },
+    { 0x52a6c95fc0655034u, 0x18c240c4aecb13bbu },
+    { 0x7ca8d50071dfc806u, 0x1327fc58da0f6ff5u },
+    { 0x6520247d3556476eu, 0x1da48ce468e7c702u },
+    { 0x6139cdd76802e6e9u, 0x16ef5b40c2fc7779u },
+    { 0xf951a7ff43de8c79u, 0x11bebdf578b2f391u },
+    { 0x7be8bee8d6e957e8u, 0x1b758d848fac54b0u },
+    { 0x8bd3f9e999a423eau, 0x153eda614071a3b7u },
+    { 0x0848f973cb3ee3ceu, 0x10701bd527b4978cu },
+    { 0x153285ebb9efbfa2u, 0x196fbb9bb44db44du },
+    { 0xadeee7f86c07b696u, 0x13ae3591f5b4d936u },
+    { 0x4d686a4eaf182222u, 0x1e74404f3daada91u },
+    { 0x98c0a106e09ebd9fu, 0x17900ea4fda7c257u },
+    { 0x8f20e37371497d0eu, 0x123b140576d820b2u },
+    { 0xb043138134743d85u, 0x1c35f4275f7a29adu }
+};
+
+/* Rounding corrections, 2 bits per power of 5^0 .. 5^325 */
+static const uint32_t uprintf__ryu_pow5_offsets[21] UPRINTF_UNUSED = {
+    0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u,
+    0x40000000u, 0x59695995u, 0x55545555u, 0x56555515u,
+    0x41150504u, 0x40555410u, 0x44555145u, 0x44504540u,
+    0x45555550u, 0x40004000u, 0x96440440u, 0x55565565u,
+    0x54454045u, 0x40154151u, 0x55559155u, 0x51405555u,
+    0x00000105u
+};
+
+/* Same for the inverses of 5^0 .. 5^341 */
+static const uint32_t uprintf__ryu_inv_offsets[22] UPRINTF_UNUSED = {
+    0x54544554u, 0x04055545u, 0x10041000u, 0x00400414u,
+    0x40010000u, 0x41155555u, 0x00000454u, 0x00010044u,
+    0x40000000u, 0x44000041u, 0x50454450u, 0x55550054u,
+    0x51655554u, 0x40004000u, 0x01000001u, 0x00010500u,
+    0x51515411u, 0x05555554u, 0x50411500u, 0x40040000u,
+    0x05040110u, 0x00000000u
+};
+
+/* ========================================================================== */
+/*  128-bit arithmetic                                                        */
+/* ========================================================================== */
+
+/* a * b: low word returned, high word in *hi */
+UPRINTF_INLINE uint64_t uprintf__umul128(uint64_t a, uint64_t b, uint64_t *hi) {
+#if defined(UPRINTF_HAS_INT128)
+    uprintf__u128 p = (uprintf__u128)a * b;
+    *hi = (uint64_t)(p >> 64);
+    return (uint64_t)p;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t b00 = a_lo * b_lo, b01 = a_lo * b_hi;
+    uint64_t b10 = a_hi * b_lo, b11 = a_hi * b_hi;
+    uint64_t mid1 = b10 + (b00 >> 32);
+    uint64_t mid2 = b01 + (uint32_t)mid1;
+    *hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+    return (mid2 << 32) | (uint32_t)b00;
+#endif
+}
+
+/* (hi:lo) >> dist, low word, for 0 < dist < 64 */
+UPRINTF_INLINE uint64_t uprintf__shr128(uint64_t lo, uint64_t hi, unsigned dist) {
+    return (hi << (64 - dist)) | (lo >> dist);
+}
+
+/* ========================================================================== */
+/*  Shortest digits (Ryu)                                                     */
+/* ========================================================================== */
+
+/* value = digits * 10^exp */
+typedef struct {
+    uint64_t digits;
+    int      exp;
+    int      neg;
+} uprintf__decimal;
+
+/* uprintf__shortest_*() classes */
+#define UPRINTF__FP_FINITE 0
+#define UPRINTF__FP_INF    1
+#define UPRINTF__FP_NAN    2
+
+/* ceil(log2(5^e)), or 1 for e = 0 */
+UPRINTF_INLINE unsigned uprintf__ryu_pow5_bits(unsigned e) {
+    return ((e * 1217359u) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) and floor(log10(5^e)) */
+UPRINTF_INLINE unsigned uprintf__ryu_log10_pow2(unsigned e) {
+    return (e * 78913u) >> 18;
+}
+
+UPRINTF_INLINE unsigned uprintf__ryu_log10_pow5(unsigned e) {
+    return (e * 732923u) >> 20;
+}
+
+/* Top 125 bits of 5^i, 0 <= i < 326 */
+UPRINTF_INLINE void uprintf__ryu_pow5_split(unsigned i, uint64_t out[2]) {
+    unsigned base = i / 26, base2 = base * 26, off = i - base2, delta;
+    const uint64_t *mul = uprintf__ryu_pow5_split2[base];
+    uint64_t lo0, hi0, lo1, hi1, sum;
+
+    if (off == 0) { out[0] = mul[0]; out[1] = mul[1]; return; }
+    lo1 = uprintf__umul128(uprintf__ryu_pow5[off], mul[1], &hi1);
+    lo0 = uprintf__umul128(uprintf__ryu_pow5[off], mul[0], &hi0);
+    sum = hi0 + lo1;
+    if (sum < hi0) hi1++;
+    delta = uprintf__ryu_pow5_bits(i) - uprintf__ryu_pow5_bits(base2);
+    out[0] = uprintf__shr128(lo0, sum, delta) + ((uprintf__ryu_pow5_offsets[i / 16] >> ((i % 16) << 1)) & 3u);
+    out[1] = uprintf__shr128(sum, hi1, delta);
+}
+
+/* 2^(125 + bits(5^i) - 1) / 5^i rounded up, 0 <= i < 342 */
+UPRINTF_INLINE void uprintf__ryu_inv_split(unsigned i, uint64_t out[2]) {
+    unsigned base = (i + 25) / 26, base2 = base * 26, off = base2 - i, delta;
+    const uint64_t *mul = uprintf__ryu_inv_split2[base];
+    uint64_t lo0, hi0, lo1, hi1, sum;
+
+    if (off == 0) { out[0] = mul[0]; out[1] = mul[1]; return; }
+    lo1 = uprintf__umul128(uprintf__ryu_pow5[off], mul[1], &hi1);
+    lo0 = uprintf__umul128(uprintf__ryu_pow5[off], mul[0] - 1, &hi0);
+    sum = hi0 + lo1;
+    if (sum < hi0) hi1++;
+    delta = uprintf__ryu_pow5_bits(base2) - uprintf__ryu_pow5_bits(i);
+    out[0] = uprintf__shr128(lo0, sum, delta) + 1 + ((uprintf__ryu_inv_offsets[i / 16] >> ((i % 16) << 1)) & 3u);
+    out[1] = uprintf__shr128(sum, hi1, delta);
+}
+
+/* (m * mul) >> j for 64 < j < 128 */
+UPRINTF_INLINE uint64_t uprintf__ryu_mul_shift(uint64_t m, const uint64_t mul[2], int j) {
+    uint64_t hi0, lo1, hi1, sum;
+    (void)uprintf__umul128(m, mul[0], &hi0);
+    lo1 = uprintf__umul128(m, mul[1], &hi1);
+    sum = hi0 + lo1;
+    if (sum < hi0) hi1++;
+    return uprintf__shr128(sum, hi1, (unsigned)(j - 64));
+}
+
+/* Largest p with 5^p dividing v, v != 0 */
+UPRINTF_INLINE unsigned uprintf__ryu_pow5_factor(uint64_t v) {
+    unsigned n = 0;
+    while (v % 5 == 0) { v /= 5; n++; }
+    return n;
+}
+
+/*
+ * Shortest decimal inside the rounding interval of m2 * 2^e2. mm_shift is
+ * 0 when the next lower value is twice as close (m2 a power of two above
+ * the smallest normal): the interval is asymmetric there.
+ */
+UPRINTF_INLINE void uprintf__ryu(uint64_t m2, int e2, int mm_shift, uprintf__decimal *out) {
+    uint64_t mv = 4 * m2, vr, vp, vm, mul[2];
+    int even = (m2 & 1) == 0, vm_tz = 0, vr_tz = 0, e10, removed = 0;
+    unsigned last = 0;
+
+    e2 -= 2;
+    if (e2 >= 0) {
+        unsigned q = uprintf__ryu_log10_pow2((unsigned)e2) - (e2 > 3);
+        int j = -e2 + (int)q + UPRINTF__RYU_INV_BITS + (int)uprintf__ryu_pow5_bits(q) - 1;
+        e10 = (int)q;
+        uprintf__ryu_inv_split(q, mul);
+        vr = uprintf__ryu_mul_shift(mv, mul, j);
+        vp = uprintf__ryu_mul_shift(mv + 2, mul, j);
+        vm = uprintf__ryu_mul_shift(mv - 1 - (uint64_t)mm_shift, mul, j);
+        if (q <= 21) {
+            /* Only one of mv, mv + 2, mv - 1 - mm_shift can be a multiple of 5 */
+            if (mv % 5 == 0) vr_tz = uprintf__ryu_pow5_factor(mv) >= q;
+            else if (even) vm_tz = uprintf__ryu_pow5_factor(mv - 1 - (uint64_t)mm_shift) >= q;
+            else vp -= uprintf__ryu_pow5_factor(mv + 2) >= q;
+        }
+    } else {
+        unsigned q = uprintf__ryu_log10_pow5((unsigned)-e2) - (-e2 > 1);
+        unsigned i = (unsigned)-e2 - q;
+        int j = (int)q - ((int)uprintf__ryu_pow5_bits(i) - UPRINTF__RYU_POW5_BITS);
+        e10 = (int)q + e2;
+        uprintf__ryu_pow5_split(i, mul);
+        vr = uprintf__ryu_mul_shift(mv, mul, j);
+        vp = uprintf__ryu_mul_shift(mv + 2, mul, j);
+        vm = uprintf__ryu_mul_shift(mv - 1 - (uint64_t)mm_shift, mul, j);
+        if (q <= 1) {
+            /* mv has at least two trailing zero bits */
+            vr_tz = 1;
+            if (even) vm_tz = mm_shift == 1;
+            else vp--;
+        } else if (q < 63) {
+            vr_tz = (mv & ((1ull << q) - 1)) == 0;
+        }
+    }
+
+    if (vm_tz || vr_tz) {
+        /* Rare: an endpoint or the value itself is exact, track the zeros */
+        for (; vp / 10 > vm / 10; removed++) {
+            vm_tz &= vm % 10 == 0;
+            vr_tz &= last == 0;
+            last = (unsigned)(vr % 10);
+            vr /= 10; vp /= 10; vm /= 10;
+        }
+        if (vm_tz) {
+            for (; vm % 10 == 0; removed++) {
+                vr_tz &= last == 0;
+                last = (unsigned)(vr % 10);
+                vr /= 10; vp /= 10; vm /= 10;
+            }
+        }
+        /* Exactly halfway: round to even */
+        if (vr_tz && last == 5 && vr % 2 == 0) last = 4;
+        out->digits = vr + ((vr == vm && (!even || !vm_tz)) || last >= 5);
+    } else {
+        int round_up = 0;
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100; vp /= 100; vm /= 100;
+            removed += 2;
+        }
+        for (; vp / 10 > vm / 10; removed++) {
+            round_up = vr % 10 >= 5;
+            vr /= 10; vp /= 10; vm /= 10;
+        }
+        out->digits = vr + (vr == vm || round_up);
+    }
+    out->exp = e10 + removed;
+}
+
+/* Shortest decimal of v; returns UPRINTF__FP_* */
+UPRINTF_INLINE int uprintf__shortest_double(double v, uprintf__decimal *d) {
+    uint64_t bits, m, m2;
+    unsigned e;
+    int e2;
+
+    memcpy(&bits, &v, sizeof(bits));
+    m = bits & ((1ull << 52) - 1);
+    e = (unsigned)(bits >> 52) & 0x7ffu;
+    d->neg = (int)(bits >> 63);
+    d->digits = 0;
+    d->exp = 0;
+    if (e == 0x7ffu) return m != 0 ? UPRINTF__FP_NAN : UPRINTF__FP_INF;
+    if (e == 0 && m == 0) return UPRINTF__FP_FINITE;
+
+    m2 = e == 0 ? m : m | (1ull << 52);
+    e2 = (e == 0 ? 1 : (int)e) - 1075;
+    if (e2 <= 0 && e2 >= -52 && (m2 & ((1ull << -e2) - 1)) == 0) {
+        /* An integer below 2^53: its own digits, less the trailing zeros */
+        d->digits = m2 >> -e2;
+        while (d->digits % 10 == 0) { d->digits /= 10; d->exp++; }
+        return UPRINTF__FP_FINITE;
+    }
+    uprintf__ryu(m2, e2, m != 0 || e <= 1, d);
+    return UPRINTF__FP_FINITE;
+}
+
+/* Shortest decimal of a float: the digits read back by strtof */
+UPRINTF_INLINE int uprintf__shortest_float(float v, uprintf__decimal *d) {
+    uint32_t bits, m;
+    unsigned e;
+
+    memcpy(&bits, &v, sizeof(bits));
+    m = bits & ((1u << 23) - 1);
+    e = (bits >> 23) & 0xffu;
+    d->neg = (int)(bits >> 31);
+    d->digits = 0;
+    d->exp = 0;
+    if (e == 0xffu) return m != 0 ? UPRINTF__FP_NAN : UPRINTF__FP_INF;
+    if (e == 0 && m == 0) return UPRINTF__FP_FINITE;
+
+    uprintf__ryu(e == 0 ? m : m | (1u << 23), (e == 0 ? 1 : (int)e) - 150, m != 0 || e <= 1, d);
+    return UPRINTF__FP_FINITE;
+}
+
+/* ========================================================================== */
+/*  Layout                                                                    */
+/* ========================================================================== */
+
+/* Longest uprintf__shortest_layout() output: "0." + 323 zeros + 17 digits */
+#define UPRINTF__SHORTEST_LAYOUT_MAX 352
+
+/* "e+05", "E-123": printf's exponent, at least two digits */
+UPRINTF_INLINE size_t uprintf__put_exp(char *out, int x, int upper) {
+    unsigned ax = (unsigned)(x < 0 ? -x : x);
+    size_t len = 0;
+    out[len++] = upper ? 'E' : 'e';
+    out[len++] = x < 0 ? '-' : '+';
+    if (ax >= 100) out[len++] = (char)('0' + ax / 100);
+    out[len++] = (char)('0' + ax / 10 % 10);
+    out[len++] = (char)('0' + ax % 10);
+    return len;
+}
+
+/*
+ * Write d without sign or trailing zeros. style 'e' is scientific, 'f'
+ * fixed, and 'g' picks scientific when the exponent is below -4 or at
+ * least sci_at, as "%.{sci_at}g" would. alt keeps the decimal point.
+ * Returns the length; out is not terminated.
+ */
+UPRINTF_INLINE size_t uprintf__shortest_layout(char *out, const uprintf__decimal *d, int style,
+                                               int upper, int alt, int sci_at) {
+    char dig[20];
+    size_t nd = uprintf__u64_dec(dig, d->digits), len;
+    int x = d->exp + (int)nd - 1;
+
+    if (style == 'g') style = x < -4 || x >= sci_at ? 'e' : 'f';
+
+    if (style == 'e') {
+        out[0] = dig[0];
+        len = 1;
+        if (nd > 1 || alt) out[len++] = '.';
+        memcpy(out + len, dig + 1, nd - 1);
+        len += nd - 1;
+        len += uprintf__put_exp(out + len, x, upper);
+    } else if (x >= 0) {
+        size_t ni = (size_t)x + 1;
+        if (ni >= nd) {
+            memcpy(out, dig, nd);
+            memset(out + nd, '0', ni - nd);
+            len = ni;
+            if (alt) out[len++] = '.';
+        } else {
+            memcpy(out, dig, ni);
+            out[ni] = '.';
+            memcpy(out + ni + 1, dig + ni, nd - ni);
+            len = nd + 1;
+        }
+    } else {
+        size_t z = (size_t)(-x - 1);
+        out[0] = '0';
+        out[1] = '.';
+        memset(out + 2, '0', z);
+        memcpy(out + 2 + z, dig, nd);
+        len = 2 + z + nd;
+    }
+    return len;
+}
+
+UPRINTF_INLINE int uprintf__shortest_finish(char *buf, int kind, const uprintf__decimal *d, int sci_at) {
+    size_t len = 0;
+    if (d->neg) buf[len++] = '-';
+    if (kind == UPRINTF__FP_FINITE) {
+        len += uprintf__shortest_layout(buf + len, d, 'g', 0, 0, sci_at);
+    } else {
+        memcpy(buf + len, kind == UPRINTF__FP_INF ? "inf" : "nan", 3);
+        len += 3;
+    }
+    buf[len] = '\0';
+    return (int)len;
+}
+
+/*
+ * Shortest round-trip text of v, laid out like "%.17g" without trailing
+ * zeros: "0.1", "-2.5e-07", "1e+300", "inf". buf must hold
+ * UPRINTF_DTOA_SHORTEST_MAX bytes. Returns the length.
+ */
+UPRINTF_INLINE int uprintf_dtoa_shortest(char *buf, double v) {
+    uprintf__decimal d;
+    int kind = uprintf__shortest_double(v, &d);
+    return uprintf__shortest_finish(buf, kind, &d, 17);
+}
+
+/* Same for a float, laid out like "%.9g"; the digits read back with strtof */
+UPRINTF_INLINE int uprintf_ftoa_shortest(char *buf, float v) {
+    uprintf__decimal d;
+    int kind = uprintf__shortest_float(v, &d);
+    return uprintf__shortest_finish(buf, kind, &d, 9);
+}
+
+/* ========================================================================== */
+/*  Fixed precision                                                           */
+/* ========================================================================== */
+
+/* Largest precision uprintf__fixed_layout() takes on */
+#define UPRINTF__FIXED_PREC_MAX 17
+
+/* Longest uprintf__fixed_layout() output: "1.23456789012345678e-300" and up */
+#define UPRINTF__FIXED_LAYOUT_MAX 32
+
+/* Bit i of hi:lo, and whether any bit below i is set (i < 128) */
+UPRINTF_INLINE int uprintf__bit128(uint64_t lo, uint64_t hi, unsigned i) {
+    return (int)((i < 64 ? lo >> i : hi >> (i - 64)) & 1u);
+}
+
+UPRINTF_INLINE int uprintf__any_below128(uint64_t lo, uint64_t hi, unsigned i) {
+    if (i < 64) return (lo & ((1ull << i) - 1)) != 0;
+    return lo != 0 || (hi & ((1ull << (i - 64)) - 1)) != 0;
+}
+
+/*
+ * m2 * 2^e2 * 10^k rounded to an integer, ties to even, for
+ * -19 <= k <= 25. The product is exact: m2 * 5^k takes at most 112 bits
+ * and a negative k divides the integer part, keeping the fraction as a
+ * sticky bit. Returns -1 when the result does not fit 64 bits.
+ */
+UPRINTF_INLINE int uprintf__scale_round(uint64_t m2, int e2, int k, uint64_t *out) {
+    uint64_t lo, hi, q;
+    unsigned r;
+    int up;
+
+    if (k < 0) {
+        uint64_t ip, d = uprintf__pow10[-k], rem;
+        int frac = 0;
+        if (e2 >= 0) {
+            if (e2 >= 64 || (m2 >> (63 - e2)) >> 1 != 0) return -1;
+            ip = m2 << e2;
+        } else if (e2 > -64) {
+            ip = m2 >> -e2;
+            frac = (m2 & ((1ull << -e2) - 1)) != 0;
+        } else {
+            ip = 0;
+            frac = m2 != 0;
+        }
+        q = ip / d;
+        rem = ip % d;
+        up = rem > d / 2 || (rem == d / 2 && (frac || (q & 1)));
+        *out = q + (uint64_t)up;
+        return 0;
+    }
+
+    lo = uprintf__umul128(m2, uprintf__ryu_pow5[k], &hi);
+    if (e2 + k >= 0) {
+        unsigned sh = (unsigned)(e2 + k);
+        if (hi != 0 || sh >= 64 || (sh > 0 && lo >> (64 - sh) != 0)) return -1;
+        *out = lo << sh;
+        return 0;
+    }
+    r = (unsigned)-(e2 + k);
+    if (r > 112) {                  /* below one half */
+        *out = 0;
+        return 0;
+    }
+    if (r < 64) {
+        if (hi >> r != 0) return -1;
+        q = uprintf__shr128(lo, hi, r);
+    } else {
+        q = hi >> (r - 64);
+    }
+    up = uprintf__bit128(lo, hi, r - 1) && (uprintf__any_below128(lo, hi, r - 1) || (q & 1));
+    if (q + (uint64_t)up < q) return -1;
+    *out = q + (uint64_t)up;
+    return 0;
+}
+
+/* r as a fixed-point number with fp fraction digits; alt keeps the point */
+UPRINTF_INLINE size_t uprintf__fixed_digits(char *out, uint64_t r, unsigned fp, int alt) {
+    char dig[20];
+    size_t nd = uprintf__u64_dec(dig, r), ni;
+
+    if (nd <= fp) {
+        out[0] = '0';
+        out[1] = '.';
+        memset(out + 2, '0', fp - nd);
+        memcpy(out + 2 + fp - nd, dig, nd);
+        return 2 + fp;
+    }
+    ni = nd - fp;
+    memcpy(out, dig, ni);
+    if (fp == 0 && !alt) return ni;
+    out[ni] = '.';
+    memcpy(out + ni + 1, dig + ni, fp);
+    return ni + 1 + fp;
+}
+
+/*
+ * Finite |v| in "%.{prec}e", "%.{prec}f" or "%.{prec}g" (conv, either
+ * case), correctly rounded like glibc in the default rounding mode.
+ * Works in 64-bit integers, so it gives up (-1) when the digits do not
+ * fit: %f of 2^64 and up, %e/%g outside about [1e-19, 1e19], precisions
+ * above UPRINTF__FIXED_PREC_MAX. Returns the length; out holds
+ * UPRINTF__FIXED_LAYOUT_MAX bytes and is not terminated.
+ */
+UPRINTF_INLINE int uprintf__fixed_layout(char *out, double v, int conv, int prec, int alt) {
+    uint64_t bits, m2, r = 0;
+    int style = conv | 0x20, be, e2, n, x = 0, carried = 0;
+    char dig[20];
+    size_t len;
+
+    if (prec < 0 || prec > UPRINTF__FIXED_PREC_MAX) return -1;
+    memcpy(&bits, &v, sizeof(bits));
+    m2 = bits & ((1ull << 52) - 1);
+    be = (int)(bits >> 52 & 0x7ffu);
+    if (be == 0x7ff) return -1;
+    if (be != 0) m2 |= 1ull << 52;
+    e2 = (be == 0 ? 1 : be) - 1075;
+
+    if (style == 'f') {
+        if (uprintf__scale_round(m2, e2, prec, &r) != 0) return -1;
+        return (int)uprintf__fixed_digits(out, r, (unsigned)prec, alt);
+    }
+
+    /* n + 1 significant digits r, decimal exponent x */
+    n = style == 'e' ? prec : (prec > 0 ? prec : 1) - 1;
+    if (m2 != 0) {
+        int b = e2 + 52;
+        if (be == 0) return -1;     /* subnormal: far below 1e-19 */
+        x = b >= 0 ? (int)uprintf__ryu_log10_pow2((unsigned)b)
+                   : -(int)uprintf__ryu_log10_pow2((unsigned)-b) - 1;
+        for (;;) {                  /* x starts at most one short; rounding may carry */
+            if (n - x < -19 || n - x > 25 || uprintf__scale_round(m2, e2, n - x, &r) != 0) return -1;
+            if (r < uprintf__pow10[n + 1]) break;
+            carried = r == uprintf__pow10[n + 1];
+            x++;
+        }
+    }
+
+    if (style == 'g') {
+        if (x >= -4 && x <= n) {
+            unsigned fp = (unsigned)(n - x);
+            if (!alt) while (fp > 0 && r % 10 == 0) { r /= 10; fp--; }
+            return (int)uprintf__fixed_digits(out, r, fp, alt);
+        }
+        /* glibc drops the zeros of "%#.2g" 99.5 ("1.e+02"): leave that to it */
+        if (alt && carried) return -1;
+        if (!alt) while (n > 0 && r % 10 == 0) { r /= 10; n--; }
+    }
+
+    if (r == 0) memset(dig, '0', (size_t)n + 1);
+    else uprintf__u64_dec(dig, r);
+    out[0] = dig[0];
+    len = 1;
+    if (n > 0 || alt) out[len++] = '.';
+    memcpy(out + len, dig + 1, (size_t)n);
+    len += (size_t)n;
+    len += uprintf__put_exp(out + len, x, conv != style);
+    return (int)len;
+}
+
+#endif /* UPRINTF_DTOA_H */
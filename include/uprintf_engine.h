@@ -0,0 +1,1397 @@
+/*
+ * uprintf_engine.h — Native narrow formatting engine
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * The engine parses the format string itself and writes integers, strings,
+ * characters and pointers straight into the destination, without going
+ * through the libc vfprintf state machine. %e, %f and %g of a double with
+ * a precision up to 17 are rounded in integer arithmetic (uprintf_dtoa.h),
+ * giving the bytes glibc prints; a '*' precision of UPRINTF_SHORTEST
+ * selects the shortest digits that round-trip instead. Other floats (%a,
+ * long double, large precisions, magnitudes the 64-bit path cannot hold)
+ * and wide-character conversions are handed to the platform snprintf one
+ * conversion at a time, so their output stays byte-identical to it.
+ *
+ * Formats the engine does not model (positional arguments "%1$d", the "'"
+ * and "I" flags, glibc's "%m", unknown or truncated conversions) are
+ * formatted by the platform vsnprintf/vfprintf instead, from the start.
+ *
+ * Define UPRINTF_NATIVE_ENGINE to route uprintf_narrow, ufprintf_narrow and
+ * usnprintf_narrow through this engine.
+ */
+
+#ifndef UPRINTF_ENGINE_H
+#define UPRINTF_ENGINE_H
+
+#include "uprintf_config.h"
+#include "uprintf_itoa.h"
+#include "uprintf_dtoa.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <wchar.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#if defined(UPRINTF_WINDOWS)
+    #include <locale.h>
+    #include <io.h>
+    /* _write takes an unsigned count: keep each call well inside INT_MAX */
+    #define UPRINTF__WRITE(fd, p, n) _write((fd), (p), (unsigned)((n) > 0x40000000u ? 0x40000000u : (n)))
+#else
+    #include <langinfo.h>
+    #include <unistd.h>
+    #define UPRINTF__WRITE(fd, p, n) write((fd), (p), (n))
+#endif
+
+/* ========================================================================== */
+/*  Output sink                                                               */
+/* ========================================================================== */
+
+/*
+ * A sink is a bounded character buffer. When it fills up, the optional flush
+ * callback drains it (to a FILE*, a file descriptor, ...); without one the
+ * output is truncated but still counted, which gives snprintf semantics.
+ * The buffer must provide cap + 1 characters: the extra one holds the
+ * terminator. Wide sinks store wchar_t in wbuf; the ASCII text produced by
+ * the narrow emitters (digits, prefixes, padding) is widened on the way in.
+ * Before its first flush a sink checks the part of the format not parsed
+ * yet (rest): a specification only the platform printf can format makes
+ * the flush fail with foreign set, while the whole format can still be
+ * handed to libc.
+ */
+typedef struct uprintf__sink uprintf__sink;
+
+struct uprintf__sink {
+    char    *buf;                       /* narrow destination, NULL to count */
+    wchar_t *wbuf;                      /* wide destination (wide sinks)     */
+    size_t   cap;                       /* usable chars (excluding the NUL)  */
+    size_t   pos;                       /* chars currently held in buf       */
+    size_t   total;                     /* chars produced so far             */
+    int    (*flush)(uprintf__sink *s);  /* drains buf, 0 on success          */
+    void    *ctx;                       /* flush callback state              */
+    int      wide;                      /* wchar_t sink                      */
+    int      flushed;                   /* flush has already emitted data    */
+    int      error;                     /* conversion or output error        */
+    int      foreign;                   /* flush refused: rest needs libc    */
+    const char *rest;                   /* unparsed narrow format, or NULL   */
+};
+
+UPRINTF_INLINE void uprintf__sink_init(uprintf__sink *s, char *buf, size_t n) {
+    s->buf = buf;
+    s->wbuf = NULL;
+    s->cap = (buf != NULL && n > 0) ? n - 1 : 0;
+    s->pos = 0;
+    s->total = 0;
+    s->flush = NULL;
+    s->ctx = NULL;
+    s->wide = 0;
+    s->flushed = 0;
+    s->error = 0;
+    s->foreign = 0;
+    s->rest = NULL;
+}
+
+UPRINTF_INLINE void uprintf__sink_init_wide(uprintf__sink *s, wchar_t *wbuf, size_t n) {
+    uprintf__sink_init(s, NULL, 0);
+    s->wbuf = wbuf;
+    s->cap = (wbuf != NULL && n > 0) ? n - 1 : 0;
+    s->wide = 1;
+}
+
+/* A sink without a destination only counts: emitters may skip producing text */
+UPRINTF_INLINE int uprintf__sink_counting(const uprintf__sink *s) {
+    return s->buf == NULL && s->wbuf == NULL;
+}
+
+/* Make room in a full sink. Returns the number of free chars afterwards. */
+UPRINTF_INLINE int uprintf__format_foreign(const char *fmt);
+
+UPRINTF_INLINE size_t uprintf__sink_drain(uprintf__sink *s) {
+    if (s->flush == NULL || s->error) return 0;
+    if (!s->flushed && s->rest != NULL && uprintf__format_foreign(s->rest)) {
+        s->foreign = 1;
+        s->error = 1;
+        return 0;
+    }
+    if (s->flush(s) != 0) {
+        s->error = 1;
+        return 0;
+    }
+    s->flushed = 1;
+    return s->cap - s->pos;
+}
+
+UPRINTF_INLINE void uprintf__sink_write(uprintf__sink *s, const char *src, size_t len) {
+    s->total += len;
+    while (len > 0) {
+        size_t room = s->cap - s->pos;
+        if (room == 0 && (room = uprintf__sink_drain(s)) == 0) return;
+        if (room > len) room = len;
+        if (s->wide) {
+            size_t i;
+            for (i = 0; i < room; i++) s->wbuf[s->pos + i] = (wchar_t)(unsigned char)src[i];
+        } else {
+            memcpy(s->buf + s->pos, src, room);
+        }
+        s->pos += room;
+        src += room;
+        len -= room;
+    }
+}
+
+/* Wide sinks only */
+UPRINTF_INLINE void uprintf__sink_write_wide(uprintf__sink *s, const wchar_t *src, size_t len) {
+    s->total += len;
+    while (len > 0) {
+        size_t room = s->cap - s->pos;
+        if (room == 0 && (room = uprintf__sink_drain(s)) == 0) return;
+        if (room > len) room = len;
+        wmemcpy(s->wbuf + s->pos, src, room);
+        s->pos += room;
+        src += room;
+        len -= room;
+    }
+}
+
+UPRINTF_INLINE void uprintf__sink_fill(uprintf__sink *s, char c, size_t count) {
+    s->total += count;
+    while (count > 0) {
+        size_t room = s->cap - s->pos;
+        if (room == 0 && (room = uprintf__sink_drain(s)) == 0) return;
+        if (room > count) room = count;
+        if (s->wide) wmemset(s->wbuf + s->pos, (wchar_t)c, room);
+        else memset(s->buf + s->pos, c, room);
+        s->pos += room;
+        count -= room;
+    }
+}
+
+/* ========================================================================== */
+/*  Conversion specifications                                                 */
+/* ========================================================================== */
+
+/* Flags */
+#define UPRINTF__F_LEFT   0x01   /* '-' */
+#define UPRINTF__F_PLUS   0x02   /* '+' */
+#define UPRINTF__F_SPACE  0x04   /* ' ' */
+#define UPRINTF__F_ZERO   0x08   /* '0' */
+#define UPRINTF__F_ALT    0x10   /* '#' */
+#define UPRINTF__F_WSTAR  0x20   /* width taken from the argument list     */
+#define UPRINTF__F_PSTAR  0x40   /* precision taken from the argument list */
+
+/* Length modifiers */
+enum {
+    UPRINTF__LEN_NONE = 0,
+    UPRINTF__LEN_HH,
+    UPRINTF__LEN_H,
+    UPRINTF__LEN_L,
+    UPRINTF__LEN_LL,
+    UPRINTF__LEN_J,
+    UPRINTF__LEN_Z,
+    UPRINTF__LEN_T,
+    UPRINTF__LEN_BIGL
+};
+
+typedef struct {
+    unsigned char flags;    /* UPRINTF__F_*                          */
+    unsigned char length;   /* UPRINTF__LEN_*                        */
+    char          conv;     /* conversion character                  */
+    int           width;    /* minimum field width, 0 if none        */
+    int           prec;     /* precision, -1 if none                 */
+} uprintf__spec;
+
+/* One fetched argument, typed by its conversion */
+typedef union {
+    uintmax_t      u;       /* integers: magnitude                   */
+    double         d;       /* %f %e %g %a                           */
+    long double    ld;      /* %Lf ...                               */
+    const void    *p;       /* %s %ls %p                             */
+    void          *out;     /* %n                                    */
+    wint_t         wc;      /* %lc                                   */
+} uprintf__arg;
+
+/* Result of parsing one specification */
+enum {
+    UPRINTF__SPEC_OK = 0,        /* conversion understood by the engine   */
+    UPRINTF__SPEC_FOREIGN        /* only the platform printf can do this  */
+};
+
+/* Flag bit for a flag character, 0 if c is not one */
+UPRINTF_INLINE unsigned uprintf__flag_bit(unsigned c) {
+    switch (c) {
+        case '-': return UPRINTF__F_LEFT;
+        case '+': return UPRINTF__F_PLUS;
+        case ' ': return UPRINTF__F_SPACE;
+        case '0': return UPRINTF__F_ZERO;
+        case '#': return UPRINTF__F_ALT;
+        default:  return 0;
+    }
+}
+
+/*
+ * Length modifier starting at c (next is the following character).
+ * Returns how many characters it spans, 0 if there is none.
+ */
+UPRINTF_INLINE int uprintf__length_mod(unsigned c, unsigned next, uprintf__spec *spec) {
+    switch (c) {
+        case 'h':
+            if (next == 'h') { spec->length = UPRINTF__LEN_HH; return 2; }
+            spec->length = UPRINTF__LEN_H;
+            return 1;
+        case 'l':
+            if (next == 'l') { spec->length = UPRINTF__LEN_LL; return 2; }
+            spec->length = UPRINTF__LEN_L;
+            return 1;
+        case 'q': spec->length = UPRINTF__LEN_LL;   return 1;
+        case 'j': spec->length = UPRINTF__LEN_J;    return 1;
+        case 'z': spec->length = UPRINTF__LEN_Z;    return 1;
+        case 't': spec->length = UPRINTF__LEN_T;    return 1;
+        case 'L': spec->length = UPRINTF__LEN_BIGL; return 1;
+        default:  return 0;
+    }
+}
+
+/* Record the conversion character; 0 if the engine handles it */
+UPRINTF_INLINE int uprintf__conversion(unsigned c, uprintf__spec *spec) {
+    switch (c) {
+        case 'C':
+            spec->conv = 'c';
+            spec->length = UPRINTF__LEN_L;
+            return UPRINTF__SPEC_OK;
+        case 'S':
+            spec->conv = 's';
+            spec->length = UPRINTF__LEN_L;
+            return UPRINTF__SPEC_OK;
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        case 'a': case 'A': case 'c': case 's': case 'p': case 'n':
+        case '%':
+            spec->conv = (char)c;
+            return UPRINTF__SPEC_OK;
+        default:
+            return UPRINTF__SPEC_FOREIGN;
+    }
+}
+
+UPRINTF_INLINE void uprintf__spec_reset(uprintf__spec *spec) {
+    spec->flags = 0;
+    spec->length = UPRINTF__LEN_NONE;
+    spec->conv = '\0';
+    spec->width = 0;
+    spec->prec = -1;
+}
+
+/*
+ * Parse the specification following a '%'. *pp points just past the '%'
+ * on entry and just past the conversion character on success.
+ * Widths and precisions above UPRINTF_MAX_WIDTH / UPRINTF_MAX_PRECISION
+ * are clamped.
+ */
+UPRINTF_INLINE int uprintf__parse_spec(const char **pp, uprintf__spec *spec) {
+    const char *p = *pp;
+    unsigned bit;
+    long v;
+
+    uprintf__spec_reset(spec);
+
+    for (; (bit = uprintf__flag_bit((unsigned char)*p)) != 0; p++) spec->flags |= (unsigned char)bit;
+    if (*p == '\'' || *p == 'I') return UPRINTF__SPEC_FOREIGN;
+
+    if (*p == '*') {
+        spec->flags |= UPRINTF__F_WSTAR;
+        p++;
+    } else {
+        for (v = 0; *p >= '0' && *p <= '9'; p++)
+            if (v <= UPRINTF_MAX_WIDTH) v = v * 10 + (*p - '0');
+        if (*p == '$') return UPRINTF__SPEC_FOREIGN;
+        spec->width = (int)(v > UPRINTF_MAX_WIDTH ? UPRINTF_MAX_WIDTH : v);
+    }
+
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->flags |= UPRINTF__F_PSTAR;
+            p++;
+        } else {
+            for (v = 0; *p >= '0' && *p <= '9'; p++)
+                if (v <= UPRINTF_MAX_PRECISION) v = v * 10 + (*p - '0');
+            spec->prec = (int)(v > UPRINTF_MAX_PRECISION ? UPRINTF_MAX_PRECISION : v);
+        }
+    }
+
+    if (*p != '\0') p += uprintf__length_mod((unsigned char)p[0], (unsigned char)p[1], spec);
+
+    if (uprintf__conversion((unsigned char)*p, spec) != UPRINTF__SPEC_OK)
+        return UPRINTF__SPEC_FOREIGN;
+    *pp = p + 1;
+    return UPRINTF__SPEC_OK;
+}
+
+/* Wide twin of uprintf__parse_spec() */
+UPRINTF_INLINE int uprintf__parse_spec_wide(const wchar_t **pp, uprintf__spec *spec) {
+    const wchar_t *p = *pp;
+    unsigned bit;
+    long v;
+
+    uprintf__spec_reset(spec);
+
+    for (; (bit = uprintf__flag_bit((unsigned)*p)) != 0; p++) spec->flags |= (unsigned char)bit;
+    if (*p == L'\'' || *p == L'I') return UPRINTF__SPEC_FOREIGN;
+
+    if (*p == L'*') {
+        spec->flags |= UPRINTF__F_WSTAR;
+        p++;
+    } else {
+        for (v = 0; *p >= L'0' && *p <= L'9'; p++)
+            if (v <= UPRINTF_MAX_WIDTH) v = v * 10 + (*p - L'0');
+        if (*p == L'$') return UPRINTF__SPEC_FOREIGN;
+        spec->width = (int)(v > UPRINTF_MAX_WIDTH ? UPRINTF_MAX_WIDTH : v);
+    }
+
+    if (*p == L'.') {
+        p++;
+        if (*p == L'*') {
+            spec->flags |= UPRINTF__F_PSTAR;
+            p++;
+        } else {
+            for (v = 0; *p >= L'0' && *p <= L'9'; p++)
+                if (v <= UPRINTF_MAX_PRECISION) v = v * 10 + (*p - L'0');
+            spec->prec = (int)(v > UPRINTF_MAX_PRECISION ? UPRINTF_MAX_PRECISION : v);
+        }
+    }
+
+    if (*p != L'\0') p += uprintf__length_mod((unsigned)p[0], (unsigned)p[1], spec);
+
+    if ((unsigned)*p > 0x7f || uprintf__conversion((unsigned)*p, spec) != UPRINTF__SPEC_OK)
+        return UPRINTF__SPEC_FOREIGN;
+    *pp = p + 1;
+    return UPRINTF__SPEC_OK;
+}
+
+/* Resolve '*' width/precision, in argument order */
+#define UPRINTF__RESOLVE_STARS(spec, ap) do {                                \
+    if ((spec)->flags & UPRINTF__F_WSTAR) {                                  \
+        long w_ = (long)va_arg(ap, int);                                     \
+        if (w_ < 0) { (spec)->flags |= UPRINTF__F_LEFT; w_ = -w_; }          \
+        (spec)->width = (int)(w_ > UPRINTF_MAX_WIDTH ? UPRINTF_MAX_WIDTH : w_); \
+    }                                                                        \
+    if ((spec)->flags & UPRINTF__F_PSTAR) {                                  \
+        int p_ = va_arg(ap, int);                                            \
+        (spec)->prec = p_ == UPRINTF_SHORTEST ? p_ : p_ < 0 ? -1             \
+            : (p_ > UPRINTF_MAX_PRECISION ? UPRINTF_MAX_PRECISION : p_);     \
+    }                                                                        \
+} while (0)
+
+/*
+ * Fetch the argument of one conversion. Signed integers are stored as
+ * magnitude in arg->u; the return value is 1 when the value is negative.
+ */
+#define UPRINTF__FETCH_SIGNED(ap, type, arg, neg) do {                       \
+    type v_ = (type)va_arg(ap, type);                                        \
+    (neg) = v_ < 0;                                                          \
+    (arg)->u = (neg) ? (uintmax_t)0 - (uintmax_t)(intmax_t)v_                \
+                     : (uintmax_t)(intmax_t)v_;                              \
+} while (0)
+
+UPRINTF_INLINE int uprintf__fetch_arg(const uprintf__spec *spec, va_list *ap, uprintf__arg *arg) {
+    int neg = 0;
+    switch (spec->conv) {
+        case 'd': case 'i':
+            switch (spec->length) {
+                case UPRINTF__LEN_HH: {
+                    int v = va_arg(*ap, int);
+                    signed char c = (signed char)v;
+                    neg = c < 0;
+                    arg->u = neg ? (uintmax_t)(-(int)c) : (uintmax_t)c;
+                    break;
+                }
+                case UPRINTF__LEN_H: {
+                    int v = va_arg(*ap, int);
+                    short h = (short)v;
+                    neg = h < 0;
+                    arg->u = neg ? (uintmax_t)(-(long)h) : (uintmax_t)h;
+                    break;
+                }
+                case UPRINTF__LEN_L:    UPRINTF__FETCH_SIGNED(*ap, long, arg, neg);      break;
+                case UPRINTF__LEN_LL:
+                case UPRINTF__LEN_BIGL: UPRINTF__FETCH_SIGNED(*ap, long long, arg, neg); break;
+                case UPRINTF__LEN_J:    UPRINTF__FETCH_SIGNED(*ap, intmax_t, arg, neg);  break;
+                case UPRINTF__LEN_Z:    UPRINTF__FETCH_SIGNED(*ap, ptrdiff_t, arg, neg); break;
+                case UPRINTF__LEN_T:    UPRINTF__FETCH_SIGNED(*ap, ptrdiff_t, arg, neg); break;
+                case UPRINTF__LEN_NONE:
+                default:                UPRINTF__FETCH_SIGNED(*ap, int, arg, neg);       break;
+            }
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            switch (spec->length) {
+                case UPRINTF__LEN_HH:   arg->u = (unsigned char)va_arg(*ap, unsigned int);  break;
+                case UPRINTF__LEN_H:    arg->u = (unsigned short)va_arg(*ap, unsigned int); break;
+                case UPRINTF__LEN_L:    arg->u = va_arg(*ap, unsigned long);                break;
+                case UPRINTF__LEN_LL:
+                case UPRINTF__LEN_BIGL: arg->u = va_arg(*ap, unsigned long long);           break;
+                case UPRINTF__LEN_J:    arg->u = va_arg(*ap, uintmax_t);                    break;
+                case UPRINTF__LEN_Z:    arg->u = va_arg(*ap, size_t);                       break;
+                case UPRINTF__LEN_T:    arg->u = (uintmax_t)va_arg(*ap, ptrdiff_t);         break;
+                case UPRINTF__LEN_NONE:
+                default:                arg->u = va_arg(*ap, unsigned int);                 break;
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if (spec->length == UPRINTF__LEN_BIGL) arg->ld = va_arg(*ap, long double);
+            else arg->d = va_arg(*ap, double);
+            break;
+        case 'c':
+            if (spec->length == UPRINTF__LEN_L) arg->wc = va_arg(*ap, wint_t);
+            else arg->u = (unsigned char)va_arg(*ap, int);
+            break;
+        case 's': case 'p':
+            arg->p = va_arg(*ap, const void *);
+            break;
+        case 'n':
+            arg->out = va_arg(*ap, void *);
+            break;
+        default:
+            break;
+    }
+    return neg;
+}
+
+/* ========================================================================== */
+/*  Emitters                                                                  */
+/* ========================================================================== */
+
+/* Longest integer rendering: 64-bit octal */
+#define UPRINTF__INT_DIGITS_MAX 24
+
+/* Pad a field of len bytes to the spec's width (spaces) */
+UPRINTF_INLINE size_t uprintf__field_pad(const uprintf__spec *spec, size_t len) {
+    return (size_t)spec->width > len ? (size_t)spec->width - len : 0;
+}
+
+UPRINTF_INLINE void uprintf__emit_int(uprintf__sink *s, const uprintf__spec *spec,
+                                      uintmax_t mag, int neg) {
+    char digits[UPRINTF__INT_DIGITS_MAX];
+    char prefix[3];
+    size_t ndig = 0, nprefix = 0, zeros = 0, len, pad;
+    unsigned base;
+    int is_ptr = spec->conv == 'p';
+    char *d = digits;
+
+    switch (spec->conv) {
+        case 'o':           base = 8;  break;
+        case 'x': case 'X':
+        case 'p':           base = 16; break;
+        default:            base = 10; break;
+    }
+
+    /* Sign: only signed conversions (and glibc's %p) carry one */
+    if (spec->conv == 'd' || spec->conv == 'i' || is_ptr) {
+        if (neg)                                 prefix[nprefix++] = '-';
+        else if (spec->flags & UPRINTF__F_PLUS)  prefix[nprefix++] = '+';
+        else if (spec->flags & UPRINTF__F_SPACE) prefix[nprefix++] = ' ';
+    }
+
+    if (mag == 0) {
+        /* A zero value prints "0" unless the precision is explicitly zero */
+        if (spec->prec != 0) { digits[0] = '0'; ndig = 1; }
+    } else if (base == 10) {
+        ndig = uprintf__sink_counting(s) ? uprintf__dec_len((uint64_t)mag)
+                                         : uprintf__u64_dec(digits, (uint64_t)mag);
+    } else if (base == 16) {
+        if (is_ptr || (spec->flags & UPRINTF__F_ALT)) {
+            prefix[nprefix++] = '0';
+            prefix[nprefix++] = spec->conv == 'X' ? 'X' : 'x';
+        }
+        ndig = uprintf__sink_counting(s) ? uprintf__hex_len((uint64_t)mag)
+                                         : uprintf__u64_hex(digits, (uint64_t)mag, spec->conv == 'X');
+    } else {
+        d = digits + sizeof(digits);
+        while (mag != 0) { *--d = (char)('0' + (mag & 7)); mag >>= 3; }
+        ndig = (size_t)(digits + sizeof(digits) - d);
+    }
+
+    if (spec->prec >= 0 && (size_t)spec->prec > ndig)
+        zeros = (size_t)spec->prec - ndig;
+
+    /* '#' with 'o' forces a leading zero digit */
+    if (base == 8 && (spec->flags & UPRINTF__F_ALT) && zeros == 0 &&
+        (ndig == 0 || *d != '0'))
+        zeros = 1;
+
+    len = nprefix + zeros + ndig;
+    if ((spec->flags & (UPRINTF__F_ZERO | UPRINTF__F_LEFT)) == UPRINTF__F_ZERO &&
+        spec->prec < 0 && (size_t)spec->width > len) {
+        zeros += (size_t)spec->width - len;
+        len = (size_t)spec->width;
+    }
+
+    pad = uprintf__field_pad(spec, len);
+    if (!(spec->flags & UPRINTF__F_LEFT)) uprintf__sink_fill(s, ' ', pad);
+    uprintf__sink_write(s, prefix, nprefix);
+    uprintf__sink_fill(s, '0', zeros);
+    uprintf__sink_write(s, d, ndig);
+    if (spec->flags & UPRINTF__F_LEFT) uprintf__sink_fill(s, ' ', pad);
+}
+
+UPRINTF_INLINE void uprintf__emit_str(uprintf__sink *s, const uprintf__spec *spec,
+                                      const char *str, size_t len) {
+    size_t pad = uprintf__field_pad(spec, len);
+    if (!(spec->flags & UPRINTF__F_LEFT)) uprintf__sink_fill(s, ' ', pad);
+    uprintf__sink_write(s, str, len);
+    if (spec->flags & UPRINTF__F_LEFT) uprintf__sink_fill(s, ' ', pad);
+}
+
+/* Length of str, reading at most max bytes (max < 0: unbounded) */
+UPRINTF_INLINE size_t uprintf__strnlen(const char *str, int max) {
+    const char *end;
+    if (max < 0) return strlen(str);
+    end = (const char *)memchr(str, '\0', (size_t)max);
+    return end != NULL ? (size_t)(end - str) : (size_t)max;
+}
+
+/* Rebuild the specification as a printf format, stars already resolved */
+UPRINTF_INLINE void uprintf__spec_format(const uprintf__spec *spec, char *out) {
+    char tmp[24];
+    char *t;
+    unsigned v;
+
+    *out++ = '%';
+    if (spec->flags & UPRINTF__F_LEFT)  *out++ = '-';
+    if (spec->flags & UPRINTF__F_PLUS)  *out++ = '+';
+    if (spec->flags & UPRINTF__F_SPACE) *out++ = ' ';
+    if (spec->flags & UPRINTF__F_ZERO)  *out++ = '0';
+    if (spec->flags & UPRINTF__F_ALT)   *out++ = '#';
+    if (spec->width > 0) {
+        t = tmp + sizeof(tmp);
+        for (v = (unsigned)spec->width; v != 0; v /= 10) *--t = (char)('0' + v % 10);
+        while (t < tmp + sizeof(tmp)) *out++ = *t++;
+    }
+    if (spec->prec >= 0) {
+        *out++ = '.';
+        t = tmp + sizeof(tmp);
+        v = (unsigned)spec->prec;
+        do { *--t = (char)('0' + v % 10); v /= 10; } while (v != 0);
+        while (t < tmp + sizeof(tmp)) *out++ = *t++;
+    }
+    if (spec->length == UPRINTF__LEN_BIGL) *out++ = 'L';
+    if (spec->length == UPRINTF__LEN_L)    *out++ = 'l';
+    *out++ = spec->conv;
+    *out = '\0';
+}
+
+/* Longest rebuilt specification: "%-+ 0#" + 2 numbers + ".", length, conv */
+#define UPRINTF__SPEC_FMT_MAX 48
+
+/* Largest conversion a wide sink renders on the stack; longer ones use the heap */
+#ifndef UPRINTF__CONV_MAX
+    #define UPRINTF__CONV_MAX 512
+#endif
+
+UPRINTF_INLINE int uprintf__snprintf_arg(char *dst, size_t n, const char *fmt,
+                                         const uprintf__spec *spec, const uprintf__arg *arg) {
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    switch (spec->conv) {
+        case 'c': return snprintf(dst, n, fmt, arg->wc);
+        case 's': return snprintf(dst, n, fmt, (const wchar_t *)arg->p);
+        default:
+            if (spec->length == UPRINTF__LEN_BIGL) return snprintf(dst, n, fmt, arg->ld);
+            return snprintf(dst, n, fmt, arg->d);
+    }
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+}
+
+/* Render a conversion of len chars into a heap buffer and copy it into the sink */
+UPRINTF_INLINE void uprintf__emit_libc_heap(uprintf__sink *s, const char *fmt, size_t len,
+                                            const uprintf__spec *spec, const uprintf__arg *arg) {
+    char *heap = (char *)malloc(len + 1);
+
+    if (heap == NULL || uprintf__snprintf_arg(heap, len + 1, fmt, spec, arg) != (int)len)
+        s->error = 1;
+    else
+        uprintf__sink_write(s, heap, len);
+    free(heap);
+}
+
+/*
+ * Hand one conversion to the platform snprintf. On narrow sinks the result
+ * is rendered in place when it fits, draining a flushing sink first if
+ * needed; one larger than the whole flushing buffer goes through the heap.
+ * Wide sinks go through a UPRINTF__CONV_MAX scratch buffer, or the heap
+ * for a longer conversion.
+ */
+UPRINTF_INLINE void uprintf__emit_libc(uprintf__sink *s, const uprintf__spec *spec,
+                                       const uprintf__arg *arg) {
+    char fmt[UPRINTF__SPEC_FMT_MAX];
+    int attempt, ret = -1;
+
+    uprintf__spec_format(spec, fmt);
+
+    /* A counting wide sink only needs the length: take the narrow path */
+    if (s->wide && !uprintf__sink_counting(s)) {
+        char tmp[UPRINTF__CONV_MAX];
+        ret = uprintf__snprintf_arg(tmp, sizeof(tmp), fmt, spec, arg);
+        if (ret < 0) s->error = 1;
+        else if ((size_t)ret >= sizeof(tmp)) uprintf__emit_libc_heap(s, fmt, (size_t)ret, spec, arg);
+        else uprintf__sink_write(s, tmp, (size_t)ret);
+        return;
+    }
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        size_t room = s->cap - s->pos;
+        char *dst = s->buf != NULL ? s->buf + s->pos : NULL;
+        size_t n = s->buf != NULL ? room + 1 : 0;
+
+        ret = uprintf__snprintf_arg(dst, n, fmt, spec, arg);
+        if (ret < 0) {
+            s->error = 1;
+            return;
+        }
+        if ((size_t)ret <= room) {
+            s->pos += (size_t)ret;
+            break;
+        }
+        if (attempt == 0 && s->flush != NULL && (size_t)ret <= s->cap) {
+            if (uprintf__sink_drain(s) >= (size_t)ret) continue;
+        }
+        if (s->flush != NULL) {
+            uprintf__emit_libc_heap(s, fmt, (size_t)ret, spec, arg);
+            return;
+        }
+        s->pos = s->cap;
+        break;
+    }
+    s->total += (size_t)ret;
+}
+
+/* Sign, padding and body of a natively formatted float; only finite values zero-pad */
+UPRINTF_INLINE void uprintf__emit_float(uprintf__sink *s, const uprintf__spec *spec, int neg,
+                                        const char *body, size_t len, int finite) {
+    int zero = (spec->flags & UPRINTF__F_ZERO) && !(spec->flags & UPRINTF__F_LEFT) && finite;
+    char sign = neg ? '-' : (spec->flags & UPRINTF__F_PLUS) ? '+'
+              : (spec->flags & UPRINTF__F_SPACE) ? ' ' : '\0';
+    size_t pad = uprintf__field_pad(spec, len + (sign != '\0'));
+
+    if (!(spec->flags & UPRINTF__F_LEFT) && !zero) uprintf__sink_fill(s, ' ', pad);
+    if (sign != '\0') uprintf__sink_write(s, &sign, 1);
+    if (zero) uprintf__sink_fill(s, '0', pad);
+    uprintf__sink_write(s, body, len);
+    if (spec->flags & UPRINTF__F_LEFT) uprintf__sink_fill(s, ' ', pad);
+}
+
+/* The LC_NUMERIC decimal point, which printf puts in floats */
+UPRINTF_INLINE const char *uprintf__decimal_point(void) {
+#if defined(UPRINTF_WINDOWS)
+    return localeconv()->decimal_point;
+#else
+    return nl_langinfo(RADIXCHAR);
+#endif
+}
+
+UPRINTF_INLINE const char *uprintf__nonfinite_text(int kind, int upper) {
+    if (kind == UPRINTF__FP_INF) return upper ? "INF" : "inf";
+    return upper ? "NAN" : "nan";
+}
+
+/* %e %f %g with precision UPRINTF_SHORTEST: the shortest round-trip digits */
+UPRINTF_INLINE void uprintf__emit_shortest(uprintf__sink *s, const uprintf__spec *spec, double v) {
+    char body[UPRINTF__SHORTEST_LAYOUT_MAX];
+    uprintf__decimal d;
+    int kind = uprintf__shortest_double(v, &d);
+    int upper = spec->conv == 'E' || spec->conv == 'F' || spec->conv == 'G';
+    size_t len;
+
+    if (kind == UPRINTF__FP_FINITE) {
+        const char *dp = uprintf__decimal_point();
+        char *dot;
+        len = uprintf__shortest_layout(body, &d, spec->conv | 0x20, upper,
+                                       spec->flags & UPRINTF__F_ALT, 17);
+        /* A one-byte decimal point other than '.' replaces it; longer ones are not modelled */
+        if (dp[0] != '.' && dp[0] != '\0' && dp[1] == '\0' &&
+            (dot = (char *)memchr(body, '.', len)) != NULL)
+            *dot = dp[0];
+    } else {
+        memcpy(body, uprintf__nonfinite_text(kind, upper), 3);
+        len = 3;
+    }
+    uprintf__emit_float(s, spec, d.neg, body, len, kind == UPRINTF__FP_FINITE);
+}
+
+/*
+ * %e %f %g of a double with a precision up to UPRINTF__FIXED_PREC_MAX, in
+ * integer arithmetic (uprintf__fixed_layout). Returns -1, having written
+ * nothing, when the value is out of its range or the locale's decimal
+ * point is not '.': libc formats it instead.
+ */
+UPRINTF_INLINE int uprintf__emit_fixed(uprintf__sink *s, const uprintf__spec *spec, double v) {
+    char body[UPRINTF__FIXED_LAYOUT_MAX];
+    uint64_t bits;
+    int upper = spec->conv == 'E' || spec->conv == 'F' || spec->conv == 'G';
+    int len, kind;
+
+    memcpy(&bits, &v, sizeof(bits));
+    kind = (bits >> 52 & 0x7ffu) != 0x7ffu ? UPRINTF__FP_FINITE
+         : (bits & ((1ull << 52) - 1)) != 0 ? UPRINTF__FP_NAN : UPRINTF__FP_INF;
+    if (kind == UPRINTF__FP_FINITE) {
+        const char *dp = uprintf__decimal_point();
+        if (dp[0] != '.' || dp[1] != '\0') return -1;
+        len = uprintf__fixed_layout(body, v, spec->conv, spec->prec < 0 ? 6 : spec->prec,
+                                    spec->flags & UPRINTF__F_ALT);
+        if (len < 0) return -1;
+    } else {
+        memcpy(body, uprintf__nonfinite_text(kind, upper), 3);
+        len = 3;
+    }
+    uprintf__emit_float(s, spec, (int)(bits >> 63), body, (size_t)len, kind == UPRINTF__FP_FINITE);
+    return 0;
+}
+
+/* Wide string field on a wide sink */
+UPRINTF_INLINE void uprintf__emit_wstr(uprintf__sink *s, const uprintf__spec *spec,
+                                       const wchar_t *str, size_t len) {
+    size_t pad = uprintf__field_pad(spec, len);
+    if (!(spec->flags & UPRINTF__F_LEFT)) uprintf__sink_fill(s, ' ', pad);
+    uprintf__sink_write_wide(s, str, len);
+    if (spec->flags & UPRINTF__F_LEFT) uprintf__sink_fill(s, ' ', pad);
+}
+
+UPRINTF_INLINE size_t uprintf__wcsnlen(const wchar_t *str, int max) {
+    size_t len = 0;
+    while ((max < 0 || len < (size_t)max) && str[len] != L'\0') len++;
+    return len;
+}
+
+/* Multibyte string on a wide sink: the precision counts wide characters */
+UPRINTF_INLINE void uprintf__emit_mbs_wide(uprintf__sink *s, const uprintf__spec *spec,
+                                           const char *str) {
+    mbstate_t st;
+    const char *p = str;
+    size_t count = 0, i, r, pad;
+    wchar_t wc;
+
+    memset(&st, 0, sizeof(st));
+    while (spec->prec < 0 || count < (size_t)spec->prec) {
+        r = mbrtowc(&wc, p, MB_LEN_MAX, &st);
+        if (r == 0) break;
+        if (r == (size_t)-1 || r == (size_t)-2) { s->error = 1; return; }
+        p += r;
+        count++;
+    }
+
+    pad = uprintf__field_pad(spec, count);
+    if (!(spec->flags & UPRINTF__F_LEFT)) uprintf__sink_fill(s, ' ', pad);
+    memset(&st, 0, sizeof(st));
+    for (p = str, i = 0; i < count; i++) {
+        p += mbrtowc(&wc, p, MB_LEN_MAX, &st);
+        uprintf__sink_write_wide(s, &wc, 1);
+    }
+    if (spec->flags & UPRINTF__F_LEFT) uprintf__sink_fill(s, ' ', pad);
+}
+
+/* Emit one parsed conversion. Returns 0, or -1 for a rejected %n. */
+UPRINTF_INLINE int uprintf__emit(uprintf__sink *s, const uprintf__spec *spec,
+                                 const uprintf__arg *arg, int neg) {
+    switch (spec->conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            uprintf__emit_int(s, spec, arg->u, neg);
+            break;
+        case 'p':
+            if (arg->p == NULL) {
+                uprintf__spec plain = *spec;
+                plain.prec = -1;
+                uprintf__emit_str(s, &plain, "(nil)", 5);
+            } else {
+                uprintf__emit_int(s, spec, (uintmax_t)(uintptr_t)arg->p, 0);
+            }
+            break;
+        case 's':
+            if (arg->p == NULL) {
+                if (spec->prec < 0 || spec->prec >= 6) uprintf__emit_str(s, spec, "(null)", 6);
+                else uprintf__emit_str(s, spec, "", 0);
+            } else if (spec->length == UPRINTF__LEN_L) {
+                const wchar_t *ws = (const wchar_t *)arg->p;
+                if (s->wide) uprintf__emit_wstr(s, spec, ws, uprintf__wcsnlen(ws, spec->prec));
+                else uprintf__emit_libc(s, spec, arg);
+            } else if (s->wide) {
+                uprintf__emit_mbs_wide(s, spec, (const char *)arg->p);
+            } else {
+                const char *str = (const char *)arg->p;
+                uprintf__emit_str(s, spec, str, uprintf__strnlen(str, spec->prec));
+            }
+            break;
+        case 'c':
+            if (s->wide) {
+                wchar_t wc;
+                if (spec->length == UPRINTF__LEN_L) {
+                    wc = (wchar_t)arg->wc;
+                } else {
+                    wint_t w = btowc((int)arg->u);
+                    if (w == WEOF) { s->error = 1; break; }
+                    wc = (wchar_t)w;
+                }
+                uprintf__emit_wstr(s, spec, &wc, 1);
+            } else if (spec->length == UPRINTF__LEN_L) {
+                uprintf__emit_libc(s, spec, arg);
+            } else {
+                char c = (char)arg->u;
+                uprintf__emit_str(s, spec, &c, 1);
+            }
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+            if (spec->length == UPRINTF__LEN_BIGL)
+                uprintf__emit_libc(s, spec, arg);
+            else if (spec->prec == UPRINTF_SHORTEST)
+                uprintf__emit_shortest(s, spec, arg->d);
+            else if (uprintf__emit_fixed(s, spec, arg->d) != 0)
+                uprintf__emit_libc(s, spec, arg);
+            break;
+        case '%':
+            uprintf__sink_write(s, "%", 1);
+            break;
+        case 'n':
+#ifdef UPRINTF_ENABLE_N
+            if (arg->out != NULL) {
+                switch (spec->length) {
+                    case UPRINTF__LEN_HH: *(signed char *)arg->out = (signed char)s->total; break;
+                    case UPRINTF__LEN_H:  *(short *)arg->out = (short)s->total;             break;
+                    case UPRINTF__LEN_L:  *(long *)arg->out = (long)s->total;               break;
+                    case UPRINTF__LEN_LL:
+                    case UPRINTF__LEN_BIGL: *(long long *)arg->out = (long long)s->total;   break;
+                    case UPRINTF__LEN_J:  *(intmax_t *)arg->out = (intmax_t)s->total;       break;
+                    case UPRINTF__LEN_Z:  *(size_t *)arg->out = s->total;                   break;
+                    case UPRINTF__LEN_T:  *(ptrdiff_t *)arg->out = (ptrdiff_t)s->total;     break;
+                    case UPRINTF__LEN_NONE:
+                    default:              *(int *)arg->out = (int)s->total;                 break;
+                }
+            }
+            break;
+#else
+            return -1;
+#endif
+        default:
+            uprintf__emit_libc(s, spec, arg);
+            break;
+    }
+    return 0;
+}
+
+/* ========================================================================== */
+/*  Format driver                                                             */
+/* ========================================================================== */
+
+/* uprintf__vformat() status codes */
+#define UPRINTF__FMT_OK       0
+#define UPRINTF__FMT_ERROR   -1   /* %n rejected, encoding or output error */
+#define UPRINTF__FMT_FOREIGN -2   /* format needs the platform printf      */
+
+UPRINTF_INLINE int uprintf__vformat(uprintf__sink *s, const char *fmt, va_list ap) {
+    const char *p = fmt;
+    va_list args;
+    int status = UPRINTF__FMT_OK;
+
+    va_copy(args, ap);
+    while (*p) {
+        const char *lit = p;
+        uprintf__spec spec;
+        uprintf__arg arg;
+        int neg, r;
+
+        arg.u = 0;
+        while (*p && *p != '%') p++;
+        s->rest = p;
+        if (p > lit) uprintf__sink_write(s, lit, (size_t)(p - lit));
+        if (*p == '\0') break;
+
+        p++;
+        r = uprintf__parse_spec(&p, &spec);
+        if (r == UPRINTF__SPEC_FOREIGN) { status = UPRINTF__FMT_FOREIGN; break; }
+        s->rest = p;
+
+        UPRINTF__RESOLVE_STARS(&spec, args);
+        neg = spec.conv == '%' ? 0 : uprintf__fetch_arg(&spec, &args, &arg);
+        if (uprintf__emit(s, &spec, &arg, neg) != 0) { status = UPRINTF__FMT_ERROR; break; }
+        if (s->error) break;
+    }
+    va_end(args);
+
+    if (s->foreign) status = UPRINTF__FMT_FOREIGN;
+    else if (status == UPRINTF__FMT_OK && s->error) status = UPRINTF__FMT_ERROR;
+    return status;
+}
+
+/* Wide twin of uprintf__vformat(), for measuring and string builders */
+UPRINTF_INLINE int uprintf__vformat_wide(uprintf__sink *s, const wchar_t *fmt, va_list ap) {
+    const wchar_t *p = fmt;
+    va_list args;
+    int status = UPRINTF__FMT_OK;
+
+    va_copy(args, ap);
+    while (*p) {
+        const wchar_t *lit = p;
+        uprintf__spec spec;
+        uprintf__arg arg;
+        int neg, r;
+
+        arg.u = 0;
+        while (*p && *p != L'%') p++;
+        if (p > lit) uprintf__sink_write_wide(s, lit, (size_t)(p - lit));
+        if (*p == L'\0') break;
+
+        p++;
+        r = uprintf__parse_spec_wide(&p, &spec);
+        if (r == UPRINTF__SPEC_FOREIGN) { status = UPRINTF__FMT_FOREIGN; break; }
+
+        UPRINTF__RESOLVE_STARS(&spec, args);
+        neg = spec.conv == '%' ? 0 : uprintf__fetch_arg(&spec, &args, &arg);
+        if (uprintf__emit(s, &spec, &arg, neg) != 0) { status = UPRINTF__FMT_ERROR; break; }
+        if (s->error) break;
+    }
+    va_end(args);
+
+    if (status == UPRINTF__FMT_OK && s->error) status = UPRINTF__FMT_ERROR;
+    return status;
+}
+
+/* Convert a sink's byte count into a printf return value */
+UPRINTF_INLINE int uprintf__sink_result(const uprintf__sink *s) {
+    return s->total > (size_t)INT_MAX ? -1 : (int)s->total;
+}
+
+/* ========================================================================== */
+/*  Public entry points                                                       */
+/* ========================================================================== */
+
+/*
+ * vsnprintf() replacement: writes at most n bytes (including the NUL) and
+ * returns the length the full output would have. buf may be NULL when n is 0.
+ */
+UPRINTF_INLINE int uprintf_native_vsnprintf(char *buf, size_t n, const char *fmt, va_list ap)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 3, 0)))
+#endif
+;
+
+UPRINTF_INLINE int uprintf_native_vsnprintf(char *buf, size_t n, const char *fmt, va_list ap) {
+    uprintf__sink s;
+    int status;
+
+    if (fmt == NULL) return -1;
+    uprintf__sink_init(&s, buf, n);
+    status = uprintf__vformat(&s, fmt, ap);
+    if (status == UPRINTF__FMT_FOREIGN) return vsnprintf(buf, n, fmt, ap);
+    if (s.buf != NULL) s.buf[s.pos] = '\0';
+    if (status != UPRINTF__FMT_OK) return -1;
+    return uprintf__sink_result(&s);
+}
+
+/*
+ * vswprintf() through the engine, with snprintf's return value: the full
+ * length even when buf (n characters, NULL with n 0) is too short.
+ * Returns -1 on an error, UPRINTF__FMT_FOREIGN when the engine does not
+ * model the format; the caller then uses the platform vswprintf.
+ */
+UPRINTF_INLINE int uprintf__native_vswprintf(wchar_t *buf, size_t n, const wchar_t *fmt, va_list ap) {
+    uprintf__sink s;
+    int status;
+
+    if (fmt == NULL) return -1;
+    uprintf__sink_init_wide(&s, buf, n);
+    status = uprintf__vformat_wide(&s, fmt, ap);
+    if (s.wbuf != NULL) s.wbuf[s.pos] = L'\0';
+    if (status != UPRINTF__FMT_OK) return status == UPRINTF__FMT_FOREIGN ? status : -1;
+    return uprintf__sink_result(&s);
+}
+
+/*
+ * Whether fmt has a specification only the platform printf can format.
+ * A flushing sink checks the unparsed rest of the format with this before
+ * its first flush: once output has left the buffer it is too late to hand
+ * the whole format to libc. Output that fits the buffer is never scanned
+ * twice.
+ */
+UPRINTF_INLINE int uprintf__format_foreign(const char *fmt) {
+    const char *p = fmt;
+    uprintf__spec spec;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        p++;
+        if (uprintf__parse_spec(&p, &spec) != UPRINTF__SPEC_OK) return 1;
+    }
+    return 0;
+}
+
+/* Flush callback for FILE* sinks */
+UPRINTF_INLINE int uprintf__flush_stream(uprintf__sink *s) {
+    size_t len = s->pos;
+    s->pos = 0;
+    return fwrite(s->buf, 1, len, (FILE *)s->ctx) == len ? 0 : -1;
+}
+
+/*
+ * vfprintf() replacement: formats into a UPRINTF_STACK_BUF_MAX stack buffer
+ * and hands it to the stream with a single fwrite per buffer. Formats the
+ * engine does not model go to vfprintf; they are found before the first
+ * fwrite, so nothing is printed twice.
+ */
+UPRINTF_INLINE int uprintf_native_vfprintf(FILE *stream, const char *fmt, va_list ap)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 0)))
+#endif
+;
+
+UPRINTF_INLINE int uprintf_native_vfprintf(FILE *stream, const char *fmt, va_list ap) {
+    char buf[UPRINTF_STACK_BUF_MAX];
+    uprintf__sink s;
+    int status;
+
+    if (stream == NULL || fmt == NULL) return -1;
+    uprintf__sink_init(&s, buf, sizeof(buf));
+    s.flush = uprintf__flush_stream;
+    s.ctx = stream;
+    status = uprintf__vformat(&s, fmt, ap);
+    if (status == UPRINTF__FMT_FOREIGN) return vfprintf(stream, fmt, ap);
+    if (status == UPRINTF__FMT_OK && s.pos > 0 && uprintf__flush_stream(&s) != 0)
+        status = UPRINTF__FMT_ERROR;
+    if (status != UPRINTF__FMT_OK) return -1;
+    return uprintf__sink_result(&s);
+}
+
+/* write(2) all of [p, p+n), retrying on EINTR and short writes */
+UPRINTF_INLINE int uprintf__write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        long w = (long)UPRINTF__WRITE(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Flush callback for file descriptor sinks; ctx points at the fd */
+UPRINTF_INLINE int uprintf__flush_fd(uprintf__sink *s) {
+    size_t len = s->pos;
+    s->pos = 0;
+    return uprintf__write_all(*(const int *)s->ctx, s->buf, len);
+}
+
+/*
+ * dprintf() replacement: formats into a UPRINTF_STACK_BUF_MAX stack buffer
+ * and writes it with one write(2), bypassing stdio. Longer output is
+ * written a buffer at a time. Formats the engine does not model are
+ * formatted by vsnprintf, into a heap buffer when the stack one is short.
+ */
+UPRINTF_INLINE int uprintf_native_vdprintf(int fd, const char *fmt, va_list ap)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 0)))
+#endif
+;
+
+UPRINTF_INLINE int uprintf_native_vdprintf(int fd, const char *fmt, va_list ap) {
+    char buf[UPRINTF_STACK_BUF_MAX];
+    uprintf__sink s;
+    int status;
+
+    if (fd < 0 || fmt == NULL) return -1;
+    uprintf__sink_init(&s, buf, sizeof(buf));
+    s.flush = uprintf__flush_fd;
+    s.ctx = &fd;
+    status = uprintf__vformat(&s, fmt, ap);
+    if (status == UPRINTF__FMT_FOREIGN) {
+        char *heap = NULL, *out = buf;
+        va_list args;
+        int ret;
+
+        va_copy(args, ap);
+        ret = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (ret >= (int)sizeof(buf)) {
+            if ((heap = (char *)malloc((size_t)ret + 1)) == NULL) return -1;
+            ret = vsnprintf(heap, (size_t)ret + 1, fmt, ap);
+            out = heap;
+        }
+        if (ret > 0 && uprintf__write_all(fd, out, (size_t)ret) != 0) ret = -1;
+        free(heap);
+        return ret;
+    }
+    if (status == UPRINTF__FMT_OK && s.pos > 0 && uprintf__flush_fd(&s) != 0)
+        status = UPRINTF__FMT_ERROR;
+    if (status != UPRINTF__FMT_OK) return -1;
+    return uprintf__sink_result(&s);
+}
+
+/* ========================================================================== */
+/*  Pre-compiled formats                                                      */
+/* ========================================================================== */
+
+/*
+ * uprintf_compile_narrow/wide() parse a format once into a fixed-size
+ * program of literal runs and fully decoded conversions; uprintf_exec_*()
+ * then walk that program for each call, with no format parsing left.
+ *
+ *   static uprintf_program req_log;
+ *   uprintf_compile_narrow(&req_log, "%s %s -> %d (%.3f ms)\n");
+ *   ...
+ *   uprintf_exec_narrow(buf, sizeof(buf), &req_log, method, path, status, ms);
+ *
+ * The program points into the format string (literal runs are not
+ * copied), so the format must outlive it: string literals are ideal.
+ * Compilation fails (-1) on %n (unless UPRINTF_ENABLE_N), on formats the
+ * engine does not model, and on formats needing more than
+ * UPRINTF_PROGRAM_MAX_OPS operations. A compiled program is read-only and
+ * can be shared between threads.
+ */
+
+#ifndef UPRINTF_PROGRAM_MAX_OPS
+    #define UPRINTF_PROGRAM_MAX_OPS 32
+#endif
+
+/* Operation kinds */
+#define UPRINTF__OP_LITERAL 0
+#define UPRINTF__OP_CONV    1
+
+typedef struct {
+    unsigned char  kind;        /* UPRINTF__OP_*                         */
+    uprintf__spec  spec;        /* decoded conversion (UPRINTF__OP_CONV) */
+    unsigned int   off;         /* literal run: offset in the format     */
+    unsigned int   len;         /* literal run: length in characters     */
+} uprintf__op;
+
+typedef struct {
+    const void    *fmt;         /* source format (char or wchar_t)       */
+    unsigned char  wide;        /* compiled from a wchar_t format        */
+    unsigned short count;       /* operations in use                     */
+    uprintf__op    ops[UPRINTF_PROGRAM_MAX_OPS];
+} uprintf_program;
+
+/* Append a literal run, merging it with a directly preceding one */
+UPRINTF_INLINE int uprintf__program_literal(uprintf_program *prog, size_t off, size_t len) {
+    uprintf__op *op;
+    if (off > UINT_MAX || len > UINT_MAX - off) return -1;
+    if (prog->count > 0) {
+        op = &prog->ops[prog->count - 1];
+        if (op->kind == UPRINTF__OP_LITERAL && op->off + op->len == off) {
+            op->len += (unsigned int)len;
+            return 0;
+        }
+    }
+    if (prog->count >= UPRINTF_PROGRAM_MAX_OPS) return -1;
+    op = &prog->ops[prog->count++];
+    op->kind = UPRINTF__OP_LITERAL;
+    uprintf__spec_reset(&op->spec);
+    op->off = (unsigned int)off;
+    op->len = (unsigned int)len;
+    return 0;
+}
+
+/* Append a conversion; "%%" becomes a one-character literal run */
+UPRINTF_INLINE int uprintf__program_conv(uprintf_program *prog, const uprintf__spec *spec,
+                                         size_t conv_off) {
+    uprintf__op *op;
+    if (spec->conv == '%') return uprintf__program_literal(prog, conv_off, 1);
+#ifndef UPRINTF_ENABLE_N
+    if (spec->conv == 'n') return -1;
+#endif
+    if (prog->count >= UPRINTF_PROGRAM_MAX_OPS) return -1;
+    op = &prog->ops[prog->count++];
+    op->kind = UPRINTF__OP_CONV;
+    op->spec = *spec;
+    op->off = 0;
+    op->len = 0;
+    return 0;
+}
+
+UPRINTF_INLINE int uprintf_compile_narrow(uprintf_program *prog, const char *fmt) {
+    const char *p = fmt;
+    uprintf__spec spec;
+
+    UPRINTF_ASSERT(prog != NULL, "uprintf_compile: program is NULL");
+    if (prog == NULL) return -1;
+    prog->fmt = fmt;
+    prog->wide = 0;
+    prog->count = 0;
+    if (fmt == NULL) return -1;
+
+    while (*p) {
+        const char *lit = p;
+        while (*p && *p != '%') p++;
+        if (p > lit && uprintf__program_literal(prog, (size_t)(lit - fmt), (size_t)(p - lit)) != 0)
+            goto fail;
+        if (*p == '\0') break;
+        p++;
+        if (uprintf__parse_spec(&p, &spec) != UPRINTF__SPEC_OK) goto fail;
+        if (uprintf__program_conv(prog, &spec, (size_t)(p - 1 - fmt)) != 0) goto fail;
+    }
+    return 0;
+
+fail:
+    prog->count = 0;
+    return -1;
+}
+
+UPRINTF_INLINE int uprintf_compile_wide(uprintf_program *prog, const wchar_t *fmt) {
+    const wchar_t *p = fmt;
+    uprintf__spec spec;
+
+    UPRINTF_ASSERT(prog != NULL, "uprintf_compile: program is NULL");
+    if (prog == NULL) return -1;
+    prog->fmt = fmt;
+    prog->wide = 1;
+    prog->count = 0;
+    if (fmt == NULL) return -1;
+
+    while (*p) {
+        const wchar_t *lit = p;
+        while (*p && *p != L'%') p++;
+        if (p > lit && uprintf__program_literal(prog, (size_t)(lit - fmt), (size_t)(p - lit)) != 0)
+            goto fail;
+        if (*p == L'\0') break;
+        p++;
+        if (uprintf__parse_spec_wide(&p, &spec) != UPRINTF__SPEC_OK) goto fail;
+        if (uprintf__program_conv(prog, &spec, (size_t)(p - 1 - fmt)) != 0) goto fail;
+    }
+    return 0;
+
+fail:
+    prog->count = 0;
+    return -1;
+}
+
+/* Run a program against an argument list into any sink */
+UPRINTF_INLINE int uprintf__exec(uprintf__sink *s, const uprintf_program *prog, va_list ap) {
+    va_list args;
+    unsigned i;
+
+    va_copy(args, ap);
+    for (i = 0; i < prog->count && !s->error; i++) {
+        const uprintf__op *op = &prog->ops[i];
+        uprintf__spec spec;
+        uprintf__arg arg;
+        int neg;
+
+        if (op->kind == UPRINTF__OP_LITERAL) {
+            if (prog->wide) uprintf__sink_write_wide(s, (const wchar_t *)prog->fmt + op->off, op->len);
+            else uprintf__sink_write(s, (const char *)prog->fmt + op->off, op->len);
+            continue;
+        }
+        spec = op->spec;
+        arg.u = 0;
+        UPRINTF__RESOLVE_STARS(&spec, args);
+        neg = uprintf__fetch_arg(&spec, &args, &arg);
+        if (uprintf__emit(s, &spec, &arg, neg) != 0) s->error = 1;
+    }
+    va_end(args);
+    return s->error ? -1 : 0;
+}
+
+/*
+ * Buffer variants: write at most n characters (including the terminator)
+ * and return the length the full output needs, like snprintf. The wide
+ * variant returns that length too, rather than vswprintf's -1.
+ */
+UPRINTF_INLINE int uprintf_vexec_narrow(char *buf, size_t n, const uprintf_program *prog, va_list ap) {
+    uprintf__sink s;
+    int status;
+    if (prog == NULL || prog->wide) return -1;
+    uprintf__sink_init(&s, buf, n);
+    status = uprintf__exec(&s, prog, ap);
+    if (s.buf != NULL) s.buf[s.pos] = '\0';
+    return status != 0 ? -1 : uprintf__sink_result(&s);
+}
+
+UPRINTF_INLINE int uprintf_exec_narrow(char *buf, size_t n, const uprintf_program *prog, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, prog);
+    ret = uprintf_vexec_narrow(buf, n, prog, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf_vexec_wide(wchar_t *buf, size_t n, const uprintf_program *prog, va_list ap) {
+    uprintf__sink s;
+    int status;
+    if (prog == NULL || !prog->wide) return -1;
+    uprintf__sink_init_wide(&s, buf, n);
+    status = uprintf__exec(&s, prog, ap);
+    if (s.wbuf != NULL) s.wbuf[s.pos] = L'\0';
+    return status != 0 ? -1 : uprintf__sink_result(&s);
+}
+
+UPRINTF_INLINE int uprintf_exec_wide(wchar_t *buf, size_t n, const uprintf_program *prog, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, prog);
+    ret = uprintf_vexec_wide(buf, n, prog, ap);
+    va_end(ap);
+    return ret;
+}
+
+/* Flush callback for wide FILE* sinks */
+UPRINTF_INLINE int uprintf__flush_stream_wide(uprintf__sink *s) {
+    s->wbuf[s->pos] = L'\0';
+    s->pos = 0;
+    return fputws(s->wbuf, (FILE *)s->ctx) < 0 ? -1 : 0;
+}
+
+/* Stream variants: one UPRINTF_STACK_BUF_MAX stack buffer, flushed as it fills */
+UPRINTF_INLINE int ufprintf_vexec_narrow(FILE *stream, const uprintf_program *prog, va_list ap) {
+    char buf[UPRINTF_STACK_BUF_MAX];
+    uprintf__sink s;
+    int status;
+
+    if (stream == NULL || prog == NULL || prog->wide) return -1;
+    uprintf__sink_init(&s, buf, sizeof(buf));
+    s.flush = uprintf__flush_stream;
+    s.ctx = stream;
+    status = uprintf__exec(&s, prog, ap);
+    if (status == 0 && s.pos > 0 && uprintf__flush_stream(&s) != 0) status = -1;
+    return status != 0 ? -1 : uprintf__sink_result(&s);
+}
+
+UPRINTF_INLINE int ufprintf_exec_narrow(FILE *stream, const uprintf_program *prog, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, prog);
+    ret = ufprintf_vexec_narrow(stream, prog, ap);
+    va_end(ap);
+    return ret;
+}
+
+UPRINTF_INLINE int ufprintf_vexec_wide(FILE *stream, const uprintf_program *prog, va_list ap) {
+    wchar_t buf[UPRINTF_STACK_BUF_MAX / sizeof(wchar_t)];
+    uprintf__sink s;
+    int status;
+
+    if (stream == NULL || prog == NULL || !prog->wide) return -1;
+    uprintf__sink_init_wide(&s, buf, sizeof(buf) / sizeof(buf[0]));
+    s.flush = uprintf__flush_stream_wide;
+    s.ctx = stream;
+    status = uprintf__exec(&s, prog, ap);
+    if (status == 0 && s.pos > 0 && uprintf__flush_stream_wide(&s) != 0) status = -1;
+    return status != 0 ? -1 : uprintf__sink_result(&s);
+}
+
+UPRINTF_INLINE int ufprintf_exec_wide(FILE *stream, const uprintf_program *prog, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, prog);
+    ret = ufprintf_vexec_wide(stream, prog, ap);
+    va_end(ap);
+    return ret;
+}
+
+#endif /* UPRINTF_ENGINE_H */
@@ -0,0 +1,183 @@
+/*
+ * uprintf_itoa.h — Integer to text conversion primitives
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * uprintf_u32toa(), uprintf_u64toa(), uprintf_i64toa() and
+ * uprintf_u64tohex() write an integer without padding, terminate it and
+ * return its length. They are the kernels behind the native engine's
+ * %d %i %u %x %X %p, and can be used directly to build records:
+ *
+ *   char buf[UPRINTF_I64TOA_MAX];
+ *   int n = uprintf_i64toa(buf, -42);     // "-42", n == 3
+ *
+ * The length is known before the first digit is written: the bit length
+ * (count-leading-zeros) gives log10 to within one, and a table of powers
+ * of ten settles it. Decimal digits are then stored two at a time from a
+ * 200-byte table of pairs, eight digits per 64-bit division.
+ */
+
+#ifndef UPRINTF_ITOA_H
+#define UPRINTF_ITOA_H
+
+#include "uprintf_config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(UPRINTF_MSVC) && (defined(_M_X64) || defined(_M_ARM64))
+    #include <intrin.h>
+#endif
+
+/* Buffer sizes including the terminator: "18446744073709551615", "-9223372036854775808" */
+#define UPRINTF_U32TOA_MAX  11
+#define UPRINTF_U64TOA_MAX  21
+#define UPRINTF_I64TOA_MAX  21
+#define UPRINTF_HEXTOA_MAX  17
+
+/* ========================================================================== */
+/*  Tables                                                                    */
+/* ========================================================================== */
+
+/* 10^0 .. 10^19 */
+static const uint64_t uprintf__pow10[20] UPRINTF_UNUSED = {
+    1u, 10u, 100u, 1000u, 10000u,
+    100000u, 1000000u, 10000000u, 100000000u, 1000000000u,
+    10000000000u, 100000000000u, 1000000000000u, 10000000000000u, 100000000000000u,
+    1000000000000000u, 10000000000000000u, 100000000000000000u, 1000000000000000000u,
+    10000000000000000000u
+};
+
+/* "00" "01" .. "99" */
+static const char uprintf__digit_pairs[201] UPRINTF_UNUSED =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* ========================================================================== */
+/*  Digit counting                                                            */
+/* ========================================================================== */
+
+/* Bits needed to write v, at least 1 */
+UPRINTF_INLINE unsigned uprintf__bit_length(uint64_t v) {
+    v |= 1;
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    return 64u - (unsigned)__builtin_clzll(v);
+#elif defined(UPRINTF_MSVC) && (defined(_M_X64) || defined(_M_ARM64))
+    {
+        unsigned long i;
+        _BitScanReverse64(&i, v);
+        return (unsigned)i + 1;
+    }
+#else
+    {
+        unsigned n = 1;
+        while (v >>= 1) n++;
+        return n;
+    }
+#endif
+}
+
+/* Decimal digits of v, 1 for 0. bits * 1233 / 4096 is log10(2^bits) or one more */
+UPRINTF_INLINE unsigned uprintf__dec_len(uint64_t v) {
+    unsigned t = (uprintf__bit_length(v) * 1233u) >> 12;
+    return t + ((v | 1) >= uprintf__pow10[t]);
+}
+
+UPRINTF_INLINE unsigned uprintf__hex_len(uint64_t v) {
+    return (uprintf__bit_length(v) + 3) / 4;
+}
+
+/* ========================================================================== */
+/*  Kernels                                                                   */
+/* ========================================================================== */
+
+/* Decimal digits of v ending at end, two at a time */
+UPRINTF_INLINE void uprintf__put_dec32(char *end, uint32_t v) {
+    while (v >= 100) {
+        uint32_t i = (v % 100) * 2;
+        v /= 100;
+        end -= 2;
+        memcpy(end, uprintf__digit_pairs + i, 2);
+    }
+    if (v >= 10) memcpy(end - 2, uprintf__digit_pairs + v * 2, 2);
+    else end[-1] = (char)('0' + v);
+}
+
+/* Exactly eight digits of v < 10^8 ending at end */
+UPRINTF_INLINE void uprintf__put_dec8(char *end, uint32_t v) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        memcpy(end - 2, uprintf__digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+        end -= 2;
+    }
+}
+
+/* Decimal digits of v at out, not terminated; returns the count */
+UPRINTF_INLINE unsigned uprintf__u64_dec(char *out, uint64_t v) {
+    unsigned n = uprintf__dec_len(v);
+    char *end = out + n;
+    while (v > 0xffffffffu) {
+        uprintf__put_dec8(end, (uint32_t)(v % 100000000u));
+        v /= 100000000u;
+        end -= 8;
+    }
+    uprintf__put_dec32(end, (uint32_t)v);
+    return n;
+}
+
+/* Hex digits of v at out, not terminated; returns the count */
+UPRINTF_INLINE unsigned uprintf__u64_hex(char *out, uint64_t v, int upper) {
+    const char *xdigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned n = uprintf__hex_len(v);
+    char *p = out + n;
+    do { *--p = xdigits[v & 15]; v >>= 4; } while (p != out);
+    return n;
+}
+
+/* ========================================================================== */
+/*  Public API                                                                */
+/* ========================================================================== */
+
+/* v in decimal; buf holds UPRINTF_U32TOA_MAX bytes. Returns the length */
+UPRINTF_INLINE int uprintf_u32toa(char *buf, uint32_t v) {
+    unsigned n = uprintf__dec_len(v);
+    uprintf__put_dec32(buf + n, v);
+    buf[n] = '\0';
+    return (int)n;
+}
+
+/* v in decimal; buf holds UPRINTF_U64TOA_MAX bytes. Returns the length */
+UPRINTF_INLINE int uprintf_u64toa(char *buf, uint64_t v) {
+    unsigned n = uprintf__u64_dec(buf, v);
+    buf[n] = '\0';
+    return (int)n;
+}
+
+/* v in decimal with a '-' when negative; buf holds UPRINTF_I64TOA_MAX bytes */
+UPRINTF_INLINE int uprintf_i64toa(char *buf, int64_t v) {
+    uint64_t mag = v < 0 ? 0u - (uint64_t)v : (uint64_t)v;
+    unsigned n = 0;
+    if (v < 0) buf[n++] = '-';
+    n += uprintf__u64_dec(buf + n, mag);
+    buf[n] = '\0';
+    return (int)n;
+}
+
+/* v in lowercase hex, or uppercase, no prefix; buf holds UPRINTF_HEXTOA_MAX bytes */
+UPRINTF_INLINE int uprintf_u64tohex(char *buf, uint64_t v, int upper) {
+    unsigned n = uprintf__u64_hex(buf, v, upper);
+    buf[n] = '\0';
+    return (int)n;
+}
+
+#endif /* UPRINTF_ITOA_H */
@@ -0,0 +1,186 @@
+/*
+ * uprintf_latency.h — Latency histograms of stream output
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_LATENCY (POSIX, GCC/Clang), every uprintf and ufprintf
+ * call, narrow or wide, is timed with the monotonic clock and counted in
+ * a log-bucketed histogram owned by the calling thread. The time covers
+ * formatting and the write, so a blocked pipe or a slow disk shows up in
+ * the tail. Buckets follow HdrHistogram: exact below 8 ns, then eight
+ * sub-buckets per power of two (within 12.5%), up to 2^40 ns.
+ *
+ *   uprintf_latency_stats st;
+ *   uprintf_latency_snapshot(&st);
+ *   if (st.p99_ns > 1000000) alert("logging is slow");
+ *
+ * A thread claims one of UPRINTF_LATENCY_THREADS static histograms
+ * (default 32) on its first call and keeps it. Its own counters are
+ * updated without atomic read-modify-writes; threads beyond the limit
+ * share the last histogram with atomic adds. Nothing is allocated. The
+ * snapshot merges all histograms; it and uprintf_latency_reset() may run
+ * while other threads print, at the cost of being slightly out of date.
+ */
+
+#ifndef UPRINTF_LATENCY_H
+#define UPRINTF_LATENCY_H
+
+#include "uprintf_config.h"
+
+#include <stddef.h>
+
+#if defined(UPRINTF_LATENCY) && defined(UPRINTF_HAS_ATOMICS) && defined(UPRINTF_SHARED_WEAK)
+
+#include <string.h>
+#include <time.h>
+
+#define UPRINTF__LATENCY_ON 1
+
+#ifndef UPRINTF_LATENCY_THREADS
+    #define UPRINTF_LATENCY_THREADS 32
+#endif
+
+#if UPRINTF_LATENCY_THREADS < 1
+    #error "UPRINTF_LATENCY_THREADS must be at least 1"
+#endif
+
+/* 8 exact buckets, then 8 per power of two from 2^3 to 2^39 */
+#define UPRINTF_LATENCY_BUCKETS 304
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long p50_ns;
+    unsigned long long p99_ns;
+    unsigned long long p999_ns;
+    unsigned long long buckets[UPRINTF_LATENCY_BUCKETS];
+} uprintf_latency_stats;
+
+typedef struct {
+    unsigned long long buckets[UPRINTF_LATENCY_BUCKETS];
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+} uprintf__lat_hist;
+
+UPRINTF_SHARED uprintf__lat_hist uprintf__lat_hists[UPRINTF_LATENCY_THREADS];
+UPRINTF_SHARED unsigned uprintf__lat_claimed;
+UPRINTF_SHARED __thread uprintf__lat_hist *uprintf__lat_mine;
+
+UPRINTF_INLINE unsigned long long uprintf__lat_now(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+UPRINTF_INLINE unsigned uprintf__lat_bucket(unsigned long long ns) {
+    unsigned e;
+    if (ns < 8) return (unsigned)ns;
+    e = 63u - (unsigned)__builtin_clzll(ns);
+    if (e > 39) return UPRINTF_LATENCY_BUCKETS - 1;
+    return (e - 2) * 8 + (unsigned)(ns >> (e - 3) & 7u);
+}
+
+/* Largest value that lands in bucket b */
+UPRINTF_INLINE unsigned long long uprintf__lat_bucket_max(unsigned b) {
+    unsigned e;
+    if (b < 8) return b;
+    e = b / 8 + 2;
+    return ((8ull + b % 8) << (e - 3)) + (1ull << (e - 3)) - 1;
+}
+
+UPRINTF_INLINE void uprintf__lat_record(unsigned long long ns) {
+    uprintf__lat_hist *h = uprintf__lat_mine;
+    unsigned b = uprintf__lat_bucket(ns);
+
+    if (h == NULL) {
+        unsigned i = __atomic_fetch_add(&uprintf__lat_claimed, 1u, __ATOMIC_RELAXED);
+        h = &uprintf__lat_hists[i < UPRINTF_LATENCY_THREADS ? i : UPRINTF_LATENCY_THREADS - 1];
+        uprintf__lat_mine = h;
+    }
+    if (h != &uprintf__lat_hists[UPRINTF_LATENCY_THREADS - 1]) {
+        /* Single writer: readers only need untorn words */
+        UPRINTF_ATOMIC_STORE(&h->buckets[b], UPRINTF_ATOMIC_LOAD(&h->buckets[b]) + 1);
+        UPRINTF_ATOMIC_STORE(&h->total_ns, UPRINTF_ATOMIC_LOAD(&h->total_ns) + ns);
+        if (ns > UPRINTF_ATOMIC_LOAD(&h->max_ns)) UPRINTF_ATOMIC_STORE(&h->max_ns, ns);
+    } else {
+        unsigned long long m = UPRINTF_ATOMIC_LOAD(&h->max_ns);
+        UPRINTF_ATOMIC_ADD(&h->buckets[b], 1ull);
+        UPRINTF_ATOMIC_ADD(&h->total_ns, ns);
+        while (ns > m && !__atomic_compare_exchange_n(&h->max_ns, &m, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+}
+
+/* Time `call` and assign its result to ret */
+#define UPRINTF__LAT_CALL(ret, call) do {                                       \
+    unsigned long long uprintf__t0 = uprintf__lat_now();                        \
+    (ret) = (call);                                                             \
+    uprintf__lat_record(uprintf__lat_now() - uprintf__t0);                      \
+} while (0)
+
+/* Upper bound of the bucket holding the pct-th percentile, 0 when empty */
+UPRINTF_INLINE unsigned long long uprintf_latency_percentile(const uprintf_latency_stats *st, double pct) {
+    unsigned long long rank, seen = 0;
+    unsigned b;
+
+    if (st == NULL || st->count == 0) return 0;
+    rank = (unsigned long long)(pct / 100.0 * (double)st->count + 0.999999);
+    if (rank == 0) rank = 1;
+    for (b = 0; b < UPRINTF_LATENCY_BUCKETS; b++) {
+        seen += st->buckets[b];
+        if (seen >= rank) {
+            unsigned long long v = uprintf__lat_bucket_max(b);
+            return v < st->max_ns ? v : st->max_ns;
+        }
+    }
+    return st->max_ns;
+}
+
+/* Merge every thread's histogram into *st */
+UPRINTF_INLINE int uprintf_latency_snapshot(uprintf_latency_stats *st) {
+    unsigned n = UPRINTF_ATOMIC_LOAD(&uprintf__lat_claimed), i, b;
+
+    if (st == NULL) return -1;
+    memset(st, 0, sizeof(*st));
+    if (n > UPRINTF_LATENCY_THREADS) n = UPRINTF_LATENCY_THREADS;
+    for (i = 0; i < n; i++) {
+        const uprintf__lat_hist *h = &uprintf__lat_hists[i];
+        unsigned long long m = UPRINTF_ATOMIC_LOAD(&h->max_ns);
+        for (b = 0; b < UPRINTF_LATENCY_BUCKETS; b++) {
+            unsigned long long c = UPRINTF_ATOMIC_LOAD(&h->buckets[b]);
+            st->buckets[b] += c;
+            st->count += c;
+        }
+        st->total_ns += UPRINTF_ATOMIC_LOAD(&h->total_ns);
+        if (m > st->max_ns) st->max_ns = m;
+    }
+    st->p50_ns = uprintf_latency_percentile(st, 50.0);
+    st->p99_ns = uprintf_latency_percentile(st, 99.0);
+    st->p999_ns = uprintf_latency_percentile(st, 99.9);
+    return 0;
+}
+
+/* Zero every histogram; threads keep the one they claimed */
+UPRINTF_INLINE void uprintf_latency_reset(void) {
+    unsigned i, b;
+    for (i = 0; i < UPRINTF_LATENCY_THREADS; i++) {
+        uprintf__lat_hist *h = &uprintf__lat_hists[i];
+        for (b = 0; b < UPRINTF_LATENCY_BUCKETS; b++) UPRINTF_ATOMIC_STORE(&h->buckets[b], 0ull);
+        UPRINTF_ATOMIC_STORE(&h->total_ns, 0ull);
+        UPRINTF_ATOMIC_STORE(&h->max_ns, 0ull);
+    }
+}
+
+#else
+
+#define UPRINTF__LAT_CALL(ret, call) ((ret) = (call))
+
+#endif /* UPRINTF_LATENCY */
+
+#endif /* UPRINTF_LATENCY_H */
@@ -0,0 +1,291 @@
+/*
+ * uprintf_markup.h — Inline color markup in narrow format strings
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_MARKUP, narrow uprintf, ufprintf, ufdprintf and usnprintf
+ * expand style tags in the format before formatting it:
+ *
+ *   uprintf("{bold}{tomato}%s{/} done\n", name);
+ *   uprintf("{bg:#1e1e2e}{fg:lightgreen} ok {/}\n");
+ *
+ * Tags: a CSS color name or #rrggbb, optionally prefixed with fg: or bg:;
+ * bold, dim, italic, underline, blink, inverse, hidden, strike; /bold and
+ * so on to turn one off; {/} to reset everything. Adjacent tags become a
+ * single sequence. Colors are written for the current uc_color_depth(),
+ * and dropped entirely at UC_DEPTH_NONE. "{{" prints "{"; braces around
+ * anything else ("{%d}", JSON) are left as they are.
+ *
+ * The expansion of a string literal is cached per format pointer in a
+ * table of UPRINTF_MARKUP_CACHE_SIZE entries (power of two, default 64)
+ * holding up to UPRINTF_MARKUP_MAX chars each (default 256), so a literal
+ * pays for the CSS lookups and color conversion once. Only the literal
+ * entry points of uprintf.h (a format proven clean at compile time) use
+ * the cache; formats in buffers, whose contents can change under the same
+ * address, and formats that do not fit are expanded on every call. An
+ * entry is filled when its slot is claimed and published with a release
+ * store. An entry expanded for another color depth is refilled in place,
+ * so change the depth while no other thread is printing. Without GCC/Clang
+ * atomics there is no cache.
+ *
+ * An expansion containing %n is rejected: a color tag dropped at
+ * UC_DEPTH_NONE must not turn "%{red}n" into "%n" behind the %n check.
+ *
+ * Wide output, ufprintf_async() and ulog_deferred() do not expand markup.
+ * Pulls in uprintf_color.h: link with -lm on Unix.
+ */
+
+#ifndef UPRINTF_MARKUP_H
+#define UPRINTF_MARKUP_H
+
+#include "uprintf_config.h"
+
+#if defined(UPRINTF_MARKUP)
+
+#include "uprintf_color.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UPRINTF__MARKUP_ON 1
+
+#ifndef UPRINTF_MARKUP_CACHE_SIZE
+    #define UPRINTF_MARKUP_CACHE_SIZE 64
+#endif
+
+#ifndef UPRINTF_MARKUP_MAX
+    #define UPRINTF_MARKUP_MAX 256
+#endif
+
+#if (UPRINTF_MARKUP_CACHE_SIZE & (UPRINTF_MARKUP_CACHE_SIZE - 1)) != 0
+    #error "UPRINTF_MARKUP_CACHE_SIZE must be a power of two"
+#endif
+
+/* Longest tag name: "bg:lightgoldenrodyellow" */
+#define UPRINTF__MARKUP_TAG_MAX 24
+
+/* SGR parameters of one run of adjacent tags; one tag adds at most 17 */
+#define UPRINTF__MARKUP_PARAMS 128
+
+/* Expansions are checked for %n again (uprintf.h) */
+#if !defined(UPRINTF_ENABLE_N)
+UPRINTF_INLINE int uprintf_has_percent_n_narrow(const char *fmt);
+    #define UPRINTF__MARKUP_REJECT(text) uprintf_has_percent_n_narrow(text)
+#else
+    #define UPRINTF__MARKUP_REJECT(text) 0
+#endif
+
+/* ========================================================================== */
+/*  Expansion                                                                 */
+/* ========================================================================== */
+
+static const char *const uprintf__markup_attrs[8] UPRINTF_UNUSED = {
+    "bold", "dim", "italic", "underline", "blink", "inverse", "hidden", "strike"
+};
+
+/*
+ * Append the SGR parameters of tag name[0..len) ("1;", "38;2;255;99;71;")
+ * at p and return the new end, or NULL if it is not a tag.
+ */
+UPRINTF_INLINE char *uprintf__markup_tag(char *p, const char *name, size_t len) {
+    char key[UPRINTF__MARKUP_TAG_MAX + 1];
+    const char *s = key;
+    char layer = '3';
+    int r, g, b, off = 0;
+    unsigned i;
+
+    if (len == 0 || len > UPRINTF__MARKUP_TAG_MAX) return NULL;
+    memcpy(key, name, len);
+    key[len] = '\0';
+
+    if (key[0] == '/') {
+        if (len == 1) return uc__sgr_code(p, 0);
+        off = 1;
+        s++;
+    }
+    for (i = 0; i < 8; i++)
+        if (strcmp(s, uprintf__markup_attrs[i]) == 0)
+            return uc__sgr_code(p, off ? uc__attr_off[i] : uc__attr_on[i]);
+    if (off) return NULL;
+
+    if (strncmp(s, "bg:", 3) == 0) {
+        layer = '4';
+        s += 3;
+    } else if (strncmp(s, "fg:", 3) == 0) {
+        s += 3;
+    }
+    if (s[0] == '#') {
+        if (strlen(s) != 7 || strspn(s + 1, "0123456789abcdefABCDEF") != 6) return NULL;
+        uc__parse_hex(s, &r, &g, &b);
+    } else if (uc__css_lookup(s, &r, &g, &b) != 0) {
+        return NULL;
+    }
+    if (uc__depth == UC_DEPTH_NONE) return p;
+    return uc__sgr_color(p, layer, UC_RGB(r, g, b));
+}
+
+/* Copy len chars to dst at *o, keeping within n; *o counts them all */
+UPRINTF_INLINE void uprintf__markup_put(char *dst, size_t n, size_t *o, const char *src, size_t len) {
+    if (*o + 1 < n) {
+        size_t room = n - 1 - *o;
+        memcpy(dst + *o, src, len < room ? len : room);
+    }
+    *o += len;
+}
+
+/*
+ * Expand the markup of src into dst (n chars, NUL-terminated when n > 0).
+ * Returns the length of the full expansion, like snprintf, or -1.
+ */
+UPRINTF_INLINE int uprintf_markup_expand(char *dst, size_t n, const char *src) {
+    char params[UPRINTF__MARKUP_PARAMS];
+    size_t o = 0;
+
+    for (;;) {
+        const char *brace = strchr(src, '{'), *q;
+        char *p = params;
+
+        if (brace == NULL) {
+            uprintf__markup_put(dst, n, &o, src, strlen(src));
+            break;
+        }
+        uprintf__markup_put(dst, n, &o, src, (size_t)(brace - src));
+        if (brace[1] == '{') {
+            uprintf__markup_put(dst, n, &o, "{", 1);
+            src = brace + 2;
+            continue;
+        }
+
+        /* A run of adjacent tags becomes one sequence */
+        for (q = brace; *q == '{' && p - params <= UPRINTF__MARKUP_PARAMS - 32; ) {
+            const char *close = q + 1;
+            char *end;
+            while (*close != '\0' && *close != '}' && close - q <= UPRINTF__MARKUP_TAG_MAX) close++;
+            if (*close != '}' || (end = uprintf__markup_tag(p, q + 1, (size_t)(close - q - 1))) == NULL) break;
+            p = end;
+            q = close + 1;
+        }
+        if (q == brace) {
+            uprintf__markup_put(dst, n, &o, "{", 1);
+            src = brace + 1;
+            continue;
+        }
+        if (p > params) {
+            p[-1] = 'm';
+            uprintf__markup_put(dst, n, &o, "\033[", 2);
+            uprintf__markup_put(dst, n, &o, params, (size_t)(p - params));
+        }
+        src = q;
+    }
+    if (n > 0) dst[o < n ? o : n - 1] = '\0';
+    return o > (size_t)INT_MAX ? -1 : (int)o;
+}
+
+/* ========================================================================== */
+/*  Per-format cache                                                          */
+/* ========================================================================== */
+
+#if defined(UPRINTF_HAS_ATOMICS)
+
+#define UPRINTF__MARKUP_CACHE_ON 1
+
+#define UPRINTF__MARKUP_PROBES 4
+
+#define UPRINTF__MK_ACQ_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define UPRINTF__MK_REL_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct {
+    uintptr_t key;                      /* 0 free, 1 being filled, else the format */
+    int       depth;                    /* uc__depth the text was expanded for     */
+    int       plain;                    /* no tags: print the format itself        */
+    char      text[UPRINTF_MARKUP_MAX];
+} uprintf__markup_entry;
+
+UPRINTF_SHARED uprintf__markup_entry uprintf__markup_cache[UPRINTF_MARKUP_CACHE_SIZE];
+
+UPRINTF_INLINE size_t uprintf__markup_slot(const char *fmt) {
+    uintptr_t h = (uintptr_t)fmt;
+    h ^= h >> 16;
+    h = (uintptr_t)((uint32_t)h * 2654435761u);
+    return (size_t)(h >> 8);
+}
+
+/* Take a slot for filling: a free one (expected 0) or a stale entry (its key) */
+UPRINTF_INLINE int uprintf__markup_claim(uintptr_t *key, uintptr_t expected) {
+    return __atomic_compare_exchange_n(key, &expected, (uintptr_t)1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+UPRINTF_INLINE void uprintf_markup_cache_clear(void) {
+    size_t i;
+    for (i = 0; i < UPRINTF_MARKUP_CACHE_SIZE; i++)
+        UPRINTF__MK_REL_STORE(&uprintf__markup_cache[i].key, (uintptr_t)0);
+}
+
+#else
+
+UPRINTF_INLINE void uprintf_markup_cache_clear(void) {
+}
+
+#endif /* UPRINTF_HAS_ATOMICS */
+
+/*
+ * The format to hand to the formatter: fmt itself when it has no tags,
+ * the cached expansion (cached is set only for string literals), or a
+ * malloc'd one returned in *heap for the caller to free. NULL when out of
+ * memory or when the expansion contains %n.
+ */
+UPRINTF_INLINE const char *uprintf__markup(const char *fmt, char **heap, int cached) {
+    int len;
+#if defined(UPRINTF__MARKUP_CACHE_ON)
+    uprintf__markup_entry *e, *slot = NULL;
+    uintptr_t key, stale = 0;
+    size_t i = uprintf__markup_slot(fmt), k;
+
+    *heap = NULL;
+    for (k = 0; cached && k < UPRINTF__MARKUP_PROBES; k++) {
+        e = &uprintf__markup_cache[(i + k) & (UPRINTF_MARKUP_CACHE_SIZE - 1)];
+        key = UPRINTF__MK_ACQ_LOAD(&e->key);
+        if (key == (uintptr_t)fmt) {
+            if (e->depth == uc__depth) return e->plain ? fmt : e->text;
+            slot = e;           /* expanded for another depth: refill it */
+            stale = key;
+            break;
+        }
+        if (key == 0) {
+            slot = e;
+            break;
+        }
+    }
+    if (strchr(fmt, '{') == NULL) return fmt;
+    if (slot != NULL && uprintf__markup_claim(&slot->key, stale)) {
+        len = uprintf_markup_expand(slot->text, sizeof(slot->text), fmt);
+        if (len >= 0 && (size_t)len < sizeof(slot->text) && !UPRINTF__MARKUP_REJECT(slot->text)) {
+            slot->depth = uc__depth;
+            slot->plain = strcmp(slot->text, fmt) == 0;
+            UPRINTF__MK_REL_STORE(&slot->key, (uintptr_t)fmt);
+            return slot->plain ? fmt : slot->text;
+        }
+        UPRINTF__MK_REL_STORE(&slot->key, (uintptr_t)0);
+    }
+#else
+    (void)cached;
+    *heap = NULL;
+    if (strchr(fmt, '{') == NULL) return fmt;
+#endif
+    len = uprintf_markup_expand(NULL, 0, fmt);
+    if (len < 0 || (*heap = (char *)malloc((size_t)len + 1)) == NULL) return NULL;
+    uprintf_markup_expand(*heap, (size_t)len + 1, fmt);
+    if (UPRINTF__MARKUP_REJECT(*heap)) {
+        free(*heap);
+        *heap = NULL;
+        return NULL;
+    }
+    return *heap;
+}
+
+#endif /* UPRINTF_MARKUP */
+
+#endif /* UPRINTF_MARKUP_H */
@@ -0,0 +1,183 @@
+/*
+ * uprintf_sink.h — Per-thread buffered stdout/stderr output
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_THREAD_SINK (POSIX only), narrow output to stdout and stderr
+ * is formatted into a buffer owned by the calling thread instead of going
+ * through the stdio FILE lock. A buffer is written with one write(2) when
+ * the next record does not fit, on uprintf_flush(), when the thread exits
+ * and at exit() for the exiting thread. A record (one uprintf call) is
+ * never split across writes, and a write of several records stays within
+ * PIPE_BUF so a pipe receives it atomically: lines from different threads
+ * do not interleave. A record larger than the whole buffer is written
+ * directly through stdio and flushed at once.
+ *
+ * Output written with plain printf, or still buffered in threads that are
+ * running when the process exits, is not ordered with the sink. Wide output
+ * keeps using the stdio stream.
+ */
+
+#ifndef UPRINTF_SINK_H
+#define UPRINTF_SINK_H
+
+#include "uprintf_config.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#if defined(UPRINTF_THREAD_SINK) && !defined(UPRINTF_WINDOWS) && defined(UPRINTF_SHARED_WEAK)
+
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define UPRINTF__TSINK_ON 1
+
+/* Largest write(2) a pipe takes atomically */
+#if defined(PIPE_BUF)
+    #define UPRINTF__TSINK_PIPE_BUF PIPE_BUF
+#else
+    #define UPRINTF__TSINK_PIPE_BUF 4096
+#endif
+
+/* Bytes buffered per thread and per stream */
+#ifndef UPRINTF_THREAD_SINK_SIZE
+    #define UPRINTF_THREAD_SINK_SIZE UPRINTF__TSINK_PIPE_BUF
+#endif
+
+/* Pending records written together; a larger buffer only holds bigger single records */
+#if UPRINTF_THREAD_SINK_SIZE < UPRINTF__TSINK_PIPE_BUF
+    #define UPRINTF__TSINK_ATOMIC UPRINTF_THREAD_SINK_SIZE
+#else
+    #define UPRINTF__TSINK_ATOMIC UPRINTF__TSINK_PIPE_BUF
+#endif
+
+/* Stream slots */
+#define UPRINTF__TSINK_STDOUT 0
+#define UPRINTF__TSINK_STDERR 1
+
+typedef struct {
+    size_t        len[2];
+    unsigned char registered;   /* thread-exit destructor armed */
+    char          buf[2][UPRINTF_THREAD_SINK_SIZE];
+} uprintf__tsink;
+
+UPRINTF_SHARED __thread uprintf__tsink uprintf__tsink_tls;
+UPRINTF_SHARED pthread_once_t uprintf__tsink_once = PTHREAD_ONCE_INIT;
+UPRINTF_SHARED pthread_key_t uprintf__tsink_key;
+
+/* Write the first n buffered bytes and keep the rest */
+UPRINTF_INLINE int uprintf__tsink_write(uprintf__tsink *t, int slot, size_t n) {
+    int ret;
+    if (n == 0) return 0;
+    ret = uprintf__write_all(fileno(slot == UPRINTF__TSINK_STDERR ? stderr : stdout),
+                             t->buf[slot], n);
+    t->len[slot] -= n;
+    if (t->len[slot] > 0) memmove(t->buf[slot], t->buf[slot] + n, t->len[slot]);
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf__tsink_drain(uprintf__tsink *t, int slot) {
+    return uprintf__tsink_write(t, slot, t->len[slot]);
+}
+
+UPRINTF_INLINE int uprintf__tsink_flush(void) {
+    uprintf__tsink *t = &uprintf__tsink_tls;
+    int ret = 0;
+    if (uprintf__tsink_drain(t, UPRINTF__TSINK_STDOUT) != 0) ret = -1;
+    if (uprintf__tsink_drain(t, UPRINTF__TSINK_STDERR) != 0) ret = -1;
+    return ret;
+}
+
+UPRINTF_INLINE void uprintf__tsink_thread_exit(void *arg) {
+    (void)arg;
+    (void)uprintf__tsink_flush();
+}
+
+UPRINTF_INLINE void uprintf__tsink_process_exit(void) {
+    (void)uprintf__tsink_flush();
+}
+
+/* The child of fork() must not write the parent's pending records again */
+UPRINTF_INLINE void uprintf__tsink_child(void) {
+    uprintf__tsink_tls.len[UPRINTF__TSINK_STDOUT] = 0;
+    uprintf__tsink_tls.len[UPRINTF__TSINK_STDERR] = 0;
+}
+
+UPRINTF_INLINE void uprintf__tsink_setup(void) {
+    (void)pthread_key_create(&uprintf__tsink_key, uprintf__tsink_thread_exit);
+    (void)atexit(uprintf__tsink_process_exit);
+    (void)pthread_atfork(NULL, NULL, uprintf__tsink_child);
+}
+
+#if defined(UPRINTF_NATIVE_ENGINE)
+    #define UPRINTF__TSINK_VSNPRINTF uprintf_native_vsnprintf
+#else
+    #define UPRINTF__TSINK_VSNPRINTF vsnprintf
+#endif
+
+/* Format one record for stdout/stderr into the calling thread's buffer */
+UPRINTF_INLINE int uprintf__tsink_vfprintf(FILE *stream, const char *fmt, va_list ap) {
+    uprintf__tsink *t = &uprintf__tsink_tls;
+    int slot = stream == stderr ? UPRINTF__TSINK_STDERR : UPRINTF__TSINK_STDOUT;
+    size_t pending, room;
+    va_list aq;
+    int n;
+
+    if (!t->registered) {
+        (void)pthread_once(&uprintf__tsink_once, uprintf__tsink_setup);
+        (void)pthread_setspecific(uprintf__tsink_key, t);
+        t->registered = 1;
+    }
+
+    pending = t->len[slot];
+    room = UPRINTF_THREAD_SINK_SIZE - pending;
+    va_copy(aq, ap);
+    n = UPRINTF__TSINK_VSNPRINTF(t->buf[slot] + pending, room, fmt, aq);
+    va_end(aq);
+    if (n < 0) return n;
+    if ((size_t)n < room) {
+        t->len[slot] += (size_t)n;
+        /* Past PIPE_BUF together: write the earlier records on their own */
+        if (pending > 0 && t->len[slot] > UPRINTF__TSINK_ATOMIC &&
+            uprintf__tsink_write(t, slot, pending) != 0)
+            return -1;
+        return n;
+    }
+
+    /* Does not fit behind the pending records: write those first */
+    if (uprintf__tsink_drain(t, slot) != 0) return -1;
+    if ((size_t)n < UPRINTF_THREAD_SINK_SIZE) {
+        n = UPRINTF__TSINK_VSNPRINTF(t->buf[slot], UPRINTF_THREAD_SINK_SIZE, fmt, ap);
+        if (n > 0) t->len[slot] = (size_t)n;
+        return n;
+    }
+
+    /* Larger than the whole buffer */
+    n = vfprintf(stream, fmt, ap);
+    if (fflush(stream) != 0) return -1;
+    return n;
+}
+
+#endif /* UPRINTF_THREAD_SINK */
+
+/*
+ * uprintf_flush() — write out pending narrow output of the calling thread
+ * (thread sink) and flush the stdout/stderr stdio buffers.
+ * Returns 0, or -1 if a write failed.
+ */
+UPRINTF_INLINE int uprintf_flush(void) {
+    int ret = 0;
+#if defined(UPRINTF__TSINK_ON)
+    ret = uprintf__tsink_flush();
+#endif
+    if (fflush(stdout) != 0) ret = -1;
+    if (fflush(stderr) != 0) ret = -1;
+    return ret;
+}
+
+#endif /* UPRINTF_SINK_H */
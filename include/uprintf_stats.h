@@ -0,0 +1,220 @@
+/*
+ * uprintf_stats.h — Per-call-site counters for the uprintf macros
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_STATS, every expansion of the uprintf, ufprintf, ufdprintf,
+ * usnprintf and usprintf macros owns a static record: file, line, a copy
+ * of the first 48 chars of the format seen on its first call (the format
+ * may live in a buffer that is gone by the time of the dump), and counters
+ * for calls, bytes written, truncated usnprintf results and the ticks
+ * spent in the call. Counters are bumped with relaxed atomics; a record
+ * joins the global list on its first call with one compare-and-swap, so
+ * nothing is locked.
+ *
+ *   uprintf_stats_dump(stderr);   // costliest call sites first
+ *
+ * Ticks come from the time-stamp counter on x86, the virtual counter on
+ * AArch64 and timespec_get() nanoseconds elsewhere; compare them between
+ * sites, not across machines. Calls to the *_narrow / *_wide functions
+ * are not counted. Needs C11 _Generic and GCC/Clang on a platform with
+ * weak symbols; elsewhere the macros are unchanged and the dump says so.
+ */
+
+#ifndef UPRINTF_STATS_H
+#define UPRINTF_STATS_H
+
+#include "uprintf_config.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+#if defined(UPRINTF_STATS)
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(UPRINTF_HAS_GENERIC) && defined(UPRINTF_HAS_ATOMICS) && defined(UPRINTF_SHARED_WEAK)
+
+#include <time.h>
+
+#define UPRINTF__STATS_ON 1
+
+/* Format chars kept per site */
+#define UPRINTF__STATS_FMT_MAX 48
+
+typedef struct uprintf_stats_site {
+    const char                *file;
+    int                        line;
+    int                        wide;        /* the format was a wchar_t string   */
+    int                        fmt_cut;     /* the format is longer than fmt     */
+    size_t                     calls;
+    size_t                     bytes;       /* chars written, truncation applied */
+    size_t                     truncated;   /* usnprintf results that did not fit */
+    unsigned long long         ticks;
+    int                        registered;
+    struct uprintf_stats_site *next;
+    char                       fmt[UPRINTF__STATS_FMT_MAX + 1];  /* first call's format, non-ASCII as '?' */
+} uprintf_stats_site;
+
+UPRINTF_SHARED uprintf_stats_site *uprintf__stats_head;
+
+UPRINTF_INLINE unsigned long long uprintf__stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    unsigned long long v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+/* Char i of a narrow or wide format */
+UPRINTF_INLINE unsigned long uprintf__stats_fmt_char(const void *fmt, int wide, size_t i) {
+    return wide ? (unsigned long)((const wchar_t *)fmt)[i]
+                : (unsigned long)((const unsigned char *)fmt)[i];
+}
+
+/* Link s into the list; only the caller that flips `registered` pushes */
+UPRINTF_INLINE void uprintf__stats_register(uprintf_stats_site *s, const void *fmt, int wide) {
+    int expected = 0;
+    uprintf_stats_site *head;
+    size_t i = 0;
+
+    if (!__atomic_compare_exchange_n(&s->registered, &expected, 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    if (fmt != NULL) {
+        unsigned long c;
+        for (; i < UPRINTF__STATS_FMT_MAX && (c = uprintf__stats_fmt_char(fmt, wide, i)) != 0; i++)
+            s->fmt[i] = c < 0x80 ? (char)c : '?';
+        s->fmt_cut = i == UPRINTF__STATS_FMT_MAX && uprintf__stats_fmt_char(fmt, wide, i) != 0;
+    }
+    s->fmt[i] = '\0';
+    s->wide = wide;
+    head = __atomic_load_n(&uprintf__stats_head, __ATOMIC_RELAXED);
+    do {
+        s->next = head;
+    } while (!__atomic_compare_exchange_n(&uprintf__stats_head, &head, s, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* cap is the usnprintf buffer size, 0 for the unbounded calls */
+UPRINTF_INLINE void uprintf__stats_record(uprintf_stats_site *s, int ret, size_t cap, unsigned long long ticks) {
+    UPRINTF_ATOMIC_ADD(&s->calls, (size_t)1);
+    UPRINTF_ATOMIC_ADD(&s->ticks, ticks);
+    if (ret <= 0) return;
+    if (cap != 0 && (size_t)ret >= cap) {
+        UPRINTF_ATOMIC_ADD(&s->truncated, (size_t)1);
+        UPRINTF_ATOMIC_ADD(&s->bytes, cap - 1);
+    } else {
+        UPRINTF_ATOMIC_ADD(&s->bytes, (size_t)ret);
+    }
+}
+
+/*
+ * Wrap one macro call: `call` is the entry point invocation, cap the
+ * usnprintf size or 0. Evaluates to the call's return value.
+ */
+#define UPRINTF__STATS_CALL(f, call, cap) __extension__({                       \
+    static uprintf_stats_site uprintf__site = { __FILE__, __LINE__, 0, 0, 0, 0, 0, 0, 0, NULL, "" }; \
+    unsigned long long uprintf__t0;                                             \
+    int uprintf__ret;                                                           \
+    if (!UPRINTF_ATOMIC_LOAD(&uprintf__site.registered))                        \
+        uprintf__stats_register(&uprintf__site, (const void *)(f),              \
+            _Generic((f), wchar_t *: 1, const wchar_t *: 1, default: 0));       \
+    uprintf__t0 = uprintf__stats_ticks();                                       \
+    uprintf__ret = (call);                                                      \
+    uprintf__stats_record(&uprintf__site, uprintf__ret, (cap), uprintf__stats_ticks() - uprintf__t0); \
+    uprintf__ret;                                                               \
+})
+
+/* First registered call site; follow ->next for the rest */
+UPRINTF_INLINE const uprintf_stats_site *uprintf_stats_sites(void) {
+    return __atomic_load_n(&uprintf__stats_head, __ATOMIC_ACQUIRE);
+}
+
+/* Zero every counter; sites stay registered */
+UPRINTF_INLINE void uprintf_stats_reset(void) {
+    uprintf_stats_site *s;
+    for (s = __atomic_load_n(&uprintf__stats_head, __ATOMIC_ACQUIRE); s != NULL; s = s->next) {
+        UPRINTF_ATOMIC_STORE(&s->calls, (size_t)0);
+        UPRINTF_ATOMIC_STORE(&s->bytes, (size_t)0);
+        UPRINTF_ATOMIC_STORE(&s->truncated, (size_t)0);
+        UPRINTF_ATOMIC_STORE(&s->ticks, 0ull);
+    }
+}
+
+UPRINTF_INLINE int uprintf__stats_cmp(const void *a, const void *b) {
+    unsigned long long x = UPRINTF_ATOMIC_LOAD(&(*(uprintf_stats_site *const *)a)->ticks);
+    unsigned long long y = UPRINTF_ATOMIC_LOAD(&(*(uprintf_stats_site *const *)b)->ticks);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* The site's format copy on one line, escapes spelled out */
+UPRINTF_INLINE void uprintf__stats_put_format(FILE *out, const uprintf_stats_site *s) {
+    const char *p;
+    fputc('"', out);
+    for (p = s->fmt; *p != '\0'; p++) {
+        int c = (unsigned char)*p;
+        if (c == '\n') fputs("\\n", out);
+        else if (c == '\t') fputs("\\t", out);
+        else if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20 || c == 0x7f) fprintf(out, "\\x%02x", (unsigned)c);
+        else fputc(c, out);
+    }
+    fputs(s->fmt_cut ? "\"..." : "\"", out);
+}
+
+/*
+ * Report every call site that ran, costliest first: ticks, calls, bytes,
+ * truncations, file:line and format. Returns the number of sites listed.
+ */
+UPRINTF_INLINE int uprintf_stats_dump(FILE *out) {
+    uprintf_stats_site *s, **v;
+    size_t n = 0, i, listed = 0;
+
+    if (out == NULL) return -1;
+    for (s = __atomic_load_n(&uprintf__stats_head, __ATOMIC_ACQUIRE); s != NULL; s = s->next) n++;
+    if (n == 0) return 0;
+    if ((v = (uprintf_stats_site **)malloc(n * sizeof(*v))) == NULL) return -1;
+    /* The list only grows at the head: the first n stay put */
+    for (i = 0, s = __atomic_load_n(&uprintf__stats_head, __ATOMIC_ACQUIRE); i < n; s = s->next) v[i++] = s;
+    qsort(v, n, sizeof(*v), uprintf__stats_cmp);
+
+    fprintf(out, "%20s %12s %14s %10s  %s\n", "ticks", "calls", "bytes", "truncated", "site / format");
+    for (i = 0; i < n; i++) {
+        size_t calls = UPRINTF_ATOMIC_LOAD(&v[i]->calls);
+        if (calls == 0) continue;
+        fprintf(out, "%20llu %12lu %14lu %10lu  %s:%d ",
+                UPRINTF_ATOMIC_LOAD(&v[i]->ticks), (unsigned long)calls,
+                (unsigned long)UPRINTF_ATOMIC_LOAD(&v[i]->bytes),
+                (unsigned long)UPRINTF_ATOMIC_LOAD(&v[i]->truncated), v[i]->file, v[i]->line);
+        uprintf__stats_put_format(out, v[i]);
+        fputc('\n', out);
+        listed++;
+    }
+    free(v);
+    return (int)listed;
+}
+
+#else
+
+UPRINTF_INLINE void uprintf_stats_reset(void) {
+}
+
+UPRINTF_INLINE int uprintf_stats_dump(FILE *out) {
+    if (out == NULL) return -1;
+    fputs("uprintf stats: not available in this build (needs C11, GCC/Clang, weak symbols)\n", out);
+    return 0;
+}
+
+#endif /* UPRINTF_HAS_GENERIC && UPRINTF_HAS_ATOMICS && UPRINTF_SHARED_WEAK */
+
+#endif /* UPRINTF_STATS */
+
+#endif /* UPRINTF_STATS_H */
@@ -0,0 +1,340 @@
+/*
+ * uprintf_strbuf.h — Growable string builders with inline storage
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * A ustrbuf (char) or uwstrbuf (wchar_t) keeps text in the struct itself
+ * until it outgrows UPRINTF_STRBUF_INLINE bytes, then moves it to a
+ * buffer that doubles as needed. ustrbuf_appendf() (uprintf.h) formats
+ * straight into the free tail; only output longer than the tail is
+ * formatted a second time, after growing.
+ *
+ *   ustrbuf sb;
+ *   ustrbuf_init(&sb, NULL);                  // NULL: malloc/realloc/free
+ *   ustrbuf_appendf(&sb, "%s=%d", key, value);
+ *   ustrbuf_append(&sb, "\n", 1);
+ *   puts(ustrbuf_cstr(&sb));
+ *   ustrbuf_free(&sb);
+ *
+ * Memory comes from a ustrbuf_allocator, a single resize callback in the
+ * style of lua_Alloc. ustrbuf_arena hands out pieces of a caller-supplied
+ * block and never touches the heap:
+ *
+ *   static char block[64 * 1024];
+ *   ustrbuf_arena arena;
+ *   ustrbuf_allocator a;
+ *   ustrbuf_arena_init(&arena, block, sizeof(block));
+ *   a = ustrbuf_arena_allocator(&arena);
+ *   ustrbuf_init(&sb, &a);
+ *
+ * Failures are sticky: after an allocation or format error, sb.error is
+ * set, the text stays as it was before the failing call, and every later
+ * append returns -1. A batch of appends can be checked once at the end.
+ * The struct may be copied while the text is inline or after
+ * ustrbuf_take(); a builder is not thread-safe.
+ */
+
+#ifndef UPRINTF_STRBUF_H
+#define UPRINTF_STRBUF_H
+
+#include "uprintf_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+/* Inline storage per builder, in bytes */
+#ifndef UPRINTF_STRBUF_INLINE
+    #define UPRINTF_STRBUF_INLINE 256
+#endif
+
+#if UPRINTF_STRBUF_INLINE < 16
+    #error "UPRINTF_STRBUF_INLINE must be at least 16"
+#endif
+
+/* ========================================================================== */
+/*  Allocators                                                                */
+/* ========================================================================== */
+
+/*
+ * Resize ptr from old_size to new_size bytes and return the new address,
+ * or NULL on failure with ptr left intact. ptr is NULL for a fresh
+ * allocation; new_size 0 releases ptr (the return value is ignored).
+ */
+typedef void *(*ustrbuf_realloc_fn)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+
+typedef struct {
+    ustrbuf_realloc_fn fn;
+    void              *ctx;
+} ustrbuf_allocator;
+
+UPRINTF_INLINE void *uprintf__strbuf_heap(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    (void)ctx;
+    (void)old_size;
+    if (new_size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, new_size);
+}
+
+/* Bump allocator over a caller-supplied block */
+typedef struct {
+    unsigned char *base;
+    size_t         size;
+    size_t         used;
+    size_t         last;    /* offset of the most recent allocation */
+} ustrbuf_arena;
+
+#define UPRINTF__ARENA_ALIGN 16
+
+UPRINTF_INLINE void ustrbuf_arena_init(ustrbuf_arena *a, void *block, size_t size) {
+    a->base = (unsigned char *)block;
+    a->size = block != NULL ? size : 0;
+    a->used = 0;
+    a->last = 0;
+}
+
+/*
+ * The most recent allocation grows and shrinks in place, which is the
+ * common case for a single builder; any other block is copied to the
+ * top. Freed space is only reclaimed when it is on top.
+ */
+UPRINTF_INLINE void *ustrbuf_arena_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    ustrbuf_arena *a = (ustrbuf_arena *)ctx;
+    unsigned char *p = (unsigned char *)ptr;
+    int top = p != NULL && p == a->base + a->last && a->last + old_size == a->used;
+    size_t off;
+
+    if (new_size == 0) {
+        if (top) a->used = a->last;
+        return NULL;
+    }
+    if (top) {
+        if (new_size > a->size - a->last) return NULL;
+        a->used = a->last + new_size;
+        return p;
+    }
+    off = a->used + (UPRINTF__ARENA_ALIGN - (size_t)((uintptr_t)(a->base + a->used) % UPRINTF__ARENA_ALIGN))
+                    % UPRINTF__ARENA_ALIGN;
+    if (off > a->size || new_size > a->size - off) return NULL;
+    if (p != NULL) memcpy(a->base + off, p, old_size < new_size ? old_size : new_size);
+    a->last = off;
+    a->used = off + new_size;
+    return a->base + off;
+}
+
+UPRINTF_INLINE ustrbuf_allocator ustrbuf_arena_allocator(ustrbuf_arena *a) {
+    ustrbuf_allocator al;
+    al.fn = ustrbuf_arena_realloc;
+    al.ctx = a;
+    return al;
+}
+
+/* ========================================================================== */
+/*  Builders                                                                  */
+/* ========================================================================== */
+
+typedef struct {
+    char             *heap;     /* NULL while the text is inline         */
+    size_t            len;      /* chars, excluding the terminator       */
+    size_t            cap;      /* usable chars, excluding the terminator */
+    int               error;    /* sticky allocation or format failure   */
+    ustrbuf_allocator alloc;
+    char              small[UPRINTF_STRBUF_INLINE];
+} ustrbuf;
+
+typedef struct {
+    wchar_t          *heap;
+    size_t            len;
+    size_t            cap;
+    int               error;
+    ustrbuf_allocator alloc;
+    wchar_t           small[UPRINTF_STRBUF_INLINE / sizeof(wchar_t)];
+} uwstrbuf;
+
+/*
+ * The narrow and wide builders share their storage logic through these,
+ * which work on chars of csize bytes.
+ */
+UPRINTF_INLINE void uprintf__strbuf_setup(ustrbuf_allocator *alloc, const ustrbuf_allocator *from) {
+    if (from != NULL && from->fn != NULL) {
+        *alloc = *from;
+    } else {
+        alloc->fn = uprintf__strbuf_heap;
+        alloc->ctx = NULL;
+    }
+}
+
+/*
+ * Make room for `extra` more chars after len: at least double the
+ * capacity, moving inline text to the allocator on the first growth.
+ * *heap and *cap are updated. Returns 0, or -1 with nothing changed.
+ */
+UPRINTF_INLINE int uprintf__strbuf_grow(const ustrbuf_allocator *alloc, void **heap, const void *small,
+                                        size_t *cap, size_t len, size_t extra, size_t csize) {
+    size_t ncap;
+    void *p;
+
+    if (extra <= *cap - len) return 0;
+    if (extra > SIZE_MAX / csize - 1 - len) return -1;
+    ncap = *cap <= (SIZE_MAX / csize - 1) / 2 ? *cap * 2 : SIZE_MAX / csize - 1;
+    if (ncap < len + extra) ncap = len + extra;
+
+    p = alloc->fn(alloc->ctx, *heap, *heap != NULL ? (*cap + 1) * csize : 0, (ncap + 1) * csize);
+    if (p == NULL) return -1;
+    if (*heap == NULL) memcpy(p, small, (len + 1) * csize);
+    *heap = p;
+    *cap = ncap;
+    return 0;
+}
+
+/* --- Narrow ---------------------------------------------------------------- */
+
+/* alloc NULL: the C library heap. The allocator is copied. */
+UPRINTF_INLINE void ustrbuf_init_narrow(ustrbuf *sb, const ustrbuf_allocator *alloc) {
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) - 1;
+    sb->error = 0;
+    sb->small[0] = '\0';
+    uprintf__strbuf_setup(&sb->alloc, alloc);
+}
+
+/* The text, always terminated; valid until the next append */
+UPRINTF_INLINE const char *ustrbuf_cstr_narrow(const ustrbuf *sb) {
+    return sb->heap != NULL ? sb->heap : sb->small;
+}
+
+/* Ensure extra more chars fit without reallocating. 0, or -1 (sticky) */
+UPRINTF_INLINE int ustrbuf_reserve_narrow(ustrbuf *sb, size_t extra) {
+    void *heap = sb->heap;
+    if (sb->error) return -1;
+    if (uprintf__strbuf_grow(&sb->alloc, &heap, sb->small, &sb->cap, sb->len, extra, sizeof(char)) != 0) {
+        sb->error = 1;
+        return -1;
+    }
+    sb->heap = (char *)heap;
+    return 0;
+}
+
+UPRINTF_INLINE int ustrbuf_append_narrow(ustrbuf *sb, const char *str, size_t len) {
+    char *d;
+    if (sb == NULL || (str == NULL && len > 0) || ustrbuf_reserve_narrow(sb, len) != 0) return -1;
+    d = sb->heap != NULL ? sb->heap : sb->small;
+    if (len > 0) memcpy(d + sb->len, str, len);
+    sb->len += len;
+    d[sb->len] = '\0';
+    return 0;
+}
+
+/* Empty the text, keeping the storage and clearing the error */
+UPRINTF_INLINE void ustrbuf_clear_narrow(ustrbuf *sb) {
+    sb->len = 0;
+    sb->error = 0;
+    (sb->heap != NULL ? sb->heap : sb->small)[0] = '\0';
+}
+
+UPRINTF_INLINE void ustrbuf_free_narrow(ustrbuf *sb) {
+    if (sb->heap != NULL) sb->alloc.fn(sb->alloc.ctx, sb->heap, (sb->cap + 1) * sizeof(char), 0);
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) - 1;
+    sb->error = 0;
+    sb->small[0] = '\0';
+}
+
+/*
+ * Hand the text over: returns a terminated buffer from the builder's
+ * allocator (free() it with the default one) and its length in *len,
+ * then leaves the builder empty. Heap text is handed over as is; inline
+ * text is copied into an allocation of exactly len + 1 chars. Returns
+ * NULL, keeping the text, on error.
+ */
+UPRINTF_INLINE char *ustrbuf_take_narrow(ustrbuf *sb, size_t *len) {
+    char *p = sb->heap;
+    if (sb->error) return NULL;
+    if (p == NULL) {
+        p = (char *)sb->alloc.fn(sb->alloc.ctx, NULL, 0, (sb->len + 1) * sizeof(char));
+        if (p == NULL) return NULL;
+        memcpy(p, sb->small, sb->len + 1);
+    }
+    if (len != NULL) *len = sb->len;
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) - 1;
+    sb->small[0] = '\0';
+    return p;
+}
+
+/* --- Wide ------------------------------------------------------------------ */
+
+UPRINTF_INLINE void ustrbuf_init_wide(uwstrbuf *sb, const ustrbuf_allocator *alloc) {
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) / sizeof(wchar_t) - 1;
+    sb->error = 0;
+    sb->small[0] = L'\0';
+    uprintf__strbuf_setup(&sb->alloc, alloc);
+}
+
+UPRINTF_INLINE const wchar_t *ustrbuf_cstr_wide(const uwstrbuf *sb) {
+    return sb->heap != NULL ? sb->heap : sb->small;
+}
+
+UPRINTF_INLINE int ustrbuf_reserve_wide(uwstrbuf *sb, size_t extra) {
+    void *heap = sb->heap;
+    if (sb->error) return -1;
+    if (uprintf__strbuf_grow(&sb->alloc, &heap, sb->small, &sb->cap, sb->len, extra, sizeof(wchar_t)) != 0) {
+        sb->error = 1;
+        return -1;
+    }
+    sb->heap = (wchar_t *)heap;
+    return 0;
+}
+
+UPRINTF_INLINE int ustrbuf_append_wide(uwstrbuf *sb, const wchar_t *str, size_t len) {
+    wchar_t *d;
+    if (sb == NULL || (str == NULL && len > 0) || ustrbuf_reserve_wide(sb, len) != 0) return -1;
+    d = sb->heap != NULL ? sb->heap : sb->small;
+    if (len > 0) wmemcpy(d + sb->len, str, len);
+    sb->len += len;
+    d[sb->len] = L'\0';
+    return 0;
+}
+
+UPRINTF_INLINE void ustrbuf_clear_wide(uwstrbuf *sb) {
+    sb->len = 0;
+    sb->error = 0;
+    (sb->heap != NULL ? sb->heap : sb->small)[0] = L'\0';
+}
+
+UPRINTF_INLINE void ustrbuf_free_wide(uwstrbuf *sb) {
+    if (sb->heap != NULL) sb->alloc.fn(sb->alloc.ctx, sb->heap, (sb->cap + 1) * sizeof(wchar_t), 0);
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) / sizeof(wchar_t) - 1;
+    sb->error = 0;
+    sb->small[0] = L'\0';
+}
+
+UPRINTF_INLINE wchar_t *ustrbuf_take_wide(uwstrbuf *sb, size_t *len) {
+    wchar_t *p = sb->heap;
+    if (sb->error) return NULL;
+    if (p == NULL) {
+        p = (wchar_t *)sb->alloc.fn(sb->alloc.ctx, NULL, 0, (sb->len + 1) * sizeof(wchar_t));
+        if (p == NULL) return NULL;
+        wmemcpy(p, sb->small, sb->len + 1);
+    }
+    if (len != NULL) *len = sb->len;
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = sizeof(sb->small) / sizeof(wchar_t) - 1;
+    sb->small[0] = L'\0';
+    return p;
+}
+
+#endif /* UPRINTF_STRBUF_H */
@@ -0,0 +1,260 @@
+/*
+ * uprintf_strip.h — Drop ANSI escape sequences from non-terminal output
+ * Part of the uprintf library (universal printf)
+ *
+ * This file is included automatically by uprintf.h. Do not include directly.
+ *
+ * With UPRINTF_STRIP_ANSI, narrow output from uprintf, ufprintf and
+ * ufdprintf loses its CSI sequences (ESC '[' parameters final-byte: the
+ * colors and styles of uprintf_color.h, cursor movement, ...) when the
+ * destination is not a terminal. Call sites do not change. The record is
+ * formatted by the built-in engine into a stack buffer, the text between
+ * sequences is moved together in place, and the buffer is written with a
+ * single write, so a ufdprintf() record stays one write(2). An SSE2 scan
+ * finds the ESC bytes; text before the first sequence is not moved. A
+ * sequence that straddles two buffers is still recognized; one split
+ * across two calls is not.
+ *
+ *   uprintf_set_strip_ansi(UPRINTF_STRIP_ALWAYS);   // or _NEVER, _AUTO
+ *
+ * In UPRINTF_STRIP_AUTO mode (the default), a destination is stripped when
+ * isatty() says it is not a terminal. The answer for stdout and stderr is
+ * cached until the next uprintf_set_strip_ansi(); other descriptors are
+ * asked on every call. A stripped call returns the number of bytes
+ * written, without the sequences. Wide output, ufprintf_async(),
+ * ulog_deferred() and the per-thread stdout/stderr buffers of
+ * UPRINTF_THREAD_SINK are not filtered. On POSIX, fileno() must be
+ * declared: build with _POSIX_C_SOURCE or -pthread.
+ */
+
+#ifndef UPRINTF_STRIP_H
+#define UPRINTF_STRIP_H
+
+#include "uprintf_config.h"
+#include "uprintf_engine.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#if defined(UPRINTF_STRIP_ANSI)
+
+#include <limits.h>
+#include <stdlib.h>
+
+#if defined(UPRINTF_WINDOWS)
+    #include <io.h>
+    #define UPRINTF__ISATTY(fd)   _isatty(fd)
+    #define UPRINTF__FILENO(f)    _fileno(f)
+#else
+    #include <unistd.h>
+    #define UPRINTF__ISATTY(fd)   isatty(fd)
+    #define UPRINTF__FILENO(f)    fileno(f)
+#endif
+
+#if defined(UPRINTF_SIMD)
+    #include <emmintrin.h>
+#endif
+
+#define UPRINTF__STRIP_ON 1
+
+/* Modes for uprintf_set_strip_ansi() */
+#define UPRINTF_STRIP_AUTO   0      /* strip unless the destination is a terminal */
+#define UPRINTF_STRIP_ALWAYS 1
+#define UPRINTF_STRIP_NEVER  2
+
+#if defined(UPRINTF_HAS_ATOMICS)
+    #define UPRINTF__STRIP_GET(p)    UPRINTF_ATOMIC_LOAD(p)
+    #define UPRINTF__STRIP_SET(p, v) UPRINTF_ATOMIC_STORE(p, v)
+#else
+    #define UPRINTF__STRIP_GET(p)    (*(p))
+    #define UPRINTF__STRIP_SET(p, v) (*(p) = (v))
+#endif
+
+UPRINTF_SHARED int uprintf__strip_mode;
+
+/* isatty() of stdout and stderr: 0 not asked yet, 1 terminal, 2 other */
+UPRINTF_SHARED int uprintf__strip_tty[3];
+
+UPRINTF_INLINE void uprintf_set_strip_ansi(int mode) {
+    UPRINTF__STRIP_SET(&uprintf__strip_mode, mode);
+    UPRINTF__STRIP_SET(&uprintf__strip_tty[1], 0);
+    UPRINTF__STRIP_SET(&uprintf__strip_tty[2], 0);
+}
+
+/* Whether output to fd is stripped right now */
+UPRINTF_INLINE int uprintf_strip_ansi_active(int fd) {
+    int mode = UPRINTF__STRIP_GET(&uprintf__strip_mode), tty;
+
+    if (mode != UPRINTF_STRIP_AUTO) return mode == UPRINTF_STRIP_ALWAYS;
+    if (fd < 0) return 0;
+    if (fd != 1 && fd != 2) return !UPRINTF__ISATTY(fd);
+    if ((tty = UPRINTF__STRIP_GET(&uprintf__strip_tty[fd])) == 0) {
+        tty = UPRINTF__ISATTY(fd) ? 1 : 2;
+        UPRINTF__STRIP_SET(&uprintf__strip_tty[fd], tty);
+    }
+    return tty == 2;
+}
+
+/* First ESC in [p, end), or end */
+UPRINTF_INLINE const char *uprintf__find_esc(const char *p, const char *end) {
+#if defined(UPRINTF_SIMD)
+    const __m128i esc = _mm_set1_epi8(0x1b);
+    while (end - p >= 16) {
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(const void *)p), esc));
+        if (m != 0) return p + __builtin_ctz((unsigned)m);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\033') p++;
+    return p;
+}
+
+/* Where the filter is between buffers */
+#define UPRINTF__STRIP_TEXT 0
+#define UPRINTF__STRIP_ESC  1       /* after ESC */
+#define UPRINTF__STRIP_CSI  2       /* after ESC '[' */
+
+typedef struct {
+    FILE   *stream;                 /* NULL: write(2) to fd */
+    int     fd;
+    int     state;
+    size_t  written;
+} uprintf__strip_ctx;
+
+UPRINTF_INLINE int uprintf__strip_out(uprintf__strip_ctx *c, const char *p, size_t n) {
+    if (n == 0) return 0;
+    c->written += n;
+    if (c->stream != NULL) return fwrite(p, 1, n, c->stream) == n ? 0 : -1;
+    return uprintf__write_all(c->fd, p, n);
+}
+
+/*
+ * Drop the CSI sequences of [p, p+n) in place and return the length kept.
+ * Parameter and intermediate bytes are dropped up to the final byte
+ * (0x40-0x7E); a control character ends a malformed sequence and is kept,
+ * as is an ESC that does not start a CSI. The kept text only moves down,
+ * so it ends up contiguous for a single write. An ESC at the end of a
+ * buffer that is not the last leaves the state at UPRINTF__STRIP_ESC.
+ */
+UPRINTF_INLINE size_t uprintf__strip_feed(uprintf__strip_ctx *c, char *p, size_t n, int last) {
+    char *start = p, *end = p + n, *run = p, *dst = p;
+
+    while (p < end) {
+        unsigned char ch;
+        switch (c->state) {
+            case UPRINTF__STRIP_TEXT:
+                p += uprintf__find_esc(p, end) - p;
+                if (dst != run) memmove(dst, run, (size_t)(p - run));
+                dst += p - run;
+                if (p == end) return (size_t)(dst - start);
+                p++;
+                c->state = UPRINTF__STRIP_ESC;
+                break;
+            case UPRINTF__STRIP_ESC:
+                if (*p == '[') {
+                    p++;
+                    c->state = UPRINTF__STRIP_CSI;
+                } else {
+                    *dst++ = '\033';
+                    c->state = UPRINTF__STRIP_TEXT;
+                    run = p;
+                }
+                break;
+            default:
+                ch = (unsigned char)*p;
+                if (ch < 0x20) {
+                    c->state = UPRINTF__STRIP_TEXT;
+                    run = p;
+                } else {
+                    p++;
+                    if (ch >= 0x40 && ch <= 0x7E) {
+                        c->state = UPRINTF__STRIP_TEXT;
+                        run = p;
+                    }
+                }
+                break;
+        }
+    }
+    /* An ESC at the very end starts nothing: keep it */
+    if (last && c->state == UPRINTF__STRIP_ESC) {
+        *dst++ = '\033';
+        c->state = UPRINTF__STRIP_TEXT;
+    }
+    return (size_t)(dst - start);
+}
+
+/*
+ * Flush callback: the sink's buffer is filtered in place and written at
+ * once. An ESC at its end is carried to the front of the next buffer, so
+ * the filter can still keep it next to the text that follows.
+ */
+UPRINTF_INLINE int uprintf__strip_flush(uprintf__sink *s) {
+    uprintf__strip_ctx *c = (uprintf__strip_ctx *)s->ctx;
+    size_t kept = uprintf__strip_feed(c, s->buf, s->pos, 0);
+    int ret = uprintf__strip_out(c, s->buf, kept);
+
+    s->pos = 0;
+    if (c->state == UPRINTF__STRIP_ESC) {
+        c->state = UPRINTF__STRIP_TEXT;
+        s->buf[s->pos++] = '\033';
+    }
+    return ret;
+}
+
+UPRINTF_INLINE int uprintf__strip_vformat(uprintf__strip_ctx *c, const char *fmt, va_list ap) {
+    char buf[UPRINTF_STACK_BUF_MAX];
+    uprintf__sink s;
+    int status;
+
+    uprintf__sink_init(&s, buf, sizeof(buf));
+    s.flush = uprintf__strip_flush;
+    s.ctx = c;
+    status = uprintf__vformat(&s, fmt, ap);
+    if (status == UPRINTF__FMT_OK && s.pos > 0 &&
+        uprintf__strip_out(c, buf, uprintf__strip_feed(c, buf, s.pos, 1)) != 0)
+        status = UPRINTF__FMT_ERROR;
+
+    /* Formats the engine does not model, caught before any output: vsnprintf it all */
+    if (status == UPRINTF__FMT_FOREIGN) {
+        char *heap = NULL, *out = buf;
+        va_list args;
+        int ret;
+
+        va_copy(args, ap);
+        ret = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (ret >= (int)sizeof(buf)) {
+            if ((heap = (char *)malloc((size_t)ret + 1)) == NULL) return -1;
+            ret = vsnprintf(heap, (size_t)ret + 1, fmt, ap);
+            out = heap;
+        }
+        status = ret >= 0 && uprintf__strip_out(c, out, uprintf__strip_feed(c, out, (size_t)ret, 1)) == 0
+            ? UPRINTF__FMT_OK : UPRINTF__FMT_ERROR;
+        free(heap);
+    }
+    if (status != UPRINTF__FMT_OK || c->written > (size_t)INT_MAX) return -1;
+    return (int)c->written;
+}
+
+UPRINTF_INLINE int uprintf__strip_vfprintf(FILE *stream, const char *fmt, va_list ap) {
+    uprintf__strip_ctx c;
+    c.stream = stream;
+    c.fd = -1;
+    c.state = UPRINTF__STRIP_TEXT;
+    c.written = 0;
+    return uprintf__strip_vformat(&c, fmt, ap);
+}
+
+UPRINTF_INLINE int uprintf__strip_vdprintf(int fd, const char *fmt, va_list ap) {
+    uprintf__strip_ctx c;
+    c.stream = NULL;
+    c.fd = fd;
+    c.state = UPRINTF__STRIP_TEXT;
+    c.written = 0;
+    return uprintf__strip_vformat(&c, fmt, ap);
+}
+
+#endif /* UPRINTF_STRIP_ANSI */
+
+#endif /* UPRINTF_STRIP_H */
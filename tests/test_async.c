@@ -0,0 +1,312 @@
+/*
+ * test_async.c — Tests for asynchronous output (ufprintf_async)
+ *
+ * Built with UPRINTF_ASYNC, a small ring (UPRINTF_ASYNC_SLOTS=64) so the
+ * overflow policies can be driven, and -pthread.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(UPRINTF__ASYNC_ON)
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__ASYNC_ON)
+
+#define N_THREADS 8
+#define N_LINES   4000
+
+static FILE *g_out;
+
+static void *producer(void *arg) {
+    int id = *(const int *)arg;
+    int i;
+    for (i = 0; i < N_LINES; i++)
+        ufprintf_async(g_out, "thread %02d line %05d end\n", id, i);
+    return NULL;
+}
+
+static void test_sync_fallback(void) {
+    char line[64];
+    int count = 0;
+    FILE *tmp = tmpfile();
+    if (tmp == NULL) return;
+    check_ret("not started: prints synchronously", ufprintf_async(tmp, "sync %d\n", 1), 7);
+    rewind(tmp);
+    if (fgets(line, sizeof(line), tmp) == NULL) line[0] = '\0';
+    check_true("synchronous content", strcmp(line, "sync 1\n") == 0);
+    check_ret("%n still rejected", ufprintf_async(tmp, "%s%n", "x", &count), -1);
+    fclose(tmp);
+}
+
+static void test_block_policy(void) {
+    pthread_t th[N_THREADS];
+    int ids[N_THREADS], next[N_THREADS] = {0};
+    char line[UPRINTF_ASYNC_SLOT_SIZE * 2], big[UPRINTF_ASYNC_SLOT_SIZE * 2];
+    int i, id, n, intact = 1;
+    long lines = 0;
+    uprintf_async_stats st0, st;
+
+    g_out = tmpfile();
+    if (g_out == NULL) return;
+    st0 = uprintf_async_get_stats();
+    check_ret("start", uprintf_async_start(UPRINTF_ASYNC_BLOCK), 0);
+    check_ret("second start rejected", uprintf_async_start(UPRINTF_ASYNC_BLOCK), -1);
+
+    for (i = 0; i < N_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&th[i], NULL, producer, &ids[i]);
+    }
+    for (i = 0; i < N_THREADS; i++) pthread_join(th[i], NULL);
+
+    memset(big, 'y', sizeof(big));
+    big[sizeof(big) - 1] = '\0';
+    ufprintf_async(g_out, "%s\n", big);
+    check_ret("flush", uprintf_async_flush(), 0);
+    st = uprintf_async_get_stats();
+
+    rewind(g_out);
+    while (fgets(line, sizeof(line), g_out) != NULL) {
+        if (line[0] == 'y') break;
+        if (sscanf(line, "thread %2d line %5d end", &id, &n) != 2
+            || id < 0 || id >= N_THREADS || n != next[id]) { intact = 0; break; }
+        next[id]++;
+        lines++;
+    }
+    check_true("records intact and ordered per thread", intact);
+    check_ret("all records written", lines, (long)N_THREADS * N_LINES);
+    check_true("truncated record keeps its newline",
+               strlen(line) == UPRINTF_ASYNC_SLOT_SIZE - 1 && line[UPRINTF_ASYNC_SLOT_SIZE - 2] == '\n');
+    check_ret("queued count", (long)(st.queued - st0.queued), (long)N_THREADS * N_LINES + 1);
+    check_ret("truncated count", (long)(st.truncated - st0.truncated), 1);
+    check_ret("nothing dropped", (long)(st.dropped - st0.dropped), 0);
+
+    uprintf_async_stop();
+    check_ret("flush after stop", uprintf_async_flush(), -1);
+    fclose(g_out);
+}
+
+/* Producers still running when the writer stops: every record is written */
+static void test_stop_race(void) {
+    pthread_t th[N_THREADS];
+    int ids[N_THREADS];
+    char line[64];
+    long lines = 0;
+    int i;
+
+    g_out = tmpfile();
+    if (g_out == NULL) return;
+    /* Calls after the stop print through stdio: keep their lines whole */
+    setvbuf(g_out, NULL, _IOLBF, 0);
+    uprintf_async_start(UPRINTF_ASYNC_BLOCK);
+    for (i = 0; i < N_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&th[i], NULL, producer, &ids[i]);
+    }
+    uprintf_async_stop();
+    for (i = 0; i < N_THREADS; i++) pthread_join(th[i], NULL);
+    fflush(g_out);
+
+    rewind(g_out);
+    while (fgets(line, sizeof(line), g_out) != NULL)
+        if (strncmp(line, "thread ", 7) == 0) lines++;
+    check_ret("stop during output: no record lost", lines, (long)N_THREADS * N_LINES);
+    fclose(g_out);
+}
+
+static int g_spin_stop;
+static int g_flushed;
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+/* Keeps the ring busy until g_spin_stop */
+static void *spinner(void *arg) {
+    int id = *(const int *)arg, i = 0;
+    while (!__atomic_load_n(&g_spin_stop, __ATOMIC_ACQUIRE))
+        ufprintf_async(g_out, "spin %02d %d\n", id, i++);
+    return NULL;
+}
+
+static void *flusher(void *arg) {
+    (void)arg;
+    uprintf_async_flush();
+    __atomic_store_n(&g_flushed, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Reads a pipe slowly, so the writer keeps blocking and the ring stays full */
+static void *slow_reader(void *arg) {
+    int fd = *(const int *)arg;
+    char buf[64];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        if (!__atomic_load_n(&g_spin_stop, __ATOMIC_ACQUIRE)) sleep_ms(1);
+    return NULL;
+}
+
+/* uprintf_async_flush() must return while producers keep the ring non-empty */
+static void test_flush_under_load(void) {
+    pthread_t th[N_THREADS], fl, reader;
+    int ids[N_THREADS], fds[2];
+    int i, waited;
+
+    if (pipe(fds) != 0) return;
+    g_out = fdopen(fds[1], "w");
+    if (g_out == NULL) return;
+    g_spin_stop = g_flushed = 0;
+    pthread_create(&reader, NULL, slow_reader, &fds[0]);
+    uprintf_async_start(UPRINTF_ASYNC_BLOCK);
+    for (i = 0; i < N_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&th[i], NULL, spinner, &ids[i]);
+    }
+    sleep_ms(20);
+    pthread_create(&fl, NULL, flusher, NULL);
+    for (waited = 0; waited < 500 && !__atomic_load_n(&g_flushed, __ATOMIC_ACQUIRE); waited++)
+        sleep_ms(10);
+    check_true("flush returns while producers keep the ring full",
+               __atomic_load_n(&g_flushed, __ATOMIC_ACQUIRE));
+
+    __atomic_store_n(&g_spin_stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < N_THREADS; i++) pthread_join(th[i], NULL);
+    pthread_join(fl, NULL);
+    uprintf_async_stop();
+    fclose(g_out);
+    pthread_join(reader, NULL);
+    close(fds[0]);
+}
+
+/* Reads a pipe until EOF, keeping the last line seen */
+typedef struct {
+    int  fd;
+    long bytes;
+    long lines;
+    int  ordered;
+    long last;
+} pipe_reader;
+
+static void *read_pipe(void *arg) {
+    pipe_reader *pr = (pipe_reader *)arg;
+    FILE *in = fdopen(pr->fd, "r");
+    char line[64];
+    long seq;
+    pr->last = -1;
+    pr->ordered = 1;
+    while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+        pr->bytes += (long)strlen(line);
+        pr->lines++;
+        if (sscanf(line, "rec %ld", &seq) != 1 || seq <= pr->last) pr->ordered = 0;
+        pr->last = seq;
+    }
+    if (in != NULL) fclose(in);
+    return NULL;
+}
+
+/*
+ * Nobody reads the pipe while the records are produced: the writer blocks
+ * once the pipe is full and the ring overflows.
+ */
+static void run_overflow(int policy, long count, long *rejected, pipe_reader *pr, size_t *dropped) {
+    int fds[2];
+    FILE *w;
+    pthread_t reader;
+    long i;
+    uprintf_async_stats st0;
+
+    memset(pr, 0, sizeof(*pr));
+    *rejected = 0;
+    if (pipe(fds) != 0) return;
+    w = fdopen(fds[1], "w");
+    pr->fd = fds[0];
+
+    st0 = uprintf_async_get_stats();
+    uprintf_async_start(policy);
+    for (i = 0; i < count; i++)
+        if (ufprintf_async(w, "rec %08ld\n", i) < 0) (*rejected)++;
+
+    pthread_create(&reader, NULL, read_pipe, pr);
+    uprintf_async_stop();
+    fclose(w);
+    pthread_join(reader, NULL);
+    *dropped = uprintf_async_get_stats().dropped - st0.dropped;
+}
+
+static void test_drop_policy(void) {
+    pipe_reader pr;
+    long rejected;
+    size_t dropped = 0;
+
+    run_overflow(UPRINTF_ASYNC_DROP, 100000, &rejected, &pr, &dropped);
+    check_true("drop: records dropped", rejected > 0);
+    check_ret("drop: counter matches rejected calls", (long)dropped, rejected);
+    check_ret("drop: accepted records written", pr.lines, 100000 - rejected);
+    check_true("drop: survivors in order", pr.ordered);
+}
+
+static void test_overwrite_policy(void) {
+    pipe_reader pr;
+    long rejected;
+    size_t dropped = 0;
+
+    run_overflow(UPRINTF_ASYNC_OVERWRITE, 100000, &rejected, &pr, &dropped);
+    check_ret("overwrite: no call rejected", rejected, 0);
+    check_true("overwrite: oldest records discarded", dropped > 0);
+    check_ret("overwrite: survivors written", pr.lines, 100000 - (long)dropped);
+    check_true("overwrite: survivors in order", pr.ordered);
+    check_ret("overwrite: newest record kept", pr.last, 99999);
+}
+
+#endif /* UPRINTF__ASYNC_ON */
+
+int main(void) {
+    printf("=== uprintf async output tests ===\n\n");
+
+#if defined(UPRINTF__ASYNC_ON)
+    printf("[Synchronous fallback]\n");
+    test_sync_fallback();
+    printf("\n[Block policy]\n");
+    test_block_policy();
+    test_stop_race();
+    test_flush_under_load();
+    printf("\n[Drop policy]\n");
+    test_drop_policy();
+    printf("\n[Overwrite policy]\n");
+    test_overwrite_policy();
+#else
+    printf("  (async output not available on this platform)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
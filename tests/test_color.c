@@ -3,11 +3,16 @@
  * Tests color conversions (RGB, Hex, HSL, OKLCH, CSS) and escape generation.
  */
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L    /* setenv */
+#endif
+
 #define UPRINTF_HEADER_ONLY
 #include "uprintf.h"
 #include "uprintf_color.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <wchar.h>
@@ -64,6 +69,29 @@ static void test_rgb(void) {
     /* Clamping */
     uc_fg_rgb(buf, 300, -10, 128);
     check_str("clamped values", buf, "\033[38;2;255;0;128m");
+
+    check_true("fg return length", uc_fg_rgb(buf, 7, 42, 255) == 16);
+    check_true("bg return length", uc_bg_rgb(buf, 255, 255, 255) == 19);
+}
+
+/* Every component value, in every position, matches snprintf */
+static void test_rgb_exhaustive(void) {
+    char buf[UC_SEQ_MAX], expected[UC_SEQ_MAX];
+    wchar_t wbuf[UC_SEQ_MAX];
+    int v, i, len, same = 1, wsame = 1;
+
+    for (v = 0; v < 256 && same; v++) {
+        int r = v, g = (v * 7) & 255, b = 255 - v;
+        len = snprintf(expected, sizeof(expected), "\033[38;2;%d;%d;%dm", r, g, b);
+        same = uc_fg_rgb(buf, r, g, b) == len && strcmp(buf, expected) == 0;
+        same = same && uc_fg_rgb(buf, g, b, r) == (int)strlen(buf);
+        snprintf(expected, sizeof(expected), "\033[48;2;%d;%d;%dm", b, r, g);
+        same = same && uc_bg_rgb(buf, b, r, g) == len && strcmp(buf, expected) == 0;
+        wsame = wsame && uc_wbg_rgb(wbuf, b, r, g) == len;
+        for (i = 0; wsame && i <= len; i++) wsame = wbuf[i] == (wchar_t)(unsigned char)expected[i];
+    }
+    check_true("fg/bg rgb identical to snprintf for 0-255", same);
+    check_true("wide rgb identical to snprintf for 0-255", wsame);
 }
 
 /* ========================================================================== */
@@ -179,6 +207,55 @@ static void test_oklch(void) {
     check_true("oklch bg generates escape", strncmp(buf, "\033[48;2;", 7) == 0);
 }
 
+/* Largest channel difference between a batch result and the scalar path */
+static int batch_error(const unsigned char *got, int r, int g, int b) {
+    int d = abs(got[0] - r), e = abs(got[1] - g), f = abs(got[2] - b);
+    return d > e ? (d > f ? d : f) : (e > f ? e : f);
+}
+
+#define N_BATCH 4099    /* not a multiple of the lane count */
+
+static void test_batch(void) {
+    static float p0[N_BATCH], p1[N_BATCH], p2[N_BATCH];
+    static unsigned char rgb[3 * N_BATCH];
+    int i, r, g, b, err, worst = 0;
+
+    /* OKLCH over the whole gamut and beyond it, hues outside 0-360 included */
+    for (i = 0; i < N_BATCH; i++) {
+        p0[i] = (float)(i % 11) / 10.0f;
+        p1[i] = (float)(i % 7) * 0.07f;
+        p2[i] = (float)(i % 541) * 1.37f - 200.0f;
+    }
+    uc_oklch_to_rgb_batch(p0, p1, p2, rgb, N_BATCH);
+    for (i = 0; i < N_BATCH; i++) {
+        uc__oklch_to_rgb(p0[i], p1[i], p2[i], &r, &g, &b);
+        err = batch_error(rgb + 3 * i, r, g, b);
+        if (err > worst) worst = err;
+    }
+    check_true("oklch batch within 1 of scalar", worst <= 1);
+
+    worst = 0;
+    for (i = 0; i < N_BATCH; i++) {
+        p0[i] = (float)(i % 733) * 0.99f - 360.0f;
+        p1[i] = (float)(i % 13) / 11.0f - 0.05f;
+        p2[i] = (float)(i % 17) / 15.0f - 0.05f;
+    }
+    uc_hsl_to_rgb_batch(p0, p1, p2, rgb, N_BATCH);
+    for (i = 0; i < N_BATCH; i++) {
+        uc__hsl_to_rgb(p0[i], p1[i], p2[i], &r, &g, &b);
+        err = batch_error(rgb + 3 * i, r, g, b);
+        if (err > worst) worst = err;
+    }
+    check_true("hsl batch within 1 of scalar", worst <= 1);
+
+    /* Every entry of the gamma table */
+    for (i = 0, worst = 0; i < 256; i++) {
+        double u = i / 255.0;
+        if (uc__srgb8[i] != (int)(uc__srgb_transfer(u * u) * 255.0 + 0.5)) worst = 1;
+    }
+    check_true("srgb table matches the transfer function", worst == 0);
+}
+
 /* ========================================================================== */
 /*  CSS named colors tests                                                    */
 /* ========================================================================== */
@@ -225,6 +302,182 @@ static void test_css(void) {
     check_rgb("css unknown -> black", buf, 0, 0, 0);
 }
 
+/* Every entry of the table is found by its name, in any case, and nothing else is */
+static void test_css_table(void) {
+    char upper[UC__CSS_NAME_MAX + 2];
+    int r, g, b, ok = 1, miss = 1;
+    size_t s, i, pool = 0;
+
+    for (s = 0; s < UC__CSS_COLOR_COUNT && ok; s++) {
+        const uc__css_color *e = &uc__css_colors[s];
+        const char *name = uc__css_names + e->off;
+        ok = strlen(name) == e->len
+            && uc__css_lookup(name, &r, &g, &b) == 0 && r == e->r && g == e->g && b == e->b;
+        for (i = 0; i <= e->len; i++)
+            upper[i] = (char)(name[i] >= 'a' && name[i] <= 'z' ? name[i] - 32 : name[i]);
+        ok = ok && uc__css_lookup(upper, &r, &g, &b) == 0 && r == e->r && g == e->g && b == e->b;
+        pool += e->len + 1u;
+    }
+    check_true("css every name resolves to its entry", ok && pool + 1 == sizeof(uc__css_names));
+
+    miss = miss && uc__css_lookup("", &r, &g, &b) == -1;
+    miss = miss && uc__css_lookup("re", &r, &g, &b) == -1;
+    miss = miss && uc__css_lookup("redd", &r, &g, &b) == -1;
+    miss = miss && uc__css_lookup("aliceblu", &r, &g, &b) == -1;
+    miss = miss && uc__css_lookup("lightgoldenrodyellowx", &r, &g, &b) == -1;
+    miss = miss && uc__css_lookup("red\xc3\xa9", &r, &g, &b) == -1;
+    check_true("css near misses are rejected", miss && r == 0 && g == 0 && b == 0);
+}
+
+/* ========================================================================== */
+/*  Style state tests                                                         */
+/* ========================================================================== */
+
+/* Apply an SGR sequence to `term` the way a terminal would; 0 if malformed */
+static int apply_sgr(uc_style *term, const char *seq) {
+    unsigned v[64];
+    int n = 0, i;
+    if (seq[0] == '\0') return 1;
+    if (strncmp(seq, "\033[", 2) != 0) return 0;
+    for (seq += 2; n < 64; seq++) {
+        char *end;
+        v[n++] = (unsigned)strtoul(seq, &end, 10);
+        seq = end;
+        if (*seq == 'm') break;
+        if (*seq != ';') return 0;
+    }
+    if (seq[1] != '\0') return 0;
+    for (i = 0; i < n; i++) {
+        unsigned c = v[i];
+        if (c == 0) { term->fg = term->bg = UC_COLOR_DEFAULT; term->attrs = 0; }
+        else if (c == 22) term->attrs &= ~(UC_ATTR_BOLD | UC_ATTR_DIM);
+        else if (c == 39) term->fg = UC_COLOR_DEFAULT;
+        else if (c == 49) term->bg = UC_COLOR_DEFAULT;
+        else if ((c == 38 || c == 48) && i + 4 < n && v[i + 1] == 2) {
+            uint32_t rgb = UC_RGB(v[i + 2], v[i + 3], v[i + 4]);
+            if (c == 38) term->fg = rgb; else term->bg = rgb;
+            i += 4;
+        } else {
+            int k, found = 0;
+            for (k = 0; k < 8; k++) {
+                if (c == uc__attr_on[k]) { term->attrs |= 1u << k; found = 1; }
+                else if (c == uc__attr_off[k] && c != 22) { term->attrs &= ~(1u << k); found = 1; }
+            }
+            if (!found) return 0;
+        }
+    }
+    return 1;
+}
+
+static void test_style_state(void) {
+    uc_state st = {{0, 0, 0}, 0};
+    uc_style red = { UC_RGB(255, 0, 0), UC_COLOR_DEFAULT, UC_ATTR_BOLD };
+    uc_style red_on_blue = { UC_RGB(255, 0, 0), UC_RGB(0, 0, 255), UC_ATTR_BOLD };
+    uc_style both = { UC_RGB(255, 0, 0), UC_RGB(0, 0, 255), UC_ATTR_BOLD | UC_ATTR_DIM };
+    uc_style dim = { UC_RGB(255, 0, 0), UC_RGB(0, 0, 255), UC_ATTR_DIM };
+    uc_style plain = { UC_COLOR_DEFAULT, UC_COLOR_DEFAULT, 0 };
+    uc_style term = plain;
+    char buf[UC_STYLE_MAX];
+    wchar_t wbuf[UC_STYLE_MAX];
+    unsigned seed = 7u;
+    int i, len, ok = 1, longest = 0;
+
+    uc_emit_style(&st, buf, &red);
+    check_str("style first emit resets", buf, "\033[0;1;38;2;255;0;0m");
+    check_true("style unchanged emits nothing", uc_emit_style(&st, buf, &red) == 0 && buf[0] == '\0');
+    uc_emit_style(&st, buf, &red_on_blue);
+    check_str("style only the new background", buf, "\033[48;2;0;0;255m");
+    uc_emit_style(&st, buf, &both);
+    uc_emit_style(&st, buf, &dim);
+    check_str("style bold off keeps dim", buf, "\033[22;2m");
+    len = uc_emit_style(&st, buf, &plain);
+    check_true("style back to plain is a reset", len == 4 && strcmp(buf, UC_RESET) == 0);
+    uc_state_invalidate(&st);
+    check_true("style invalidate forces a sequence", uc_emit_style(&st, buf, &plain) == 4);
+    len = uc_wemit_style(&st, wbuf, &red);
+    check_true("wide style emit", len == 17 && wcscmp(wbuf, L"\033[1;38;2;255;0;0m") == 0);
+
+    /* Random walk: the terminal always ends up in the requested style */
+    uc_state_init(&st);
+    for (i = 0; i < 20000 && ok; i++) {
+        uc_style want;
+        seed = seed * 1103515245u + 12345u;
+        want.attrs = seed >> 8 & 0xFFu;
+        want.fg = (seed >> 16 & 3u) == 0 ? UC_COLOR_DEFAULT : UC_RGB(seed >> 3, seed >> 11, seed >> 19);
+        seed = seed * 1103515245u + 12345u;
+        want.bg = (seed >> 16 & 3u) == 0 ? UC_COLOR_DEFAULT : UC_RGB(seed >> 5, seed >> 13, seed >> 21);
+        len = uc_emit_style(&st, buf, &want);
+        if (len > longest) longest = len;
+        ok = len == (int)strlen(buf) && apply_sgr(&term, buf)
+            && term.fg == want.fg && term.bg == want.bg && term.attrs == want.attrs;
+    }
+    check_true("style random walk tracks the terminal", ok && longest < UC_STYLE_MAX);
+}
+
+/* ========================================================================== */
+/*  Color depth tests                                                         */
+/* ========================================================================== */
+
+static void test_depth(void) {
+    char buf[UC_SEQ_MAX];
+    wchar_t wbuf[UC_SEQ_MAX];
+    uc_state st = {{0, 0, 0}, 0};
+    uc_style red = { UC_RGB(255, 0, 0), UC_COLOR_DEFAULT, UC_ATTR_BOLD };
+    int i, same = 1;
+
+#if !defined(_WIN32)
+    setenv("NO_COLOR", "1", 1);
+    setenv("COLORTERM", "truecolor", 1);
+    check_true("detect NO_COLOR wins", uc__detect_depth() == UC_DEPTH_NONE);
+    unsetenv("NO_COLOR");
+    check_true("detect COLORTERM=truecolor", uc__detect_depth() == UC_DEPTH_TRUECOLOR);
+    unsetenv("COLORTERM");
+    setenv("TERM", "xterm-256color", 1);
+    check_true("detect TERM=xterm-256color", uc__detect_depth() == UC_DEPTH_256);
+    setenv("TERM", "xterm", 1);
+    check_true("detect TERM=xterm", uc__detect_depth() == UC_DEPTH_16);
+    setenv("TERM", "dumb", 1);
+    check_true("detect TERM=dumb", uc__detect_depth() == UC_DEPTH_NONE);
+#endif
+    check_true("unknown depth rejected", uc_set_color_depth(7) == -1 && uc_color_depth() == UC_DEPTH_TRUECOLOR);
+
+    uc_set_color_depth(UC_DEPTH_256);
+    check_true("256 fg orange", uc_fg_rgb(buf, 255, 135, 0) == 11 && strcmp(buf, "\033[38;5;208m") == 0);
+    uc_bg_css(buf, "red");
+    check_str("256 bg css red", buf, "\033[48;5;196m");
+    uc_wfg_hex(wbuf, "#000000");
+    check_true("256 wide fg black", wcscmp(wbuf, L"\033[38;5;16m") == 0);
+    /* Grays can land on the ramp; every other cube color is its own nearest */
+    for (i = 0; i < 216; i++) {
+        int r = uc__cube_level[i / 36], g = uc__cube_level[i / 6 % 6], b = uc__cube_level[i % 6];
+        if ((r != g || g != b) && uc__lut[UC__LUT_INDEX(r, g, b)] != 16 + i) same = 0;
+    }
+    check_true("256 cube colors map to themselves", same);
+    uc_emit_style(&st, buf, &red);
+    check_str("256 style", buf, "\033[0;1;38;5;196m");
+
+    uc_set_color_depth(UC_DEPTH_16);
+    uc_fg_rgb(buf, 255, 0, 0);
+    check_str("16 fg bright red", buf, "\033[91m");
+    uc_fg_rgb(buf, 205, 0, 0);
+    check_str("16 fg red", buf, "\033[31m");
+    uc_bg_rgb(buf, 0, 0, 238);
+    check_str("16 bg blue", buf, "\033[44m");
+    uc_bg_hsl(buf, 0.0, 0.0, 1.0);
+    check_str("16 bg bright white", buf, "\033[107m");
+    uc_state_invalidate(&st);
+    uc_emit_style(&st, buf, &red);
+    check_str("16 style", buf, "\033[0;1;91m");
+
+    uc_set_color_depth(UC_DEPTH_NONE);
+    check_true("none fg is empty", uc_fg_oklch(buf, 0.6, 0.2, 30.0) == 0 && buf[0] == '\0');
+    uc_state_invalidate(&st);
+    uc_emit_style(&st, buf, &red);
+    check_str("none style keeps attributes", buf, "\033[0;1m");
+
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);
+}
+
 /* ========================================================================== */
 /*  Wide variants tests                                                       */
 /* ========================================================================== */
@@ -303,19 +556,28 @@ static void test_visual_demo(void) {
 
 int main(void) {
     uc_init();
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);   /* expected sequences are 24-bit */
 
     printf("=== uprintf color tests ===\n\n");
 
     printf("[RGB]\n");
     test_rgb();
+    test_rgb_exhaustive();
     printf("\n[Hex]\n");
     test_hex();
     printf("\n[HSL]\n");
     test_hsl();
     printf("\n[OKLCH]\n");
     test_oklch();
+    printf("\n[Batch conversion]\n");
+    test_batch();
     printf("\n[CSS named colors]\n");
     test_css();
+    test_css_table();
+    printf("\n[Style state]\n");
+    test_style_state();
+    printf("\n[Color depth]\n");
+    test_depth();
     printf("\n[Wide variants]\n");
     test_wide();
     printf("\n[Compile-time macros]\n");
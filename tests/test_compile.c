@@ -0,0 +1,196 @@
+/*
+ * test_compile.c — Tests for pre-compiled formats (uprintf_compile/exec)
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <wchar.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got, expected); g_fail++; }
+}
+
+static void check_ret(const char *test_name, int got, int expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %d, expected %d\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+/* Compile fmt, run it, and compare with vsnprintf on the same arguments */
+static void check_exec(const char *test_name, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
+#endif
+;
+
+static void check_exec(const char *test_name, const char *fmt, ...) {
+    uprintf_program prog;
+    char want[256], got[256];
+    va_list ap, aq;
+    int want_ret, got_ret = -1;
+
+    va_start(ap, fmt);
+    va_copy(aq, ap);
+    want_ret = vsnprintf(want, sizeof(want), fmt, ap);
+    got[0] = '\0';
+    if (uprintf_compile_narrow(&prog, fmt) == 0)
+        got_ret = uprintf_vexec_narrow(got, sizeof(got), &prog, aq);
+    va_end(aq);
+    va_end(ap);
+
+    printf("  [TEST] %s... ", test_name);
+    if (want_ret == got_ret && strcmp(want, got) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got [%d] \"%s\", expected [%d] \"%s\"\n", got_ret, got, want_ret, want); g_fail++; }
+}
+
+static void test_compile(void) {
+    uprintf_program prog;
+
+    check_ret("compile plain literal", uprintf_compile_narrow(&prog, "hello"), 0);
+    check_true("plain literal is one op", prog.count == 1 && prog.ops[0].kind == UPRINTF__OP_LITERAL);
+
+    check_ret("compile mixed format", uprintf_compile_narrow(&prog, "a=%d b=%-5s"), 0);
+    check_true("mixed format op count", prog.count == 4);
+    check_true("decoded flags/width", prog.ops[3].spec.flags == UPRINTF__F_LEFT && prog.ops[3].spec.width == 5);
+
+    uprintf_compile_narrow(&prog, "100%% sure");
+    check_true("%% merged into literal run", prog.count == 2);
+
+    check_ret("compile rejects %n", uprintf_compile_narrow(&prog, "x%n"), -1);
+    check_ret("compile rejects %ln", uprintf_compile_narrow(&prog, "%5ln"), -1);
+    check_ret("compile rejects positional", uprintf_compile_narrow(&prog, "%1$d"), -1);
+    check_ret("compile rejects trailing %", uprintf_compile_narrow(&prog, "abc%"), -1);
+    check_ret("compile rejects NULL", uprintf_compile_narrow(&prog, NULL), -1);
+    check_true("failed compile leaves empty program", prog.count == 0);
+    check_ret("compile rejects wide %n", uprintf_compile_wide(&prog, L"%n"), -1);
+}
+
+static void test_op_limit(void) {
+    uprintf_program prog;
+    char fmt[UPRINTF_PROGRAM_MAX_OPS * 2 + 4];
+    size_t i;
+
+    /* "%d%d..." with one conversion too many */
+    for (i = 0; i <= UPRINTF_PROGRAM_MAX_OPS; i++) { fmt[2 * i] = '%'; fmt[2 * i + 1] = 'd'; }
+    fmt[2 * i] = '\0';
+    check_ret("too many ops rejected", uprintf_compile_narrow(&prog, fmt), -1);
+
+    fmt[2 * UPRINTF_PROGRAM_MAX_OPS] = '\0';
+    check_ret("exactly max ops accepted", uprintf_compile_narrow(&prog, fmt), 0);
+}
+
+static void test_exec_narrow(void) {
+    uprintf_program prog;
+    char buf[8];
+    int x = 1;
+
+    check_exec("exec ints", "%d %i %u %x %X %o", -42, 7, 42u, 255u, 255u, 8u);
+    check_exec("exec lengths", "%hhd %hd %ld %lld %zu %jd", 300, 70000, -5L, LLONG_MIN, (size_t)9, (intmax_t)-1);
+    check_exec("exec flags", "[%-6d|%06d|%+d|% d|%#x|%#o]", 1, -2, 3, 4, 5u, 6u);
+    check_exec("exec stars", "[%*d|%-*.*s]", 6, 42, 8, 3, "abcdef");
+    check_exec("exec negative star width", "[%*d]", -6, 42);
+    check_exec("exec strings", "%s|%.2s|%c|%5c", "str", "xyz", 'q', 'r');
+    check_exec("exec pointer", "%p %p", (void*)&x, (void*)NULL);
+    check_exec("exec floats", "%f %.2e %g %10.3f", 3.14159, 12345.678, 0.0001, -2.5);
+    check_exec("exec long double", "%.3Lf", (long double)1.125);
+    check_exec("exec wide args", "%ls %lc", L"wide", (wint_t)L'c');
+    check_exec("exec percent", "100%% %d%%", 5);
+
+    uprintf_compile_narrow(&prog, "%s-%s");
+    check_ret("exec truncation return", uprintf_exec_narrow(buf, sizeof(buf), &prog, "abcd", "efgh"), 9);
+    check_str("exec truncation content", buf, "abcd-ef");
+    check_ret("exec count only", uprintf_exec_narrow(NULL, 0, &prog, "ab", "c"), 4);
+
+    /* Programs are reusable */
+    uprintf_compile_narrow(&prog, "#%d");
+    uprintf_exec_narrow(buf, sizeof(buf), &prog, 1);
+    check_str("reuse 1", buf, "#1");
+    uprintf_exec_narrow(buf, sizeof(buf), &prog, 22);
+    check_str("reuse 2", buf, "#22");
+
+#if defined(UPRINTF_HAS_GENERIC)
+    uprintf_compile(&prog, "%d+%d");
+    uprintf_exec(buf, sizeof(buf), &prog, 2, 3);
+    check_str("generic compile/exec", buf, "2+3");
+#endif
+
+    check_ret("exec NULL program", uprintf_exec_narrow(buf, sizeof(buf), NULL), -1);
+    uprintf_compile_wide(&prog, L"%d");
+    check_ret("narrow exec of wide program", uprintf_exec_narrow(buf, sizeof(buf), &prog, 1), -1);
+}
+
+static void test_exec_wide(void) {
+    uprintf_program prog;
+    wchar_t got[128], want[128];
+    wchar_t small[6];
+    int ret;
+
+    uprintf_compile_wide(&prog, L"%ls=%d [%-4lc] %s %5.1f %#x %%");
+    ret = uprintf_exec_wide(got, 128, &prog, L"k", -12, (wint_t)L'v', "narrow", 2.25, 255u);
+    swprintf(want, 128, L"%ls=%d [%-4lc] %s %5.1f %#x %%", L"k", -12, (wint_t)L'v', "narrow", 2.25, 255u);
+    check_true("wide exec matches swprintf", wcscmp(got, want) == 0);
+    check_ret("wide exec return", ret, (int)wcslen(want));
+
+    uprintf_compile_wide(&prog, L"%.3ls|%6ls|%c");
+    uprintf_exec_wide(got, 128, &prog, L"abcdef", L"ab", 'z');
+    check_true("wide exec precision/width", wcscmp(got, L"abc|    ab|z") == 0);
+
+    uprintf_compile_wide(&prog, L"%ls");
+    ret = uprintf_exec_wide(small, 6, &prog, L"truncated");
+    check_true("wide exec truncation content", wcscmp(small, L"trunc") == 0);
+    check_ret("wide exec truncation return", ret, 9);
+
+    uprintf_compile_wide(&prog, L"%.300f");
+    ret = uprintf_exec_wide(got, 128, &prog, 1e300);
+    check_ret("wide exec long conversion return", ret, 301 + 1 + 300);
+    check_true("wide exec long conversion content", wcsncmp(got, L"1000000000", 10) == 0 && wcslen(got) == 127);
+}
+
+static void test_exec_stream(void) {
+    uprintf_program prog;
+    char line[64];
+    FILE *tmp = tmpfile();
+    int ret;
+
+    if (tmp == NULL) return;
+    uprintf_compile_narrow(&prog, "[%s:%d]\n");
+    ret = ufprintf_exec_narrow(tmp, &prog, "stream", 7);
+    check_ret("ufprintf_exec_narrow return", ret, 11);
+    rewind(tmp);
+    if (fgets(line, sizeof(line), tmp) == NULL) line[0] = '\0';
+    check_str("ufprintf_exec_narrow content", line, "[stream:7]\n");
+    fclose(tmp);
+}
+
+int main(void) {
+    printf("=== uprintf compiled format tests ===\n\n");
+
+    printf("[Compile]\n");
+    test_compile();
+    printf("\n[Operation limit]\n");
+    test_op_limit();
+    printf("\n[Exec narrow]\n");
+    test_exec_narrow();
+    printf("\n[Exec wide]\n");
+    test_exec_wide();
+    printf("\n[Exec stream]\n");
+    test_exec_stream();
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * test_deferred.c — Tests for deferred binary logging (ulog_deferred)
+ *
+ * Built with UPRINTF_DEFERRED and -pthread. Every record is also formatted
+ * with snprintf; the decoded log must match that text byte for byte.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <wchar.h>
+
+#if defined(UPRINTF__DLOG_ON)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__DLOG_ON)
+
+static char g_path[64];
+static char g_expected[8192];
+static size_t g_exp_len;
+
+/* Log a record and append what snprintf makes of it to g_expected */
+#define LOG_BOTH(...) do {                                                    \
+    int r_ = ulog_deferred(__VA_ARGS__);                                      \
+    if (r_ != 0) printf("  ulog_deferred failed at line %d\n", __LINE__);     \
+    g_exp_len += (size_t)snprintf(g_expected + g_exp_len,                     \
+                                  sizeof(g_expected) - g_exp_len, __VA_ARGS__); \
+} while (0)
+
+static int open_log(void) {
+    snprintf(g_path, sizeof(g_path), "/tmp/uprintf_dlog_%ld.ulog", (long)getpid());
+    return ulog_open(g_path);
+}
+
+/* Decode g_path into a malloc'd string */
+static char *decode_log(long *records) {
+    FILE *in = fopen(g_path, "rb");
+    FILE *out = tmpfile();
+    char *text = NULL;
+    long size;
+
+    *records = -1;
+    if (in == NULL || out == NULL) goto done;
+    *records = ulog_decode(in, out);
+    size = ftell(out);
+    text = (char *)malloc((size_t)(size > 0 ? size : 0) + 1);
+    if (text == NULL) goto done;
+    rewind(out);
+    text[fread(text, 1, (size_t)(size > 0 ? size : 0), out)] = '\0';
+done:
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    return text;
+}
+
+static void test_roundtrip(void) {
+    int x = 0;
+    long records;
+    char *text;
+
+    check_ret("no log open", ulog_deferred("closed %d\n", 1), -1);
+    check_ret("open", open_log(), 0);
+
+    g_exp_len = 0;
+    LOG_BOTH("plain literal\n");
+    LOG_BOTH("ints %d %i %d %hhd %hd\n", 0, -42, INT_MIN, 300, 70000);
+    LOG_BOTH("longs %ld %lld %jd %zu %td\n", LONG_MIN, LLONG_MAX, (intmax_t)-7, (size_t)123, (ptrdiff_t)-9);
+    LOG_BOTH("unsigned %u %x %#X %#o %lu %llx\n", 4000000000u, 255u, 255u, 8u, ULONG_MAX, 0xdeadbeefcafeULL);
+    LOG_BOTH("flags [%-6d|%06d|%+d|% d]\n", 1, -2, 3, 4);
+    LOG_BOTH("stars [%*d|%-*.*s|%*d]\n", 6, 42, 8, 3, "abcdef", -5, 7);
+    LOG_BOTH("strings %s|%.2s|%10s|%-4s|\n", "str", "xyz", "right", "l");
+    LOG_BOTH("chars %c%c %3c\n", 'o', 'k', 'z');
+    LOG_BOTH("wide %ls %lc %.2ls\n", L"wide", (wint_t)L'w', L"abc");
+    LOG_BOTH("floats %f %.2e %g %10.3f %a\n", 3.14159, 12345.678, 0.0001, -2.5, 1.0);
+    LOG_BOTH("long double %.3Lf %Lg\n", (long double)1.125, (long double)-2.5);
+    LOG_BOTH("pointer %p %p\n", (void *)&x, (void *)NULL);
+    LOG_BOTH("percent 100%% %d%%\n", 5);
+    for (x = 0; x < 3; x++) LOG_BOTH("repeat %d\n", x);
+
+    check_ret("%n format rejected", ulog_deferred("bad%n\n", &x), -1);
+    check_ret("close", ulog_close(), 0);
+
+    text = decode_log(&records);
+    check_ret("records decoded", records, 16);
+    check_true("decoded text matches snprintf", text != NULL && strcmp(text, g_expected) == 0);
+    if (text != NULL && strcmp(text, g_expected) != 0) printf("--- got ---\n%s--- want ---\n%s", text, g_expected);
+    free(text);
+    remove(g_path);
+}
+
+static void test_formats_per_file(void) {
+    FILE *in;
+    unsigned char data[512];
+    size_t size, pos;
+    int defs = 0, i, j;
+
+    /* Same call site across two files: the definition is in each, once */
+    for (i = 0; i < 2; i++) {
+        open_log();
+        for (j = 0; j < 3; j++) ulog_deferred("site %d\n", j);
+        ulog_close();
+    }
+    in = fopen(g_path, "rb");
+    size = in != NULL ? fread(data, 1, sizeof(data), in) : 0;
+    if (in != NULL) fclose(in);
+    for (pos = 16; pos + 8 <= size; ) {
+        uint32_t word, len;
+        memcpy(&word, data + pos, 4);
+        memcpy(&len, data + pos + 4, 4);
+        if (word & 0x80000000u) defs++;
+        pos += 8 + len;
+    }
+    check_ret("one definition per file", defs, 1);
+    check_ret("file fully parsed", (long)pos, (long)size);
+    remove(g_path);
+}
+
+static void test_oversized(void) {
+    char *big = (char *)malloc(UPRINTF_DEFERRED_BUF_SIZE + 1);
+    if (big == NULL) return;
+    memset(big, 'x', UPRINTF_DEFERRED_BUF_SIZE);
+    big[UPRINTF_DEFERRED_BUF_SIZE] = '\0';
+    open_log();
+    check_ret("record larger than the buffer", ulog_deferred("%s\n", big), -1);
+    check_ret("short record after it", ulog_deferred("%.4s\n", big), 0);
+    ulog_close();
+    remove(g_path);
+    free(big);
+}
+
+#define N_THREADS 4
+#define N_LINES   5000
+
+static void *producer(void *arg) {
+    int id = *(const int *)arg;
+    int i;
+    for (i = 0; i < N_LINES; i++)
+        ulog_deferred("thread %d line %d %s\n", id, i, "payload");
+    return NULL;    /* the thread-exit hook writes the rest */
+}
+
+static void test_threads(void) {
+    pthread_t th[N_THREADS];
+    int ids[N_THREADS], next[N_THREADS] = {0};
+    int i, id, n, ordered = 1;
+    long records, lines = 0;
+    char *text, *line;
+
+    open_log();
+    for (i = 0; i < N_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&th[i], NULL, producer, &ids[i]);
+    }
+    for (i = 0; i < N_THREADS; i++) pthread_join(th[i], NULL);
+    ulog_close();
+
+    text = decode_log(&records);
+    for (line = text; line != NULL && *line; line = strchr(line, '\n') + 1) {
+        if (sscanf(line, "thread %d line %d payload", &id, &n) != 2
+            || id < 0 || id >= N_THREADS || n != next[id]) { ordered = 0; break; }
+        next[id]++;
+        lines++;
+    }
+    check_ret("threaded records decoded", records, (long)N_THREADS * N_LINES);
+    check_true("threaded records ordered per thread", ordered && lines == records);
+    free(text);
+    remove(g_path);
+}
+
+/* One call site shared by the threads below */
+static int log_shared(int id, int i) {
+    return ulog_deferred("shared %d %d\n", id, i);
+}
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cv = PTHREAD_COND_INITIALIZER;
+static int g_logged, g_release;
+
+/* Logs the site first, then stays alive with the record still buffered */
+static void *first_logger(void *arg) {
+    (void)arg;
+    log_shared(0, 0);
+    pthread_mutex_lock(&g_mu);
+    g_logged = 1;
+    pthread_cond_broadcast(&g_cv);
+    while (!g_release) pthread_cond_wait(&g_cv, &g_mu);
+    pthread_mutex_unlock(&g_mu);
+    return NULL;
+}
+
+static void *bulk_logger(void *arg) {
+    int i;
+    (void)arg;
+    for (i = 0; i < N_LINES; i++) log_shared(1, i);
+    ulog_flush();
+    return NULL;
+}
+
+static void test_close_other_threads(void) {
+    pthread_t a, b;
+    long records;
+    char *text;
+
+    open_log();
+    g_logged = g_release = 0;
+    pthread_create(&a, NULL, first_logger, NULL);
+    pthread_mutex_lock(&g_mu);
+    while (!g_logged) pthread_cond_wait(&g_cv, &g_mu);
+    pthread_mutex_unlock(&g_mu);
+    pthread_create(&b, NULL, bulk_logger, NULL);
+    pthread_join(b, NULL);
+
+    /* The definition went out with the first record; a's record is still buffered */
+    check_ret("close with a thread still buffering", ulog_close(), 0);
+    pthread_mutex_lock(&g_mu);
+    g_release = 1;
+    pthread_cond_broadcast(&g_cv);
+    pthread_mutex_unlock(&g_mu);
+    pthread_join(a, NULL);
+
+    text = decode_log(&records);
+    check_ret("records of every thread decoded", records, (long)N_LINES + 1);
+    check_true("buffered record written by close", text != NULL && strstr(text, "shared 0 0\n") != NULL);
+    check_ret("logging after close", log_shared(2, 0), -1);
+    free(text);
+    remove(g_path);
+}
+
+static void test_decode_rejects(void) {
+    FILE *in = tmpfile(), *out = tmpfile();
+    if (in == NULL || out == NULL) return;
+    fputs("not a log file at all", in);
+    rewind(in);
+    check_ret("decode rejects foreign file", ulog_decode(in, out), -1);
+    fclose(in);
+    fclose(out);
+}
+
+/* Append one raw record to f */
+static void put_record(FILE *f, uint32_t word, const void *payload, uint32_t len) {
+    fwrite(&word, 4, 1, f);
+    fwrite(&len, 4, 1, f);
+    fwrite(payload, 1, len, f);
+}
+
+static void test_decode_unknown_id(void) {
+    FILE *in = tmpfile(), *out = tmpfile();
+    unsigned char hdr[UPRINTF__DLOG_HDR_SIZE];
+    int32_t v = 7;
+    char text[64];
+    size_t n;
+
+    if (in == NULL || out == NULL) return;
+    uprintf__dlog_file_header(hdr);
+    fwrite(hdr, 1, sizeof(hdr), in);
+    put_record(in, 5, &v, 4);                           /* never defined */
+    put_record(in, 1 | 0x80000000u, "known %d\n", 9);
+    put_record(in, 1, &v, 4);
+    rewind(in);
+    check_ret("record with an unknown id skipped", ulog_decode(in, out), 1);
+    rewind(out);
+    n = fread(text, 1, sizeof(text) - 1, out);
+    text[n] = '\0';
+    check_true("defined record still decoded", strcmp(text, "known 7\n") == 0);
+    fclose(in);
+    fclose(out);
+}
+
+#endif /* UPRINTF__DLOG_ON */
+
+int main(void) {
+    printf("=== uprintf deferred logging tests ===\n\n");
+
+#if defined(UPRINTF__DLOG_ON)
+    printf("[Round trip]\n");
+    test_roundtrip();
+    printf("\n[Definitions]\n");
+    test_formats_per_file();
+    printf("\n[Oversized record]\n");
+    test_oversized();
+    printf("\n[Threads]\n");
+    test_threads();
+    test_close_other_threads();
+    printf("\n[Decoder]\n");
+    test_decode_rejects();
+    test_decode_unknown_id();
+#else
+    printf("  (deferred logging not available on this platform)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,400 @@
+/*
+ * test_dtoa.c — Tests for shortest round-trip float formatting
+ *
+ * The reference digits come from the C library: the smallest precision
+ * whose correctly rounded "%.*e" reads back (strtod/strtof) as the same
+ * value. Next to that precision's nearest digits, the neighbours one unit
+ * up and down are tried, since the rounding interval is lopsided at
+ * powers of two.
+ *
+ * The fixed-precision path must print exactly what snprintf prints.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <locale.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got, expected); g_fail++; }
+}
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+/* ========================================================================== */
+/*  Reference                                                                 */
+/* ========================================================================== */
+
+static uint64_t g_rng = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next_u64(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static void normalize(uprintf__decimal *d) {
+    while (d->digits != 0 && d->digits % 10 == 0) { d->digits /= 10; d->exp++; }
+}
+
+static int reads_back(uint64_t digits, int exp, double x, int is_float) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%llue%d", (unsigned long long)digits, exp);
+    if (is_float) return strtof(buf, NULL) == (float)x;
+    return strtod(buf, NULL) == x;
+}
+
+/* Shortest digits of a positive finite x from snprintf and strtod */
+static void reference(double x, int is_float, uprintf__decimal *out) {
+    char buf[48];
+    int p;
+
+    for (p = 1; p <= 17; p++) {
+        uint64_t digits = 0;
+        char *e;
+        const char *c;
+        int exp;
+
+        snprintf(buf, sizeof(buf), "%.*e", p - 1, x);
+        e = strchr(buf, 'e');
+        for (c = buf; c < e; c++) if (*c != '.') digits = digits * 10 + (uint64_t)(*c - '0');
+        exp = atoi(e + 1) - (p - 1);
+
+        out->exp = exp;
+        if (reads_back(digits, exp, x, is_float)) out->digits = digits;
+        else if (reads_back(digits + 1, exp, x, is_float)) out->digits = digits + 1;
+        else if (digits > 1 && reads_back(digits - 1, exp, x, is_float)) out->digits = digits - 1;
+        else continue;
+        normalize(out);
+        return;
+    }
+    out->digits = 0;
+}
+
+static int compare_double(double x) {
+    uprintf__decimal got, want;
+    char buf[UPRINTF_DTOA_SHORTEST_MAX];
+
+    uprintf__shortest_double(x, &got);
+    reference(fabs(x), 0, &want);
+    if (got.digits != want.digits || got.exp != want.exp) {
+        printf("\n    %.17g: got %llue%d, expected %llue%d", x, (unsigned long long)got.digits,
+               got.exp, (unsigned long long)want.digits, want.exp);
+        return 1;
+    }
+    uprintf_dtoa_shortest(buf, x);
+    if (strtod(buf, NULL) != x) {
+        printf("\n    %.17g: \"%s\" does not read back", x, buf);
+        return 1;
+    }
+    return 0;
+}
+
+static int compare_float(float x) {
+    uprintf__decimal got, want;
+    char buf[UPRINTF_DTOA_SHORTEST_MAX];
+
+    uprintf__shortest_float(x, &got);
+    reference(fabs((double)x), 1, &want);
+    if (got.digits != want.digits || got.exp != want.exp) {
+        printf("\n    %.9g: got %llue%d, expected %llue%d", (double)x, (unsigned long long)got.digits,
+               got.exp, (unsigned long long)want.digits, want.exp);
+        return 1;
+    }
+    uprintf_ftoa_shortest(buf, x);
+    if (strtof(buf, NULL) != x) {
+        printf("\n    %.9g: \"%s\" does not read back", (double)x, buf);
+        return 1;
+    }
+    return 0;
+}
+
+/* ========================================================================== */
+/*  Digits                                                                    */
+/* ========================================================================== */
+
+#define N_RANDOM 100000
+
+static void test_random_doubles(void) {
+    int i, bad = 0;
+    for (i = 0; i < N_RANDOM && bad < 10; i++) {
+        uint64_t bits = next_u64();
+        double x;
+        memcpy(&x, &bits, sizeof(x));
+        if (isnan(x) || isinf(x) || x == 0) continue;
+        bad += compare_double(x);
+    }
+    if (bad) printf("\n");
+    check_ret("random bit patterns", bad, 0);
+}
+
+static void test_structured_doubles(void) {
+    int e, i, bad = 0;
+
+    /* Every power of two, and its neighbours: the lopsided intervals */
+    for (e = -1074; e <= 1023; e++) {
+        double x = ldexp(1.0, e);
+        bad += compare_double(x);
+        bad += compare_double(nextafter(x, 0));
+        if (e < 1023) bad += compare_double(nextafter(x, INFINITY));
+    }
+    /* Short mantissas at every exponent: exact ties and trailing zeros */
+    for (i = 0; i < 20000; i++) {
+        uint64_t r = next_u64();
+        bad += compare_double(ldexp((double)(r % 100000 + 1), (int)(r >> 32) % 2000 - 1000));
+    }
+    /* Integers, and decimals that are short by construction */
+    for (i = 0; i < 20000; i++) {
+        uint64_t r = next_u64();
+        bad += compare_double((double)(r >> (r & 63)));
+        bad += compare_double((double)(r % 1000000) * pow(10.0, (double)((int)(r >> 40) % 600 - 300)));
+    }
+    /* Subnormals */
+    for (i = 0; i < 20000; i++) {
+        uint64_t bits = next_u64() >> 12;
+        double x;
+        memcpy(&x, &bits, sizeof(x));
+        if (x != 0) bad += compare_double(x);
+    }
+    if (bad) printf("\n");
+    check_ret("powers of two, ties, integers, subnormals", bad, 0);
+}
+
+static void test_floats(void) {
+    int i, e, bad = 0;
+    for (i = 0; i < N_RANDOM && bad < 10; i++) {
+        uint32_t bits = (uint32_t)next_u64();
+        float x;
+        memcpy(&x, &bits, sizeof(x));
+        if (isnan(x) || isinf(x) || x == 0) continue;
+        bad += compare_float(x);
+    }
+    for (e = -149; e <= 127; e++) bad += compare_float(ldexpf(1.0f, e));
+    for (i = 0; i < 20000; i++) {
+        uint64_t r = next_u64();
+        bad += compare_float((float)ldexp((double)(r % 1000 + 1), (int)(r >> 32) % 240 - 140));
+    }
+    if (bad) printf("\n");
+    check_ret("floats", bad, 0);
+}
+
+/* ========================================================================== */
+/*  Text                                                                      */
+/* ========================================================================== */
+
+static void test_text(void) {
+    char buf[UPRINTF_DTOA_SHORTEST_MAX];
+
+    uprintf_dtoa_shortest(buf, 0.1);
+    check_str("0.1", buf, "0.1");
+    uprintf_dtoa_shortest(buf, 1.0 / 3);
+    check_str("1/3", buf, "0.3333333333333333");
+    uprintf_dtoa_shortest(buf, -2.5e-7);
+    check_str("small negative", buf, "-2.5e-07");
+    uprintf_dtoa_shortest(buf, 1e23);
+    check_str("1e23", buf, "1e+23");
+    uprintf_dtoa_shortest(buf, 1e16);
+    check_str("fixed up to 17 digits", buf, "10000000000000000");
+    uprintf_dtoa_shortest(buf, 0.0001);
+    check_str("fixed down to 1e-4", buf, "0.0001");
+    uprintf_dtoa_shortest(buf, 5e-324);
+    check_str("smallest subnormal", buf, "5e-324");
+    check_ret("longest", uprintf_dtoa_shortest(buf, -2.2250738585072014e-308), UPRINTF_DTOA_SHORTEST_MAX - 1);
+    uprintf_dtoa_shortest(buf, -0.0);
+    check_str("negative zero", buf, "-0");
+    uprintf_dtoa_shortest(buf, -HUGE_VAL);
+    check_str("infinity", buf, "-inf");
+    uprintf_dtoa_shortest(buf, NAN);
+    check_str("nan", buf, "nan");
+    uprintf_ftoa_shortest(buf, 0.1f);
+    check_str("float 0.1", buf, "0.1");
+    uprintf_ftoa_shortest(buf, 16777216.0f);
+    check_str("float layout like %.9g", buf, "16777216");
+    uprintf_ftoa_shortest(buf, 3.4028235e38f);
+    check_str("largest float", buf, "3.4028235e+38");
+}
+
+static size_t native(char *buf, size_t n, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    ret = uprintf_native_vsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    return (size_t)ret;
+}
+
+static void test_engine(void) {
+    static char big[400];
+    char buf[128];
+    uprintf_program prog;
+
+    native(buf, sizeof(buf), "%.*g|%.*e|%.*f", UPRINTF_SHORTEST, 0.3, UPRINTF_SHORTEST, 1234.5,
+           UPRINTF_SHORTEST, 1e-7);
+    check_str("g, e and f styles", buf, "0.3|1.2345e+03|0.0000001");
+    native(buf, sizeof(buf), "[%+10.*G][%-7.*g][%08.*g][% .*E]", UPRINTF_SHORTEST, 1e300,
+           UPRINTF_SHORTEST, 2.5, UPRINTF_SHORTEST, -3.25, UPRINTF_SHORTEST, 0.5);
+    check_str("flags and width", buf, "[   +1E+300][2.5    ][-0003.25][ 5E-01]");
+    native(buf, sizeof(buf), "[%#.*g][%5.*f][%.*g]", UPRINTF_SHORTEST, 5.0, UPRINTF_SHORTEST,
+           -HUGE_VAL, UPRINTF_SHORTEST, 1e22);
+    check_str("alt form, infinity, large", buf, "[5.][ -inf][1e+22]");
+    native(big, sizeof(big), "%.*f", UPRINTF_SHORTEST, 5e-324);
+    check_ret("longest fixed", (long)strlen(big), 2 + 323 + 1);
+    native(buf, sizeof(buf), "%.*g %.*s %.*g", -3, 0.1, UPRINTF_SHORTEST, "str", 6, 0.1);
+    check_str("other precisions unchanged", buf, "0.1 str 0.1");
+
+    if (uprintf_compile_narrow(&prog, "v=%.*g\n") == 0) {
+        uprintf_exec_narrow(buf, sizeof(buf), &prog, UPRINTF_SHORTEST, 6.02214076e23);
+        check_str("compiled program", buf, "v=6.02214076e+23\n");
+    }
+}
+
+/* ========================================================================== */
+/*  Fixed precision                                                           */
+/* ========================================================================== */
+
+static int same_as_libc(const char *fmt, int prec, double x) {
+    char got[128], want[128];
+    native(got, sizeof(got), fmt, prec, x);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    snprintf(want, sizeof(want), fmt, prec, x);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+    if (strcmp(got, want) == 0) return 0;
+    printf("\n    \"%s\" %d %.17g: got \"%s\", expected \"%s\"", fmt, prec, x, got, want);
+    return 1;
+}
+
+static const char *const g_fixed_fmts[] = {
+    "%.*f", "%.*e", "%.*g", "%.*E", "%.*G", "%.*F",
+    "%+.*f", "% .*e", "%-12.*g|", "%012.*f", "%#.*g", "%#.*e", "%#.*f", "%+014.*E",
+};
+
+#define N_FMTS (int)(sizeof(g_fixed_fmts) / sizeof(g_fixed_fmts[0]))
+
+/* Values near 10^p, with every magnitude the integer path covers and beyond */
+static double fixed_sample(void) {
+    uint64_t r = next_u64();
+    double x = (double)(r >> 11) / 9007199254740992.0;
+    switch (r & 3) {
+        case 0:  return x * pow(10.0, (double)((int)(r >> 2 & 63) - 30));
+        case 1:  return (double)(r >> 40) / pow(10.0, (double)(r >> 2 & 7));
+        case 2:  return ldexp((double)(r >> 44), (int)(r >> 2 & 31) - 24);
+        default: return -x * pow(10.0, (double)((int)(r >> 2 & 31) - 10));
+    }
+}
+
+static void test_fixed_random(void) {
+    char body[UPRINTF__FIXED_LAYOUT_MAX];
+    int i, f, bad = 0, native_path = 0;
+    for (i = 0; i < 20000 && bad < 10; i++) {
+        double x = fixed_sample();
+        int prec = (int)(next_u64() % (UPRINTF__FIXED_PREC_MAX + 2)) - 1;
+        for (f = 0; f < N_FMTS; f++) bad += same_as_libc(g_fixed_fmts[f], prec, x);
+        native_path += uprintf__fixed_layout(body, x, 'e', prec < 0 ? 6 : prec, 0) >= 0;
+    }
+    if (bad) printf("\n");
+    check_ret("random values, precisions and flags", bad, 0);
+    check_true("most take the integer path", native_path > 15000);
+}
+
+static void test_fixed_edges(void) {
+    static const double vals[] = {
+        0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 1e-5, 9.5, 99.5, 999999.5, 0.05,
+        0.15, 1.005, 2.675, 9.9999995, 99999.95, 1e15, 123456789012345678.0, 1.8e19,
+        1e22, 1e-19, 1e-20, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+        0.1, 1.0 / 3, 2.0 / 3, 1e-4, 9.99999e-5, 123456.0, 1234567.0, 4.35, 1e17 + 0.5,
+    };
+    int i, f, p, bad = 0;
+    for (i = 0; i < (int)(sizeof(vals) / sizeof(vals[0])); i++)
+        for (f = 0; f < N_FMTS; f++)
+            for (p = -1; p <= UPRINTF__FIXED_PREC_MAX + 3; p++) {
+                bad += same_as_libc(g_fixed_fmts[f], p, vals[i]);
+                bad += same_as_libc(g_fixed_fmts[f], p, nextafter(vals[i], 1.0));
+            }
+    for (f = 0; f < N_FMTS; f++) {
+        bad += same_as_libc(g_fixed_fmts[f], 3, HUGE_VAL);
+        bad += same_as_libc(g_fixed_fmts[f], 3, -HUGE_VAL);
+        bad += same_as_libc(g_fixed_fmts[f], 3, NAN);
+    }
+    if (bad) printf("\n");
+    check_ret("ties, carries, zeros, extremes", bad, 0);
+}
+
+static void test_fixed_text(void) {
+    static char big[400];
+    char buf[128];
+    uint64_t r = 0;
+
+    native(buf, sizeof(buf), "%.2f|%.0f|%.0f|%.3e|%g", 0.125, 2.5, 3.5, 9.9996, 100000.0);
+    check_str("ties to even", buf, "0.12|2|4|1.000e+01|100000");
+    native(buf, sizeof(buf), "[%08.2f][%-9.1e][%+G][% 5.0f]", -3.14159, 6.02e23, 1e-10, 0.4);
+    check_str("flags and width", buf, "[-0003.14][6.0e+23  ][+1E-10][    0]");
+    native(big, sizeof(big), "%f %e", 1e300, 1e300);
+    check_ret("out of range falls back", (long)strlen(big), 301 + 7 + 1 + 13);
+    check_ret("scale_round: 2^64 does not fit", uprintf__scale_round(1, 64, 0, &r), -1);
+    check_ret("scale_round: exact tie rounds to even", uprintf__scale_round(5, -1, 0, &r) == 0 ? (long)r : -1, 2);
+}
+
+/* A ',' decimal point goes to libc; skipped when no such locale is installed */
+static void test_fixed_locale(void) {
+    static const char *const names[] = { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8" };
+    char got[64], want[64];
+    size_t i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (setlocale(LC_NUMERIC, names[i]) != NULL) break;
+    if (i == sizeof(names) / sizeof(names[0])) {
+        printf("  (no locale with a ',' decimal point installed)\n");
+        return;
+    }
+    native(got, sizeof(got), "%.2f|%e|%g", 3.25, 0.5, 1.5);
+    snprintf(want, sizeof(want), "%.2f|%e|%g", 3.25, 0.5, 1.5);
+    check_str("locale decimal point", got, want);
+    setlocale(LC_NUMERIC, "C");
+}
+
+int main(void) {
+    printf("=== uprintf shortest float formatting tests ===\n\n");
+
+    printf("[Digits]\n");
+    test_random_doubles();
+    test_structured_doubles();
+    test_floats();
+    printf("\n[Text]\n");
+    test_text();
+    printf("\n[Engine]\n");
+    test_engine();
+    printf("\n[Fixed precision]\n");
+    test_fixed_random();
+    test_fixed_edges();
+    test_fixed_text();
+    test_fixed_locale();
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * test_itoa.c — Tests for the integer conversion primitives
+ *
+ * Every result is compared with snprintf, at every digit-count boundary
+ * and on random values; the engine checks compare the integer
+ * conversions that now go through the kernels.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got, expected); g_fail++; }
+}
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static uint64_t g_rng = 0x2545f4914f6cdd1dull;
+
+static uint64_t next_u64(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+/* All four primitives on v against snprintf; returns the number of mismatches */
+static int compare(uint64_t v) {
+    char got[UPRINTF_U64TOA_MAX], want[32];
+    int bad = 0, n;
+
+    n = uprintf_u64toa(got, v);
+    snprintf(want, sizeof(want), "%" PRIu64, v);
+    bad += strcmp(got, want) != 0 || n != (int)strlen(want);
+
+    n = uprintf_i64toa(got, (int64_t)v);
+    snprintf(want, sizeof(want), "%" PRId64, (int64_t)v);
+    bad += strcmp(got, want) != 0 || n != (int)strlen(want);
+
+    n = uprintf_u64tohex(got, v, (int)(v & 1));
+    snprintf(want, sizeof(want), (v & 1) ? "%" PRIX64 : "%" PRIx64, v);
+    bad += strcmp(got, want) != 0 || n != (int)strlen(want);
+
+    if (v <= UINT32_MAX) {
+        n = uprintf_u32toa(got, (uint32_t)v);
+        snprintf(want, sizeof(want), "%" PRIu32, (uint32_t)v);
+        bad += strcmp(got, want) != 0 || n != (int)strlen(want);
+    }
+    if (bad) printf("\n    %" PRIu64 ": mismatch", v);
+    return bad;
+}
+
+/* ========================================================================== */
+/*  Primitives                                                                */
+/* ========================================================================== */
+
+static void test_boundaries(void) {
+    uint64_t p = 1;
+    int i, bad = 0;
+
+    bad += compare(0);
+    for (i = 0; i < 20; i++) {          /* 10^i - 1, 10^i, 10^i + 1 */
+        bad += compare(p - 1) + compare(p) + compare(p + 1);
+        if (i < 19) p *= 10;
+    }
+    for (i = 0; i < 64; i++) {          /* 2^i - 1, 2^i */
+        bad += compare((1ull << i) - 1) + compare(1ull << i);
+    }
+    bad += compare(UINT64_MAX) + compare((uint64_t)INT64_MAX) + compare((uint64_t)INT64_MIN);
+    bad += compare(UINT32_MAX) + compare((uint64_t)UINT32_MAX + 1);
+    if (bad) printf("\n");
+    check_ret("powers of ten and two", bad, 0);
+}
+
+static void test_random(void) {
+    int i, bad = 0;
+    for (i = 0; i < 200000 && bad < 10; i++) {
+        uint64_t r = next_u64();
+        bad += compare(r >> (r & 63));
+    }
+    if (bad) printf("\n");
+    check_ret("random values of every length", bad, 0);
+}
+
+static void test_text(void) {
+    char buf[UPRINTF_I64TOA_MAX];
+
+    check_ret("u32toa length", uprintf_u32toa(buf, 4294967295u), 10);
+    check_str("u32toa", buf, "4294967295");
+    check_ret("i64toa length", uprintf_i64toa(buf, INT64_MIN), UPRINTF_I64TOA_MAX - 1);
+    check_str("i64toa minimum", buf, "-9223372036854775808");
+    uprintf_i64toa(buf, 0);
+    check_str("zero", buf, "0");
+    check_ret("hex length", uprintf_u64tohex(buf, UINT64_MAX, 0), UPRINTF_HEXTOA_MAX - 1);
+    uprintf_u64tohex(buf, 0xdeadbeefull, 1);
+    check_str("uppercase hex", buf, "DEADBEEF");
+}
+
+/* ========================================================================== */
+/*  Engine                                                                    */
+/* ========================================================================== */
+
+static int native(char *buf, size_t n, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    ret = uprintf_native_vsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+static void test_engine(void) {
+    static const char *const fmts[] = {
+        "%d", "%+d", "% 12d", "%-12d|", "%012d", "%.15d", "%u", "%x", "%#x", "%#X",
+        "%#018X", "%.0d", "%.0x", "%#o", "%o", "%.0o", "%#.0o",
+    };
+    char got[64], want[64];
+    int i, f, bad = 0;
+
+    for (i = 0; i < 20000 && bad < 10; i++) {
+        uint64_t r = next_u64();
+        int v = (int)(r >> (r & 63));
+        long long ll = (long long)(r >> (r >> 6 & 63));
+        for (f = 0; f < (int)(sizeof(fmts) / sizeof(fmts[0])); f++) {
+            native(got, sizeof(got), fmts[f], (r & 7) == 0 ? 0 : v);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+            snprintf(want, sizeof(want), fmts[f], (r & 7) == 0 ? 0 : v);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+            if (strcmp(got, want) != 0) { printf("\n    \"%s\": \"%s\" vs \"%s\"", fmts[f], got, want); bad++; }
+        }
+        native(got, sizeof(got), "%lld|%llu|%llx|%p", ll, (unsigned long long)ll, (unsigned long long)ll, (void *)(uintptr_t)r);
+        snprintf(want, sizeof(want), "%lld|%llu|%llx|%p", ll, (unsigned long long)ll, (unsigned long long)ll, (void *)(uintptr_t)r);
+        if (strcmp(got, want) != 0) { printf("\n    \"%s\" vs \"%s\"", got, want); bad++; }
+    }
+    if (bad) printf("\n");
+    check_ret("integer conversions match snprintf", bad, 0);
+}
+
+int main(void) {
+    printf("=== uprintf integer conversion tests ===\n\n");
+
+    printf("[Primitives]\n");
+    test_boundaries();
+    test_random();
+    test_text();
+    printf("\n[Engine]\n");
+    test_engine();
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * test_latency.c — Tests for output latency histograms (UPRINTF_LATENCY)
+ *
+ * Built with UPRINTF_LATENCY and -pthread. A pipe whose reader starts
+ * late provides one call that blocks for tens of milliseconds.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(UPRINTF__LATENCY_ON)
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__LATENCY_ON)
+
+static void test_buckets(void) {
+    unsigned long long v;
+    int bad = 0;
+
+    for (v = 0; v < (1ull << 41); v = v < 4096 ? v + 1 : v + v / 7 + 1) {
+        unsigned b = uprintf__lat_bucket(v);
+        unsigned long long hi = uprintf__lat_bucket_max(b);
+        if (v >= (1ull << 40)) {
+            if (b != UPRINTF_LATENCY_BUCKETS - 1) bad++;
+            continue;
+        }
+        if (hi < v || (b > 0 && uprintf__lat_bucket_max(b - 1) >= v)) bad++;
+        if (v >= 8 && (double)(hi - v) > (double)v * 0.125) bad++;
+    }
+    check_ret("bucket bounds hold", bad, 0);
+    check_ret("last bucket", (long)uprintf__lat_bucket(~0ull), UPRINTF_LATENCY_BUCKETS - 1);
+}
+
+static void test_percentiles(void) {
+    static uprintf_latency_stats st;
+
+    memset(&st, 0, sizeof(st));
+    check_ret("empty histogram", (long)uprintf_latency_percentile(&st, 99.0), 0);
+    st.buckets[uprintf__lat_bucket(100)] = 990;
+    st.buckets[uprintf__lat_bucket(5000)] = 9;
+    st.buckets[uprintf__lat_bucket(2000000)] = 1;
+    st.count = 1000;
+    st.max_ns = 2000000;
+    check_true("p50", uprintf_latency_percentile(&st, 50.0) == uprintf__lat_bucket_max(uprintf__lat_bucket(100)));
+    check_true("p99.5", uprintf_latency_percentile(&st, 99.5) == uprintf__lat_bucket_max(uprintf__lat_bucket(5000)));
+    check_ret("p100 is the max", (long)uprintf_latency_percentile(&st, 100.0), 2000000);
+}
+
+static void test_counts(void) {
+    uprintf_latency_stats st;
+    FILE *f = tmpfile();
+    int i;
+
+    if (f == NULL) { check_true("tmpfile", 0); return; }
+    uprintf_latency_reset();
+    for (i = 0; i < 1000; i++) ufprintf(f, "line %d\n", i);
+    for (i = 0; i < 10; i++) ufprintf(f, L"wide %d\n", i);
+    fclose(f);
+
+    uprintf_latency_snapshot(&st);
+    check_ret("every call counted", (long)st.count, 1010);
+    check_true("percentiles ordered", st.p50_ns <= st.p99_ns && st.p99_ns <= st.p999_ns && st.p999_ns <= st.max_ns);
+    check_true("total covers the max", st.total_ns >= st.max_ns && st.max_ns > 0);
+}
+
+static int g_read_fd;
+
+/* Start reading only after the writer has been blocked for a while */
+static void *slow_reader(void *arg) {
+    struct timespec ts = { 0, 40 * 1000000L };
+    char buf[4096];
+    (void)arg;
+    nanosleep(&ts, NULL);
+    while (read(g_read_fd, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static void test_blocked_pipe(void) {
+    static char big[256 * 1024];
+    uprintf_latency_stats st;
+    pthread_t reader;
+    FILE *f;
+    int p[2], i;
+
+    if (pipe(p) != 0 || (f = fdopen(p[1], "w")) == NULL) { check_true("pipe", 0); return; }
+    setvbuf(f, NULL, _IONBF, 0);
+    g_read_fd = p[0];
+    memset(big, 'b', sizeof(big) - 1);
+
+    uprintf_latency_reset();
+    pthread_create(&reader, NULL, slow_reader, NULL);
+    ufprintf(f, "%s", big);                 /* larger than the pipe: waits for the reader */
+    for (i = 0; i < 100; i++) ufprintf(f, "%d\n", i);
+    fclose(f);
+    pthread_join(reader, NULL);
+    close(p[0]);
+
+    uprintf_latency_snapshot(&st);
+    check_ret("calls", (long)st.count, 101);
+    check_true("stall reaches the max", st.max_ns >= 20 * 1000000ull);
+    check_true("stall shows at p99.9", st.p999_ns >= 20 * 1000000ull);
+    check_true("median stays fast", st.p50_ns < 5 * 1000000ull);
+}
+
+#define N_THREADS 4
+
+static void *writer(void *arg) {
+    FILE *f = tmpfile();
+    int i;
+    (void)arg;
+    if (f == NULL) return NULL;
+    for (i = 0; i < 500; i++) ufprintf(f, "%s %d\n", "thread", i);
+    fclose(f);
+    return NULL;
+}
+
+static void test_threads(void) {
+    uprintf_latency_stats st;
+    pthread_t t[N_THREADS];
+    int i;
+
+    uprintf_latency_reset();
+    for (i = 0; i < N_THREADS; i++) pthread_create(&t[i], NULL, writer, NULL);
+    for (i = 0; i < N_THREADS; i++) pthread_join(t[i], NULL);
+    uprintf_latency_snapshot(&st);
+    check_ret("merged across threads", (long)st.count, N_THREADS * 500);
+
+    uprintf_latency_reset();
+    uprintf_latency_snapshot(&st);
+    check_ret("reset", (long)st.count, 0);
+}
+
+#endif /* UPRINTF__LATENCY_ON */
+
+int main(void) {
+    printf("=== uprintf latency histogram tests ===\n\n");
+
+#if defined(UPRINTF__LATENCY_ON)
+    printf("[Buckets]\n");
+    test_buckets();
+    test_percentiles();
+    printf("\n[Counting]\n");
+    test_counts();
+    printf("\n[Blocked pipe]\n");
+    test_blocked_pipe();
+    printf("\n[Threads]\n");
+    test_threads();
+#else
+    printf("  (latency histograms not available on this platform)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * test_literal.c — Compile-time %n check for literal formats
+ *
+ * Built with optimization so the literal automaton is folded. With
+ * UPRINTF_TEST_LITERAL_FAIL defined this file must NOT compile: the build
+ * checks that a %n literal is rejected at compile time.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got, expected); g_fail++; }
+}
+
+static void check_ret(const char *test_name, int got, int expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %d, expected %d\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__LIT_CHECK)
+
+static void test_literal_verdicts(void) {
+#if defined(__OPTIMIZE__)
+    check_true("clean literal folded", UPRINTF__LIT_STATE("id=%d name=%-10s") == UPRINTF__LS_CLEAN);
+    check_true("%%n literal is clean", UPRINTF__LIT_STATE("100%%n") == UPRINTF__LS_CLEAN);
+    check_true("wide literal folded", UPRINTF__LIT_STATE(L"%ls=%5.2f") == UPRINTF__LS_CLEAN);
+#endif
+    {
+        const char *ptr = "x%n";
+        check_true("pointer left to run time", UPRINTF__LIT_STATE(ptr) == UPRINTF__LS_UNKNOWN);
+    }
+}
+
+static void test_literal_calls(void) {
+    char buf[64];
+    wchar_t wbuf[64];
+    char fmt_n[8];
+    int ret;
+
+    ret = usnprintf(buf, sizeof(buf), "%s=%04d %%n", "k", 42);
+    check_str("usnprintf literal output", buf, "k=0042 %n");
+    check_ret("usnprintf literal return", ret, 9);
+
+    usprintf(buf, "%c%c", 'o', 'k');
+    check_str("usprintf literal output", buf, "ok");
+
+    usnprintf(wbuf, 64, L"%ls-%d", L"w", 7);
+    check_true("wide literal output", wcscmp(wbuf, L"w-7") == 0);
+
+    check_ret("literal NULL buffer still rejected", usnprintf((char *)NULL, 4, "%s", "x"), -1);
+
+    /* Non-literal formats keep the runtime check */
+    strcpy(fmt_n, "a%n");
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    check_ret("runtime %n still rejected", usnprintf(buf, sizeof(buf), fmt_n, (int *)NULL), -1);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    #pragma GCC diagnostic pop
+#endif
+}
+
+/* The automaton also runs at run time on arrays: check it against the scanner */
+static void test_automaton_differential(void) {
+    static const char alphabet[] = "%%%nnd.*0123lhjztL-+ #xs ab";
+    char fmt[UPRINTF__LIT_SCAN_MAX + 1];
+    unsigned int rng = 99u;
+    int iter, i, len, state, mismatches = 0;
+
+    for (iter = 0; iter < 20000; iter++) {
+        rng = rng * 1103515245u + 12345u;
+        len = (int)((rng >> 16) % UPRINTF__LIT_SCAN_MAX);
+        for (i = 0; i < len; i++) {
+            rng = rng * 1103515245u + 12345u;
+            fmt[i] = alphabet[(rng >> 16) % (sizeof(alphabet) - 1)];
+        }
+        memset(fmt + len, 0, sizeof(fmt) - (size_t)len);
+        state = UPRINTF__LIT_RUN(fmt);
+        if (state != (uprintf__has_percent_n_narrow_scalar(fmt) ? UPRINTF__LS_FOUND : UPRINTF__LS_CLEAN))
+            mismatches++;
+    }
+    check_ret("automaton matches scanner", mismatches, 0);
+}
+
+#endif /* UPRINTF__LIT_CHECK */
+
+#if defined(UPRINTF_TEST_LITERAL_FAIL)
+void uprintf_test_must_not_compile(char *buf);
+void uprintf_test_must_not_compile(char *buf) {
+    usnprintf(buf, 16, "count%n", (int *)NULL);
+}
+#endif
+
+int main(void) {
+    printf("=== uprintf literal format tests ===\n\n");
+
+#if defined(UPRINTF__LIT_CHECK)
+    printf("[Literal verdicts]\n");
+    test_literal_verdicts();
+    printf("\n[Literal calls]\n");
+    test_literal_calls();
+    printf("\n[Automaton differential]\n");
+    test_automaton_differential();
+#else
+    printf("  (compile-time literal check not available)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * test_markup.c — Tests for inline color markup (UPRINTF_MARKUP)
+ *
+ * Built with UPRINTF_MARKUP. Expansions are compared with the sequences
+ * the color functions write for the same colors at the same depth.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+/* Escapes shown as \e so failures stay readable */
+static void show(const char *s) {
+    for (; *s; s++) {
+        if (*s == '\033') printf("\\e");
+        else putchar(*s);
+    }
+}
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; return; }
+    printf("FAIL: got \"");
+    show(got);
+    printf("\", expected \"");
+    show(expected);
+    printf("\"\n");
+    g_fail++;
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__MARKUP_ON)
+
+static char g_buf[1024];
+
+static void test_tags(void) {
+    char exp[256], seq[UC_SEQ_MAX];
+
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);
+    usnprintf(g_buf, sizeof(g_buf), "{bold}{tomato}%s{/} done", "x");
+    check_str("adjacent tags merge", g_buf, "\033[1;38;2;255;99;71mx\033[0m done");
+
+    usnprintf(g_buf, sizeof(g_buf), "{bg:#1E1E2E}{fg:lightgreen}ok{/bold}%d", 5);
+    check_str("fg:, bg: and hex", g_buf, "\033[48;2;30;30;46;38;2;144;238;144mok\033[22m5");
+
+    usnprintf(g_buf, sizeof(g_buf), "{CornflowerBlue}%s", "c");
+    uc_fg_css(seq, "cornflowerblue");
+    snprintf(exp, sizeof(exp), "%sc", seq);
+    check_str("css names are case-insensitive", g_buf, exp);
+
+    usnprintf(g_buf, sizeof(g_buf), "{italic} {underline}{strike}%c{/}", 'x');
+    check_str("attributes", g_buf, "\033[3m \033[4;9mx\033[0m");
+}
+
+static void test_passthrough(void) {
+    usnprintf(g_buf, sizeof(g_buf), "{\"id\": %d, \"tags\": {}}", 7);
+    check_str("JSON braces left alone", g_buf, "{\"id\": 7, \"tags\": {}}");
+
+    usnprintf(g_buf, sizeof(g_buf), "{{bold}} {%d} {nosuchcolor} {#12345} {/nope}", 3);
+    check_str("escaped and unknown tags", g_buf, "{bold}} {3} {nosuchcolor} {#12345} {/nope}");
+
+    usnprintf(g_buf, sizeof(g_buf), "{red}{unknown}{blue}%s", "");
+    check_str("a run stops at an unknown tag", g_buf, "\033[38;2;255;0;0m{unknown}\033[38;2;0;0;255m");
+
+    usnprintf(g_buf, sizeof(g_buf), "%s {bold", "tail");
+    check_str("unterminated tag", g_buf, "tail {bold");
+
+    check_ret("expand counts without output", uprintf_markup_expand(NULL, 0, "{bold}ab"), 6);
+}
+
+static void test_depth(void) {
+    char exp[256], seq[UC_SEQ_MAX];
+
+    uprintf_markup_cache_clear();
+    uc_set_color_depth(UC_DEPTH_256);
+    usnprintf(g_buf, sizeof(g_buf), "{tomato}%c", 't');
+    uc_fg_css(seq, "tomato");
+    snprintf(exp, sizeof(exp), "%st", seq);
+    check_str("256 colors", g_buf, exp);
+
+    uprintf_markup_cache_clear();
+    uc_set_color_depth(UC_DEPTH_16);
+    usnprintf(g_buf, sizeof(g_buf), "{bg:navy}%c", 'n');
+    uc_bg_css(seq, "navy");
+    snprintf(exp, sizeof(exp), "%sn", seq);
+    check_str("16 colors", g_buf, exp);
+
+    uprintf_markup_cache_clear();
+    uc_set_color_depth(UC_DEPTH_NONE);
+    usnprintf(g_buf, sizeof(g_buf), "{red}{bold}a{gold}%c{/}", 'b');
+    check_str("no color keeps attributes", g_buf, "\033[1mab\033[0m");
+
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);
+    uprintf_markup_cache_clear();
+}
+
+#if defined(UPRINTF__MARKUP_CACHE_ON)
+
+static const char *const g_styled = "{bold}{orange}%d{/}";
+
+static void test_cache(void) {
+    char *heap1, *heap2, *heap3;
+    const char *a, *b, *c;
+    char big[600];
+
+    uprintf_markup_cache_clear();
+    a = uprintf__markup(g_styled, &heap1, 1);
+    b = uprintf__markup(g_styled, &heap2, 1);
+    check_true("second lookup hits the cache", a == b && heap1 == NULL && heap2 == NULL);
+    check_str("cached text", a, "\033[1;38;2;255;165;0m%d\033[0m");
+
+    c = uprintf__markup("plain %d\n", &heap3, 1);
+    check_true("format without tags is used as is", c != NULL && strcmp(c, "plain %d\n") == 0 && heap3 == NULL);
+
+    /* Another depth: the entry is refilled in place */
+    uc_set_color_depth(UC_DEPTH_16);
+    c = uprintf__markup(g_styled, &heap3, 1);
+    check_true("other depth refills the entry", c == a && heap3 == NULL && strstr(c, "38;2;") == NULL);
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);
+    c = uprintf__markup(g_styled, &heap3, 1);
+    check_str("refilled again for the first depth", c, "\033[1;38;2;255;165;0m%d\033[0m");
+
+    /* Not a literal: expanded on every call */
+    c = uprintf__markup(g_styled, &heap3, 0);
+    check_true("uncached lookup expands to the heap", c == heap3 && heap3 != NULL);
+    free(heap3);
+
+    /* Longer than UPRINTF_MARKUP_MAX: expanded on every call */
+    memset(big, 'a', sizeof(big) - 8);
+    memcpy(big + sizeof(big) - 8, "{red}b\n", 8);
+    c = uprintf__markup(big, &heap3, 1);
+    check_true("long format goes to the heap", heap3 != NULL && c == heap3 &&
+               strlen(c) == sizeof(big) - 8 + strlen("\033[38;2;255;0;0m") + 2);
+    free(heap3);
+}
+
+#endif /* UPRINTF__MARKUP_CACHE_ON */
+
+/* Formats in buffers are never cached: a reused buffer prints its new format */
+static void test_buffers(void) {
+    char fmt[32];
+
+    strcpy(fmt, "{bold}A=%d\n");
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+    usnprintf(g_buf, sizeof(g_buf), fmt, 1);
+    check_str("buffer format", g_buf, "\033[1mA=1\n");
+    strcpy(fmt, "{bold}B=%s\n");
+    usnprintf(g_buf, sizeof(g_buf), fmt, "str");
+    check_str("rewritten buffer format", g_buf, "\033[1mB=str\n");
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+}
+
+/* A tag dropped at UC_DEPTH_NONE must not let "%{red}n" through as "%n" */
+static void test_percent_n(void) {
+    char fmt[16];
+    int victim = 12345;
+
+    strcpy(fmt, "%{red}n");
+    uprintf_markup_cache_clear();
+    uc_set_color_depth(UC_DEPTH_NONE);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-extra-args"
+#endif
+    check_ret("buffer %{red}n rejected", usnprintf(g_buf, sizeof(g_buf), fmt, &victim), -1);
+    check_ret("literal %{red}n rejected", usnprintf(g_buf, sizeof(g_buf), "x%{red}n", &victim), -1);
+    check_ret("ufprintf %{red}n rejected", ufprintf(stdout, fmt, &victim), -1);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+    check_ret("target untouched", victim, 12345);
+    uc_set_color_depth(UC_DEPTH_TRUECOLOR);
+    uprintf_markup_cache_clear();
+}
+
+static void test_streams(void) {
+    FILE *f = tmpfile();
+    size_t n;
+    int ret;
+
+    if (f == NULL) { check_true("tmpfile", 0); return; }
+    ret = ufprintf(f, "{green}%s{/}\n", "ok");
+    rewind(f);
+    n = fread(g_buf, 1, sizeof(g_buf) - 1, f);
+    g_buf[n] = '\0';
+    check_str("ufprintf expands", g_buf, "\033[38;2;0;128;0mok\033[0m\n");
+    check_ret("ufprintf length", ret, (long)n);
+    fclose(f);
+}
+
+#endif /* UPRINTF__MARKUP_ON */
+
+int main(void) {
+    printf("=== uprintf markup tests ===\n\n");
+
+#if defined(UPRINTF__MARKUP_ON)
+    printf("[Tags]\n");
+    test_tags();
+    printf("\n[Pass-through]\n");
+    test_passthrough();
+    printf("\n[Color depth]\n");
+    test_depth();
+#if defined(UPRINTF__MARKUP_CACHE_ON)
+    printf("\n[Cache]\n");
+    test_cache();
+#endif
+    printf("\n[Buffers and %%n]\n");
+    test_buffers();
+    test_percent_n();
+    printf("\n[Streams]\n");
+    test_streams();
+#else
+    printf("  (markup not enabled)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -1,5 +1,8 @@
 /*
  * test_narrow.c — Tests for uprintf with narrow (char*) format strings
+ *
+ * Also built with -DUPRINTF_NATIVE_ENGINE (test_narrow_native) so the whole
+ * suite runs against the built-in formatting engine.
  */
 
 #define UPRINTF_HEADER_ONLY
@@ -15,6 +18,10 @@
 #include <float.h>
 #include <limits.h>
 
+#if !defined(UPRINTF_WINDOWS)
+#include <unistd.h>
+#endif
+
 static int g_pass = 0;
 static int g_fail = 0;
 
@@ -186,6 +193,174 @@ static void test_return_value(void) {
     check_ret("return value with args", ret, 2);
 }
 
+/* Native engine output must match the platform vsnprintf byte for byte */
+static void check_parity(const char *test_name, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 2, 3)))
+#endif
+;
+
+static void check_parity(const char *test_name, const char *fmt, ...) {
+    char want[256], got[256];
+    va_list ap, aq;
+    int want_ret, got_ret;
+
+    va_start(ap, fmt);
+    va_copy(aq, ap);
+    want_ret = vsnprintf(want, sizeof(want), fmt, ap);
+    got_ret = uprintf_native_vsnprintf(got, sizeof(got), fmt, aq);
+    va_end(aq);
+    va_end(ap);
+
+    printf("  [TEST] %s... ", test_name);
+    if (want_ret == got_ret && strcmp(want, got) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got [%d] \"%s\", expected [%d] \"%s\"\n", got_ret, got, want_ret, want); g_fail++; }
+}
+
+static int native_snprintf(char *buf, size_t n, const char *fmt, ...)
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    __attribute__((format(printf, 3, 4)))
+#endif
+;
+
+static int native_snprintf(char *buf, size_t n, const char *fmt, ...) {
+    va_list ap;
+    int ret;
+    va_start(ap, fmt);
+    ret = uprintf_native_vsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+static void test_native_engine(void) {
+    char small[8];
+    char big[UPRINTF_STACK_BUF_MAX * 2 + 64];
+    FILE *tmp;
+    int x = 42;
+    int ret;
+    size_t len;
+
+    check_parity("parity %d %i %u", "%d %i %u", INT_MIN, INT_MAX, UINT_MAX);
+    check_parity("parity %lld min", "%lld", LLONG_MIN);
+    check_parity("parity %hhd %hd wrap", "%hhd %hd", 200, 40000);
+    check_parity("parity %#o %#x zero", "%#o %#x %#.0o", 0u, 0u, 0u);
+    check_parity("parity %*.*d negative width", "[%*.*d]", -6, 3, 9);
+    check_parity("parity %.*d negative precision", "[%.*d]", -1, 0);
+    check_parity("parity %-6c", "[%-6c|%3c]", 'a', 'b');
+    check_parity("parity %p", "[%p|%20p|%-12p]", (void*)&x, (void*)&x, (void*)NULL);
+    check_parity("parity floats", "%f %e %g %a %10.3Lf", 1.0 / 3.0, 6.02e23, 1e-10, 0.5, (long double)2.5);
+    check_parity("parity %ls %lc", "[%ls|%5lc]", L"wide", (wint_t)L'w');
+
+    /* Deliberately odd formats: glibc extensions and ignored flags */
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-extra-args"
+#endif
+#if defined(UPRINTF_GCC)
+#pragma GCC diagnostic ignored "-Wformat-overflow"
+#endif
+    check_parity("parity %+ d flags", "%+d % d %+ d", 5, 5, 5);
+    check_parity("parity %-08.3d", "[%-08.3d]", -7);
+    check_parity("parity %s NULL", "[%s|%.3s|%8s]", (char*)NULL, (char*)NULL, (char*)NULL);
+    check_parity("parity %p flags", "[%+p|%#018p]", (void*)&x, (void*)&x);
+    check_parity("parity %% width", "[%5%]");
+    check_parity("parity positional fallback", "%2$s %1$s", "world", "hello");
+    check_parity("parity trailing %", "abc %");
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+
+    ret = native_snprintf(small, sizeof(small), "%s", "truncated");
+    check_ret("native truncation return", ret, 9);
+    check_str("native truncation content", small, "truncat");
+
+    /* FILE* output larger than the internal stack buffer */
+    tmp = tmpfile();
+    if (tmp != NULL) {
+        memset(big, 'a', sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+        ret = ufprintf_narrow(tmp, "<%s>%d", big, 7);
+        check_ret("ufprintf long output return", ret, (int)sizeof(big) + 2);
+        len = (size_t)ftell(tmp);
+        check_true("ufprintf long output size", len == sizeof(big) + 2);
+
+        /* One conversion larger than the stack buffer still matches libc */
+        rewind(tmp);
+        ret = ufprintf_narrow(tmp, "%.5000f\n", 1.5);
+        check_ret("ufprintf oversize conversion return", ret, snprintf(NULL, 0, "%.5000f\n", 1.5));
+        check_true("ufprintf oversize conversion size", ftell(tmp) == (long)ret);
+
+        /* A foreign spec after a buffer's worth of output: libc formats it all */
+        rewind(tmp);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#endif
+        ret = ufprintf_narrow(tmp, "%s%'d", big, 7);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+        check_ret("ufprintf late foreign spec return", ret, (int)sizeof(big));
+        check_true("ufprintf late foreign spec size", ftell(tmp) == (long)ret);
+        fclose(tmp);
+    }
+}
+
+#if !defined(UPRINTF_WINDOWS)
+/* Close the write end and read the pipe to EOF */
+static size_t drain_pipe(int fds[2], char *buf, size_t n) {
+    size_t len = 0;
+    ssize_t r;
+    close(fds[1]);
+    while (len < n - 1 && (r = read(fds[0], buf + len, n - 1 - len)) > 0) len += (size_t)r;
+    buf[len] = '\0';
+    close(fds[0]);
+    return len;
+}
+
+static void test_fd_output(void) {
+    char buf[UPRINTF_STACK_BUF_MAX * 3 + 16];
+    char big[UPRINTF_STACK_BUF_MAX * 3];
+    int fds[2], x = 0, ret;
+    size_t len;
+
+    if (pipe(fds) != 0) return;
+    ret = ufdprintf(fds[1], "fd %d %s\n", 42, "ok");
+    check_ret("ufdprintf return", ret, 9);
+    /* One write(2): the whole record is in the pipe for a single read */
+    ret = (int)read(fds[0], buf, sizeof(buf) - 1);
+    buf[ret > 0 ? ret : 0] = '\0';
+    check_str("ufdprintf single write", buf, "fd 42 ok\n");
+    check_ret("ufdprintf %n rejected", ufdprintf_narrow(fds[1], "%s%n", "x", &x), -1);
+    check_ret("ufdprintf bad fd", ufdprintf_narrow(-1, "%d", 1), -1);
+
+    /* Longer than the stack buffer: written in chunks, nothing lost */
+    memset(big, 'b', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    ret = ufdprintf(fds[1], "[%s]", big);
+    check_ret("ufdprintf long output return", ret, (int)sizeof(big) + 1);
+    len = drain_pipe(fds, buf, sizeof(buf));
+    check_true("ufdprintf long output content",
+               len == sizeof(big) + 1 && buf[0] == '[' && buf[len - 1] == ']');
+
+    /* A foreign spec after a buffer's worth of output: nothing written twice */
+    if (pipe(fds) != 0) return;
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#endif
+    ret = ufdprintf_narrow(fds[1], "%s%'d", big, 7);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+    check_ret("ufdprintf late foreign spec return", ret, (int)sizeof(big));
+    len = drain_pipe(fds, buf, sizeof(buf));
+    check_true("ufdprintf late foreign spec content",
+               len == sizeof(big) && buf[0] == 'b' && buf[len - 1] == '7');
+}
+#endif
+
 static void test_utf8(void) {
     char buf[256];
 
@@ -211,6 +386,12 @@ int main(void) {
     test_return_value();
     printf("\n[UTF-8]\n");
     test_utf8();
+    printf("\n[Native engine]\n");
+    test_native_engine();
+#if !defined(UPRINTF_WINDOWS)
+    printf("\n[File descriptor output]\n");
+    test_fd_output();
+#endif
 
     printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
     return g_fail > 0 ? 1 : 0;
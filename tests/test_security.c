@@ -2,6 +2,7 @@
  * test_security.c — Security tests: %n rejection, NULL handling
  *
  * Compiled WITHOUT UPRINTF_ENABLE_N to test %n rejection.
+ * Also built as test_security_cache with UPRINTF_SCAN_CACHE.
  */
 
 #define UPRINTF_HEADER_ONLY
@@ -94,8 +95,96 @@ static void test_percent_n_scanner(void) {
     check_true("scanner wide: %n", uprintf_has_percent_n_wide(L"hello%n") == 1);
     check_true("scanner wide: no %n", uprintf_has_percent_n_wide(L"hello %d") == 0);
     check_true("scanner wide: %%%% safe", uprintf_has_percent_n_wide(L"%%n") == 0);
+    check_true("scanner: %n past 32-byte block",
+               uprintf_has_percent_n_narrow("a long templated message without conversions %5s %n") == 1);
+    check_true("scanner: conversion char consumed", uprintf_has_percent_n_narrow("%5%n") == 0);
+    check_true("scanner wide: %n past 32-byte block",
+               uprintf_has_percent_n_wide(L"a long templated message, wide this time %ln") == 1);
 }
 
+#if defined(UPRINTF__SCAN_CACHE_ON)
+
+/* Deliberate %n and non-literal formats below */
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wformat"
+    #pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+
+static void test_scan_cache(void) {
+    static const char hot[] = "cached %s=%d";
+    char buf[64], mutable_fmt[16];
+    wchar_t wbuf[8];
+    uprintf_scan_cache_stats before, after;
+    int i;
+
+    uprintf_scan_cache_clear();
+    before = uprintf_scan_cache_get_stats();
+    for (i = 0; i < 10; i++) usnprintf_narrow(buf, sizeof(buf), hot, "k", i);
+    after = uprintf_scan_cache_get_stats();
+    check_true("cache: first call misses", after.misses - before.misses == 1);
+    check_true("cache: repeat calls hit", after.hits - before.hits == 9);
+
+    for (i = 0; i < 3; i++)
+        check_ret("cache: %n never cached", usnprintf_narrow(buf, sizeof(buf), "x%n", (int*)NULL), -1);
+    check_ret("cache: wide %n never cached", usnprintf_wide(wbuf, 8, L"%n", (int*)NULL), -1);
+
+    /* The key is the address: a rewritten buffer must be invalidated */
+    strcpy(mutable_fmt, "%d");
+    check_true("cache: mutable fmt accepted", usnprintf_narrow(buf, sizeof(buf), mutable_fmt, 1) >= 0);
+    strcpy(mutable_fmt, "%n");
+    uprintf_scan_cache_invalidate(mutable_fmt);
+    check_ret("cache: invalidated fmt rescanned", usnprintf_narrow(buf, sizeof(buf), mutable_fmt, (int*)NULL), -1);
+}
+
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+    #pragma GCC diagnostic pop
+#endif
+
+#endif /* UPRINTF__SCAN_CACHE_ON */
+
+#if defined(UPRINTF_SIMD)
+
+/* Random formats dense in '%' and spec characters, at every alignment */
+static unsigned int g_rng = 12345u;
+
+static unsigned int rng_next(void) {
+    g_rng = g_rng * 1103515245u + 12345u;
+    return (g_rng >> 16) & 0x7fffu;
+}
+
+static void test_percent_n_differential(void) {
+    static const char alphabet[] = "%%%%nnd.*0123lhjztL-+ #xs abcdefghij";
+    char buf[256 + 64];
+    wchar_t wbuf[256 + 16];
+    int level, max_level = uprintf__scan_level();
+    int mismatches = 0, found = 0;
+    int iter, i, len, off;
+
+    for (iter = 0; iter < 20000; iter++) {
+        len = (int)(rng_next() % 256);
+        off = (int)(rng_next() % 64);
+        for (i = 0; i < len; i++) {
+            buf[off + i] = alphabet[rng_next() % (sizeof(alphabet) - 1)];
+            wbuf[off % 16 + i] = (wchar_t)(unsigned char)buf[off + i];
+        }
+        buf[off + len] = '\0';
+        wbuf[off % 16 + len] = L'\0';
+
+        i = uprintf__has_percent_n_narrow_scalar(buf + off);
+        found += i;
+        for (level = 0; level <= max_level; level++) {
+            if (uprintf__has_percent_n_narrow_simd(buf + off, level) != i) mismatches++;
+            if (uprintf__has_percent_n_wide_simd(wbuf + off % 16, level) !=
+                uprintf__has_percent_n_wide_scalar(wbuf + off % 16)) mismatches++;
+        }
+    }
+    check_true("differential: random formats hit both verdicts", found > 0 && found < 20000);
+    check_ret("differential: SIMD matches scalar", mismatches, 0);
+}
+
+#endif /* UPRINTF_SIMD */
+
 int main(void) {
     printf("=== uprintf security tests ===\n\n");
 
@@ -107,6 +196,14 @@ int main(void) {
     test_null_format();
     printf("\n[%%n scanner unit tests]\n");
     test_percent_n_scanner();
+#if defined(UPRINTF__SCAN_CACHE_ON)
+    printf("\n[%%n verdict cache]\n");
+    test_scan_cache();
+#endif
+#if defined(UPRINTF_SIMD)
+    printf("\n[%%n scanner SIMD differential]\n");
+    test_percent_n_differential();
+#endif
 
     printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
     return g_fail > 0 ? 1 : 0;
@@ -104,6 +104,41 @@ static void test_return_values(void) {
     check_ret("empty string arg return 0", ret, 0);
 }
 
+static void test_measure(void) {
+    static char big[1024];
+    static wchar_t wbig[1024];
+    int ret, count = 0;
+
+    ret = uprintf_measure_narrow("[%5d|%-8s|%#x|%.3f|%c]", -42, "ab", 255u, 3.14159, 'z');
+    check_ret("narrow matches snprintf", ret,
+              snprintf(big, sizeof(big), "[%5d|%-8s|%#x|%.3f|%c]", -42, "ab", 255u, 3.14159, 'z'));
+    ret = uprintf_measure_narrow("%llu %lld %p %.0d", 18446744073709551615ull, -1ll, (void *)big, 0);
+    check_ret("integers sized without digits", ret,
+              snprintf(big, sizeof(big), "%llu %lld %p %.0d", 18446744073709551615ull, -1ll, (void *)big, 0));
+    ret = uprintf_measure_narrow("%.300f %La", 1e300, 1.0L);
+    check_ret("libc conversions counted", ret, snprintf(big, sizeof(big), "%.300f %La", 1e300, 1.0L));
+    check_ret("narrow empty", uprintf_measure_narrow("%s", ""), 0);
+    check_ret("narrow %n rejected", uprintf_measure_narrow("%s%n", "x", &count), -1);
+    check_ret("narrow NULL fmt", uprintf_measure_narrow(NULL), -1);
+
+    ret = uprintf_measure_wide(L"[%5d|%-8ls|%s|%x|%.2e]", 7, L"wide", "mb", 48879u, 12345.678);
+    check_ret("wide matches usnprintf", ret,
+              usnprintf_wide(wbig, 1024, L"[%5d|%-8ls|%s|%x|%.2e]", 7, L"wide", "mb", 48879u, 12345.678));
+    ret = uprintf_measure_wide(L"%.300f|%lc", 1e300, L'w');
+    check_ret("wide libc conversion counted", ret, usnprintf_wide(wbig, 1024, L"%.300f|%lc", 1e300, L'w'));
+    ret = uprintf_measure_wide(L"%2$s %1$d", 5, "pos");
+    check_ret("wide positional via libc", ret, 5);
+    check_ret("wide %n rejected", uprintf_measure_wide(L"%n", &count), -1);
+
+#if defined(UPRINTF_HAS_GENERIC)
+    check_ret("generic narrow", uprintf_measure("%d", 100), 3);
+    check_ret("generic wide", uprintf_measure(L"%ls!", L"hey"), 4);
+#endif
+    check_true("measured length fits exactly",
+               usnprintf_narrow(big, (size_t)uprintf_measure_narrow("%08.3f", 2.5) + 1, "%08.3f", 2.5) == 8 &&
+               strcmp(big, "0002.500") == 0);
+}
+
 int main(void) {
     printf("=== usnprintf buffer tests ===\n\n");
 
@@ -115,6 +150,8 @@ int main(void) {
     test_null_and_zero();
     printf("\n[Return values]\n");
     test_return_values();
+    printf("\n[Measuring]\n");
+    test_measure();
 
     printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
     return g_fail > 0 ? 1 : 0;
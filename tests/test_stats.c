@@ -0,0 +1,200 @@
+/*
+ * test_stats.c — Tests for per-call-site statistics (UPRINTF_STATS)
+ *
+ * Built with UPRINTF_STATS and -pthread. Call sites are found in the
+ * record list by their line number.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(UPRINTF__STATS_ON)
+#include <pthread.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__STATS_ON)
+
+static const uprintf_stats_site *find_site(int line) {
+    const uprintf_stats_site *s;
+    for (s = uprintf_stats_sites(); s != NULL; s = s->next)
+        if (s->line == line && strcmp(s->file, __FILE__) == 0) return s;
+    return NULL;
+}
+
+static int g_line_trunc, g_line_small, g_line_big, g_line_wide, g_line_helper, g_line_heap;
+static char g_big[2048];
+
+/* Every caller of the helper shares its one call site */
+static int helper(char *buf, size_t n, int v) {
+    g_line_helper = __LINE__ + 1;
+    return usnprintf(buf, n, "v=%d", v);
+}
+
+static void test_counters(void) {
+    const uprintf_stats_site *s;
+    char buf[64];
+    wchar_t wbuf[16];
+    FILE *f = tmpfile();
+    char *heap;
+    size_t bytes = 0;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        g_line_trunc = __LINE__ + 1;
+        usnprintf(buf, 8, "%s", "0123456789");
+    }
+    for (i = 0; i < 100; i++) {
+        g_line_small = __LINE__ + 1;
+        bytes += (size_t)usnprintf(buf, sizeof(buf), "id=%d", i);
+    }
+    memset(g_big, 'x', sizeof(g_big) - 1);
+    for (i = 0; f != NULL && i < 50; i++) {
+        g_line_big = __LINE__ + 1;
+        ufprintf(f, "%s\n", g_big);
+    }
+    g_line_wide = __LINE__ + 1;
+    usnprintf(wbuf, 16, L"w=%d", 5);
+    helper(buf, sizeof(buf), 1);
+    helper(buf, sizeof(buf), 22);
+
+    /* The dump must not read the format buffer after it is gone */
+    heap = (char *)malloc(64);
+    if (heap != NULL) {
+        memset(heap, 'h', 63);
+        memcpy(heap, "heap=%d ", 8);
+        heap[63] = '\0';
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+        g_line_heap = __LINE__ + 1;
+        usnprintf(buf, sizeof(buf), heap, 3);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+        memset(heap, 'Z', 63);
+        free(heap);
+    }
+    if (f != NULL) fclose(f);
+
+    s = find_site(g_line_trunc);
+    check_true("truncating site registered", s != NULL);
+    if (s != NULL) {
+        check_ret("truncating calls", (long)s->calls, 10);
+        check_ret("truncations", (long)s->truncated, 10);
+        check_ret("bytes stop at the buffer", (long)s->bytes, 70);
+    }
+    s = find_site(g_line_small);
+    check_true("small site registered", s != NULL);
+    if (s != NULL) {
+        check_ret("small calls", (long)s->calls, 100);
+        check_ret("small bytes", (long)s->bytes, (long)bytes);
+        check_ret("no truncation", (long)s->truncated, 0);
+        check_true("format recorded", !s->wide && !s->fmt_cut && strcmp(s->fmt, "id=%d") == 0);
+    }
+    s = find_site(g_line_big);
+    check_true("stream site counted", s != NULL && s->calls == 50 && s->bytes == 50 * sizeof(g_big));
+    s = find_site(g_line_wide);
+    check_true("wide site", s != NULL && s->wide && strcmp(s->fmt, "w=%d") == 0 && s->bytes == 3);
+    s = find_site(g_line_heap);
+    check_true("format copied from a freed buffer",
+               s != NULL && s->fmt_cut && strlen(s->fmt) == 48 && strncmp(s->fmt, "heap=%d ", 8) == 0);
+    s = find_site(g_line_helper);
+    check_true("one site per expansion", s != NULL && s->calls == 2 && s->bytes == 7);
+}
+
+static void test_dump(void) {
+    FILE *f = tmpfile();
+    char line[512], want[64];
+    int listed;
+
+    if (f == NULL) { check_true("tmpfile", 0); return; }
+    listed = uprintf_stats_dump(f);
+    check_true("dump lists the sites", listed >= 5);
+    rewind(f);
+    /* Header, then the 50 writes of 2 KiB: by far the costliest */
+    snprintf(want, sizeof(want), "%s:%d ", __FILE__, g_line_big);
+    check_true("costliest site first",
+               fgets(line, sizeof(line), f) != NULL && fgets(line, sizeof(line), f) != NULL &&
+               strstr(line, want) != NULL);
+    check_true("formats are escaped", strstr(line, "\"%s\\n\"") != NULL);
+    fclose(f);
+
+    uprintf_stats_reset();
+    f = tmpfile();
+    if (f == NULL) return;
+    check_ret("reset empties the report", uprintf_stats_dump(f), 0);
+    fclose(f);
+}
+
+#define N_THREADS 4
+#define N_CALLS   20000
+
+static int g_line_thread;
+
+static void *thread_main(void *arg) {
+    char buf[32];
+    int i;
+    (void)arg;
+    for (i = 0; i < N_CALLS; i++) {
+        g_line_thread = __LINE__ + 1;
+        usnprintf(buf, sizeof(buf), "%05d\n", i % 100000);
+    }
+    return NULL;
+}
+
+static void test_threads(void) {
+    pthread_t t[N_THREADS];
+    const uprintf_stats_site *s;
+    int i, n = 0;
+
+    for (i = 0; i < N_THREADS; i++) pthread_create(&t[i], NULL, thread_main, NULL);
+    for (i = 0; i < N_THREADS; i++) pthread_join(t[i], NULL);
+
+    for (s = uprintf_stats_sites(); s != NULL; s = s->next)
+        if (s->line == g_line_thread) n++;
+    check_ret("site registered once", n, 1);
+    s = find_site(g_line_thread);
+    check_true("no lost calls", s != NULL && s->calls == (size_t)N_THREADS * N_CALLS);
+    check_true("no lost bytes", s != NULL && s->bytes == (size_t)N_THREADS * N_CALLS * 6);
+}
+
+#endif /* UPRINTF__STATS_ON */
+
+int main(void) {
+    printf("=== uprintf call-site statistics tests ===\n\n");
+
+#if defined(UPRINTF__STATS_ON)
+    printf("[Counters]\n");
+    test_counters();
+    printf("\n[Dump]\n");
+    test_dump();
+    printf("\n[Threads]\n");
+    test_threads();
+#else
+    printf("  (call-site statistics not available in this build)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
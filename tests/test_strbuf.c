@@ -0,0 +1,261 @@
+/*
+ * test_strbuf.c — Tests for the ustrbuf / uwstrbuf string builders
+ *
+ * A counting allocator checks that short text never leaves the inline
+ * storage and that growth is geometric; formatted appends are compared
+ * with snprintf, and the arena allocator is checked to keep the heap
+ * untouched and to fail cleanly when it runs out.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got != NULL && strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got != NULL ? got : "(null)", expected); g_fail++; }
+}
+
+static void check_wstr(const char *test_name, const wchar_t *got, const wchar_t *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got != NULL && wcscmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%ls\", expected \"%ls\"\n", got != NULL ? got : L"(null)", expected); g_fail++; }
+}
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+/* Heap allocator that counts its calls */
+static int g_allocs = 0;
+
+static void *counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    (void)ctx;
+    (void)old_size;
+    if (new_size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    g_allocs++;
+    return realloc(ptr, new_size);
+}
+
+static const ustrbuf_allocator g_counting = { counting_realloc, NULL };
+
+/* ========================================================================== */
+/*  Narrow                                                                    */
+/* ========================================================================== */
+
+static void test_inline(void) {
+    ustrbuf sb;
+
+    g_allocs = 0;
+    ustrbuf_init(&sb, &g_counting);
+    check_str("empty builder", ustrbuf_cstr(&sb), "");
+    ustrbuf_append(&sb, "key", 3);
+    ustrbuf_appendf(&sb, "=%d;%s", 42, "ok");
+    check_str("short text", ustrbuf_cstr(&sb), "key=42;ok");
+    check_ret("length", (long)sb.len, 9);
+    check_ret("no allocation while inline", g_allocs, 0);
+    ustrbuf_free(&sb);
+}
+
+static void test_growth(void) {
+    ustrbuf sb;
+    char want[8192];
+    size_t n = 0;
+    int i, bad = 0;
+
+    g_allocs = 0;
+    ustrbuf_init(&sb, &g_counting);
+    for (i = 0; i < 1000; i++) {
+        ustrbuf_appendf(&sb, "%d,", i);
+        n += (size_t)snprintf(want + n, sizeof(want) - n, "%d,", i);
+        bad += sb.len != n;
+    }
+    check_ret("length tracks every append", bad, 0);
+    check_str("1000 appends", ustrbuf_cstr(&sb), want);
+    check_ret("geometric growth", g_allocs <= 6, 1);
+    check_ret("error flag clear", sb.error, 0);
+    ustrbuf_free(&sb);
+}
+
+static void test_second_pass(void) {
+    ustrbuf sb;
+    char want[2048];
+    int ret;
+
+    ustrbuf_init(&sb, NULL);
+    ustrbuf_append(&sb, "head:", 5);
+    ret = ustrbuf_appendf(&sb, "%-1000s|%08.3f|%x", "pad", 3.14159, 0xbeefu);
+    snprintf(want, sizeof(want), "head:%-1000s|%08.3f|%x", "pad", 3.14159, 0xbeefu);
+    check_ret("long output: return value", ret, (long)strlen(want) - 5);
+    check_str("long output: text", ustrbuf_cstr(&sb), want);
+
+    ustrbuf_clear(&sb);
+    check_str("clear", ustrbuf_cstr(&sb), "");
+    ustrbuf_appendf(&sb, "%s %5.1e %c", "after", 12345.678, 'z');
+    snprintf(want, sizeof(want), "%s %5.1e %c", "after", 12345.678, 'z');
+    check_str("reuse after clear", ustrbuf_cstr(&sb), want);
+    ustrbuf_free(&sb);
+}
+
+static void test_errors(void) {
+    ustrbuf sb;
+    int count = 0;
+
+    ustrbuf_init(&sb, NULL);
+    ustrbuf_appendf(&sb, "%s", "kept");
+    check_ret("%n rejected", ustrbuf_appendf(&sb, "x%n", &count), -1);
+    check_ret("error is sticky", ustrbuf_append(&sb, "y", 1), -1);
+    check_str("text unchanged", ustrbuf_cstr(&sb), "kept");
+    check_ret("take refuses on error", ustrbuf_take(&sb, NULL) == NULL, 1);
+    ustrbuf_clear(&sb);
+    check_ret("clear resets the error", ustrbuf_append(&sb, "y", 1), 0);
+    ustrbuf_free(&sb);
+}
+
+static void test_take(void) {
+    ustrbuf sb;
+    char *s;
+    size_t len = 0;
+    int i;
+
+    ustrbuf_init(&sb, NULL);
+    ustrbuf_appendf(&sb, "inline %d", 7);
+    s = ustrbuf_take(&sb, &len);
+    check_str("take inline text", s, "inline 7");
+    check_ret("take inline length", (long)len, 8);
+    check_str("builder empty after take", ustrbuf_cstr(&sb), "");
+    free(s);
+
+    for (i = 0; i < 100; i++) ustrbuf_appendf(&sb, "%08d", i);
+    {
+        const char *before = ustrbuf_cstr(&sb);
+        s = ustrbuf_take(&sb, &len);
+        check_ret("take heap text without copying", s == before, 1);
+    }
+    check_ret("take heap length", (long)len, 800);
+    check_ret("taken text", strncmp(s + 792, "00000099", 8), 0);
+    free(s);
+    ustrbuf_free(&sb);
+}
+
+/* ========================================================================== */
+/*  Wide                                                                      */
+/* ========================================================================== */
+
+/* The explicit _wide names keep this section valid in C99, which has no _Generic */
+static void test_wide(void) {
+    uwstrbuf sb;
+    wchar_t want[4096];
+    size_t n = 0;
+    int i;
+
+    ustrbuf_init_wide(&sb, NULL);
+    ustrbuf_append_wide(&sb, L"w:", 2);
+    ustrbuf_appendf_wide(&sb, L"%d-%ls", 5, L"café");
+    check_wstr("wide short text", ustrbuf_cstr_wide(&sb), L"w:5-café");
+
+    ustrbuf_clear_wide(&sb);
+    for (i = 0; i < 300; i++) {
+        ustrbuf_appendf_wide(&sb, L"%x|", i * 977);
+        n += (size_t)swprintf(want + n, sizeof(want) / sizeof(wchar_t) - n, L"%x|", i * 977);
+    }
+    check_wstr("wide growth", ustrbuf_cstr_wide(&sb), want);
+
+    /* Positional arguments go to the platform vswprintf */
+    ustrbuf_clear_wide(&sb);
+    ustrbuf_appendf_wide(&sb, L"%2$s %1$s %3$0300d", L"world", L"hello", 1);
+    swprintf(want, sizeof(want) / sizeof(wchar_t), L"%2$s %1$s %3$0300d", L"world", L"hello", 1);
+    check_wstr("wide positional format", ustrbuf_cstr_wide(&sb), want);
+    check_ret("wide positional length", (long)sb.len, (long)wcslen(want));
+
+    /* A conversion longer than the engine's scratch buffer */
+    ustrbuf_clear_wide(&sb);
+    ustrbuf_appendf_wide(&sb, L"%.300f", 1e300);
+    swprintf(want, sizeof(want) / sizeof(wchar_t), L"%.300f", 1e300);
+    check_wstr("wide long conversion", ustrbuf_cstr_wide(&sb), want);
+    check_ret("wide long conversion error", sb.error, 0);
+    ustrbuf_free_wide(&sb);
+}
+
+/* ========================================================================== */
+/*  Arena                                                                     */
+/* ========================================================================== */
+
+static void test_arena(void) {
+    static char block[16 * 1024];
+    ustrbuf_arena arena;
+    ustrbuf_allocator a;
+    ustrbuf sb;
+    char want[8192];
+    size_t n = 0;
+    int i;
+
+    ustrbuf_arena_init(&arena, block, sizeof(block));
+    a = ustrbuf_arena_allocator(&arena);
+    ustrbuf_init(&sb, &a);
+    for (i = 0; i < 500; i++) {
+        ustrbuf_appendf(&sb, "<%d>", i);
+        n += (size_t)snprintf(want + n, sizeof(want) - n, "<%d>", i);
+    }
+    check_str("arena-backed text", ustrbuf_cstr(&sb), want);
+    check_ret("text lives in the block",
+              ustrbuf_cstr(&sb) >= block && ustrbuf_cstr(&sb) < block + sizeof(block), 1);
+    check_ret("grown in place", arena.used - arena.last, (long)sb.cap + 1);
+    ustrbuf_free(&sb);
+    check_ret("free on top returns the space", (long)arena.used, (long)arena.last);
+}
+
+static void test_arena_exhausted(void) {
+    static char block[512];
+    ustrbuf_arena arena;
+    ustrbuf_allocator a;
+    ustrbuf sb;
+    size_t before = 0;
+    int i, ret = 0;
+
+    ustrbuf_arena_init(&arena, block, sizeof(block));
+    a = ustrbuf_arena_allocator(&arena);
+    ustrbuf_init(&sb, &a);
+    for (i = 0; i < 1000 && ret >= 0; i++) {
+        before = sb.len;
+        ret = ustrbuf_appendf(&sb, "%-100d", i);
+    }
+    check_ret("append fails when the arena is full", ret, -1);
+    check_ret("error set", sb.error, 1);
+    check_ret("length kept", (long)sb.len, (long)before);
+    check_ret("text kept", strlen(ustrbuf_cstr(&sb)) == before && strncmp(ustrbuf_cstr(&sb), "0   ", 4) == 0, 1);
+    check_ret("later appends fail", ustrbuf_appendf(&sb, "%c", 'x'), -1);
+    ustrbuf_free(&sb);
+}
+
+int main(void) {
+    printf("=== uprintf string builder tests ===\n\n");
+
+    printf("[Narrow]\n");
+    test_inline();
+    test_growth();
+    test_second_pass();
+    test_errors();
+    test_take();
+    printf("\n[Wide]\n");
+    test_wide();
+    printf("\n[Arena]\n");
+    test_arena();
+    test_arena_exhausted();
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * test_strip.c — Tests for escape stripping on non-terminal output
+ *
+ * Built with UPRINTF_STRIP_ANSI. Output goes to pipes and temporary files,
+ * which are never terminals, and is compared with a byte-at-a-time
+ * reference filter.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(UPRINTF__STRIP_ON) && !defined(_WIN32)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_str(const char *test_name, const char *got, const char *expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (strcmp(got, expected) == 0) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got \"%s\", expected \"%s\"\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__STRIP_ON) && !defined(_WIN32)
+
+static char g_out[65536];
+
+/* Everything written to the pipe so far, NUL-terminated; returns its length */
+static long drain(int fd) {
+    long n = 0, r;
+    while (n < (long)sizeof(g_out) - 1 && (r = (long)read(fd, g_out + n, sizeof(g_out) - 1 - (size_t)n)) > 0)
+        n += r;
+    g_out[n] = '\0';
+    return n;
+}
+
+/* Reference: the same rules as uprintf__strip_feed, one byte at a time */
+static size_t strip_ref(char *dst, const char *src, size_t n) {
+    size_t i, o = 0;
+    int state = 0;
+    for (i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if (state == 1) {
+            if (c == '[') { state = 2; continue; }
+            dst[o++] = '\033';
+            state = 0;
+        } else if (state == 2) {
+            if (c >= 0x20) {
+                if (c >= 0x40 && c <= 0x7E) state = 0;
+                continue;
+            }
+            state = 0;
+        }
+        if (c == 0x1b) state = 1;
+        else dst[o++] = (char)c;
+    }
+    if (state == 1) dst[o++] = '\033';
+    return o;
+}
+
+/* Write through ufdprintf on a fresh pipe and read it back into g_out */
+#define PIPE_PRINT(ret, ...) do {                                             \
+    int p_[2];                                                                \
+    if (pipe(p_) != 0) { perror("pipe"); exit(1); }                           \
+    (ret) = ufdprintf(p_[1], __VA_ARGS__);                                    \
+    close(p_[1]);                                                             \
+    drain(p_[0]);                                                             \
+    close(p_[0]);                                                             \
+} while (0)
+
+static void test_modes(void) {
+    int ret;
+
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    PIPE_PRINT(ret, "\033[1;31merror\033[0m: %s\n", "disk full");
+    check_str("auto strips a pipe", g_out, "error: disk full\n");
+    check_ret("return counts written bytes", ret, (long)strlen("error: disk full\n"));
+
+    uprintf_set_strip_ansi(UPRINTF_STRIP_NEVER);
+    PIPE_PRINT(ret, "\033[32m%d\033[0m", 7);
+    check_str("never keeps sequences", g_out, "\033[32m7\033[0m");
+    check_ret("never returns full length", ret, 10);
+
+    uprintf_set_strip_ansi(UPRINTF_STRIP_ALWAYS);
+    check_true("always is active on any fd", uprintf_strip_ansi_active(1) && uprintf_strip_ansi_active(2));
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    check_true("auto is inactive on a closed fd", !uprintf_strip_ansi_active(-1));
+}
+
+static void test_sequences(void) {
+    int ret;
+
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    PIPE_PRINT(ret, "a\033[38;2;255;128;0mb\033[2Kc\033[?25l%c", 'd');
+    check_str("truecolor, erase, private mode", g_out, "abcd");
+    PIPE_PRINT(ret, "x\033]0;title\007y\033(%c", 'B');
+    check_str("non-CSI escapes are kept", g_out, "x\033]0;title\007y\033(B");
+    PIPE_PRINT(ret, "x\033[12\n%c", 'y');
+    check_str("control byte ends a CSI", g_out, "x\ny");
+    PIPE_PRINT(ret, "%s\033", "tail");
+    check_str("trailing ESC is kept", g_out, "tail\033");
+    check_ret("trailing ESC counted", ret, 5);
+    PIPE_PRINT(ret, "%s|%5d", "\033[1mbold\033[22m", 42);
+    check_str("sequences inside arguments", g_out, "bold|   42");
+    PIPE_PRINT(ret, "%2$s-%1$s", "\033[1ma", "b\033[0m");
+    check_str("positional format (platform printf)", g_out, "b-a");
+}
+
+/* A record with several sequences is one write(2): one datagram on a socket */
+static void test_single_write(void) {
+    int sv[2];
+    long n;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0) { perror("socketpair"); exit(1); }
+    uprintf_set_strip_ansi(UPRINTF_STRIP_ALWAYS);
+    ufdprintf(sv[0], "\033[1m%s\033[0m \033[31m%d\033[0m \033[4m%s\033[24m\n", "a", 1, "b");
+    n = (long)recv(sv[1], g_out, sizeof(g_out) - 1, 0);
+    g_out[n > 0 ? n : 0] = '\0';
+    check_str("stripped record written at once", g_out, "a 1 b\n");
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/* Sequences land on every offset around the 4096-byte buffer boundary */
+static void test_boundaries(void) {
+    static char text[12000], expect[12000];
+    unsigned seed = 12345;
+    int shift, late, bad = 0;
+
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    for (shift = 0; shift < 40; shift++) {
+        size_t n = 0, e;
+        int ret;
+
+        memset(text, 'p', (size_t)(UPRINTF_STACK_BUF_MAX - 20 + shift));
+        n = (size_t)(UPRINTF_STACK_BUF_MAX - 20 + shift);
+        while (n < 9000) {
+            seed = seed * 1103515245u + 12345u;
+            switch ((seed >> 16) % 4) {
+                case 0:  n += (size_t)sprintf(text + n, "\033[%um", (seed >> 8) % 108); break;
+                case 1:  n += (size_t)sprintf(text + n, "\033[38;5;%u;1m", (seed >> 4) % 256); break;
+                case 2:  text[n++] = '\033'; text[n++] = 'M'; break;
+                default: n += (size_t)sprintf(text + n, "word%u ", seed % 1000); break;
+            }
+        }
+        text[n] = '\0';
+        e = strip_ref(expect, text, n);
+        expect[e] = '\0';
+        PIPE_PRINT(ret, "%s", text);
+        if (strcmp(g_out, expect) != 0 || ret != (int)e) bad++;
+    }
+    check_ret("split sequences match reference", bad, 0);
+
+    /* A platform-only spec after a buffer's worth of output: written once, stripped */
+    memset(text, 'p', UPRINTF_STACK_BUF_MAX + 100);
+    text[UPRINTF_STACK_BUF_MAX + 100] = '\0';
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#endif
+    PIPE_PRINT(late, "%s\033[1m%'d\033[0m", text, 7);
+#if defined(UPRINTF_GCC) || defined(UPRINTF_CLANG)
+#pragma GCC diagnostic pop
+#endif
+    check_ret("late platform spec: return", late, UPRINTF_STACK_BUF_MAX + 101);
+    check_true("late platform spec: content",
+               strlen(g_out) == UPRINTF_STACK_BUF_MAX + 101 && g_out[UPRINTF_STACK_BUF_MAX + 100] == '7');
+}
+
+static void test_stream(void) {
+    FILE *f = tmpfile();
+    char buf[128];
+    size_t n;
+    int ret;
+
+    if (f == NULL) { check_true("tmpfile", 0); return; }
+    uprintf_set_strip_ansi(UPRINTF_STRIP_AUTO);
+    ret = ufprintf(f, "\033[4m%s\033[24m=%d\n", "key", 3);
+    rewind(f);
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    check_str("ufprintf to a file is stripped", buf, "key=3\n");
+    check_ret("ufprintf returns stripped length", ret, 6);
+    fclose(f);
+}
+
+#endif /* UPRINTF__STRIP_ON && !_WIN32 */
+
+int main(void) {
+    printf("=== uprintf escape stripping tests ===\n\n");
+
+#if defined(UPRINTF__STRIP_ON) && !defined(_WIN32)
+    printf("[Modes]\n");
+    test_modes();
+    printf("\n[Sequences]\n");
+    test_sequences();
+    test_single_write();
+    printf("\n[Buffer boundaries]\n");
+    test_boundaries();
+    printf("\n[Streams]\n");
+    test_stream();
+#else
+    printf("  (escape stripping not tested on this platform)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * test_thread_sink.c — Tests for the per-thread stdout sink
+ *
+ * Built with UPRINTF_THREAD_SINK and -pthread. stdout (fd 1) is redirected
+ * to a temporary file while the sink is exercised; results are reported
+ * once it is restored.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#include "uprintf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(UPRINTF__TSINK_ON)
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+static void check_ret(const char *test_name, long got, long expected) {
+    printf("  [TEST] %s... ", test_name);
+    if (got == expected) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL: got %ld, expected %ld\n", got, expected); g_fail++; }
+}
+
+static void check_true(const char *test_name, int cond) {
+    printf("  [TEST] %s... ", test_name);
+    if (cond) { printf("OK\n"); g_pass++; }
+    else { printf("FAIL\n"); g_fail++; }
+}
+
+#if defined(UPRINTF__TSINK_ON)
+
+#define N_THREADS 8
+#define N_LINES   3000
+
+static FILE *g_out;
+static int g_saved_fd = -1;
+
+static void redirect_stdout(void) {
+    fflush(stdout);
+    g_out = tmpfile();
+    g_saved_fd = dup(STDOUT_FILENO);
+    dup2(fileno(g_out), STDOUT_FILENO);
+}
+
+static void restore_stdout(void) {
+    fflush(stdout);
+    dup2(g_saved_fd, STDOUT_FILENO);
+    close(g_saved_fd);
+}
+
+static long out_size(void) {
+    struct stat st;
+    if (fstat(fileno(g_out), &st) != 0) return -1;
+    return (long)st.st_size;
+}
+
+static void *writer(void *arg) {
+    int id = *(const int *)arg;
+    int i;
+    for (i = 0; i < N_LINES; i++)
+        uprintf("thread %02d line %05d payload %s\n", id, i, "abcdefghijklmnopqrstuvwxyz");
+    return NULL;   /* pending records are written by the thread-exit hook */
+}
+
+/* Every line intact, and each thread's lines in order */
+static int verify_lines(long *lines_out) {
+    char line[128];
+    int next[N_THREADS] = {0};
+    int id, n;
+    long lines = 0;
+    char tail[32];
+
+    rewind(g_out);
+    while (fgets(line, sizeof(line), g_out) != NULL) {
+        if (strncmp(line, "thread ", 7) != 0) continue;
+        if (sscanf(line, "thread %2d line %5d payload %31s", &id, &n, tail) != 3) return 0;
+        if (id < 0 || id >= N_THREADS || n != next[id]) return 0;
+        if (strcmp(tail, "abcdefghijklmnopqrstuvwxyz") != 0) return 0;
+        next[id]++;
+        lines++;
+    }
+    *lines_out = lines;
+    return 1;
+}
+
+static void test_thread_sink(void) {
+    pthread_t th[N_THREADS];
+    int ids[N_THREADS];
+    long before_flush, after_flush, lines = 0, big_len, big_start;
+    long atomic_start, atomic_written;
+    int i, intact, big_ok = 0;
+    char head[8];
+    char *big;
+
+    redirect_stdout();
+
+    uprintf("deferred %d\n", 1);
+    before_flush = out_size();
+    uprintf_flush();
+    after_flush = out_size();
+
+    for (i = 0; i < N_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&th[i], NULL, writer, &ids[i]);
+    }
+    for (i = 0; i < N_THREADS; i++) pthread_join(th[i], NULL);
+    intact = verify_lines(&lines);
+
+    /* Pending records are written before they pass PIPE_BUF together */
+    atomic_start = out_size();
+    for (i = 0; i <= UPRINTF__TSINK_ATOMIC / 100; i++) uprintf("%099d\n", i);
+    atomic_written = out_size() - atomic_start;
+    uprintf_flush();
+
+    /* A record larger than the buffer goes out whole, after pending ones */
+    big_len = UPRINTF_THREAD_SINK_SIZE * 3;
+    big = (char *)malloc((size_t)big_len + 1);
+    if (big != NULL) {
+        memset(big, 'x', (size_t)big_len);
+        big[big_len] = '\0';
+        big_start = out_size();
+        uprintf("%s", "pending;");
+        uprintf("%s\n", big);
+        uprintf_flush();
+        big_ok = out_size() == big_start + 8 + big_len + 1
+              && fseek(g_out, big_start, SEEK_SET) == 0
+              && fread(head, 1, 8, g_out) == 8
+              && memcmp(head, "pending;", 8) == 0;
+        free(big);
+    }
+
+    restore_stdout();
+    fclose(g_out);
+
+    check_ret("output deferred until flush", before_flush, 0);
+    check_ret("uprintf_flush writes the record", after_flush, 11);
+    check_true("threaded lines intact and ordered", intact);
+    check_ret("all threaded lines written at thread exit", lines, (long)N_THREADS * N_LINES);
+    check_true("records written in PIPE_BUF pieces",
+               atomic_written > 0 && atomic_written <= UPRINTF__TSINK_ATOMIC && atomic_written % 100 == 0);
+    check_true("oversized record after pending ones", big_ok);
+}
+
+#endif /* UPRINTF__TSINK_ON */
+
+int main(void) {
+    printf("=== uprintf thread sink tests ===\n\n");
+
+#if defined(UPRINTF__TSINK_ON)
+    printf("[Thread sink]\n");
+    test_thread_sink();
+#else
+    printf("  (thread sink not available on this platform)\n");
+#endif
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail > 0 ? 1 : 0;
+}
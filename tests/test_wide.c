@@ -13,6 +13,10 @@
 #include <stdint.h>
 #include <locale.h>
 
+#if !defined(UPRINTF_WINDOWS)
+#include <unistd.h>
+#endif
+
 static int g_pass = 0;
 static int g_fail = 0;
 
@@ -141,6 +145,34 @@ static void test_return_value(void) {
     check_true("return value > 0", ret > 0);
 }
 
+#if !defined(UPRINTF_WINDOWS)
+static void test_fd_output(void) {
+    wchar_t big[UPRINTF_STACK_BUF_MAX];
+    char buf[UPRINTF_STACK_BUF_MAX + 16];
+    size_t len = 0;
+    ssize_t r;
+    int fds[2], ret;
+
+    if (pipe(fds) != 0) return;
+    ret = ufdprintf_wide(fds[1], L"fd %d %ls\n", 42, L"ok");
+    check_true("ufdprintf wide return", ret == 9);
+
+    /* Longer than the stack buffer: the record goes through the heap */
+    wmemset(big, L'w', sizeof(big) / sizeof(big[0]) - 1);
+    big[sizeof(big) / sizeof(big[0]) - 1] = L'\0';
+    ret = ufdprintf_wide(fds[1], L"%ls.", big);
+    check_true("ufdprintf wide long return", ret == (int)(sizeof(big) / sizeof(big[0])));
+
+    close(fds[1]);
+    while (len < sizeof(buf) - 1 && (r = read(fds[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+        len += (size_t)r;
+    buf[len] = '\0';
+    close(fds[0]);
+    check_true("ufdprintf wide content", strncmp(buf, "fd 42 ok\nwww", 12) == 0
+               && len == 9 + sizeof(big) / sizeof(big[0]) && buf[len - 1] == '.');
+}
+#endif
+
 int main(void) {
     setlocale(LC_ALL, "C");
 
@@ -158,6 +190,10 @@ int main(void) {
     test_unicode();
     printf("\n[Return values]\n");
     test_return_value();
+#if !defined(UPRINTF_WINDOWS)
+    printf("\n[File descriptor output]\n");
+    test_fd_output();
+#endif
 
     printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
     return g_fail > 0 ? 1 : 0;
@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+"""
+gen_css_colors.py -- Generate the CSS named-color table of uprintf_color.h
+
+Builds a minimal perfect hash over the 148 CSS color names and rewrites the
+block between the BEGIN/END markers in include/uprintf_color.h. The hash
+must stay in step with uc__css_hash() and uc__css_mix() in that header.
+
+Usage: gen_css_colors.py [--check] [HEADER]
+
+With --check, the header is left alone and the exit status is 1 when the
+block in it is out of date.
+"""
+
+import os
+import sys
+
+COLORS = [
+    ("aliceblue",            240, 248, 255),
+    ("antiquewhite",         250, 235, 215),
+    ("aqua",                   0, 255, 255),
+    ("aquamarine",           127, 255, 212),
+    ("azure",                240, 255, 255),
+    ("beige",                245, 245, 220),
+    ("bisque",               255, 228, 196),
+    ("black",                  0,   0,   0),
+    ("blanchedalmond",       255, 235, 205),
+    ("blue",                   0,   0, 255),
+    ("blueviolet",           138,  43, 226),
+    ("brown",                165,  42,  42),
+    ("burlywood",            222, 184, 135),
+    ("cadetblue",             95, 158, 160),
+    ("chartreuse",           127, 255,   0),
+    ("chocolate",            210, 105,  30),
+    ("coral",                255, 127,  80),
+    ("cornflowerblue",       100, 149, 237),
+    ("cornsilk",             255, 248, 220),
+    ("crimson",              220,  20,  60),
+    ("cyan",                   0, 255, 255),
+    ("darkblue",               0,   0, 139),
+    ("darkcyan",               0, 139, 139),
+    ("darkgoldenrod",        184, 134,  11),
+    ("darkgray",             169, 169, 169),
+    ("darkgreen",              0, 100,   0),
+    ("darkgrey",             169, 169, 169),
+    ("darkkhaki",            189, 183, 107),
+    ("darkmagenta",          139,   0, 139),
+    ("darkolivegreen",        85, 107,  47),
+    ("darkorange",           255, 140,   0),
+    ("darkorchid",           153,  50, 204),
+    ("darkred",              139,   0,   0),
+    ("darksalmon",           233, 150, 122),
+    ("darkseagreen",         143, 188, 143),
+    ("darkslateblue",         72,  61, 139),
+    ("darkslategray",         47,  79,  79),
+    ("darkslategrey",         47,  79,  79),
+    ("darkturquoise",          0, 206, 209),
+    ("darkviolet",           148,   0, 211),
+    ("deeppink",             255,  20, 147),
+    ("deepskyblue",            0, 191, 255),
+    ("dimgray",              105, 105, 105),
+    ("dimgrey",              105, 105, 105),
+    ("dodgerblue",            30, 144, 255),
+    ("firebrick",            178,  34,  34),
+    ("floralwhite",          255, 250, 240),
+    ("forestgreen",           34, 139,  34),
+    ("fuchsia",              255,   0, 255),
+    ("gainsboro",            220, 220, 220),
+    ("ghostwhite",           248, 248, 255),
+    ("gold",                 255, 215,   0),
+    ("goldenrod",            218, 165,  32),
+    ("gray",                 128, 128, 128),
+    ("green",                  0, 128,   0),
+    ("greenyellow",          173, 255,  47),
+    ("grey",                 128, 128, 128),
+    ("honeydew",             240, 255, 240),
+    ("hotpink",              255, 105, 180),
+    ("indianred",            205,  92,  92),
+    ("indigo",                75,   0, 130),
+    ("ivory",                255, 255, 240),
+    ("khaki",                240, 230, 140),
+    ("lavender",             230, 230, 250),
+    ("lavenderblush",        255, 240, 245),
+    ("lawngreen",            124, 252,   0),
+    ("lemonchiffon",         255, 250, 205),
+    ("lightblue",            173, 216, 230),
+    ("lightcoral",           240, 128, 128),
+    ("lightcyan",            224, 255, 255),
+    ("lightgoldenrodyellow", 250, 250, 210),
+    ("lightgray",            211, 211, 211),
+    ("lightgreen",           144, 238, 144),
+    ("lightgrey",            211, 211, 211),
+    ("lightpink",            255, 182, 193),
+    ("lightsalmon",          255, 160, 122),
+    ("lightseagreen",         32, 178, 170),
+    ("lightskyblue",         135, 206, 250),
+    ("lightslategray",       119, 136, 153),
+    ("lightslategrey",       119, 136, 153),
+    ("lightsteelblue",       176, 196, 222),
+    ("lightyellow",          255, 255, 224),
+    ("lime",                   0, 255,   0),
+    ("limegreen",             50, 205,  50),
+    ("linen",                250, 240, 230),
+    ("magenta",              255,   0, 255),
+    ("maroon",               128,   0,   0),
+    ("mediumaquamarine",     102, 205, 170),
+    ("mediumblue",             0,   0, 205),
+    ("mediumorchid",         186,  85, 211),
+    ("mediumpurple",         147, 112, 219),
+    ("mediumseagreen",        60, 179, 113),
+    ("mediumslateblue",      123, 104, 238),
+    ("mediumspringgreen",      0, 250, 154),
+    ("mediumturquoise",       72, 209, 204),
+    ("mediumvioletred",      199,  21, 133),
+    ("midnightblue",          25,  25, 112),
+    ("mintcream",            245, 255, 250),
+    ("mistyrose",            255, 228, 225),
+    ("moccasin",             255, 228, 181),
+    ("navajowhite",          255, 222, 173),
+    ("navy",                   0,   0, 128),
+    ("oldlace",              253, 245, 230),
+    ("olive",                128, 128,   0),
+    ("olivedrab",            107, 142,  35),
+    ("orange",               255, 165,   0),
+    ("orangered",            255,  69,   0),
+    ("orchid",               218, 112, 214),
+    ("palegoldenrod",        238, 232, 170),
+    ("palegreen",            152, 251, 152),
+    ("paleturquoise",        175, 238, 238),
+    ("palevioletred",        219, 112, 147),
+    ("papayawhip",           255, 239, 213),
+    ("peachpuff",            255, 218, 185),
+    ("peru",                 205, 133,  63),
+    ("pink",                 255, 192, 203),
+    ("plum",                 221, 160, 221),
+    ("powderblue",           176, 224, 230),
+    ("purple",               128,   0, 128),
+    ("rebeccapurple",        102,  51, 153),
+    ("red",                  255,   0,   0),
+    ("rosybrown",            188, 143, 143),
+    ("royalblue",             65, 105, 225),
+    ("saddlebrown",          139,  69,  19),
+    ("salmon",               250, 128, 114),
+    ("sandybrown",           244, 164,  96),
+    ("seagreen",              46, 139,  87),
+    ("seashell",             255, 245, 238),
+    ("sienna",               160,  82,  45),
+    ("silver",               192, 192, 192),
+    ("skyblue",              135, 206, 235),
+    ("slateblue",            106,  90, 205),
+    ("slategray",            112, 128, 144),
+    ("slategrey",            112, 128, 144),
+    ("snow",                 255, 250, 250),
+    ("springgreen",            0, 255, 127),
+    ("steelblue",             70, 130, 180),
+    ("tan",                  210, 180, 140),
+    ("teal",                   0, 128, 128),
+    ("thistle",              216, 191, 216),
+    ("tomato",               255,  99,  71),
+    ("turquoise",             64, 224, 208),
+    ("violet",               238, 130, 238),
+    ("wheat",                245, 222, 179),
+    ("white",                255, 255, 255),
+    ("whitesmoke",           245, 245, 245),
+    ("yellow",               255, 255,   0),
+    ("yellowgreen",          154, 205,  50),
+]
+
+BUCKETS = 64
+BEGIN = "/* BEGIN generated by tools/gen_css_colors.py -- do not edit */\n"
+END = "/* END generated by tools/gen_css_colors.py */\n"
+MASK = 0xFFFFFFFF
+
+
+def css_hash(name):
+    """FNV-1a over the lowercased name (uc__css_hash)"""
+    h = 2166136261
+    for c in name.lower().encode("ascii"):
+        h = ((h ^ c) * 16777619) & MASK
+    return h
+
+
+def css_mix(h):
+    """murmur3 finalizer (uc__css_mix)"""
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK
+    h ^= h >> 16
+    return h
+
+
+def css_slot(h, d, n):
+    return css_mix(h ^ ((d * 0x9E3779B9) & MASK)) % n
+
+
+def build():
+    """Per-bucket displacements and the slot of every color"""
+    n = len(COLORS)
+    buckets = [[] for _ in range(BUCKETS)]
+    for i, (name, _, _, _) in enumerate(COLORS):
+        buckets[css_hash(name) % BUCKETS].append(i)
+
+    disp = [0] * BUCKETS
+    slots = [None] * n
+    # Largest buckets first: they are the hardest to place
+    for b in sorted(range(BUCKETS), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for d in range(1 << 16):
+            taken = [css_slot(css_hash(COLORS[i][0]), d, n) for i in buckets[b]]
+            if len(set(taken)) == len(taken) and all(slots[s] is None for s in taken):
+                break
+        else:
+            sys.exit("gen_css_colors: no displacement for bucket %d" % b)
+        disp[b] = d
+        for i, s in zip(buckets[b], taken):
+            slots[s] = i
+    return disp, slots
+
+
+def render():
+    disp, slots = build()
+    pool_off = {}
+    pool_lines = []
+    off = 0
+    for name, _, _, _ in COLORS:
+        pool_off[name] = off
+        pool_lines.append('    "%s\\0"' % name)
+        off += len(name) + 1
+    longest = max(len(name) for name, _, _, _ in COLORS)
+
+    out = [BEGIN, "\n"]
+    out.append("#define UC__CSS_COLOR_COUNT %d\n" % len(COLORS))
+    out.append("#define UC__CSS_BUCKETS     %d\n" % BUCKETS)
+    out.append("#define UC__CSS_NAME_MAX    %d\n\n" % longest)
+    out.append("/* Every name, lowercase and NUL-terminated, in alphabetical order */\n")
+    out.append("static const char uc__css_names[] UPRINTF_UNUSED =\n")
+    out.append("\n".join(pool_lines) + ";\n\n")
+    out.append("/* Indexed by hash slot, not by name */\n")
+    out.append("static const uc__css_color uc__css_colors[UC__CSS_COLOR_COUNT] UPRINTF_UNUSED = {\n")
+    rows = []
+    for s, i in enumerate(slots):
+        name, r, g, b = COLORS[i]
+        rows.append("    {%4d, %2d, %3d, %3d, %3d}  /* %-20s */"
+                    % (pool_off[name], len(name), r, g, b, name))
+    out.append(",\n".join(rows) + "\n};\n\n")
+    out.append("static const unsigned short uc__css_disp[UC__CSS_BUCKETS] UPRINTF_UNUSED = {\n")
+    for k in range(0, BUCKETS, 8):
+        out.append("    " + ", ".join("%5d" % d for d in disp[k:k + 8])
+                   + ("," if k + 8 < BUCKETS else "") + "\n")
+    out.append("};\n\n")
+    out.append(END)
+    return "".join(out)
+
+
+def main(argv):
+    check = "--check" in argv
+    args = [a for a in argv if a != "--check"]
+    path = args[0] if args else os.path.join(os.path.dirname(__file__), "..",
+                                             "include", "uprintf_color.h")
+    with open(path) as f:
+        text = f.read()
+    start = text.find(BEGIN)
+    stop = text.find(END)
+    if start < 0 or stop < start:
+        sys.exit("gen_css_colors: no generated block in %s" % path)
+    new = text[:start] + render() + text[stop + len(END):]
+    if check:
+        if new != text:
+            print("%s: CSS color table is out of date" % path, file=sys.stderr)
+            return 1
+        return 0
+    if new != text:
+        with open(path, "w") as f:
+            f.write(new)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
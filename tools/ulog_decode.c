@@ -0,0 +1,43 @@
+/*
+ * ulog_decode.c — Print a binary log written by ulog_deferred() as text
+ *
+ * Usage: ulog_decode LOG [OUT]
+ *
+ * Writes to OUT, or stdout. The log must come from a build with the same
+ * ABI (byte order and type sizes) as this tool.
+ */
+
+#define UPRINTF_HEADER_ONLY
+#define UPRINTF_DEFERRED
+#include "uprintf.h"
+
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+    FILE *in, *out = stdout;
+    long n;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s LOG [OUT]\n", argv[0]);
+        return 2;
+    }
+    in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (argc == 3 && (out = fopen(argv[2], "w")) == NULL) {
+        perror(argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    n = ulog_decode(in, out);
+    fclose(in);
+    if (out != stdout && fclose(out) != 0) n = -1;
+    if (n < 0) {
+        fprintf(stderr, "%s: malformed log or written on another ABI\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}